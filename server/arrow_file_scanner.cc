@@ -0,0 +1,495 @@
+#include "arrow_file_scanner.h"
+
+#include <absl/strings/str_cat.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+#include <arrow/array/array_primitive.h>
+#include <arrow/buffer.h>
+#include <arrow/compute/api_vector.h>
+#include <arrow/compute/exec.h>
+#include <arrow/datum.h>
+#include <arrow/ipc/options.h>
+#include <arrow/ipc/reader.h>
+#include <arrow/scalar.h>
+#include <arrow/util/bit_util.h>
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <utility>
+
+namespace seqr {
+
+namespace cp = arrow::compute;
+
+namespace {
+
+absl::StatusOr<std::shared_ptr<arrow::ipc::RecordBatchFileReader>> OpenReader(
+    arrow::io::RandomAccessFile* const file, std::vector<int> included_fields,
+    arrow::MemoryPool* const memory_pool) {
+  auto ipc_read_options = arrow::ipc::IpcReadOptions::Defaults();
+  ipc_read_options.memory_pool = memory_pool;
+  // We parallelize over URLs already, no need for nested parallelism.
+  ipc_read_options.use_threads = false;
+  // Note that an empty list means that all fields get decoded.
+  ipc_read_options.included_fields = std::move(included_fields);
+  auto result = arrow::ipc::RecordBatchFileReader::Open(file, ipc_read_options);
+  if (!result.ok()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Failed to open record batch reader: ",
+                     result.status().ToString()));
+  }
+  return *std::move(result);
+}
+
+// Reads a record batch with the fields included by the reader. Columns that
+// are resident in the column store, if set, aren't decoded again. Otherwise
+// the decoded columns are added to it.
+absl::StatusOr<std::shared_ptr<arrow::RecordBatch>> ReadColumns(
+    arrow::ipc::RecordBatchFileReader* const reader, const int index,
+    const ArrowFileScanOptions& options) {
+  ResidentColumnStore* const column_store = options.column_store;
+  const auto schema = reader->schema();
+  if (column_store != nullptr && schema->num_fields() > 0) {
+    std::vector<std::shared_ptr<arrow::Array>> columns;
+    columns.reserve(schema->num_fields());
+    for (const auto& field : schema->fields()) {
+      auto column = column_store->Lookup(options.column_store_file_key, index,
+                                         field->name(), options.memory_pool);
+      if (!column.ok()) {
+        return column.status();
+      }
+      if (*column == nullptr) {
+        break;
+      }
+      columns.push_back(*std::move(column));
+    }
+    if (columns.size() == static_cast<size_t>(schema->num_fields())) {
+      const int64_t num_rows = columns[0]->length();
+      return arrow::RecordBatch::Make(schema, num_rows, std::move(columns));
+    }
+  }
+
+  auto result = reader->ReadRecordBatch(index);
+  if (!result.ok()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Failed to read record batch ", index, ": ",
+                     result.status().ToString()));
+  }
+  if (column_store != nullptr) {
+    for (int i = 0; i < schema->num_fields(); ++i) {
+      column_store->Insert(options.column_store_file_key, index,
+                           schema->field(i)->name(), (*result)->column(i));
+    }
+  }
+  return *std::move(result);
+}
+
+// Returns the positions for which the filter result is true. Nulls count as
+// false, like in the dataset scanner.
+std::vector<int64_t> SelectedPositions(const arrow::Datum& filter_result,
+                                       const int64_t length) {
+  std::vector<int64_t> result;
+  if (filter_result.is_scalar()) {
+    const auto& scalar =
+        static_cast<const arrow::BooleanScalar&>(*filter_result.scalar());
+    if (scalar.is_valid && scalar.value) {
+      result.resize(length);
+      std::iota(result.begin(), result.end(), 0);
+    }
+    return result;
+  }
+
+  const arrow::BooleanArray mask(filter_result.array());
+  for (int64_t i = 0; i < mask.length(); ++i) {
+    if (mask.IsValid(i) && mask.Value(i)) {
+      result.push_back(i);
+    }
+  }
+  return result;
+}
+
+// Returns a bitmap of the given length with the bits at positions set.
+absl::StatusOr<std::shared_ptr<arrow::Buffer>> PositionsBitmap(
+    const std::vector<int64_t>& positions, const int64_t length) {
+  // Cached bitmaps outlive the query, so they don't use its memory pool.
+  auto result = arrow::AllocateEmptyBitmap(length);
+  if (!result.ok()) {
+    return absl::ResourceExhaustedError(result.status().ToString());
+  }
+  uint8_t* const data = (*result)->mutable_data();
+  for (const int64_t position : positions) {
+    arrow::BitUtil::SetBit(data, position);
+  }
+  return *std::move(result);
+}
+
+// Evaluates the conjuncts in the given order and appends the indexes of the
+// rows for which all are true, offset by offset. Each conjunct is only
+// evaluated on the rows that passed the previous ones. Conjuncts with a cached
+// bitmap, which covers the whole record batch, are applied first instead of
+// being evaluated. If new_bitmaps is set, the bitmaps of conjuncts that were
+// evaluated on all rows are stored in it, aligned with conjuncts.
+absl::Status SelectRows(
+    const std::vector<cp::Expression>& conjuncts, const std::vector<int>& order,
+    const std::vector<std::shared_ptr<arrow::Buffer>>& cached_bitmaps,
+    std::shared_ptr<arrow::RecordBatch> record_batch, const int64_t offset,
+    cp::ExecContext* const exec_context, std::vector<int64_t>* const selection,
+    std::vector<ConjunctStats>* const conjunct_stats,
+    std::vector<std::shared_ptr<arrow::Buffer>>* const new_bitmaps) {
+  std::vector<int> evaluation_order;
+  evaluation_order.reserve(order.size());
+  for (const bool cached : {true, false}) {
+    for (const int conjunct_index : order) {
+      if ((cached_bitmaps[conjunct_index] != nullptr) == cached) {
+        evaluation_order.push_back(conjunct_index);
+      }
+    }
+  }
+
+  // Maps rows of record_batch to rows of the original record batch. Empty
+  // while no rows have been removed.
+  std::vector<int64_t> rows;
+  for (const int conjunct_index : evaluation_order) {
+    const int64_t num_rows = record_batch->num_rows();
+    if (num_rows == 0) {
+      return absl::OkStatus();
+    }
+
+    const absl::Time start = absl::Now();
+    std::vector<int64_t> positions;
+    if (const auto& bitmap = cached_bitmaps[conjunct_index];
+        bitmap != nullptr) {
+      for (int64_t i = 0; i < num_rows; ++i) {
+        if (arrow::BitUtil::GetBit(bitmap->data(),
+                                   offset + (rows.empty() ? i : rows[i]))) {
+          positions.push_back(i);
+        }
+      }
+    } else {
+      const auto filter_result = cp::ExecuteScalarExpression(
+          conjuncts[conjunct_index], arrow::Datum(record_batch), exec_context);
+      if (!filter_result.ok()) {
+        return absl::InvalidArgumentError(filter_result.status().ToString());
+      }
+      positions = SelectedPositions(*filter_result, num_rows);
+      // Results for a subset of the rows can't be cached.
+      if (new_bitmaps != nullptr && rows.empty() &&
+          conjuncts[conjunct_index].literal() == nullptr) {
+        auto new_bitmap = PositionsBitmap(positions, num_rows);
+        if (!new_bitmap.ok()) {
+          return new_bitmap.status();
+        }
+        (*new_bitmaps)[conjunct_index] = *std::move(new_bitmap);
+      }
+    }
+    auto& stats = (*conjunct_stats)[conjunct_index];
+    stats.rows_in += num_rows;
+    stats.rows_out += positions.size();
+    stats.nanos += absl::ToInt64Nanoseconds(absl::Now() - start);
+    if (cached_bitmaps[conjunct_index] == nullptr) {
+      ++stats.evaluations;
+    }
+
+    if (static_cast<int64_t>(positions.size()) == num_rows) {
+      continue;
+    }
+    if (positions.empty()) {
+      return absl::OkStatus();
+    }
+
+    // Compact the record batch, so the next conjunct only sees the survivors.
+    const auto taken = cp::Take(
+        arrow::Datum(record_batch),
+        arrow::Datum(std::make_shared<arrow::Int64Array>(
+            positions.size(), arrow::Buffer::Wrap(positions))),
+        cp::TakeOptions::Defaults(), exec_context);
+    if (!taken.ok()) {
+      return absl::InvalidArgumentError(taken.status().ToString());
+    }
+    record_batch = taken->record_batch();
+    for (auto& position : positions) {
+      position = rows.empty() ? position : rows[position];
+    }
+    rows = std::move(positions);
+  }
+
+  if (rows.empty()) {  // No rows have been removed.
+    for (int64_t i = 0; i < record_batch->num_rows(); ++i) {
+      selection->push_back(offset + i);
+    }
+  } else {
+    for (const int64_t row : rows) {
+      selection->push_back(offset + row);
+    }
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<ArrowFileScanResult> ScanArrowFile(
+    arrow::io::RandomAccessFile* const file,
+    const ArrowFileScanOptions& options) {
+  // Only reads the footer, no record batches.
+  const auto schema_reader = OpenReader(file, {}, options.memory_pool);
+  if (!schema_reader.ok()) {
+    return schema_reader.status();
+  }
+  const auto schema = (*schema_reader)->schema();
+  const int num_record_batches = (*schema_reader)->num_record_batches();
+  if (!options.record_batch_matches.empty() &&
+      options.record_batch_matches.size() !=
+          static_cast<size_t>(num_record_batches)) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Index has ", options.record_batch_matches.size(),
+        " record batches, but file has ", num_record_batches));
+  }
+
+  const bool slice_by_xpos =
+      !options.xpos_intervals.empty() &&
+      (options.xpos_sorted || IsSortedByXpos(*schema));
+
+  // Columns decoded in the first phase, in file order.
+  std::vector<int> filter_fields;
+  for (const auto& field_ref :
+       cp::FieldsInExpression(options.filter_expression)) {
+    const auto* const name = field_ref.name();
+    const int field_index =
+        name == nullptr ? -1 : schema->GetFieldIndex(*name);
+    if (field_index < 0) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Filter column ", field_ref.ToString(), " not found"));
+    }
+    filter_fields.push_back(field_index);
+  }
+  if (slice_by_xpos) {
+    const int field_index = schema->GetFieldIndex("xpos");
+    if (field_index < 0) {
+      return absl::InvalidArgumentError("Column xpos not found");
+    }
+    filter_fields.push_back(field_index);
+  }
+
+  std::vector<int> projection_fields;
+  projection_fields.reserve(options.projection_columns.size());
+  std::vector<std::shared_ptr<arrow::Field>> projection_schema_fields;
+  for (const auto& column : options.projection_columns) {
+    const int field_index = schema->GetFieldIndex(column);
+    if (field_index < 0) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Projection column ", column, " not found"));
+    }
+    projection_fields.push_back(field_index);
+    projection_schema_fields.push_back(schema->field(field_index));
+  }
+  const auto projection_schema = arrow::schema(projection_schema_fields);
+
+  // At least one column needs to be decoded to learn the number of rows, even
+  // if the filter doesn't reference any.
+  if (filter_fields.empty()) {
+    if (schema->num_fields() == 0) {
+      return absl::InvalidArgumentError("Schema has no fields");
+    }
+    filter_fields.push_back(projection_fields.empty() ? 0
+                                                      : projection_fields[0]);
+  }
+  std::sort(filter_fields.begin(), filter_fields.end());
+  filter_fields.erase(std::unique(filter_fields.begin(), filter_fields.end()),
+                      filter_fields.end());
+
+  // Columns decoded in the second phase, in file order.
+  std::vector<int> remaining_fields;
+  for (const int field_index : projection_fields) {
+    if (!std::binary_search(filter_fields.begin(), filter_fields.end(),
+                            field_index)) {
+      remaining_fields.push_back(field_index);
+    }
+  }
+  std::sort(remaining_fields.begin(), remaining_fields.end());
+  remaining_fields.erase(
+      std::unique(remaining_fields.begin(), remaining_fields.end()),
+      remaining_fields.end());
+
+  const auto filter_reader =
+      OpenReader(file, filter_fields, options.memory_pool);
+  if (!filter_reader.ok()) {
+    return filter_reader.status();
+  }
+  std::shared_ptr<arrow::ipc::RecordBatchFileReader> remaining_reader;
+  if (!remaining_fields.empty()) {
+    auto reader = OpenReader(file, remaining_fields, options.memory_pool);
+    if (!reader.ok()) {
+      return reader.status();
+    }
+    remaining_reader = *std::move(reader);
+  }
+
+  // Conjuncts are bound to the schema of the filter columns.
+  std::optional<ConjunctOrdering> local_conjunct_ordering;
+  ConjunctOrdering* conjunct_ordering = options.conjunct_ordering;
+  if (conjunct_ordering == nullptr) {
+    conjunct_ordering = &local_conjunct_ordering.emplace(
+        FlattenConjunction(options.filter_expression));
+  }
+  std::vector<cp::Expression> conjuncts;
+  conjuncts.reserve(conjunct_ordering->conjuncts().size());
+  for (const auto& conjunct : conjunct_ordering->conjuncts()) {
+    auto bound_conjunct = conjunct.Bind(*(*filter_reader)->schema());
+    if (!bound_conjunct.ok()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Failed to bind filter expression: ",
+                       bound_conjunct.status().ToString()));
+    }
+    if (bound_conjunct->type()->id() != arrow::Type::BOOL) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Filter expression ", conjunct.ToString(),
+                       " has non-boolean type ",
+                       bound_conjunct->type()->ToString()));
+    }
+    conjuncts.push_back(*std::move(bound_conjunct));
+  }
+
+  // Literals, e.g. the default filter, aren't worth caching. Their key is
+  // left empty.
+  PredicateCache* const predicate_cache = options.predicate_cache;
+  std::vector<std::string> conjunct_keys(conjuncts.size());
+  if (predicate_cache != nullptr) {
+    for (size_t i = 0; i < conjuncts.size(); ++i) {
+      if (conjuncts[i].literal() == nullptr) {
+        conjunct_keys[i] = PredicateCacheConjunctKey(conjuncts[i]);
+      }
+    }
+  }
+
+  cp::ExecContext exec_context(options.memory_pool);
+  ArrowFileScanResult result;
+  for (int i = 0; i < num_record_batches; ++i) {
+    if (!options.record_batch_matches.empty() &&
+        !options.record_batch_matches[i]) {
+      continue;
+    }
+
+    // Phase one: evaluate the filter on the filter columns.
+    const auto filter_record_batch =
+        ReadColumns(filter_reader->get(), i, options);
+    if (!filter_record_batch.ok()) {
+      return filter_record_batch.status();
+    }
+    ++result.num_filtered_record_batches;
+    const int64_t num_rows = (*filter_record_batch)->num_rows();
+
+    std::vector<RowRange> row_ranges{{0, num_rows}};
+    if (slice_by_xpos) {
+      auto sorted_row_ranges =
+          SortedXposRowRanges(**filter_record_batch, options.xpos_intervals);
+      if (!sorted_row_ranges.ok()) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Failed to apply xpos intervals to record batch ", i,
+                         ": ", sorted_row_ranges.status().message()));
+      }
+      row_ranges = *std::move(sorted_row_ranges);
+    }
+
+    std::vector<int64_t> selection;
+    const std::vector<int> conjunct_order = conjunct_ordering->Order();
+    std::vector<ConjunctStats> conjunct_stats(conjuncts.size());
+    std::vector<std::shared_ptr<arrow::Buffer>> cached_bitmaps(
+        conjuncts.size());
+    std::vector<std::shared_ptr<arrow::Buffer>> new_bitmaps(conjuncts.size());
+    if (predicate_cache != nullptr && !row_ranges.empty()) {
+      for (size_t j = 0; j < conjuncts.size(); ++j) {
+        if (conjunct_keys[j].empty()) {
+          continue;
+        }
+        auto bitmap = predicate_cache->Lookup(
+            options.predicate_cache_file_key, i, conjunct_keys[j]);
+        if (bitmap != nullptr &&
+            bitmap->size() >= arrow::BitUtil::BytesForBits(num_rows)) {
+          cached_bitmaps[j] = std::move(bitmap);
+          ++conjunct_stats[j].cache_hits;
+        } else {
+          ++conjunct_stats[j].cache_misses;
+        }
+      }
+    }
+    // Bitmaps need to cover the whole record batch.
+    const bool cache_new_bitmaps =
+        predicate_cache != nullptr && row_ranges.size() == 1 &&
+        row_ranges[0].offset == 0 && row_ranges[0].length == num_rows;
+    for (const auto& row_range : row_ranges) {
+      if (const auto status = SelectRows(
+              conjuncts, conjunct_order, cached_bitmaps,
+              (*filter_record_batch)->Slice(row_range.offset, row_range.length),
+              row_range.offset, &exec_context, &selection, &conjunct_stats,
+              cache_new_bitmaps ? &new_bitmaps : nullptr);
+          !status.ok()) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Failed to evaluate filter on record batch ", i, ": ",
+                         status.message()));
+      }
+    }
+    conjunct_ordering->Update(conjunct_stats);
+    for (size_t j = 0; j < conjuncts.size(); ++j) {
+      if (new_bitmaps[j] != nullptr && !conjunct_keys[j].empty()) {
+        predicate_cache->Insert(options.predicate_cache_file_key, i,
+                                conjunct_keys[j], std::move(new_bitmaps[j]));
+      }
+    }
+    if (selection.empty()) {
+      continue;
+    }
+
+    // Phase two: decode the remaining projection columns and take the
+    // selected rows.
+    std::shared_ptr<arrow::RecordBatch> remaining_record_batch;
+    if (remaining_reader != nullptr) {
+      auto record_batch = ReadColumns(remaining_reader.get(), i, options);
+      if (!record_batch.ok()) {
+        return record_batch.status();
+      }
+      remaining_record_batch = *std::move(record_batch);
+    }
+    ++result.num_materialized_record_batches;
+
+    const bool all_selected =
+        static_cast<int64_t>(selection.size()) == num_rows;
+    const auto indices = std::make_shared<arrow::Int64Array>(
+        selection.size(), arrow::Buffer::Wrap(selection));
+    std::vector<std::shared_ptr<arrow::Array>> columns;
+    columns.reserve(projection_fields.size());
+    for (const int field_index : projection_fields) {
+      const auto filter_it = std::lower_bound(
+          filter_fields.begin(), filter_fields.end(), field_index);
+      const auto column =
+          filter_it != filter_fields.end() && *filter_it == field_index
+              ? (*filter_record_batch)
+                    ->column(filter_it - filter_fields.begin())
+              : remaining_record_batch->column(
+                    std::lower_bound(remaining_fields.begin(),
+                                     remaining_fields.end(), field_index) -
+                    remaining_fields.begin());
+      if (all_selected) {
+        columns.push_back(column);
+        continue;
+      }
+      auto taken_column = cp::Take(*column, *indices,
+                                   cp::TakeOptions::Defaults(), &exec_context);
+      if (!taken_column.ok()) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Failed to take selected rows of record batch ", i,
+                         ": ", taken_column.status().ToString()));
+      }
+      columns.push_back(*std::move(taken_column));
+    }
+    result.record_batches.push_back(arrow::RecordBatch::Make(
+        projection_schema, static_cast<int64_t>(selection.size()),
+        std::move(columns)));
+  }
+
+  return result;
+}
+
+}  // namespace seqr
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <absl/status/statusor.h>
+#include <arrow/compute/exec/expression.h>
+#include <arrow/io/interfaces.h>
+#include <arrow/memory_pool.h>
+#include <arrow/record_batch.h>
+
+#include <string>
+#include <vector>
+
+#include "conjunct_ordering.h"
+#include "predicate_cache.h"
+#include "resident_column_store.h"
+#include "xpos_intervals.h"
+
+namespace seqr {
+
+struct ArrowFileScanOptions {
+  std::vector<std::string> projection_columns;
+  arrow::compute::Expression filter_expression = arrow::compute::literal(true);
+  // Normalized xpos intervals. Only applied using binary search if the file is
+  // sorted by xpos, otherwise they need to be part of filter_expression.
+  std::vector<XposInterval> xpos_intervals;
+  // Whether the file is known to be sorted by xpos, even if its schema doesn't
+  // mark it as sorted (see IsSortedByXpos).
+  bool xpos_sorted = false;
+  // If not empty, record batches for which this is false are skipped, e.g.
+  // based on a FileIndex.
+  std::vector<bool> record_batch_matches;
+  // Orders the conjuncts of filter_expression and collects their stats. Must
+  // have been created from FlattenConjunction(filter_expression). Can be
+  // shared across files to learn the order faster. If null, a new one is used.
+  ConjunctOrdering* conjunct_ordering = nullptr;
+  // Used for decoding and filtering, e.g. a QueryMemoryPool.
+  arrow::MemoryPool* memory_pool = arrow::default_memory_pool();
+  // If set, the results of conjuncts are cached per record batch, see
+  // PredicateCache. Requires predicate_cache_file_key.
+  PredicateCache* predicate_cache = nullptr;
+  // See PredicateCacheFileKey.
+  std::string predicate_cache_file_key;
+  // If set, decoded columns are looked up in and added to the store, see
+  // ResidentColumnStore. Requires column_store_file_key.
+  ResidentColumnStore* column_store = nullptr;
+  // See PredicateCacheFileKey.
+  std::string column_store_file_key;
+};
+
+struct ArrowFileScanResult {
+  // Filtered rows of the projection columns.
+  arrow::RecordBatchVector record_batches;
+  // Number of record batches for which the filter columns were decoded.
+  int num_filtered_record_batches = 0;
+  // Number of record batches for which the remaining projection columns were
+  // decoded, i.e. that had at least one match.
+  int num_materialized_record_batches = 0;
+};
+
+// Scans an Arrow IPC file using late materialization: for each record batch,
+// only the columns referenced by the filter are decoded first. The remaining
+// projection columns are only decoded for record batches with matches, which
+// avoids decompressing most of the file for selective filters. The conjuncts
+// of the filter are evaluated with short-circuiting, see ConjunctOrdering.
+// Conjuncts whose results are in the predicate cache are applied first,
+// without evaluating them. Resident columns are used instead of decoding them
+// from the file.
+absl::StatusOr<ArrowFileScanResult> ScanArrowFile(
+    arrow::io::RandomAccessFile* file, const ArrowFileScanOptions& options);
+
+}  // namespace seqr
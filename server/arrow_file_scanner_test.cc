@@ -0,0 +1,233 @@
+#include "arrow_file_scanner.h"
+
+#include <arrow/array/builder_binary.h>
+#include <arrow/array/builder_primitive.h>
+#include <arrow/io/memory.h>
+#include <arrow/ipc/writer.h>
+#include <arrow/testing/gtest_util.h>
+#include <arrow/util/compression.h>
+#include <arrow/util/key_value_metadata.h>
+#include <gtest/gtest.h>
+
+namespace seqr {
+
+namespace cp = arrow::compute;
+
+namespace {
+
+std::shared_ptr<arrow::RecordBatch> MakeRecordBatch(
+    const std::shared_ptr<arrow::Schema>& schema,
+    const std::vector<int64_t>& xpos_values,
+    const std::vector<double>& af_values,
+    const std::vector<std::string>& variant_ids) {
+  arrow::Int64Builder xpos_builder;
+  EXPECT_OK(xpos_builder.AppendValues(xpos_values));
+  std::shared_ptr<arrow::Array> xpos;
+  EXPECT_OK(xpos_builder.Finish(&xpos));
+
+  arrow::DoubleBuilder af_builder;
+  EXPECT_OK(af_builder.AppendValues(af_values));
+  std::shared_ptr<arrow::Array> af;
+  EXPECT_OK(af_builder.Finish(&af));
+
+  arrow::StringBuilder variant_id_builder;
+  EXPECT_OK(variant_id_builder.AppendValues(variant_ids));
+  std::shared_ptr<arrow::Array> variant_id;
+  EXPECT_OK(variant_id_builder.Finish(&variant_id));
+
+  return arrow::RecordBatch::Make(schema, xpos->length(),
+                                  {xpos, af, variant_id});
+}
+
+// Returns an Arrow file with three sorted record batches.
+std::shared_ptr<arrow::Buffer> MakeArrowFile(
+    const bool mark_as_sorted,
+    const arrow::Compression::type compression =
+        arrow::Compression::UNCOMPRESSED) {
+  auto schema = arrow::schema({arrow::field("xpos", arrow::int64()),
+                               arrow::field("AF", arrow::float64()),
+                               arrow::field("variantId", arrow::utf8())});
+  if (mark_as_sorted) {
+    schema = schema->WithMetadata(arrow::key_value_metadata(
+        {kSortedByMetadataKey}, {kSortedByXpos}));
+  }
+
+  EXPECT_OK_AND_ASSIGN(auto output_stream,
+                       arrow::io::BufferOutputStream::Create());
+  auto write_options = arrow::ipc::IpcWriteOptions::Defaults();
+  if (compression != arrow::Compression::UNCOMPRESSED) {
+    EXPECT_OK_AND_ASSIGN(write_options.codec,
+                         arrow::util::Codec::Create(compression));
+  }
+  EXPECT_OK_AND_ASSIGN(
+      auto file_writer,
+      arrow::ipc::MakeFileWriter(output_stream, schema, write_options));
+  for (const auto& record_batch :
+       {MakeRecordBatch(schema, {10, 20, 30}, {0.1, 0.6, 0.2}, {"a", "b", "c"}),
+        MakeRecordBatch(schema, {40, 50}, {0.3, 0.4}, {"d", "e"}),
+        MakeRecordBatch(schema, {60, 70}, {0.7, 0.8}, {"f", "g"})}) {
+    EXPECT_OK(file_writer->WriteRecordBatch(*record_batch));
+  }
+  EXPECT_OK(file_writer->Close());
+  EXPECT_OK_AND_ASSIGN(auto buffer, output_stream->Finish());
+  return buffer;
+}
+
+std::vector<std::string> VariantIds(const arrow::RecordBatchVector& batches) {
+  std::vector<std::string> result;
+  for (const auto& record_batch : batches) {
+    const auto& variant_ids = static_cast<const arrow::StringArray&>(
+        *record_batch->GetColumnByName("variantId"));
+    for (int64_t i = 0; i < variant_ids.length(); ++i) {
+      result.push_back(variant_ids.GetString(i));
+    }
+  }
+  return result;
+}
+
+TEST(ArrowFileScanner, MaterializesOnlyMatchingRecordBatches) {
+  arrow::io::BufferReader buffer_reader(MakeArrowFile(false));
+  ArrowFileScanOptions options;
+  options.projection_columns = {"variantId", "xpos"};
+  options.filter_expression =
+      cp::greater(cp::field_ref("AF"), cp::literal(0.5));
+  const auto result = ScanArrowFile(&buffer_reader, options);
+  ASSERT_TRUE(result.ok()) << result.status();
+
+  EXPECT_EQ(VariantIds(result->record_batches),
+            (std::vector<std::string>{"b", "f", "g"}));
+  EXPECT_EQ(result->num_filtered_record_batches, 3);
+  EXPECT_EQ(result->num_materialized_record_batches, 2);
+  ASSERT_EQ(result->record_batches.size(), 2);
+  EXPECT_EQ(result->record_batches[0]->schema()->field_names(),
+            (std::vector<std::string>{"variantId", "xpos"}));
+}
+
+TEST(ArrowFileScanner, SortedXposIntervalsAndIndexMatches) {
+  arrow::io::BufferReader buffer_reader(MakeArrowFile(true));
+  ArrowFileScanOptions options;
+  options.projection_columns = {"variantId"};
+  options.xpos_intervals = NormalizeXposIntervals({{20, 45}, {65, 100}});
+  options.record_batch_matches = {true, true, false};
+  const auto result = ScanArrowFile(&buffer_reader, options);
+  ASSERT_TRUE(result.ok()) << result.status();
+
+  EXPECT_EQ(VariantIds(result->record_batches),
+            (std::vector<std::string>{"b", "c", "d"}));
+  EXPECT_EQ(result->num_filtered_record_batches, 2);
+}
+
+TEST(ArrowFileScanner, ShortCircuitsConjuncts) {
+  arrow::io::BufferReader buffer_reader(MakeArrowFile(false));
+  ArrowFileScanOptions options;
+  options.projection_columns = {"variantId"};
+  options.filter_expression = cp::and_(
+      cp::greater(cp::field_ref("AF"), cp::literal(0.5)),
+      cp::not_equal(cp::field_ref("variantId"), cp::literal("b")));
+  ConjunctOrdering conjunct_ordering(
+      FlattenConjunction(options.filter_expression));
+  options.conjunct_ordering = &conjunct_ordering;
+  const auto result = ScanArrowFile(&buffer_reader, options);
+  ASSERT_TRUE(result.ok()) << result.status();
+
+  EXPECT_EQ(VariantIds(result->record_batches),
+            (std::vector<std::string>{"f", "g"}));
+  const auto stats = conjunct_ordering.Stats();
+  ASSERT_EQ(stats.size(), 2);
+  EXPECT_EQ(stats[0].rows_in, 7);
+  EXPECT_EQ(stats[0].rows_out, 3);
+  // Only evaluated on the rows that passed the first conjunct.
+  EXPECT_EQ(stats[1].rows_in, 3);
+  EXPECT_EQ(stats[1].rows_out, 2);
+}
+
+TEST(ArrowFileScanner, AppliesCachedConjuncts) {
+  const auto file = MakeArrowFile(true);
+  PredicateCache predicate_cache(1 << 20);
+  ArrowFileScanOptions options;
+  options.projection_columns = {"variantId"};
+  options.filter_expression =
+      cp::greater(cp::field_ref("AF"), cp::literal(0.25));
+  options.predicate_cache = &predicate_cache;
+  options.predicate_cache_file_key = PredicateCacheFileKey("file", *file);
+
+  // Evaluated on all rows, so the results get cached.
+  {
+    ConjunctOrdering conjunct_ordering(
+        FlattenConjunction(options.filter_expression));
+    options.conjunct_ordering = &conjunct_ordering;
+    arrow::io::BufferReader buffer_reader(file);
+    const auto result = ScanArrowFile(&buffer_reader, options);
+    ASSERT_TRUE(result.ok()) << result.status();
+    EXPECT_EQ(VariantIds(result->record_batches),
+              (std::vector<std::string>{"b", "d", "e", "f", "g"}));
+    const auto stats = conjunct_ordering.Stats();
+    ASSERT_EQ(stats.size(), 1);
+    EXPECT_EQ(stats[0].cache_hits, 0);
+    EXPECT_EQ(stats[0].cache_misses, 3);
+  }
+  EXPECT_EQ(predicate_cache.Stats().num_entries, 3);
+
+  // The cached bitmaps also apply to slices of the record batches.
+  options.xpos_intervals = NormalizeXposIntervals({{20, 45}, {65, 100}});
+  ConjunctOrdering conjunct_ordering(
+      FlattenConjunction(options.filter_expression));
+  options.conjunct_ordering = &conjunct_ordering;
+  arrow::io::BufferReader buffer_reader(file);
+  const auto result = ScanArrowFile(&buffer_reader, options);
+  ASSERT_TRUE(result.ok()) << result.status();
+  EXPECT_EQ(VariantIds(result->record_batches),
+            (std::vector<std::string>{"b", "d", "g"}));
+  const auto stats = conjunct_ordering.Stats();
+  ASSERT_EQ(stats.size(), 1);
+  EXPECT_EQ(stats[0].cache_hits, 3);
+  EXPECT_EQ(stats[0].cache_misses, 0);
+  EXPECT_EQ(predicate_cache.Stats().hits, 3);
+}
+
+TEST(ArrowFileScanner, UsesResidentColumns) {
+  // Columns of uncompressed files aren't stored, since they aren't decoded.
+  const auto file = MakeArrowFile(false, arrow::Compression::ZSTD);
+  ResidentColumnStore column_store(1 << 20);
+  ArrowFileScanOptions options;
+  options.projection_columns = {"variantId"};
+  options.filter_expression =
+      cp::greater(cp::field_ref("AF"), cp::literal(0.65));
+  options.column_store = &column_store;
+  options.column_store_file_key = "file";
+  column_store.RecordQuery({"AF"}, {"variantId"});
+
+  for (int i = 0; i < 2; ++i) {
+    arrow::io::BufferReader buffer_reader(file);
+    const auto result = ScanArrowFile(&buffer_reader, options);
+    ASSERT_TRUE(result.ok()) << result.status();
+    EXPECT_EQ(VariantIds(result->record_batches),
+              (std::vector<std::string>{"f", "g"}));
+  }
+
+  // AF is resident for all record batches, but variantId only for the one
+  // with matches.
+  const auto stats = column_store.Stats();
+  EXPECT_EQ(stats.num_hot_entries, 4);
+  EXPECT_EQ(stats.misses, 4);
+  EXPECT_EQ(stats.hot_hits, 4);
+}
+
+TEST(ArrowFileScanner, InvalidOptions) {
+  arrow::io::BufferReader buffer_reader(MakeArrowFile(false));
+  ArrowFileScanOptions options;
+  options.projection_columns = {"rsid"};
+  EXPECT_FALSE(ScanArrowFile(&buffer_reader, options).ok());
+
+  options.projection_columns = {"xpos"};
+  options.filter_expression = cp::field_ref("AF");
+  EXPECT_FALSE(ScanArrowFile(&buffer_reader, options).ok());
+
+  options.filter_expression = cp::literal(true);
+  options.record_batch_matches = {true};
+  EXPECT_FALSE(ScanArrowFile(&buffer_reader, options).ok());
+}
+
+}  // namespace
+
+}  // namespace seqr
@@ -0,0 +1,142 @@
+#include "conjunct_ordering.h"
+
+#include <absl/container/flat_hash_map.h>
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+namespace seqr {
+
+namespace cp = arrow::compute;
+
+namespace {
+
+// Selectivity assumed for conjuncts that haven't been evaluated yet.
+constexpr double kDefaultSelectivity = 0.5;
+
+// Stats are only trusted after this many rows, to avoid reordering based on
+// a handful of rows. Until then, the estimated costs are used, which have the
+// same unit as the measured ones.
+constexpr int64_t kMinObservedRows = 1024;
+
+// Fixed overhead of evaluating an expression on a record batch, independent
+// of its number of rows. Subtracted from the measured time, so conjuncts that
+// run on small batches of surviving rows aren't penalized.
+constexpr double kEvaluationOverheadNanos = 1000;
+
+// Costs in nanoseconds per row, the unit of the measured costs. These are
+// rough estimates; tools/list_kernel_benchmark measures the list functions for
+// recalibration.
+double FunctionCostPerRow(const std::string& function_name) {
+  static const auto* const kCosts =
+      new absl::flat_hash_map<std::string, double>{
+          {"string_list_contains_any", 30.0},
+          {"sample_value_greater_equal", 30.0},
+          {"is_in", 5.0},
+          {"index_in", 5.0},
+          {"match_substring", 20.0},
+          {"match_substring_regex", 100.0},
+          {"match_like", 20.0},
+      };
+  const auto it = kCosts->find(function_name);
+  return it == kCosts->end() ? 1.0 : it->second;
+}
+
+std::vector<double> EstimateCosts(
+    const std::vector<cp::Expression>& conjuncts) {
+  std::vector<double> result;
+  result.reserve(conjuncts.size());
+  for (const auto& conjunct : conjuncts) {
+    result.push_back(EstimateCostPerRow(conjunct));
+  }
+  return result;
+}
+
+void AppendConjuncts(const cp::Expression& expression,
+                     std::vector<cp::Expression>* const result) {
+  const auto* const call = expression.call();
+  if (call != nullptr &&
+      (call->function_name == "and" || call->function_name == "and_kleene")) {
+    for (const auto& argument : call->arguments) {
+      AppendConjuncts(argument, result);
+    }
+    return;
+  }
+  result->push_back(expression);
+}
+
+}  // namespace
+
+std::vector<cp::Expression> FlattenConjunction(
+    const cp::Expression& expression) {
+  std::vector<cp::Expression> result;
+  AppendConjuncts(expression, &result);
+  return result;
+}
+
+double EstimateCostPerRow(const cp::Expression& expression) {
+  const auto* const call = expression.call();
+  if (call == nullptr) {  // Field references and literals.
+    return 0.0;
+  }
+  double result = FunctionCostPerRow(call->function_name);
+  for (const auto& argument : call->arguments) {
+    result += EstimateCostPerRow(argument);
+  }
+  return result;
+}
+
+ConjunctOrdering::ConjunctOrdering(std::vector<cp::Expression> conjuncts)
+    : conjuncts_(std::move(conjuncts)),
+      estimated_costs_(EstimateCosts(conjuncts_)),
+      stats_(conjuncts_.size()) {}
+
+std::vector<int> ConjunctOrdering::Order() const {
+  std::vector<double> ranks;
+  ranks.reserve(conjuncts_.size());
+  {
+    absl::MutexLock lock(&mu_);
+    for (size_t i = 0; i < conjuncts_.size(); ++i) {
+      const auto& stats = stats_[i];
+      double cost = estimated_costs_[i];
+      double selectivity = kDefaultSelectivity;
+      if (stats.rows_in >= kMinObservedRows) {
+        const double nanos = std::max(
+            0.0, stats.nanos - stats.evaluations * kEvaluationOverheadNanos);
+        cost = nanos / stats.rows_in;
+        selectivity = static_cast<double>(stats.rows_out) / stats.rows_in;
+      }
+      // Conjuncts that filter nothing go last.
+      ranks.push_back(cost / std::max(1.0 - selectivity, 1e-6));
+    }
+  }
+
+  std::vector<int> result(conjuncts_.size());
+  std::iota(result.begin(), result.end(), 0);
+  // Stable, so that ties keep the order of the request.
+  std::stable_sort(result.begin(), result.end(),
+                   [&ranks](const int lhs, const int rhs) {
+                     return ranks[lhs] < ranks[rhs];
+                   });
+  return result;
+}
+
+void ConjunctOrdering::Update(const std::vector<ConjunctStats>& stats) {
+  absl::MutexLock lock(&mu_);
+  for (size_t i = 0; i < stats.size() && i < stats_.size(); ++i) {
+    stats_[i].rows_in += stats[i].rows_in;
+    stats_[i].rows_out += stats[i].rows_out;
+    stats_[i].nanos += stats[i].nanos;
+    stats_[i].evaluations += stats[i].evaluations;
+    stats_[i].cache_hits += stats[i].cache_hits;
+    stats_[i].cache_misses += stats[i].cache_misses;
+  }
+}
+
+std::vector<ConjunctStats> ConjunctOrdering::Stats() const {
+  absl::MutexLock lock(&mu_);
+  return stats_;
+}
+
+}  // namespace seqr
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <absl/base/thread_annotations.h>
+#include <absl/synchronization/mutex.h>
+#include <arrow/compute/exec/expression.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace seqr {
+
+// Splits nested "and" and "and_kleene" calls into their conjuncts. Returns the
+// expression itself if it's not a conjunction.
+std::vector<arrow::compute::Expression> FlattenConjunction(
+    const arrow::compute::Expression& expression);
+
+// Returns a rough estimate of the evaluation cost per row in nanoseconds, based
+// on the functions that are called. Used until actual costs are observed.
+double EstimateCostPerRow(const arrow::compute::Expression& expression);
+
+struct ConjunctStats {
+  // Number of rows the conjunct was evaluated on.
+  int64_t rows_in = 0;
+  // Number of rows for which the conjunct was true.
+  int64_t rows_out = 0;
+  int64_t nanos = 0;
+  // Number of times the conjunct was evaluated, i.e. record batches it ran on
+  // without a cached result.
+  int64_t evaluations = 0;
+  // Number of record batches for which the result was found or not found in
+  // the PredicateCache, if one is used.
+  int64_t cache_hits = 0;
+  int64_t cache_misses = 0;
+};
+
+// Orders the conjuncts of a filter so that cheap and selective conjuncts are
+// evaluated first, which lets later conjuncts only run on the surviving rows.
+// Costs and selectivities are learned from the record batches scanned so far,
+// starting from the estimates.
+// Thread-safe, so it can be shared by all files of a query.
+class ConjunctOrdering {
+ public:
+  explicit ConjunctOrdering(
+      std::vector<arrow::compute::Expression> conjuncts);
+
+  const std::vector<arrow::compute::Expression>& conjuncts() const {
+    return conjuncts_;
+  }
+
+  // Returns the conjunct indexes in evaluation order, by increasing
+  // cost / (1 - selectivity).
+  std::vector<int> Order() const;
+
+  // Adds the stats observed for a record batch, aligned with conjuncts().
+  void Update(const std::vector<ConjunctStats>& stats);
+
+  // Returns the accumulated stats, aligned with conjuncts().
+  std::vector<ConjunctStats> Stats() const;
+
+ private:
+  const std::vector<arrow::compute::Expression> conjuncts_;
+  const std::vector<double> estimated_costs_;
+  mutable absl::Mutex mu_;
+  std::vector<ConjunctStats> stats_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace seqr
@@ -0,0 +1,72 @@
+#include "conjunct_ordering.h"
+
+#include <gtest/gtest.h>
+
+namespace seqr {
+
+namespace cp = arrow::compute;
+
+TEST(ConjunctOrdering, FlattenConjunction) {
+  const auto a = cp::greater(cp::field_ref("AF"), cp::literal(0.1));
+  const auto b = cp::call("is_null", {cp::field_ref("clinvar")});
+  const auto c = cp::call("string_list_contains_any", {cp::field_ref("s")});
+  const auto d = cp::or_(a, b);
+
+  const auto conjuncts = FlattenConjunction(
+      cp::and_(cp::and_(a, b), cp::call("and_kleene", {c, d})));
+  ASSERT_EQ(conjuncts.size(), 4);
+  EXPECT_EQ(conjuncts[0], a);
+  EXPECT_EQ(conjuncts[1], b);
+  EXPECT_EQ(conjuncts[2], c);
+  EXPECT_EQ(conjuncts[3], d);
+
+  ASSERT_EQ(FlattenConjunction(d).size(), 1);
+}
+
+TEST(ConjunctOrdering, EstimatedCosts) {
+  const auto cheap = cp::greater(cp::field_ref("AF"), cp::literal(0.1));
+  const auto costly =
+      cp::call("string_list_contains_any", {cp::field_ref("samples")});
+  EXPECT_LT(EstimateCostPerRow(cheap), EstimateCostPerRow(costly));
+
+  // Without observations, cheap conjuncts go first.
+  const ConjunctOrdering conjunct_ordering({costly, cheap});
+  EXPECT_EQ(conjunct_ordering.Order(), (std::vector<int>{1, 0}));
+}
+
+TEST(ConjunctOrdering, LearnsSelectivity) {
+  ConjunctOrdering conjunct_ordering(
+      {cp::greater(cp::field_ref("AF"), cp::literal(0.1)),
+       cp::less(cp::field_ref("AC"), cp::literal(3))});
+  EXPECT_EQ(conjunct_ordering.Order(), (std::vector<int>{0, 1}));
+
+  // Both take the same time per row, but the second one is more selective.
+  conjunct_ordering.Update(
+      {{.rows_in = 10000, .rows_out = 9000, .nanos = 10000},
+       {.rows_in = 10000, .rows_out = 100, .nanos = 10000}});
+  EXPECT_EQ(conjunct_ordering.Order(), (std::vector<int>{1, 0}));
+
+  const auto stats = conjunct_ordering.Stats();
+  ASSERT_EQ(stats.size(), 2);
+  EXPECT_EQ(stats[1].rows_out, 100);
+}
+
+TEST(ConjunctOrdering, AmortizesEvaluationOverhead) {
+  ConjunctOrdering conjunct_ordering(
+      {cp::greater(cp::field_ref("AF"), cp::literal(0.1)),
+       cp::less(cp::field_ref("AC"), cp::literal(3))});
+
+  // Both take 1ns per row plus 1us per evaluation, but the first one ran on
+  // many small batches of surviving rows, and is more selective.
+  conjunct_ordering.Update({{.rows_in = 2000,
+                             .rows_out = 500,
+                             .nanos = 2000 + 100 * 1000,
+                             .evaluations = 100},
+                            {.rows_in = 20000,
+                             .rows_out = 10000,
+                             .nanos = 20000 + 2 * 1000,
+                             .evaluations = 2}});
+  EXPECT_EQ(conjunct_ordering.Order(), (std::vector<int>{0, 1}));
+}
+
+}  // namespace seqr
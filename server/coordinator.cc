@@ -0,0 +1,316 @@
+#include "coordinator.h"
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/strings/str_cat.h>
+#include <arrow/buffer.h>
+#include <arrow/io/memory.h>
+#include <arrow/ipc/reader.h>
+#include <arrow/ipc/writer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "stable_hash.h"
+
+namespace seqr {
+
+namespace {
+
+// Workers return CANCELLED both if they exceed max_rows by themselves and if
+// their call was cancelled, so they mark the former in the trailing metadata.
+bool IsMaxRowsExceeded(const grpc::Status& status,
+                       const grpc::ClientContext& context) {
+  if (status.ok()) {
+    return false;
+  }
+  const auto& metadata = context.GetServerTrailingMetadata();
+  return metadata.find(kMaxRowsExceededMetadataKey) != metadata.end();
+}
+
+class CoordinatorServiceImpl final : public QueryService::Service {
+ public:
+  CoordinatorServiceImpl(
+      std::vector<std::shared_ptr<QueryService::StubInterface>> workers,
+      const std::vector<std::string>& worker_addresses)
+      : workers_(std::move(workers)), ring_(worker_addresses) {}
+
+ private:
+  struct WorkerCall {
+    // Propagates the client's deadline and cancellation.
+    std::unique_ptr<grpc::ClientContext> context;
+    QueryRequest request;
+    QueryResponse response;
+    grpc::Status status;
+  };
+
+  grpc::Status Query(grpc::ServerContext* const context,
+                     const QueryRequest* const request,
+                     QueryResponse* const response) override {
+    if (request->max_rows() <= 0) {
+      return grpc::Status(
+          grpc::StatusCode::INVALID_ARGUMENT,
+          absl::StrCat("Invalid max_rows value of ", request->max_rows()));
+    }
+    // Pairs can span workers, so they can't be found by any single worker.
+    if (request->inheritance_filter().mode() ==
+        QueryRequest::InheritanceFilter::COMPOUND_HET) {
+      return grpc::Status(
+          grpc::StatusCode::INVALID_ARGUMENT,
+          "Compound het searches aren't supported by the coordinator");
+    }
+    // Datasets are registered per worker, so their files can't be partitioned.
+    if (!request->dataset_id().empty()) {
+      return grpc::Status(
+          grpc::StatusCode::INVALID_ARGUMENT,
+          "Datasets aren't supported by the coordinator, please use "
+          "arrow_urls");
+    }
+
+    std::vector<std::unique_ptr<WorkerCall>> calls(workers_.size());
+    std::vector<QueryRequest> sub_requests =
+        PartitionRequest(*request, ring_, workers_.size());
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      if (sub_requests[i].arrow_urls_size() > 0) {
+        calls[i] = std::make_unique<WorkerCall>();
+        calls[i]->context = grpc::ClientContext::FromServerContext(*context);
+        calls[i]->request = std::move(sub_requests[i]);
+      }
+    }
+
+    // TryCancel is thread-safe, and also cancels calls that haven't started.
+    const auto cancel_all = [&calls] {
+      for (const auto& call : calls) {
+        if (call != nullptr) {
+          call->context->TryCancel();
+        }
+      }
+    };
+
+    const int64_t max_rows = request->max_rows();
+    std::atomic<int64_t> num_rows = 0;
+    std::atomic<bool> max_rows_exceeded = false;
+    // Any failure makes the result unusable, so the first one cancels the
+    // outstanding calls. The other calls then fail as cancelled, so the
+    // first failure is reported.
+    std::atomic<bool> cancelled = false;
+    std::atomic<int> first_failed_call = -1;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      if (calls[i] == nullptr) {
+        continue;
+      }
+      threads.emplace_back([&, i, &worker = *workers_[i], &call = *calls[i]] {
+        call.status =
+            worker.Query(call.context.get(), call.request, &call.response);
+        const bool exceeded =
+            call.status.ok()
+                ? (num_rows += call.response.num_rows()) > max_rows
+                : IsMaxRowsExceeded(call.status, *call.context);
+        if (exceeded) {
+          max_rows_exceeded = true;
+        }
+        if ((exceeded || !call.status.ok()) && !cancelled.exchange(true)) {
+          if (!call.status.ok()) {
+            first_failed_call = static_cast<int>(i);
+          }
+          cancel_all();
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    if (max_rows_exceeded) {
+      return grpc::Status(
+          grpc::StatusCode::CANCELLED,
+          absl::StrCat("More than ", max_rows,
+                       " rows matched; please use a more restrictive search"));
+    }
+    if (first_failed_call >= 0) {
+      const grpc::Status& status = calls[first_failed_call]->status;
+      return grpc::Status(
+          status.error_code(),
+          absl::StrCat("Worker call failed: ", status.error_message()));
+    }
+
+    std::vector<std::string_view> serialized_record_batches;
+    absl::flat_hash_map<std::string, QueryResponse::ConjunctStats*>
+        conjunct_stats;
+    for (const auto& call : calls) {
+      if (call == nullptr) {
+        continue;
+      }
+      if (!call->status.ok()) {
+        return grpc::Status(call->status.error_code(),
+                            absl::StrCat("Worker call failed: ",
+                                         call->status.error_message()));
+      }
+      serialized_record_batches.push_back(call->response.record_batches());
+      response->set_peak_memory_bytes(std::max(
+          response->peak_memory_bytes(), call->response.peak_memory_bytes()));
+      // The conjuncts are the same for all workers, but their order may
+      // differ.
+      for (const auto& worker_stats : call->response.conjunct_stats()) {
+        auto& stats = conjunct_stats[worker_stats.expression()];
+        if (stats == nullptr) {
+          stats = response->add_conjunct_stats();
+          stats->set_expression(worker_stats.expression());
+        }
+        stats->set_rows_in(stats->rows_in() + worker_stats.rows_in());
+        stats->set_rows_out(stats->rows_out() + worker_stats.rows_out());
+        stats->set_nanos(stats->nanos() + worker_stats.nanos());
+        stats->set_cache_hits(stats->cache_hits() + worker_stats.cache_hits());
+        stats->set_cache_misses(stats->cache_misses() +
+                                worker_stats.cache_misses());
+      }
+      // Workers estimate their partitions independently, so the estimates
+      // and bounds add up.
+      if (call->response.has_result_size_estimate()) {
+        const auto& worker_estimate = call->response.result_size_estimate();
+        auto& estimate = *response->mutable_result_size_estimate();
+        estimate.set_estimated_rows(estimate.estimated_rows() +
+                                    worker_estimate.estimated_rows());
+        estimate.set_lower_bound(estimate.lower_bound() +
+                                 worker_estimate.lower_bound());
+        estimate.set_upper_bound(estimate.upper_bound() +
+                                 worker_estimate.upper_bound());
+        estimate.set_sampled_files(estimate.sampled_files() +
+                                   worker_estimate.sampled_files());
+        estimate.set_total_files(estimate.total_files() +
+                                 worker_estimate.total_files());
+      }
+    }
+
+    auto record_batches = MergeRecordBatches(serialized_record_batches);
+    if (!record_batches.ok()) {
+      return grpc::Status(grpc::StatusCode::INTERNAL,
+                          absl::StrCat("Failed to merge worker results: ",
+                                       record_batches.status().message()));
+    }
+    response->set_num_rows(num_rows);
+    response->set_record_batches(*std::move(record_batches));
+    return grpc::Status::OK;
+  }
+
+  const std::vector<std::shared_ptr<QueryService::StubInterface>> workers_;
+  const ConsistentHashRing ring_;
+};
+
+}  // namespace
+
+ConsistentHashRing::ConsistentHashRing(
+    const std::vector<std::string>& worker_names, const int num_virtual_nodes) {
+  ring_.reserve(worker_names.size() * num_virtual_nodes);
+  for (size_t worker = 0; worker < worker_names.size(); ++worker) {
+    for (int i = 0; i < num_virtual_nodes; ++i) {
+      ring_.emplace_back(
+          StableHash(absl::StrCat(worker_names[worker], "#", i)), worker);
+    }
+  }
+  std::sort(ring_.begin(), ring_.end());
+}
+
+int ConsistentHashRing::WorkerForUrl(const std::string_view url) const {
+  if (ring_.empty()) {
+    return -1;
+  }
+  // The first virtual node clockwise from the URL's hash.
+  const auto it = std::lower_bound(
+      ring_.begin(), ring_.end(), std::make_pair(StableHash(url), 0));
+  return it == ring_.end() ? ring_.front().second : it->second;
+}
+
+std::vector<QueryRequest> PartitionRequest(const QueryRequest& request,
+                                           const ConsistentHashRing& ring,
+                                           const int num_workers) {
+  QueryRequest template_request = request;
+  template_request.clear_arrow_urls();
+  template_request.clear_arrow_url_xpos_bounds();
+  template_request.clear_index_urls();
+  std::vector<QueryRequest> result(num_workers, template_request);
+
+  for (int i = 0; i < request.arrow_urls_size(); ++i) {
+    const std::string& url = request.arrow_urls(i);
+    auto& sub_request = result[ring.WorkerForUrl(url)];
+    sub_request.add_arrow_urls(url);
+    if (i < request.arrow_url_xpos_bounds_size()) {
+      *sub_request.add_arrow_url_xpos_bounds() =
+          request.arrow_url_xpos_bounds(i);
+    }
+    if (i < request.index_urls_size()) {
+      sub_request.add_index_urls(request.index_urls(i));
+    }
+  }
+  return result;
+}
+
+absl::StatusOr<std::string> MergeRecordBatches(
+    const std::vector<std::string_view>& serialized_record_batches) {
+  std::shared_ptr<arrow::io::BufferOutputStream> output_stream;
+  std::shared_ptr<arrow::ipc::RecordBatchWriter> file_writer;
+  for (const auto serialized : serialized_record_batches) {
+    if (serialized.empty()) {
+      continue;
+    }
+    arrow::io::BufferReader buffer_reader{
+        reinterpret_cast<const uint8_t*>(serialized.data()),
+        static_cast<int64_t>(serialized.size())};
+    auto file_reader = arrow::ipc::RecordBatchFileReader::Open(&buffer_reader);
+    if (!file_reader.ok()) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Failed to open record batches: ", file_reader.status().ToString()));
+    }
+
+    if (file_writer == nullptr) {
+      auto stream = arrow::io::BufferOutputStream::Create();
+      if (!stream.ok()) {
+        return absl::InternalError(stream.status().ToString());
+      }
+      output_stream = *std::move(stream);
+      auto writer = arrow::ipc::MakeFileWriter(output_stream,
+                                               (*file_reader)->schema());
+      if (!writer.ok()) {
+        return absl::InternalError(writer.status().ToString());
+      }
+      file_writer = *std::move(writer);
+    }
+
+    for (int i = 0; i < (*file_reader)->num_record_batches(); ++i) {
+      const auto record_batch = (*file_reader)->ReadRecordBatch(i);
+      if (!record_batch.ok()) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Failed to read record batch: ",
+                         record_batch.status().ToString()));
+      }
+      // Fails if the schema differs.
+      if (const auto status = file_writer->WriteRecordBatch(**record_batch);
+          !status.ok()) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Failed to write record batch: ", status.ToString()));
+      }
+    }
+  }
+
+  if (file_writer == nullptr) {
+    return std::string();
+  }
+  if (const auto status = file_writer->Close(); !status.ok()) {
+    return absl::InternalError(status.ToString());
+  }
+  const auto buffer = output_stream->Finish();
+  if (!buffer.ok()) {
+    return absl::InternalError(buffer.status().ToString());
+  }
+  return (*buffer)->ToString();
+}
+
+std::unique_ptr<QueryService::Service> MakeCoordinatorService(
+    std::vector<std::shared_ptr<QueryService::StubInterface>> workers,
+    const std::vector<std::string>& worker_addresses) {
+  return std::make_unique<CoordinatorServiceImpl>(std::move(workers),
+                                                  worker_addresses);
+}
+
+}  // namespace seqr
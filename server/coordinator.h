@@ -0,0 +1,63 @@
+#pragma once
+
+#include <absl/status/statusor.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "seqr_query_service.grpc.pb.h"
+
+namespace seqr {
+
+// Trailing metadata key that workers set on queries that fail because max_rows
+// is exceeded, or certain to be exceeded according to the result size
+// estimate. Distinguishes these from cancelled calls, which have the same
+// status code.
+inline constexpr char kMaxRowsExceededMetadataKey[] = "seqr-max-rows-exceeded";
+
+// Maps URLs to workers using consistent hashing with virtual nodes. When
+// workers are added or removed, most URLs stay on the same worker, which
+// keeps worker caches (e.g. the disk cache) effective. The virtual nodes are
+// derived from the worker names (e.g. their addresses) rather than their
+// positions, so reordering the workers doesn't move any URLs.
+class ConsistentHashRing {
+ public:
+  explicit ConsistentHashRing(const std::vector<std::string>& worker_names,
+                              int num_virtual_nodes = 128);
+
+  // Returns the index of the worker in worker_names, or -1 without workers.
+  int WorkerForUrl(std::string_view url) const;
+
+ private:
+  // Sorted by hash.
+  std::vector<std::pair<uint64_t, int>> ring_;
+};
+
+// Splits the request into one sub-request per worker, each containing the
+// URLs assigned to that worker together with their aligned
+// arrow_url_xpos_bounds and index_urls. All other fields are copied. Workers
+// without URLs get a sub-request with empty arrow_urls.
+std::vector<QueryRequest> PartitionRequest(const QueryRequest& request,
+                                           const ConsistentHashRing& ring,
+                                           int num_workers);
+
+// Concatenates the record batches of responses serialized in Arrow IPC file
+// format into a single file. Empty strings are skipped. Returns an empty
+// string if there are no record batches.
+absl::StatusOr<std::string> MergeRecordBatches(
+    const std::vector<std::string_view>& serialized_record_batches);
+
+// Returns a query service that scatters requests across the workers and
+// gathers their results. max_rows is enforced across all workers: once it's
+// exceeded, the outstanding worker calls are cancelled. The client's deadline
+// and cancellation are propagated to the worker calls. worker_addresses are
+// aligned with workers and place them on the ConsistentHashRing.
+std::unique_ptr<QueryService::Service> MakeCoordinatorService(
+    std::vector<std::shared_ptr<QueryService::StubInterface>> workers,
+    const std::vector<std::string>& worker_addresses);
+
+}  // namespace seqr
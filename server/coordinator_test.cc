@@ -0,0 +1,171 @@
+#include "coordinator.h"
+
+#include <absl/strings/str_cat.h>
+#include <arrow/api.h>
+#include <arrow/io/memory.h>
+#include <arrow/ipc/reader.h>
+#include <arrow/ipc/writer.h>
+#include <gtest/gtest.h>
+
+namespace seqr {
+
+namespace {
+
+std::vector<std::string> MakeUrls(const int num_urls) {
+  std::vector<std::string> result;
+  for (int i = 0; i < num_urls; ++i) {
+    result.push_back(absl::StrCat("gs://bucket/part-", i, ".arrow"));
+  }
+  return result;
+}
+
+std::vector<std::string> MakeWorkerAddresses(const int num_workers) {
+  std::vector<std::string> result;
+  for (int i = 0; i < num_workers; ++i) {
+    result.push_back(absl::StrCat("worker-", i, ":8080"));
+  }
+  return result;
+}
+
+// Serializes the values as a single int64 column in Arrow IPC file format.
+std::string SerializeInt64s(const std::vector<int64_t>& values) {
+  arrow::Int64Builder builder;
+  EXPECT_TRUE(builder.AppendValues(values).ok());
+  std::shared_ptr<arrow::Array> array;
+  EXPECT_TRUE(builder.Finish(&array).ok());
+  const auto schema = arrow::schema({arrow::field("xpos", arrow::int64())});
+  const auto record_batch =
+      arrow::RecordBatch::Make(schema, array->length(), {array});
+
+  auto output_stream = arrow::io::BufferOutputStream::Create();
+  EXPECT_TRUE(output_stream.ok());
+  auto writer = arrow::ipc::MakeFileWriter(*output_stream, schema);
+  EXPECT_TRUE(writer.ok());
+  EXPECT_TRUE((*writer)->WriteRecordBatch(*record_batch).ok());
+  EXPECT_TRUE((*writer)->Close().ok());
+  const auto buffer = (*output_stream)->Finish();
+  EXPECT_TRUE(buffer.ok());
+  return (*buffer)->ToString();
+}
+
+std::vector<int64_t> DeserializeInt64s(const std::string& serialized) {
+  std::vector<int64_t> result;
+  auto file_reader = arrow::ipc::RecordBatchFileReader::Open(
+      std::make_shared<arrow::io::BufferReader>(serialized));
+  EXPECT_TRUE(file_reader.ok()) << file_reader.status();
+  for (int i = 0; i < (*file_reader)->num_record_batches(); ++i) {
+    const auto record_batch = (*file_reader)->ReadRecordBatch(i);
+    EXPECT_TRUE(record_batch.ok()) << record_batch.status();
+    const auto& array =
+        static_cast<const arrow::Int64Array&>(*(*record_batch)->column(0));
+    for (int j = 0; j < array.length(); ++j) {
+      result.push_back(array.Value(j));
+    }
+  }
+  return result;
+}
+
+TEST(ConsistentHashRing, BalancesAndMinimizesMovement) {
+  const auto urls = MakeUrls(1000);
+  const ConsistentHashRing three_workers(MakeWorkerAddresses(3));
+  const ConsistentHashRing four_workers(MakeWorkerAddresses(4));
+
+  std::vector<int> counts(3);
+  int num_moved = 0;
+  for (const auto& url : urls) {
+    const int worker = three_workers.WorkerForUrl(url);
+    ASSERT_GE(worker, 0);
+    ASSERT_LT(worker, 3);
+    ++counts[worker];
+    const int new_worker = four_workers.WorkerForUrl(url);
+    if (new_worker != worker) {
+      // URLs only move to the added worker.
+      EXPECT_EQ(new_worker, 3);
+      ++num_moved;
+    }
+  }
+
+  for (const int count : counts) {
+    EXPECT_GT(count, 200);
+  }
+  // Ideally a quarter of the URLs move.
+  EXPECT_LT(num_moved, 400);
+}
+
+TEST(ConsistentHashRing, RemovingWorkerOnlyMovesItsUrls) {
+  const auto urls = MakeUrls(1000);
+  const auto addresses = MakeWorkerAddresses(4);
+  // Removes the second worker, which shifts the positions of the later ones.
+  auto remaining_addresses = addresses;
+  remaining_addresses.erase(remaining_addresses.begin() + 1);
+  const ConsistentHashRing four_workers(addresses);
+  const ConsistentHashRing three_workers(remaining_addresses);
+
+  int num_moved = 0;
+  for (const auto& url : urls) {
+    const std::string& address = addresses[four_workers.WorkerForUrl(url)];
+    const std::string& new_address =
+        remaining_addresses[three_workers.WorkerForUrl(url)];
+    if (new_address != address) {
+      // Only URLs of the removed worker move.
+      EXPECT_EQ(address, addresses[1]);
+      ++num_moved;
+    }
+  }
+  EXPECT_GT(num_moved, 0);
+  EXPECT_LT(num_moved, 400);
+}
+
+TEST(PartitionRequest, KeepsAlignedFields) {
+  QueryRequest request;
+  request.set_max_rows(100);
+  request.add_projection_columns("xpos");
+  const auto urls = MakeUrls(20);
+  for (size_t i = 0; i < urls.size(); ++i) {
+    request.add_arrow_urls(urls[i]);
+    request.add_index_urls(absl::StrCat(urls[i], ".index"));
+    auto* const bounds = request.add_arrow_url_xpos_bounds();
+    bounds->set_start_xpos(i);
+    bounds->set_end_xpos(i + 1);
+  }
+
+  const ConsistentHashRing ring(MakeWorkerAddresses(3));
+  const auto sub_requests = PartitionRequest(request, ring, 3);
+  ASSERT_EQ(sub_requests.size(), 3);
+  int num_urls = 0;
+  for (int worker = 0; worker < 3; ++worker) {
+    const auto& sub_request = sub_requests[worker];
+    EXPECT_EQ(sub_request.max_rows(), 100);
+    EXPECT_EQ(sub_request.projection_columns_size(), 1);
+    ASSERT_EQ(sub_request.index_urls_size(), sub_request.arrow_urls_size());
+    ASSERT_EQ(sub_request.arrow_url_xpos_bounds_size(),
+              sub_request.arrow_urls_size());
+    for (int i = 0; i < sub_request.arrow_urls_size(); ++i) {
+      const std::string& url = sub_request.arrow_urls(i);
+      EXPECT_EQ(ring.WorkerForUrl(url), worker);
+      EXPECT_EQ(sub_request.index_urls(i), absl::StrCat(url, ".index"));
+      const int64_t start_xpos =
+          sub_request.arrow_url_xpos_bounds(i).start_xpos();
+      EXPECT_EQ(url, urls[start_xpos]);
+      ++num_urls;
+    }
+  }
+  EXPECT_EQ(num_urls, urls.size());
+}
+
+TEST(MergeRecordBatches, ConcatenatesResults) {
+  const auto merged = MergeRecordBatches(
+      {SerializeInt64s({1, 2}), "", SerializeInt64s({3})});
+  ASSERT_TRUE(merged.ok()) << merged.status();
+  EXPECT_EQ(DeserializeInt64s(*merged), (std::vector<int64_t>{1, 2, 3}));
+
+  const auto empty = MergeRecordBatches({"", ""});
+  ASSERT_TRUE(empty.ok()) << empty.status();
+  EXPECT_TRUE(empty->empty());
+
+  EXPECT_FALSE(MergeRecordBatches({"not arrow"}).ok());
+}
+
+}  // namespace
+
+}  // namespace seqr
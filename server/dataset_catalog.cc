@@ -0,0 +1,290 @@
+#include "dataset_catalog.h"
+
+#include <absl/strings/match.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_join.h>
+#include <arrow/array.h>
+#include <arrow/io/memory.h>
+#include <arrow/ipc/reader.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+
+#include "parquet_reader.h"
+
+namespace seqr {
+
+namespace cp = arrow::compute;
+
+namespace {
+
+constexpr int kNumRegisterThreads = 16;
+
+struct FileInfo {
+  std::shared_ptr<arrow::Schema> schema;
+  int64_t num_rows = 0;
+  int64_t num_bytes = 0;
+  std::optional<QueryRequest::XposInterval> xpos_bounds;
+};
+
+absl::StatusOr<FileInfo> ReadArrowFileInfo(const UrlReader& url_reader,
+                                           const std::string_view url) {
+  const auto data = url_reader.Read(url);
+  if (!data.ok()) {
+    return data.status();
+  }
+  arrow::io::BufferReader buffer_reader{*data};
+  const auto schema_reader =
+      arrow::ipc::RecordBatchFileReader::Open(&buffer_reader);
+  if (!schema_reader.ok()) {
+    return absl::InvalidArgumentError(schema_reader.status().ToString());
+  }
+
+  // Only decode the xpos column. Without one, decode the first column to
+  // count the rows, as an empty list means that all fields get decoded.
+  const auto& schema = (*schema_reader)->schema();
+  auto ipc_read_options = arrow::ipc::IpcReadOptions::Defaults();
+  // Files are registered in parallel already.
+  ipc_read_options.use_threads = false;
+  if (schema->num_fields() > 0) {
+    ipc_read_options.included_fields = {
+        std::max(0, schema->GetFieldIndex("xpos"))};
+  }
+  const auto record_batch_file_reader =
+      arrow::ipc::RecordBatchFileReader::Open(&buffer_reader, ipc_read_options);
+  if (!record_batch_file_reader.ok()) {
+    return absl::InvalidArgumentError(
+        record_batch_file_reader.status().ToString());
+  }
+
+  FileInfo result;
+  result.schema = schema;
+  result.num_bytes = (*data)->size();
+  int64_t min_xpos = std::numeric_limits<int64_t>::max();
+  int64_t max_xpos = std::numeric_limits<int64_t>::min();
+  for (int i = 0; i < (*record_batch_file_reader)->num_record_batches(); ++i) {
+    const auto record_batch = (*record_batch_file_reader)->ReadRecordBatch(i);
+    if (!record_batch.ok()) {
+      return absl::InvalidArgumentError(record_batch.status().ToString());
+    }
+    result.num_rows += (*record_batch)->num_rows();
+    const auto xpos = (*record_batch)->GetColumnByName("xpos");
+    if (xpos == nullptr || xpos->type_id() != arrow::Type::INT64) {
+      continue;
+    }
+    const auto& xpos_array = static_cast<const arrow::Int64Array&>(*xpos);
+    for (int64_t j = 0; j < xpos_array.length(); ++j) {
+      if (!xpos_array.IsNull(j)) {
+        min_xpos = std::min(min_xpos, xpos_array.Value(j));
+        max_xpos = std::max(max_xpos, xpos_array.Value(j));
+      }
+    }
+  }
+
+  if (min_xpos <= max_xpos) {
+    result.xpos_bounds.emplace();
+    result.xpos_bounds->set_start_xpos(min_xpos);
+    result.xpos_bounds->set_end_xpos(max_xpos + 1);
+  }
+  return result;
+}
+
+absl::StatusOr<FileInfo> ReadParquetInfo(const UrlReader& url_reader,
+                                         const std::string_view url) {
+  const auto url_metadata = url_reader.GetMetadata(url);
+  if (!url_metadata.ok()) {
+    return url_metadata.status();
+  }
+  const auto parquet_file_info = ReadParquetFileInfo(url_reader, url);
+  if (!parquet_file_info.ok()) {
+    return parquet_file_info.status();
+  }
+  FileInfo result;
+  result.schema = parquet_file_info->schema;
+  result.num_rows = parquet_file_info->num_rows;
+  result.num_bytes = url_metadata->size;
+  return result;
+}
+
+}  // namespace
+
+DatasetCatalog::DatasetCatalog(const UrlReader& url_reader)
+    : url_reader_(url_reader) {}
+
+absl::StatusOr<Dataset> DatasetCatalog::Register(
+    const RegisterDatasetRequest& request) {
+  if (request.dataset_id().empty()) {
+    return absl::InvalidArgumentError("Missing dataset_id");
+  }
+  const int num_files = request.files_size();
+  if (num_files == 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("No files for dataset ", request.dataset_id()));
+  }
+
+  std::vector<absl::StatusOr<FileInfo>> file_infos(num_files);
+  std::atomic<int> next_index = 0;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < std::min(kNumRegisterThreads, num_files); ++i) {
+    threads.emplace_back([&] {
+      for (int index = next_index++; index < num_files; index = next_index++) {
+        const std::string& url = request.files(index).url();
+        file_infos[index] = absl::EndsWith(url, ".parquet")
+                                ? ReadParquetInfo(url_reader_, url)
+                                : ReadArrowFileInfo(url_reader_, url);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  auto entry = std::make_shared<DatasetEntry>();
+  Dataset& dataset = entry->dataset;
+  dataset.set_dataset_id(request.dataset_id());
+  std::vector<std::shared_ptr<arrow::Schema>> schemas;
+  schemas.reserve(num_files);
+  for (int i = 0; i < num_files; ++i) {
+    const auto& request_file = request.files(i);
+    const auto& file_info = file_infos[i];
+    if (!file_info.ok()) {
+      return absl::Status(
+          file_info.status().code(),
+          absl::StrCat("Failed to read ", request_file.url(), ": ",
+                       file_info.status().message()));
+    }
+    schemas.push_back(file_info->schema);
+
+    auto* const file = dataset.add_files();
+    file->set_url(request_file.url());
+    file->set_index_url(request_file.index_url());
+    if (request_file.has_xpos_bounds()) {
+      *file->mutable_xpos_bounds() = request_file.xpos_bounds();
+    } else if (file_info->xpos_bounds.has_value()) {
+      *file->mutable_xpos_bounds() = *file_info->xpos_bounds;
+    }
+    file->set_num_rows(file_info->num_rows);
+    file->set_num_bytes(file_info->num_bytes);
+    dataset.set_num_rows(dataset.num_rows() + file_info->num_rows);
+    dataset.set_num_bytes(dataset.num_bytes() + file_info->num_bytes);
+  }
+
+  auto schema = arrow::UnifySchemas(schemas);
+  if (!schema.ok()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Incompatible file schemas in dataset ",
+                     request.dataset_id(), ": ", schema.status().ToString()));
+  }
+  entry->schema = *std::move(schema);
+  for (const auto& field : entry->schema->fields()) {
+    auto* const column = dataset.add_columns();
+    column->set_name(field->name());
+    column->set_type(field->type()->ToString());
+  }
+
+  std::cout << "Registered dataset " << dataset.dataset_id() << " with "
+            << dataset.files_size() << " files, " << dataset.num_rows()
+            << " rows and " << dataset.num_bytes() << " bytes" << std::endl;
+  Dataset result = dataset;
+  absl::MutexLock lock(&mu_);
+  datasets_[request.dataset_id()] = std::move(entry);
+  return result;
+}
+
+std::vector<Dataset> DatasetCatalog::List(const bool include_files) const {
+  std::vector<Dataset> result;
+  {
+    absl::MutexLock lock(&mu_);
+    result.reserve(datasets_.size());
+    for (const auto& [dataset_id, entry] : datasets_) {
+      result.push_back(entry->dataset);
+      if (!include_files) {
+        result.back().clear_files();
+      }
+    }
+  }
+  std::sort(result.begin(), result.end(),
+            [](const Dataset& lhs, const Dataset& rhs) {
+              return lhs.dataset_id() < rhs.dataset_id();
+            });
+  return result;
+}
+
+std::shared_ptr<const DatasetEntry> DatasetCatalog::Find(
+    const std::string_view dataset_id) const {
+  absl::MutexLock lock(&mu_);
+  const auto it = datasets_.find(dataset_id);
+  return it == datasets_.end() ? nullptr : it->second;
+}
+
+absl::StatusOr<QueryRequest> ExpandDataset(const QueryRequest& request,
+                                           const Dataset& dataset) {
+  if (request.arrow_urls_size() > 0 ||
+      request.arrow_url_xpos_bounds_size() > 0 ||
+      request.index_urls_size() > 0) {
+    return absl::InvalidArgumentError(
+        "arrow_urls, arrow_url_xpos_bounds and index_urls must be empty if "
+        "dataset_id is set");
+  }
+
+  // Bounds and indexes are either set for all files or none.
+  bool has_xpos_bounds = false;
+  bool has_index_urls = false;
+  for (const auto& file : dataset.files()) {
+    has_xpos_bounds |= file.has_xpos_bounds();
+    has_index_urls |= !file.index_url().empty();
+  }
+
+  QueryRequest result = request;
+  result.clear_dataset_id();
+  for (const auto& file : dataset.files()) {
+    result.add_arrow_urls(file.url());
+    if (has_xpos_bounds) {
+      auto* const bounds = result.add_arrow_url_xpos_bounds();
+      if (file.has_xpos_bounds()) {
+        *bounds = file.xpos_bounds();
+      } else {
+        // Unknown bounds overlap everything.
+        bounds->set_start_xpos(std::numeric_limits<int64_t>::min());
+        bounds->set_end_xpos(std::numeric_limits<int64_t>::max());
+      }
+    }
+    if (has_index_urls) {
+      result.add_index_urls(file.index_url());
+    }
+  }
+  return result;
+}
+
+absl::Status ValidateColumns(
+    const arrow::Schema& schema,
+    const std::vector<std::string>& projection_columns,
+    const cp::Expression& filter_expression) {
+  std::vector<std::string> columns = projection_columns;
+  for (const auto& field_ref : cp::FieldsInExpression(filter_expression)) {
+    if (const auto* const name = field_ref.name(); name != nullptr) {
+      columns.push_back(*name);
+    }
+  }
+
+  std::vector<std::string> unknown_columns;
+  for (const auto& column : columns) {
+    if (schema.GetFieldIndex(column) < 0 &&
+        std::find(unknown_columns.begin(), unknown_columns.end(), column) ==
+            unknown_columns.end()) {
+      unknown_columns.push_back(column);
+    }
+  }
+  if (!unknown_columns.empty()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Unknown columns: ", absl::StrJoin(unknown_columns, ", ")));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace seqr
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <absl/base/thread_annotations.h>
+#include <absl/container/flat_hash_map.h>
+#include <absl/status/statusor.h>
+#include <absl/synchronization/mutex.h>
+#include <arrow/compute/exec/expression.h>
+#include <arrow/type.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "seqr_query_service.pb.h"
+#include "url_reader.h"
+
+namespace seqr {
+
+// A registered dataset together with its unified Arrow schema.
+struct DatasetEntry {
+  Dataset dataset;
+  std::shared_ptr<arrow::Schema> schema;
+};
+
+// In-memory registry of datasets, so queries don't have to list all files.
+// Thread-safe.
+class DatasetCatalog {
+ public:
+  explicit DatasetCatalog(const UrlReader& url_reader);
+
+  // Reads the files in parallel: Parquet files only need their footer, while
+  // Arrow files are read in full to count their rows and determine their xpos
+  // bounds. Fails if the file schemas can't be unified.
+  absl::StatusOr<Dataset> Register(const RegisterDatasetRequest& request);
+
+  // Sorted by dataset_id.
+  std::vector<Dataset> List(bool include_files) const;
+
+  // Returns nullptr if the dataset isn't registered.
+  std::shared_ptr<const DatasetEntry> Find(std::string_view dataset_id) const;
+
+ private:
+  const UrlReader& url_reader_;
+  mutable absl::Mutex mu_;
+  absl::flat_hash_map<std::string, std::shared_ptr<const DatasetEntry>>
+      datasets_ ABSL_GUARDED_BY(mu_);
+};
+
+// Returns a copy of the request with dataset_id replaced by the files of the
+// dataset.
+absl::StatusOr<QueryRequest> ExpandDataset(const QueryRequest& request,
+                                           const Dataset& dataset);
+
+// Checks that all projection columns and fields referenced by the filter
+// exist in the schema.
+absl::Status ValidateColumns(
+    const arrow::Schema& schema,
+    const std::vector<std::string>& projection_columns,
+    const arrow::compute::Expression& filter_expression);
+
+}  // namespace seqr
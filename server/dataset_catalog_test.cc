@@ -0,0 +1,123 @@
+#include "dataset_catalog.h"
+
+#include <gtest/gtest.h>
+
+namespace seqr {
+
+namespace cp = arrow::compute;
+
+namespace {
+
+constexpr const char* kArrowUrls[] = {
+    "file://testdata/part-00000-na12878-trio.zstd.arrow",
+    "file://testdata/part-00001-na12878-trio.zstd.arrow",
+    "file://testdata/part-00002-na12878-trio.zstd.arrow"};
+
+RegisterDatasetRequest MakeRegisterRequest(const std::string& dataset_id) {
+  RegisterDatasetRequest request;
+  request.set_dataset_id(dataset_id);
+  for (const char* const url : kArrowUrls) {
+    request.add_files()->set_url(url);
+  }
+  return request;
+}
+
+TEST(DatasetCatalog, RegistersAndListsDatasets) {
+  const auto local_file_reader = MakeLocalFileReader();
+  ASSERT_TRUE(local_file_reader.ok());
+  DatasetCatalog catalog(**local_file_reader);
+
+  const auto dataset = catalog.Register(MakeRegisterRequest("trio"));
+  ASSERT_TRUE(dataset.ok()) << dataset.status();
+  ASSERT_EQ(dataset->files_size(), 3);
+  int64_t num_rows = 0;
+  for (const auto& file : dataset->files()) {
+    EXPECT_GT(file.num_rows(), 0);
+    EXPECT_GT(file.num_bytes(), 0);
+    ASSERT_TRUE(file.has_xpos_bounds());
+    EXPECT_LT(file.xpos_bounds().start_xpos(), file.xpos_bounds().end_xpos());
+    num_rows += file.num_rows();
+  }
+  EXPECT_EQ(dataset->num_rows(), num_rows);
+  bool has_xpos_column = false;
+  for (const auto& column : dataset->columns()) {
+    if (column.name() == "xpos") {
+      EXPECT_EQ(column.type(), "int64");
+      has_xpos_column = true;
+    }
+  }
+  EXPECT_TRUE(has_xpos_column);
+
+  ASSERT_TRUE(catalog.Register(MakeRegisterRequest("another")).ok());
+  const auto datasets = catalog.List(/* include_files */ false);
+  ASSERT_EQ(datasets.size(), 2);
+  EXPECT_EQ(datasets[0].dataset_id(), "another");
+  EXPECT_EQ(datasets[1].dataset_id(), "trio");
+  EXPECT_EQ(datasets[1].files_size(), 0);
+  EXPECT_EQ(datasets[1].num_rows(), num_rows);
+
+  const auto entry = catalog.Find("trio");
+  ASSERT_TRUE(entry != nullptr);
+  EXPECT_TRUE(entry->schema->GetFieldByName("variantId") != nullptr);
+  EXPECT_TRUE(catalog.Find("unknown") == nullptr);
+}
+
+TEST(DatasetCatalog, InvalidRequests) {
+  const auto local_file_reader = MakeLocalFileReader();
+  ASSERT_TRUE(local_file_reader.ok());
+  DatasetCatalog catalog(**local_file_reader);
+
+  EXPECT_FALSE(catalog.Register(MakeRegisterRequest("")).ok());
+  RegisterDatasetRequest invalid_file = MakeRegisterRequest("invalid");
+  invalid_file.add_files()->set_url(
+      "file://testdata/na12878_trio_query.textproto");
+  EXPECT_EQ(catalog.Register(invalid_file).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_TRUE(catalog.List(/* include_files */ true).empty());
+}
+
+TEST(ExpandDataset, AlignsBoundsAndIndexes) {
+  Dataset dataset;
+  auto* const first = dataset.add_files();
+  first->set_url("gs://bucket/first.arrow");
+  first->mutable_xpos_bounds()->set_start_xpos(10);
+  first->mutable_xpos_bounds()->set_end_xpos(20);
+  auto* const second = dataset.add_files();
+  second->set_url("gs://bucket/second.arrow");
+  second->set_index_url("gs://bucket/second.index");
+
+  QueryRequest request;
+  request.set_dataset_id("dataset");
+  request.set_max_rows(10);
+  const auto expanded = ExpandDataset(request, dataset);
+  ASSERT_TRUE(expanded.ok()) << expanded.status();
+  EXPECT_TRUE(expanded->dataset_id().empty());
+  EXPECT_EQ(expanded->max_rows(), 10);
+  ASSERT_EQ(expanded->arrow_urls_size(), 2);
+  ASSERT_EQ(expanded->arrow_url_xpos_bounds_size(), 2);
+  EXPECT_EQ(expanded->arrow_url_xpos_bounds(0).start_xpos(), 10);
+  EXPECT_LT(expanded->arrow_url_xpos_bounds(1).start_xpos(), 0);
+  ASSERT_EQ(expanded->index_urls_size(), 2);
+  EXPECT_EQ(expanded->index_urls(0), "");
+  EXPECT_EQ(expanded->index_urls(1), "gs://bucket/second.index");
+
+  request.add_arrow_urls("gs://bucket/other.arrow");
+  EXPECT_FALSE(ExpandDataset(request, dataset).ok());
+}
+
+TEST(ValidateColumns, ReportsUnknownColumns) {
+  const auto schema = arrow::schema({arrow::field("xpos", arrow::int64()),
+                                     arrow::field("AF", arrow::float32())});
+  EXPECT_TRUE(ValidateColumns(*schema, {"xpos"},
+                              cp::less(cp::field_ref("AF"), cp::literal(0.1)))
+                  .ok());
+  const auto status = ValidateColumns(
+      *schema, {"xpos", "variantId"},
+      cp::less(cp::field_ref("AC"), cp::literal(3)));
+  EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(status.message(), "Unknown columns: variantId, AC");
+}
+
+}  // namespace
+
+}  // namespace seqr
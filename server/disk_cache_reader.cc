@@ -0,0 +1,369 @@
+#include "disk_cache_reader.h"
+
+#include <absl/base/thread_annotations.h>
+#include <absl/container/flat_hash_map.h>
+#include <absl/strings/str_cat.h>
+#include <absl/synchronization/mutex.h>
+#include <arrow/io/file.h>
+#include <crc32c/crc32c.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <optional>
+#include <tuple>
+#include <utility>
+
+#include "seqr_file_metadata.pb.h"
+#include "stable_hash.h"
+
+namespace seqr {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Each cached blob is stored as a data file and an entry file containing a
+// DiskCacheEntry proto. The entry file is written last, so its existence
+// implies that the data file is complete.
+constexpr char kDataExtension[] = ".data";
+constexpr char kEntryExtension[] = ".entry";
+constexpr char kTempExtension[] = ".tmp";
+
+// Writes a file atomically by renaming a temporary file.
+absl::Status WriteFileAtomically(const fs::path& path, const char* const data,
+                                 const size_t size) {
+  // Concurrent writers for the same path use distinct temporary files.
+  static std::atomic<uint64_t> counter = 0;
+  const fs::path temp_path =
+      absl::StrCat(path.string(), ".", counter++, kTempExtension);
+  std::error_code error_code;
+  {
+    std::ofstream ofs{temp_path, std::ios::binary};
+    ofs.write(data, size);
+    ofs.close();
+    if (!ofs) {
+      fs::remove(temp_path, error_code);
+      return absl::InternalError(
+          absl::StrCat("Failed to write ", temp_path.string()));
+    }
+  }
+
+  fs::rename(temp_path, path, error_code);
+  if (error_code) {
+    const std::string message = error_code.message();
+    fs::remove(temp_path, error_code);
+    return absl::InternalError(
+        absl::StrCat("Failed to rename ", temp_path.string(), ": ", message));
+  }
+  return absl::OkStatus();
+}
+
+// Maps a file into memory. The returned buffer references the mapping, which
+// avoids copying the blob.
+absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadMappedFile(
+    const fs::path& path, const int64_t expected_size) {
+  if (expected_size == 0) {
+    return AllocateBlobBuffer(0);  // Empty files can't be mapped.
+  }
+
+  auto file = arrow::io::MemoryMappedFile::Open(path.string(),
+                                                arrow::io::FileMode::READ);
+  if (!file.ok()) {
+    return absl::NotFoundError(absl::StrCat("Failed to open ", path.string(),
+                                            ": ", file.status().ToString()));
+  }
+  const auto size = (*file)->GetSize();
+  if (!size.ok() || *size != expected_size) {
+    return absl::DataLossError(
+        absl::StrCat("Unexpected size for ", path.string()));
+  }
+
+  // The mapping stays valid after the file is closed.
+  auto buffer = (*file)->ReadAt(0, expected_size);
+  if (!buffer.ok()) {
+    return absl::InternalError(absl::StrCat("Failed to mmap ", path.string(),
+                                            ": ", buffer.status().ToString()));
+  }
+  return *std::move(buffer);
+}
+
+class DiskCacheReader : public UrlReader {
+ public:
+  DiskCacheReader(std::unique_ptr<UrlReader> base_reader,
+                  DiskCacheOptions options)
+      : base_reader_(std::move(base_reader)), options_(std::move(options)) {}
+
+  // Restores the cache state from a previous run.
+  absl::Status Init() {
+    const fs::path directory{options_.directory};
+    std::error_code error_code;
+    fs::create_directories(directory, error_code);
+    if (error_code) {
+      return absl::InternalError(absl::StrCat("Failed to create ",
+                                              options_.directory, ": ",
+                                              error_code.message()));
+    }
+
+    std::vector<std::tuple<fs::file_time_type, std::string, DiskCacheEntry>>
+        found;
+    std::vector<fs::path> data_paths;
+    fs::directory_iterator it(directory, error_code);
+    for (; !error_code && it != fs::directory_iterator();
+         it.increment(error_code)) {
+      const auto& path = it->path();
+      const auto extension = path.extension();
+      std::error_code ignored;
+      if (extension == kTempExtension) {
+        // Left over from an interrupted write.
+        fs::remove(path, ignored);
+      } else if (extension == kDataExtension) {
+        data_paths.push_back(path);
+      } else if (extension == kEntryExtension) {
+        DiskCacheEntry entry;
+        std::ifstream ifs{path, std::ios::binary};
+        const std::string key = path.stem().string();
+        if (!entry.ParseFromIstream(&ifs) ||
+            fs::file_size(DataPath(key), ignored) !=
+                static_cast<std::uintmax_t>(entry.size())) {
+          fs::remove(path, ignored);
+          continue;
+        }
+        found.emplace_back(fs::last_write_time(path, ignored), key,
+                           std::move(entry));
+      }
+    }
+    if (error_code) {
+      return absl::InternalError(absl::StrCat("Failed to list ",
+                                              options_.directory, ": ",
+                                              error_code.message()));
+    }
+
+    // Oldest first, so the most recently used entries end up at the front.
+    std::sort(found.begin(), found.end(),
+              [](const auto& lhs, const auto& rhs) {
+                return std::get<0>(lhs) < std::get<0>(rhs);
+              });
+
+    absl::MutexLock lock(&mu_);
+    for (auto& [last_write_time, key, entry] : found) {
+      lru_.push_front(key);
+      total_bytes_ += entry.size();
+      entries_[key] = {std::move(entry), lru_.begin()};
+    }
+
+    // Remove data files without a valid entry.
+    for (const auto& path : data_paths) {
+      if (!entries_.contains(path.stem().string())) {
+        fs::remove(path, error_code);
+      }
+    }
+
+    EvictLocked();
+    std::cout << "Disk cache in " << options_.directory << " contains "
+              << entries_.size() << " blobs with " << total_bytes_ << " bytes"
+              << std::endl;
+    return absl::OkStatus();
+  }
+
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> Read(
+      std::string_view url) const override {
+    const auto metadata = base_reader_->GetMetadata(url);
+    if (!metadata.ok()) {
+      return metadata.status();
+    }
+    return ReadWithMetadata(url, *metadata);
+  }
+
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadWithMetadata(
+      std::string_view url, const UrlMetadata& metadata) const override {
+    const std::string key = CacheKey(url);
+    if (auto cached = ReadCached(key, url, metadata); cached.has_value()) {
+      return *std::move(cached);
+    }
+
+    // Fails if the blob has changed since reading the metadata, so the data
+    // is never cached under the wrong generation.
+    auto data = base_reader_->ReadWithMetadata(url, metadata);
+    if (!data.ok()) {
+      return data.status();
+    }
+    if (const auto status = Insert(key, url, metadata.generation, **data);
+        !status.ok()) {
+      std::cerr << "Failed to cache " << url << ": " << status << std::endl;
+    }
+    return data;
+  }
+
+  // Ranges aren't cached, as overlapping ranges would fragment the cache.
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadRange(
+      std::string_view url, const int64_t offset,
+      const int64_t length) const override {
+    return base_reader_->ReadRange(url, offset, length);
+  }
+
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadRangeOfGeneration(
+      std::string_view url, const std::string_view generation,
+      const int64_t offset, const int64_t length) const override {
+    return base_reader_->ReadRangeOfGeneration(url, generation, offset,
+                                               length);
+  }
+
+  absl::StatusOr<UrlMetadata> GetMetadata(std::string_view url) const override {
+    return base_reader_->GetMetadata(url);
+  }
+
+ private:
+  struct Entry {
+    DiskCacheEntry entry;
+    std::list<std::string>::iterator lru_position;
+  };
+
+  static std::string CacheKey(const std::string_view url) {
+    return absl::StrCat(absl::Hex(StableHash(url), absl::kZeroPad16));
+  }
+
+  fs::path DataPath(const std::string_view key) const {
+    return fs::path(options_.directory) / absl::StrCat(key, kDataExtension);
+  }
+
+  fs::path EntryPath(const std::string_view key) const {
+    return fs::path(options_.directory) / absl::StrCat(key, kEntryExtension);
+  }
+
+  // Returns the cached blob if it's still valid.
+  std::optional<std::shared_ptr<arrow::Buffer>> ReadCached(
+      const std::string& key, const std::string_view url,
+      const UrlMetadata& metadata) const {
+    DiskCacheEntry entry;
+    {
+      absl::MutexLock lock(&mu_);
+      const auto it = entries_.find(key);
+      if (it == entries_.end()) {
+        return std::nullopt;
+      }
+      entry = it->second.entry;
+      if (entry.url() != url || entry.generation() != metadata.generation ||
+          entry.size() != metadata.size) {
+        RemoveLocked(key, /* delete_files */ true);
+        return std::nullopt;
+      }
+      lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+    }
+
+    auto data = ReadMappedFile(DataPath(key), entry.size());
+    if (!data.ok() ||
+        (options_.verify_checksums &&
+         crc32c::Crc32c((*data)->data(), (*data)->size()) !=
+             entry.crc32c())) {
+      std::cerr << "Discarding invalid disk cache entry for " << url
+                << std::endl;
+      absl::MutexLock lock(&mu_);
+      RemoveLocked(key, /* delete_files */ true);
+      return std::nullopt;
+    }
+
+    // Persist the access time, to restore the LRU order after restarts.
+    std::error_code error_code;
+    fs::last_write_time(EntryPath(key), fs::file_time_type::clock::now(),
+                        error_code);
+    return *std::move(data);
+  }
+
+  absl::Status Insert(const std::string& key, const std::string_view url,
+                      const std::string& generation,
+                      const arrow::Buffer& data) const {
+    const int64_t size = data.size();
+    if (size > options_.max_bytes) {
+      return absl::OkStatus();  // Too large to cache.
+    }
+
+    DiskCacheEntry entry;
+    entry.set_url(std::string(url));
+    entry.set_size(size);
+    entry.set_generation(generation);
+    entry.set_crc32c(crc32c::Crc32c(data.data(), data.size()));
+
+    if (const auto status = WriteFileAtomically(
+            DataPath(key), reinterpret_cast<const char*>(data.data()),
+            data.size());
+        !status.ok()) {
+      return status;
+    }
+    const std::string serialized_entry = entry.SerializeAsString();
+    if (const auto status =
+            WriteFileAtomically(EntryPath(key), serialized_entry.data(),
+                                serialized_entry.size());
+        !status.ok()) {
+      return status;
+    }
+
+    absl::MutexLock lock(&mu_);
+    // The files of a previous entry have been replaced already.
+    RemoveLocked(key, /* delete_files */ false);
+    lru_.push_front(key);
+    total_bytes_ += size;
+    entries_[key] = {std::move(entry), lru_.begin()};
+    EvictLocked();
+    return absl::OkStatus();
+  }
+
+  void RemoveLocked(const std::string& key, const bool delete_files) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    const auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      return;
+    }
+    total_bytes_ -= it->second.entry.size();
+    lru_.erase(it->second.lru_position);
+    entries_.erase(it);
+
+    if (delete_files) {
+      // Remove the entry first, as it marks the data file as valid.
+      std::error_code error_code;
+      fs::remove(EntryPath(key), error_code);
+      fs::remove(DataPath(key), error_code);
+    }
+  }
+
+  void EvictLocked() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    while (total_bytes_ > options_.max_bytes && !lru_.empty()) {
+      // Copy, as removal invalidates the list element.
+      const std::string key = lru_.back();
+      RemoveLocked(key, /* delete_files */ true);
+    }
+  }
+
+  const std::unique_ptr<UrlReader> base_reader_;
+  const DiskCacheOptions options_;
+
+  // Read is const, but updates the cache state.
+  mutable absl::Mutex mu_;
+  mutable absl::flat_hash_map<std::string, Entry> entries_
+      ABSL_GUARDED_BY(mu_);
+  // Most recently used keys first.
+  mutable std::list<std::string> lru_ ABSL_GUARDED_BY(mu_);
+  mutable int64_t total_bytes_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<UrlReader>> MakeDiskCacheReader(
+    std::unique_ptr<UrlReader> base_reader, DiskCacheOptions options) {
+  if (options.max_bytes <= 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid max_bytes value of ", options.max_bytes));
+  }
+
+  auto result = std::make_unique<DiskCacheReader>(std::move(base_reader),
+                                                  std::move(options));
+  if (const auto status = result->Init(); !status.ok()) {
+    return status;
+  }
+  return result;
+}
+
+}  // namespace seqr
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <absl/status/statusor.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "url_reader.h"
+
+namespace seqr {
+
+struct DiskCacheOptions {
+  // Directory for the cached blobs, which is created if it doesn't exist. Only
+  // one process may use the directory at a time.
+  std::string directory;
+
+  // The least recently used blobs are evicted to keep the total size of the
+  // cache below this limit.
+  int64_t max_bytes = 0;
+
+  // Whether to verify the CRC32C checksum of cached blobs on every read.
+  bool verify_checksums = true;
+};
+
+// Returns a UrlReader that persists the blobs read through base_reader in a
+// local directory, e.g. on a local SSD. Cached blobs are validated against the
+// generation reported by base_reader, so modified blobs are read again. The
+// cache survives restarts.
+absl::StatusOr<std::unique_ptr<UrlReader>> MakeDiskCacheReader(
+    std::unique_ptr<UrlReader> base_reader, DiskCacheOptions options);
+
+}  // namespace seqr
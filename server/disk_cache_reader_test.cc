@@ -0,0 +1,100 @@
+#include "disk_cache_reader.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+
+#include "url_reader_test_util.h"
+
+namespace seqr {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+class DiskCacheReaderTest : public BlobDirectoryTest {
+ protected:
+  std::unique_ptr<UrlReader> MakeReader(const int64_t max_bytes) {
+    auto result = MakeDiskCacheReader(
+        std::make_unique<CountingReader>(&num_reads_),
+        {.directory = (root_ / "cache").string(), .max_bytes = max_bytes});
+    EXPECT_TRUE(result.ok()) << result.status();
+    return result.ok() ? *std::move(result) : nullptr;
+  }
+
+  std::atomic<int> num_reads_ = 0;
+};
+
+TEST_F(DiskCacheReaderTest, CachesAcrossInstances) {
+  const std::string url = WriteBlob("a", "hello");
+  {
+    const auto reader = MakeReader(1000);
+    EXPECT_EQ(ToString(reader->Read(url)), "hello");
+    EXPECT_EQ(ToString(reader->Read(url)), "hello");
+    EXPECT_EQ(num_reads_, 1);
+  }
+
+  // The cache is restored from disk.
+  const auto reader = MakeReader(1000);
+  EXPECT_EQ(ToString(reader->Read(url)), "hello");
+  EXPECT_EQ(num_reads_, 1);
+}
+
+TEST_F(DiskCacheReaderTest, ReadsModifiedBlobsAgain) {
+  const std::string url = WriteBlob("a", "hello");
+  const auto reader = MakeReader(1000);
+  EXPECT_EQ(ToString(reader->Read(url)), "hello");
+
+  WriteBlob("a", "hello world");
+  EXPECT_EQ(ToString(reader->Read(url)), "hello world");
+  EXPECT_EQ(ToString(reader->Read(url)), "hello world");
+  EXPECT_EQ(num_reads_, 2);
+}
+
+TEST_F(DiskCacheReaderTest, EvictsLeastRecentlyUsed) {
+  const std::string url_a = WriteBlob("a", std::string(40, 'a'));
+  const std::string url_b = WriteBlob("b", std::string(40, 'b'));
+  const std::string url_c = WriteBlob("c", std::string(40, 'c'));
+  const auto reader = MakeReader(100);
+  reader->Read(url_a).IgnoreError();
+  reader->Read(url_b).IgnoreError();
+  reader->Read(url_a).IgnoreError();  // Hit, so b is now the oldest.
+  reader->Read(url_c).IgnoreError();  // Evicts b.
+  EXPECT_EQ(num_reads_, 3);
+
+  reader->Read(url_a).IgnoreError();
+  reader->Read(url_c).IgnoreError();
+  EXPECT_EQ(num_reads_, 3);
+  reader->Read(url_b).IgnoreError();
+  EXPECT_EQ(num_reads_, 4);
+}
+
+TEST_F(DiskCacheReaderTest, DiscardsCorruptedEntries) {
+  const std::string url = WriteBlob("a", "hello");
+  const auto reader = MakeReader(1000);
+  EXPECT_EQ(ToString(reader->Read(url)), "hello");
+
+  // Flip the content of the cached data file, keeping its size.
+  for (const auto& dir_entry : fs::directory_iterator(root_ / "cache")) {
+    if (dir_entry.path().extension() == ".data") {
+      std::ofstream ofs{dir_entry.path(), std::ios::binary | std::ios::trunc};
+      ofs << "HELLO";
+    }
+  }
+
+  EXPECT_EQ(ToString(reader->Read(url)), "hello");
+  EXPECT_EQ(num_reads_, 2);
+  EXPECT_EQ(ToString(reader->Read(url)), "hello");
+  EXPECT_EQ(num_reads_, 2);
+}
+
+TEST(DiskCacheReader, InvalidOptions) {
+  EXPECT_FALSE(
+      MakeDiskCacheReader(*MakeLocalFileReader(), {.directory = "/tmp"}).ok());
+}
+
+}  // namespace
+
+}  // namespace seqr
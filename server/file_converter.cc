@@ -0,0 +1,293 @@
+#include "file_converter.h"
+
+#include <absl/container/flat_hash_set.h>
+#include <absl/strings/match.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_replace.h>
+#include <arrow/array/array_nested.h>
+#include <arrow/compute/api_aggregate.h>
+#include <arrow/compute/api_vector.h>
+#include <arrow/io/memory.h>
+#include <arrow/ipc/writer.h>
+#include <arrow/scalar.h>
+#include <arrow/type_traits.h>
+#include <arrow/util/key_value_metadata.h>
+
+#include <string_view>
+#include <utility>
+
+#include "xpos_intervals.h"
+
+namespace seqr {
+
+namespace cp = arrow::compute;
+
+namespace {
+
+absl::Status ConversionError(const std::string_view context,
+                             const arrow::Status& status) {
+  return absl::InvalidArgumentError(
+      absl::StrCat(context, ": ", status.ToString()));
+}
+
+// Returns a dictionary<int32, utf8> array for the given string array.
+absl::StatusOr<std::shared_ptr<arrow::Array>> DictionaryEncode(
+    const std::shared_ptr<arrow::Array>& array) {
+  const auto result = cp::DictionaryEncode(array);
+  if (!result.ok()) {
+    return ConversionError("Failed to dictionary-encode", result.status());
+  }
+  return result->make_array();
+}
+
+// Dictionary-encodes the string values of a list<utf8> array, keeping the list
+// structure. All record batch slices of the result share the dictionary.
+absl::StatusOr<std::shared_ptr<arrow::Array>> DictionaryEncodeListValues(
+    const arrow::ListArray& list_array) {
+  const auto values = DictionaryEncode(list_array.values());
+  if (!values.ok()) {
+    return values.status();
+  }
+  const auto list_type = arrow::list(
+      list_array.list_type()->value_field()->WithType((*values)->type()));
+  return std::make_shared<arrow::ListArray>(
+      list_type, list_array.length(), list_array.value_offsets(), *values,
+      list_array.null_bitmap(), list_array.null_count(), list_array.offset());
+}
+
+bool IsStringList(const arrow::DataType& type) {
+  return type.id() == arrow::Type::LIST &&
+         static_cast<const arrow::ListType&>(type).value_type()->id() ==
+             arrow::Type::STRING;
+}
+
+// Replaces the columns that should be dictionary-encoded. The table must
+// consist of single chunks.
+absl::StatusOr<std::shared_ptr<arrow::Table>> DictionaryEncodeColumns(
+    const std::shared_ptr<arrow::Table>& table,
+    const ConversionOptions& options) {
+  const absl::flat_hash_set<std::string> dictionary_columns(
+      options.dictionary_columns.begin(), options.dictionary_columns.end());
+  for (const auto& name : dictionary_columns) {
+    const auto field = table->schema()->GetFieldByName(name);
+    if (field == nullptr || field->type()->id() != arrow::Type::STRING) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Dictionary column ", name, " not found or not a string"));
+    }
+  }
+
+  std::vector<std::shared_ptr<arrow::Field>> fields;
+  std::vector<std::shared_ptr<arrow::ChunkedArray>> columns;
+  for (int i = 0; i < table->num_columns(); ++i) {
+    const auto& field = table->schema()->field(i);
+    const auto& column = table->column(i);
+    const bool encode_column = dictionary_columns.contains(field->name());
+    const bool encode_list_values =
+        options.dictionary_encode_sample_lists &&
+        absl::StartsWith(field->name(), "samples_") &&
+        IsStringList(*field->type());
+    if ((!encode_column && !encode_list_values) || column->num_chunks() != 1) {
+      fields.push_back(field);
+      columns.push_back(column);
+      continue;
+    }
+
+    const auto encoded =
+        encode_column ? DictionaryEncode(column->chunk(0))
+                      : DictionaryEncodeListValues(
+                            static_cast<const arrow::ListArray&>(
+                                *column->chunk(0)));
+    if (!encoded.ok()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Column ", field->name(), ": ",
+                       encoded.status().message()));
+    }
+    fields.push_back(field->WithType((*encoded)->type()));
+    columns.push_back(std::make_shared<arrow::ChunkedArray>(*encoded));
+  }
+
+  return arrow::Table::Make(arrow::schema(std::move(fields),
+                                          table->schema()->metadata()),
+                            std::move(columns), table->num_rows());
+}
+
+// Converts a numeric scalar to a statistics value.
+absl::Status SetStatisticsValue(const arrow::Scalar& scalar,
+                                const bool is_integer,
+                                FileStatistics::Value* const value) {
+  const auto cast =
+      scalar.CastTo(is_integer ? arrow::int64() : arrow::float64());
+  if (!cast.ok()) {
+    return ConversionError("Failed to cast statistics value", cast.status());
+  }
+  if (is_integer) {
+    value->set_int_value(static_cast<const arrow::Int64Scalar&>(**cast).value);
+  } else {
+    value->set_double_value(
+        static_cast<const arrow::DoubleScalar&>(**cast).value);
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<FileStatistics::RecordBatch> ComputeStatistics(
+    const arrow::RecordBatch& record_batch) {
+  FileStatistics::RecordBatch result;
+  result.set_num_rows(record_batch.num_rows());
+  for (int i = 0; i < record_batch.num_columns(); ++i) {
+    const auto& column = record_batch.column(i);
+    auto& column_statistics = *result.add_columns();
+    column_statistics.set_name(record_batch.column_name(i));
+    column_statistics.set_null_count(column->null_count());
+
+    const auto type_id = column->type_id();
+    const bool is_integer = arrow::is_integer(type_id);
+    const bool is_floating =
+        type_id == arrow::Type::FLOAT || type_id == arrow::Type::DOUBLE;
+    if ((!is_integer && !is_floating) ||
+        column->null_count() == column->length()) {
+      continue;
+    }
+
+    const auto min_max = cp::MinMax(column);
+    if (!min_max.ok()) {
+      return ConversionError(
+          absl::StrCat("Failed to compute min / max of ",
+                       record_batch.column_name(i)),
+          min_max.status());
+    }
+    const auto& min_max_scalar = min_max->scalar_as<arrow::StructScalar>();
+    if (const auto status =
+            SetStatisticsValue(*min_max_scalar.value[0], is_integer,
+                               column_statistics.mutable_min());
+        !status.ok()) {
+      return status;
+    }
+    if (const auto status =
+            SetStatisticsValue(*min_max_scalar.value[1], is_integer,
+                               column_statistics.mutable_max());
+        !status.ok()) {
+      return status;
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+absl::StatusOr<ConvertedFile> ConvertTable(
+    const std::shared_ptr<arrow::Table>& table,
+    const ConversionOptions& options) {
+  if (options.record_batch_size <= 0) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Invalid record_batch_size value of ", options.record_batch_size));
+  }
+
+  // The IPC format only supports these codecs.
+  std::shared_ptr<arrow::util::Codec> codec;
+  if (options.compression != arrow::Compression::UNCOMPRESSED) {
+    if (options.compression != arrow::Compression::LZ4_FRAME &&
+        options.compression != arrow::Compression::ZSTD) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Unsupported compression ",
+          arrow::util::Codec::GetCodecAsString(options.compression)));
+    }
+    auto created_codec = arrow::util::Codec::Create(
+        options.compression, options.compression_level);
+    if (!created_codec.ok()) {
+      return ConversionError("Failed to create codec", created_codec.status());
+    }
+    codec = *std::move(created_codec);
+  }
+
+  // Elasticsearch replaces dots in column names.
+  std::vector<std::string> column_names;
+  for (const auto& name : table->ColumnNames()) {
+    column_names.push_back(absl::StrReplaceAll(name, {{".", "_"}}));
+  }
+  auto renamed_table = table->RenameColumns(column_names);
+  if (!renamed_table.ok()) {
+    return ConversionError("Failed to rename columns", renamed_table.status());
+  }
+
+  // Sorting allows binary search for xpos intervals, see
+  // SliceSortedRecordBatch.
+  const auto sort_indices = cp::SortIndices(
+      *renamed_table, cp::SortOptions({cp::SortKey("xpos")}));
+  if (!sort_indices.ok()) {
+    return ConversionError("Failed to sort by xpos", sort_indices.status());
+  }
+  const auto sorted_table = cp::Take(*renamed_table, *sort_indices);
+  if (!sorted_table.ok()) {
+    return ConversionError("Failed to sort by xpos", sorted_table.status());
+  }
+
+  // Dictionaries need to be computed over the whole table, as the IPC file
+  // format doesn't support replacing dictionaries between record batches.
+  const auto combined_table = sorted_table->table()->CombineChunks();
+  if (!combined_table.ok()) {
+    return ConversionError("Failed to combine chunks", combined_table.status());
+  }
+  auto encoded_table = DictionaryEncodeColumns(*combined_table, options);
+  if (!encoded_table.ok()) {
+    return encoded_table.status();
+  }
+
+  auto sorted_metadata =
+      arrow::key_value_metadata({kSortedByMetadataKey}, {kSortedByXpos});
+  const auto& existing_metadata = (*encoded_table)->schema()->metadata();
+  const auto output_table = (*encoded_table)->ReplaceSchemaMetadata(
+      existing_metadata == nullptr
+          ? sorted_metadata
+          : existing_metadata->Merge(*sorted_metadata));
+
+  auto output_stream = arrow::io::BufferOutputStream::Create();
+  if (!output_stream.ok()) {
+    return ConversionError("Failed to create output stream",
+                           output_stream.status());
+  }
+  arrow::ipc::IpcWriteOptions write_options;
+  write_options.codec = std::move(codec);
+  auto file_writer = arrow::ipc::MakeFileWriter(
+      *output_stream, output_table->schema(), write_options);
+  if (!file_writer.ok()) {
+    return ConversionError("Failed to create file writer",
+                           file_writer.status());
+  }
+
+  ConvertedFile result;
+  arrow::TableBatchReader batch_reader(*output_table);
+  batch_reader.set_chunksize(options.record_batch_size);
+  while (true) {
+    std::shared_ptr<arrow::RecordBatch> record_batch;
+    if (const auto status = batch_reader.ReadNext(&record_batch);
+        !status.ok()) {
+      return ConversionError("Failed to read record batch", status);
+    }
+    if (record_batch == nullptr) {
+      break;
+    }
+
+    if (const auto status = (*file_writer)->WriteRecordBatch(*record_batch);
+        !status.ok()) {
+      return ConversionError("Failed to write record batch", status);
+    }
+
+    auto statistics = ComputeStatistics(*record_batch);
+    if (!statistics.ok()) {
+      return statistics.status();
+    }
+    *result.statistics.add_record_batches() = *std::move(statistics);
+  }
+
+  if (const auto status = (*file_writer)->Close(); !status.ok()) {
+    return ConversionError("Failed to close file writer", status);
+  }
+  auto buffer = (*output_stream)->Finish();
+  if (!buffer.ok()) {
+    return ConversionError("Failed to finish output stream", buffer.status());
+  }
+  result.arrow_file = *std::move(buffer);
+  return result;
+}
+
+}  // namespace seqr
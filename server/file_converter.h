@@ -0,0 +1,51 @@
+#pragma once
+
+#include <absl/status/statusor.h>
+#include <arrow/buffer.h>
+#include <arrow/table.h>
+#include <arrow/util/compression.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "seqr_file_metadata.pb.h"
+
+namespace seqr {
+
+struct ConversionOptions {
+  // Maximum number of rows per record batch. Smaller record batches are
+  // cheaper to skip and to decompress, but add per-batch overhead.
+  int64_t record_batch_size = 64 * 1024;
+
+  // The Arrow IPC format uses one codec for all buffers of a record batch.
+  // LZ4 decompresses considerably faster than zstd, at a larger file size.
+  arrow::Compression::type compression = arrow::Compression::LZ4_FRAME;
+  int compression_level = arrow::util::kUseDefaultCompressionLevel;
+
+  // Whether to dictionary-encode the values of list<string> columns whose name
+  // starts with "samples_". There are only few distinct sample IDs per file.
+  bool dictionary_encode_sample_lists = true;
+
+  // Additional string columns to dictionary-encode, which should have a low
+  // cardinality. Queries may only use these columns with functions that accept
+  // dictionary arrays.
+  std::vector<std::string> dictionary_columns;
+};
+
+struct ConvertedFile {
+  // The Arrow IPC file.
+  std::shared_ptr<arrow::Buffer> arrow_file;
+  FileStatistics statistics;
+};
+
+// Rewrites a table into a query-optimized Arrow IPC file: dots in column names
+// are replaced by underscores, rows are sorted by the "xpos" column (which is
+// recorded in the schema metadata, see IsSortedByXpos) and split into record
+// batches of the configured size.
+absl::StatusOr<ConvertedFile> ConvertTable(
+    const std::shared_ptr<arrow::Table>& table,
+    const ConversionOptions& options);
+
+}  // namespace seqr
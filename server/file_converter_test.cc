@@ -0,0 +1,144 @@
+#include "file_converter.h"
+
+#include <arrow/array/array_dict.h>
+#include <arrow/array/array_nested.h>
+#include <arrow/array/builder_binary.h>
+#include <arrow/array/builder_nested.h>
+#include <arrow/array/builder_primitive.h>
+#include <arrow/io/memory.h>
+#include <arrow/ipc/reader.h>
+#include <arrow/testing/gtest_util.h>
+#include <gtest/gtest.h>
+
+#include "xpos_intervals.h"
+
+namespace seqr {
+
+// Returns a table with unsorted xpos values and a dotted column name.
+std::shared_ptr<arrow::Table> MakeTable() {
+  auto* const memory_pool = arrow::default_memory_pool();
+
+  arrow::Int64Builder xpos_builder(memory_pool);
+  EXPECT_OK(xpos_builder.AppendValues({30, 10, 50, 20, 40}));
+  std::shared_ptr<arrow::Array> xpos;
+  EXPECT_OK(xpos_builder.Finish(&xpos));
+
+  arrow::StringBuilder contig_builder(memory_pool);
+  EXPECT_OK(contig_builder.AppendValues({"3", "1", "5", "2", "4"}));
+  std::shared_ptr<arrow::Array> contig;
+  EXPECT_OK(contig_builder.Finish(&contig));
+
+  arrow::DoubleBuilder af_builder(memory_pool);
+  EXPECT_OK(af_builder.AppendValues({0.3, 0.1, 0.5, 0.2, 0.4},
+                                    {true, true, true, false, true}));
+  std::shared_ptr<arrow::Array> af;
+  EXPECT_OK(af_builder.Finish(&af));
+
+  arrow::ListBuilder samples_builder(
+      memory_pool, std::make_shared<arrow::StringBuilder>(memory_pool));
+  auto& sample_builder =
+      static_cast<arrow::StringBuilder&>(*samples_builder.value_builder());
+  for (const std::vector<std::string>& samples :
+       std::vector<std::vector<std::string>>{
+           {"S3"}, {"S1", "S2"}, {}, {"S2"}, {"S1", "S3"}}) {
+    EXPECT_OK(samples_builder.Append());
+    EXPECT_OK(sample_builder.AppendValues(samples));
+  }
+  std::shared_ptr<arrow::Array> samples;
+  EXPECT_OK(samples_builder.Finish(&samples));
+
+  return arrow::Table::Make(
+      arrow::schema({arrow::field("xpos", arrow::int64()),
+                     arrow::field("locus.contig", arrow::utf8()),
+                     arrow::field("AF", arrow::float64()),
+                     arrow::field("samples_num_alt_1", samples->type())}),
+      {xpos, contig, af, samples});
+}
+
+std::vector<std::string> DictionaryValues(const arrow::DictionaryArray& array) {
+  const auto& dictionary =
+      static_cast<const arrow::StringArray&>(*array.dictionary());
+  std::vector<std::string> result;
+  for (int64_t i = 0; i < array.length(); ++i) {
+    result.push_back(dictionary.GetString(array.GetValueIndex(i)));
+  }
+  return result;
+}
+
+TEST(FileConverter, ConvertTable) {
+  ConversionOptions options;
+  options.record_batch_size = 2;
+  options.dictionary_columns = {"locus_contig"};
+  const auto converted_file = ConvertTable(MakeTable(), options);
+  ASSERT_TRUE(converted_file.ok()) << converted_file.status();
+
+  const auto buffer_reader =
+      std::make_shared<arrow::io::BufferReader>(converted_file->arrow_file);
+  ASSERT_OK_AND_ASSIGN(auto record_batch_file_reader,
+                       arrow::ipc::RecordBatchFileReader::Open(buffer_reader));
+  const auto schema = record_batch_file_reader->schema();
+  EXPECT_TRUE(IsSortedByXpos(*schema));
+  EXPECT_EQ(schema->field(1)->name(), "locus_contig");
+  EXPECT_TRUE(schema->field(1)->type()->Equals(
+      arrow::dictionary(arrow::int32(), arrow::utf8())));
+  EXPECT_TRUE(schema->field(3)->type()->Equals(arrow::list(
+      arrow::field("item", arrow::dictionary(arrow::int32(), arrow::utf8())))));
+  ASSERT_EQ(record_batch_file_reader->num_record_batches(), 3);
+
+  std::vector<int64_t> xpos_values;
+  std::vector<std::string> contigs;
+  std::vector<std::vector<std::string>> samples;
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_OK_AND_ASSIGN(const auto record_batch,
+                         record_batch_file_reader->ReadRecordBatch(i));
+    const auto& xpos =
+        static_cast<const arrow::Int64Array&>(*record_batch->column(0));
+    xpos_values.insert(xpos_values.end(), xpos.raw_values(),
+                       xpos.raw_values() + xpos.length());
+    for (const auto& contig : DictionaryValues(
+             static_cast<const arrow::DictionaryArray&>(
+                 *record_batch->column(1)))) {
+      contigs.push_back(contig);
+    }
+    const auto& samples_list =
+        static_cast<const arrow::ListArray&>(*record_batch->column(3));
+    for (int64_t j = 0; j < samples_list.length(); ++j) {
+      samples.push_back(
+          DictionaryValues(static_cast<const arrow::DictionaryArray&>(
+              *samples_list.value_slice(j))));
+    }
+  }
+  EXPECT_EQ(xpos_values, (std::vector<int64_t>{10, 20, 30, 40, 50}));
+  EXPECT_EQ(contigs, (std::vector<std::string>{"1", "2", "3", "4", "5"}));
+  EXPECT_EQ(samples, (std::vector<std::vector<std::string>>{
+                         {"S1", "S2"}, {"S2"}, {"S3"}, {"S1", "S3"}, {}}));
+
+  const auto& statistics = converted_file->statistics;
+  ASSERT_EQ(statistics.record_batches_size(), 3);
+  const auto& first_xpos = statistics.record_batches(0).columns(0);
+  EXPECT_EQ(first_xpos.name(), "xpos");
+  EXPECT_EQ(first_xpos.min().int_value(), 10);
+  EXPECT_EQ(first_xpos.max().int_value(), 20);
+  const auto& first_af = statistics.record_batches(0).columns(2);
+  EXPECT_EQ(first_af.null_count(), 1);
+  EXPECT_EQ(first_af.min().double_value(), 0.1);
+  EXPECT_EQ(first_af.max().double_value(), 0.1);
+  EXPECT_FALSE(statistics.record_batches(0).columns(3).has_min());
+  EXPECT_EQ(statistics.record_batches(2).num_rows(), 1);
+}
+
+TEST(FileConverter, InvalidOptions) {
+  ConversionOptions options;
+  options.compression = arrow::Compression::SNAPPY;
+  EXPECT_FALSE(ConvertTable(MakeTable(), options).ok());
+
+  options = {};
+  options.dictionary_columns = {"AF"};
+  EXPECT_FALSE(ConvertTable(MakeTable(), options).ok());
+
+  options = {};
+  options.record_batch_size = 0;
+  EXPECT_FALSE(ConvertTable(MakeTable(), options).ok());
+}
+
+}  // namespace seqr
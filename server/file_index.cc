@@ -0,0 +1,234 @@
+#include "file_index.h"
+
+#include <absl/strings/str_cat.h>
+#include <arrow/array/array_binary.h>
+#include <arrow/array/array_nested.h>
+#include <arrow/record_batch.h>
+#include <arrow/type.h>
+
+#include <algorithm>
+#include <cstdint>
+
+#include "stable_hash.h"
+
+namespace seqr {
+
+namespace {
+
+// Bloom filters are sized for a false positive rate of about 1%.
+constexpr size_t kBloomFilterBitsPerValue = 10;
+constexpr int kBloomFilterNumHashes = 7;
+
+// Calls func for each of the bit positions of the value, using double hashing.
+template <typename Func>
+void ForEachBloomFilterBit(const std::string_view value, const int num_hashes,
+                           const uint64_t num_bits, const Func& func) {
+  const uint64_t hash = StableHash(value);
+  const uint64_t h1 = hash & 0xffffffffULL;
+  const uint64_t h2 = (hash >> 32) | 1;
+  for (int i = 0; i < num_hashes; ++i) {
+    func((h1 + i * h2) % num_bits);
+  }
+}
+
+std::string_view ToStringView(const arrow::util::string_view sv) {
+  return {sv.data(), sv.size()};
+}
+
+absl::StatusOr<std::shared_ptr<arrow::Array>> GetColumn(
+    const arrow::RecordBatch& record_batch, const std::string_view name,
+    const arrow::DataType& type) {
+  auto result = record_batch.GetColumnByName(std::string(name));
+  if (result == nullptr) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Column ", name, " not found"));
+  }
+  if (!result->type()->Equals(type, /* check_metadata */ false)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Column ", name, " has unexpected type ",
+                     result->type()->ToString()));
+  }
+  return result;
+}
+
+// Returns the non-null values of a string column.
+std::vector<std::string_view> NonNullValues(const arrow::StringArray& array) {
+  std::vector<std::string_view> result;
+  result.reserve(array.length());
+  for (int64_t i = 0; i < array.length(); ++i) {
+    if (!array.IsNull(i)) {
+      result.push_back(ToStringView(array.GetView(i)));
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+FileIndex::BloomFilter MakeBloomFilter(
+    const std::vector<std::string_view>& values) {
+  // Round up to full bytes, with a minimum of 64 bits.
+  const uint64_t num_bytes =
+      std::max<uint64_t>(8, (values.size() * kBloomFilterBitsPerValue + 7) / 8);
+  std::string bits(num_bytes, '\0');
+  for (const auto value : values) {
+    ForEachBloomFilterBit(value, kBloomFilterNumHashes, num_bytes * 8,
+                          [&bits](const uint64_t bit) {
+                            bits[bit / 8] |= static_cast<char>(1 << (bit % 8));
+                          });
+  }
+
+  FileIndex::BloomFilter result;
+  result.set_bits(std::move(bits));
+  result.set_num_hashes(kBloomFilterNumHashes);
+  return result;
+}
+
+bool BloomFilterMayContain(const FileIndex::BloomFilter& bloom_filter,
+                           const std::string_view value) {
+  const auto& bits = bloom_filter.bits();
+  if (bits.empty()) {
+    return false;
+  }
+  bool result = true;
+  ForEachBloomFilterBit(value, bloom_filter.num_hashes(), bits.size() * 8,
+                        [&bits, &result](const uint64_t bit) {
+                          if ((bits[bit / 8] & (1 << (bit % 8))) == 0) {
+                            result = false;
+                          }
+                        });
+  return result;
+}
+
+absl::StatusOr<FileIndex> BuildFileIndex(
+    arrow::ipc::RecordBatchFileReader* const record_batch_file_reader) {
+  FileIndex result;
+  auto& gene_id_rows = *result.mutable_gene_id_rows();
+  int64_t row_offset = 0;
+  const int num_record_batches = record_batch_file_reader->num_record_batches();
+  for (int i = 0; i < num_record_batches; ++i) {
+    const auto record_batch = record_batch_file_reader->ReadRecordBatch(i);
+    if (!record_batch.ok()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Failed to read record batch ", i, ": ",
+                       record_batch.status().ToString()));
+    }
+
+    // List field names differ between Arrow and Parquet ("item" vs "element"),
+    // so only check the list value type for geneIds.
+    const auto gene_ids_column = (*record_batch)->GetColumnByName("geneIds");
+    if (gene_ids_column == nullptr ||
+        gene_ids_column->type_id() != arrow::Type::LIST ||
+        static_cast<const arrow::ListType&>(*gene_ids_column->type())
+                .value_type()
+                ->id() != arrow::Type::STRING) {
+      return absl::InvalidArgumentError(
+          "Column geneIds not found or not a list of strings");
+    }
+    const auto variant_id_column =
+        GetColumn(**record_batch, "variantId", *arrow::utf8());
+    if (!variant_id_column.ok()) {
+      return variant_id_column.status();
+    }
+    const auto rsid_column = GetColumn(**record_batch, "rsid", *arrow::utf8());
+    if (!rsid_column.ok()) {
+      return rsid_column.status();
+    }
+
+    const auto& gene_ids =
+        static_cast<const arrow::ListArray&>(*gene_ids_column);
+    const auto& gene_id_strings =
+        static_cast<const arrow::StringArray&>(*gene_ids.values());
+    for (int64_t row = 0; row < gene_ids.length(); ++row) {
+      if (gene_ids.IsNull(row)) {
+        continue;
+      }
+      const int64_t file_row = row_offset + row;
+      const auto end = gene_ids.value_offset(row + 1);
+      for (auto j = gene_ids.value_offset(row); j < end; ++j) {
+        if (gene_id_strings.IsNull(j)) {
+          continue;
+        }
+        auto& rows =
+            *gene_id_rows[gene_id_strings.GetString(j)].mutable_rows();
+        // Genes can be listed multiple times per row.
+        if (rows.empty() || rows[rows.size() - 1] != file_row) {
+          rows.Add(file_row);
+        }
+      }
+    }
+
+    auto& record_batch_index = *result.add_record_batches();
+    record_batch_index.set_num_rows((*record_batch)->num_rows());
+    *record_batch_index.mutable_variant_id_filter() =
+        MakeBloomFilter(NonNullValues(
+            static_cast<const arrow::StringArray&>(**variant_id_column)));
+    *record_batch_index.mutable_rsid_filter() = MakeBloomFilter(NonNullValues(
+        static_cast<const arrow::StringArray&>(**rsid_column)));
+
+    row_offset += (*record_batch)->num_rows();
+  }
+
+  return result;
+}
+
+std::vector<bool> MatchRecordBatches(const FileIndex& file_index,
+                                     const IndexLookup& lookup) {
+  const int num_record_batches = file_index.record_batches_size();
+  std::vector<bool> result(num_record_batches, true);
+
+  if (!lookup.gene_ids.empty()) {
+    // Row offset of each record batch, to map rows back to record batches.
+    std::vector<int64_t> row_offsets;
+    row_offsets.reserve(num_record_batches);
+    int64_t row_offset = 0;
+    for (const auto& record_batch : file_index.record_batches()) {
+      row_offsets.push_back(row_offset);
+      row_offset += record_batch.num_rows();
+    }
+
+    std::vector<bool> gene_matches(num_record_batches, false);
+    for (const auto& gene_id : lookup.gene_ids) {
+      const auto it = file_index.gene_id_rows().find(gene_id);
+      if (it == file_index.gene_id_rows().end()) {
+        continue;
+      }
+      for (const int64_t row : it->second.rows()) {
+        const auto batch_it =
+            std::upper_bound(row_offsets.begin(), row_offsets.end(), row);
+        if (batch_it != row_offsets.begin()) {
+          gene_matches[batch_it - row_offsets.begin() - 1] = true;
+        }
+      }
+    }
+
+    for (int i = 0; i < num_record_batches; ++i) {
+      result[i] = result[i] && gene_matches[i];
+    }
+  }
+
+  const auto may_contain_any = [](const FileIndex::BloomFilter& bloom_filter,
+                                  const std::vector<std::string>& values) {
+    return std::any_of(values.begin(), values.end(),
+                       [&bloom_filter](const std::string& value) {
+                         return BloomFilterMayContain(bloom_filter, value);
+                       });
+  };
+
+  for (int i = 0; i < num_record_batches; ++i) {
+    const auto& record_batch = file_index.record_batches(i);
+    if (!lookup.variant_ids.empty() &&
+        !may_contain_any(record_batch.variant_id_filter(),
+                         lookup.variant_ids)) {
+      result[i] = false;
+    }
+    if (!lookup.rsids.empty() &&
+        !may_contain_any(record_batch.rsid_filter(), lookup.rsids)) {
+      result[i] = false;
+    }
+  }
+
+  return result;
+}
+
+}  // namespace seqr
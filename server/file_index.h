@@ -0,0 +1,44 @@
+#pragma once
+
+#include <absl/status/statusor.h>
+#include <arrow/ipc/reader.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "seqr_file_metadata.pb.h"
+
+namespace seqr {
+
+// Builds the lookup index over the "geneIds", "variantId" and "rsid" columns
+// of all record batches in an Arrow file.
+absl::StatusOr<FileIndex> BuildFileIndex(
+    arrow::ipc::RecordBatchFileReader* record_batch_file_reader);
+
+// Point lookups by identifier, see QueryRequest. Each non-empty list is a
+// separate constraint.
+struct IndexLookup {
+  std::vector<std::string> gene_ids;
+  std::vector<std::string> variant_ids;
+  std::vector<std::string> rsids;
+
+  bool empty() const {
+    return gene_ids.empty() && variant_ids.empty() && rsids.empty();
+  }
+};
+
+// Returns for each record batch of the indexed file whether it may contain rows
+// that satisfy the lookup. There are false positives, but no false negatives.
+std::vector<bool> MatchRecordBatches(const FileIndex& file_index,
+                                     const IndexLookup& lookup);
+
+// Returns a bloom filter containing the given values.
+FileIndex::BloomFilter MakeBloomFilter(
+    const std::vector<std::string_view>& values);
+
+// Returns false if the value is definitely not contained in the bloom filter.
+bool BloomFilterMayContain(const FileIndex::BloomFilter& bloom_filter,
+                           std::string_view value);
+
+}  // namespace seqr
@@ -0,0 +1,143 @@
+#include "file_index.h"
+
+#include <absl/strings/str_cat.h>
+#include <arrow/array/builder_binary.h>
+#include <arrow/array/builder_nested.h>
+#include <arrow/io/memory.h>
+#include <arrow/ipc/reader.h>
+#include <arrow/ipc/writer.h>
+#include <arrow/testing/gtest_util.h>
+#include <gtest/gtest.h>
+
+namespace seqr {
+
+const auto kSchema =
+    arrow::schema({arrow::field("geneIds", arrow::list(arrow::utf8())),
+                   arrow::field("variantId", arrow::utf8()),
+                   arrow::field("rsid", arrow::utf8())});
+
+std::shared_ptr<arrow::RecordBatch> MakeRecordBatch(
+    const std::vector<std::vector<std::string>>& gene_ids,
+    const std::vector<std::string>& variant_ids,
+    const std::vector<std::string>& rsids) {
+  auto* const memory_pool = arrow::default_memory_pool();
+  arrow::ListBuilder list_builder(
+      memory_pool, std::make_shared<arrow::StringBuilder>(memory_pool));
+  auto& gene_id_builder =
+      static_cast<arrow::StringBuilder&>(*list_builder.value_builder());
+  for (const auto& row : gene_ids) {
+    EXPECT_OK(list_builder.Append());
+    EXPECT_OK(gene_id_builder.AppendValues(row));
+  }
+  std::shared_ptr<arrow::Array> gene_ids_array;
+  EXPECT_OK(list_builder.Finish(&gene_ids_array));
+
+  arrow::StringBuilder variant_id_builder(memory_pool);
+  EXPECT_OK(variant_id_builder.AppendValues(variant_ids));
+  std::shared_ptr<arrow::Array> variant_ids_array;
+  EXPECT_OK(variant_id_builder.Finish(&variant_ids_array));
+
+  // Empty rsids are stored as nulls.
+  arrow::StringBuilder rsid_builder(memory_pool);
+  for (const auto& rsid : rsids) {
+    EXPECT_OK(rsid.empty() ? rsid_builder.AppendNull()
+                           : rsid_builder.Append(rsid));
+  }
+  std::shared_ptr<arrow::Array> rsids_array;
+  EXPECT_OK(rsid_builder.Finish(&rsids_array));
+
+  return arrow::RecordBatch::Make(kSchema, gene_ids.size(),
+                                  {gene_ids_array, variant_ids_array,
+                                   rsids_array});
+}
+
+class FileIndexTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    const arrow::RecordBatchVector record_batches{
+        MakeRecordBatch({{"ENSG01"}, {"ENSG01", "ENSG02"}, {}},
+                        {"1-100-A-G", "1-200-C-T", "1-300-G-A"},
+                        {"rs100", "", "rs300"}),
+        MakeRecordBatch({{"ENSG03", "ENSG03"}, {"ENSG04"}},
+                        {"2-100-A-G", "2-200-C-T"}, {"", "rs2200"}),
+        MakeRecordBatch({{"ENSG02"}}, {"3-100-A-G"}, {""})};
+
+    ASSERT_OK_AND_ASSIGN(auto output_stream,
+                         arrow::io::BufferOutputStream::Create());
+    ASSERT_OK_AND_ASSIGN(auto file_writer,
+                         arrow::ipc::MakeFileWriter(output_stream, kSchema));
+    for (const auto& record_batch : record_batches) {
+      ASSERT_OK(file_writer->WriteRecordBatch(*record_batch));
+    }
+    ASSERT_OK(file_writer->Close());
+    ASSERT_OK_AND_ASSIGN(auto buffer, output_stream->Finish());
+
+    const auto buffer_reader =
+        std::make_shared<arrow::io::BufferReader>(buffer);
+    ASSERT_OK_AND_ASSIGN(
+        auto record_batch_file_reader,
+        arrow::ipc::RecordBatchFileReader::Open(buffer_reader));
+    auto file_index = BuildFileIndex(record_batch_file_reader.get());
+    ASSERT_TRUE(file_index.ok()) << file_index.status();
+    file_index_ = *std::move(file_index);
+  }
+
+  FileIndex file_index_;
+};
+
+TEST_F(FileIndexTest, GeneIdRows) {
+  ASSERT_EQ(file_index_.record_batches_size(), 3);
+  const auto& gene_id_rows = file_index_.gene_id_rows();
+  ASSERT_EQ(gene_id_rows.size(), 4);
+  EXPECT_EQ(std::vector<int64_t>(gene_id_rows.at("ENSG01").rows().begin(),
+                                 gene_id_rows.at("ENSG01").rows().end()),
+            (std::vector<int64_t>{0, 1}));
+  EXPECT_EQ(std::vector<int64_t>(gene_id_rows.at("ENSG02").rows().begin(),
+                                 gene_id_rows.at("ENSG02").rows().end()),
+            (std::vector<int64_t>{1, 5}));
+  EXPECT_EQ(std::vector<int64_t>(gene_id_rows.at("ENSG03").rows().begin(),
+                                 gene_id_rows.at("ENSG03").rows().end()),
+            (std::vector<int64_t>{3}));
+}
+
+TEST_F(FileIndexTest, MatchGeneIds) {
+  EXPECT_EQ(MatchRecordBatches(file_index_, {{"ENSG02"}, {}, {}}),
+            (std::vector<bool>{true, false, true}));
+  EXPECT_EQ(MatchRecordBatches(file_index_, {{"ENSG04", "ENSG99"}, {}, {}}),
+            (std::vector<bool>{false, true, false}));
+  EXPECT_EQ(MatchRecordBatches(file_index_, {{"ENSG99"}, {}, {}}),
+            (std::vector<bool>{false, false, false}));
+}
+
+TEST_F(FileIndexTest, MatchVariantIdsAndRsids) {
+  // Bloom filters can have false positives, but not for these few values.
+  EXPECT_EQ(MatchRecordBatches(file_index_, {{}, {"2-200-C-T"}, {}}),
+            (std::vector<bool>{false, true, false}));
+  EXPECT_EQ(MatchRecordBatches(file_index_, {{}, {}, {"rs300"}}),
+            (std::vector<bool>{true, false, false}));
+  EXPECT_EQ(MatchRecordBatches(file_index_, {{}, {"1-200-C-T"}, {"rs2200"}}),
+            (std::vector<bool>{false, false, false}));
+  EXPECT_EQ(MatchRecordBatches(file_index_, {{"ENSG01"}, {"1-200-C-T"}, {}}),
+            (std::vector<bool>{true, false, false}));
+}
+
+TEST(BloomFilter, NoFalseNegatives) {
+  std::vector<std::string> values;
+  for (int i = 0; i < 1000; ++i) {
+    values.push_back(absl::StrCat("rs", i));
+  }
+  const auto bloom_filter = MakeBloomFilter({values.begin(), values.end()});
+  for (const auto& value : values) {
+    EXPECT_TRUE(BloomFilterMayContain(bloom_filter, value));
+  }
+
+  int num_false_positives = 0;
+  for (int i = 1000; i < 2000; ++i) {
+    if (BloomFilterMayContain(bloom_filter, absl::StrCat("rs", i))) {
+      ++num_false_positives;
+    }
+  }
+  EXPECT_LT(num_false_positives, 50);
+}
+
+}  // namespace seqr
@@ -0,0 +1,301 @@
+#include "flight_service.h"
+
+#include <absl/base/thread_annotations.h>
+#include <absl/container/flat_hash_map.h>
+#include <absl/random/random.h>
+#include <absl/strings/escaping.h>
+#include <absl/strings/str_cat.h>
+#include <absl/synchronization/mutex.h>
+#include <arrow/util/key_value_metadata.h>
+
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace seqr {
+
+namespace flight = arrow::flight;
+
+namespace {
+
+// Expired results are dropped at least this often, even without calls.
+constexpr absl::Duration kExpiryInterval = absl::Seconds(1);
+
+int64_t ArrayDataBytes(const arrow::ArrayData& data) {
+  int64_t result = 0;
+  for (const auto& buffer : data.buffers) {
+    if (buffer != nullptr) {
+      result += buffer->size();
+    }
+  }
+  for (const auto& child : data.child_data) {
+    result += ArrayDataBytes(*child);
+  }
+  if (data.dictionary != nullptr) {
+    result += ArrayDataBytes(*data.dictionary);
+  }
+  return result;
+}
+
+// Buffers shared by several record batches are counted repeatedly.
+int64_t ResultBytes(const FlightQueryResult& result) {
+  int64_t total = 0;
+  for (const auto& record_batch : result.record_batches) {
+    for (const auto& column : record_batch->column_data()) {
+      total += ArrayDataBytes(*column);
+    }
+  }
+  return total;
+}
+
+// Flight clients can distinguish these codes, e.g. to tell invalid queries
+// apart from queries that matched too many rows.
+arrow::Status ToArrowStatus(const absl::Status& status) {
+  std::string message(status.message());
+  switch (status.code()) {
+    case absl::StatusCode::kOk:
+      return arrow::Status::OK();
+    case absl::StatusCode::kInvalidArgument:
+      return arrow::Status::Invalid(std::move(message));
+    case absl::StatusCode::kNotFound:
+      return arrow::Status::KeyError(std::move(message));
+    case absl::StatusCode::kCancelled:
+      return flight::MakeFlightError(flight::FlightStatusCode::Cancelled,
+                                     std::move(message));
+    case absl::StatusCode::kResourceExhausted:
+      return arrow::Status::OutOfMemory(std::move(message));
+    default:
+      return flight::MakeFlightError(flight::FlightStatusCode::Internal,
+                                     std::move(message));
+  }
+}
+
+// Hands out the record batches of a result, keeping their owner alive until
+// the stream is destroyed.
+class ResultReader : public arrow::RecordBatchReader {
+ public:
+  explicit ResultReader(FlightQueryResult result)
+      : result_(std::move(result)) {}
+
+  std::shared_ptr<arrow::Schema> schema() const override {
+    return result_.schema;
+  }
+
+  arrow::Status ReadNext(
+      std::shared_ptr<arrow::RecordBatch>* const record_batch) override {
+    if (next_index_ == result_.record_batches.size()) {
+      record_batch->reset();
+      return arrow::Status::OK();
+    }
+    // Release the record batches as soon as they've been sent.
+    *record_batch = std::move(result_.record_batches[next_index_++]);
+    return arrow::Status::OK();
+  }
+
+ private:
+  FlightQueryResult result_;
+  size_t next_index_ = 0;
+};
+
+class FlightServiceImpl : public flight::FlightServerBase {
+ public:
+  FlightServiceImpl(FlightQueryFunction run_query,
+                    const FlightServiceOptions& options)
+      : run_query_(std::move(run_query)),
+        result_ttl_(options.result_ttl),
+        max_pending_results_(options.max_pending_results),
+        max_pending_bytes_(options.max_pending_bytes),
+        expiry_thread_([this] { DropExpiredResultsUntilShutdown(); }) {}
+
+  // Waits for pending calls, which access the members of this class.
+  ~FlightServiceImpl() override {
+    if (const auto status = Shutdown(); !status.ok()) {
+      std::cerr << "Failed to shut down Flight service: " << status
+                << std::endl;
+    }
+    {
+      absl::MutexLock lock(&mu_);
+      shutting_down_ = true;
+    }
+    expiry_thread_.join();
+  }
+
+  arrow::Status GetFlightInfo(
+      const flight::ServerCallContext& context,
+      const flight::FlightDescriptor& descriptor,
+      std::unique_ptr<flight::FlightInfo>* const info) override {
+    if (descriptor.type != flight::FlightDescriptor::CMD) {
+      return arrow::Status::Invalid(
+          "Expected a command descriptor containing a serialized "
+          "QueryRequest");
+    }
+    QueryRequest request;
+    if (!request.ParseFromString(descriptor.cmd)) {
+      return arrow::Status::Invalid("Failed to parse QueryRequest");
+    }
+
+    // Don't run queries whose result couldn't be kept anyway.
+    {
+      absl::MutexLock lock(&mu_);
+      DropExpiredResults();
+      if (const auto status = CheckCapacityLocked(0); !status.ok()) {
+        return ToArrowStatus(status);
+      }
+    }
+
+    auto result = run_query_(request);
+    if (!result.ok()) {
+      return ToArrowStatus(result.status());
+    }
+    if (result->schema == nullptr) {  // No results found.
+      result->schema = arrow::schema({});
+    }
+    int64_t num_rows = 0;
+    for (const auto& record_batch : result->record_batches) {
+      num_rows += record_batch->num_rows();
+    }
+    const int64_t num_bytes = ResultBytes(*result);
+
+    // Only the FlightInfo schema contains the query stats, not the stream.
+    const auto info_schema = result->schema->WithMetadata(
+        arrow::key_value_metadata(
+            {kQueryResponseMetadataKey},
+            {absl::Base64Escape(result->response.SerializeAsString())}));
+    flight::FlightEndpoint endpoint;
+    endpoint.ticket.ticket = NewTicket();
+    auto flight_info =
+        flight::FlightInfo::Make(*info_schema, descriptor, {endpoint},
+                                 num_rows, num_bytes);
+    if (!flight_info.ok()) {
+      return flight_info.status();
+    }
+
+    absl::MutexLock lock(&mu_);
+    DropExpiredResults();
+    if (const auto status = CheckCapacityLocked(num_bytes); !status.ok()) {
+      return ToArrowStatus(status);
+    }
+    pending_bytes_ += num_bytes;
+    pending_results_.emplace(
+        endpoint.ticket.ticket,
+        PendingResult{.expiry = absl::Now() + result_ttl_,
+                      .num_bytes = num_bytes,
+                      .result = *std::move(result)});
+    *info = std::make_unique<flight::FlightInfo>(*std::move(flight_info));
+    return arrow::Status::OK();
+  }
+
+  arrow::Status DoGet(
+      const flight::ServerCallContext& context, const flight::Ticket& ticket,
+      std::unique_ptr<flight::FlightDataStream>* const stream) override {
+    std::optional<FlightQueryResult> result;
+    {
+      absl::MutexLock lock(&mu_);
+      DropExpiredResults();
+      auto node = pending_results_.extract(ticket.ticket);
+      if (node.empty()) {
+        return arrow::Status::KeyError("Unknown or expired ticket");
+      }
+      pending_bytes_ -= node.mapped().num_bytes;
+      result = std::move(node.mapped().result);
+    }
+    *stream = std::make_unique<flight::RecordBatchStream>(
+        std::make_shared<ResultReader>(*std::move(result)));
+    return arrow::Status::OK();
+  }
+
+ private:
+  struct PendingResult {
+    absl::Time expiry;
+    int64_t num_bytes = 0;
+    FlightQueryResult result;
+  };
+
+  std::string NewTicket() {
+    absl::MutexLock lock(&mu_);
+    return absl::StrCat(
+        absl::Hex(absl::Uniform<uint64_t>(bit_gen_), absl::kZeroPad16),
+        absl::Hex(absl::Uniform<uint64_t>(bit_gen_), absl::kZeroPad16));
+  }
+
+  void DropExpiredResults() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    const absl::Time now = absl::Now();
+    for (auto it = pending_results_.begin(); it != pending_results_.end();) {
+      if (it->second.expiry < now) {
+        pending_bytes_ -= it->second.num_bytes;
+        pending_results_.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  // Frees the memory of results that are never fetched, even if no calls
+  // arrive.
+  void DropExpiredResultsUntilShutdown() {
+    absl::MutexLock lock(&mu_);
+    while (!mu_.AwaitWithTimeout(absl::Condition(&shutting_down_),
+                                 kExpiryInterval)) {
+      DropExpiredResults();
+    }
+  }
+
+  // Checks whether another result of the given size can be kept.
+  absl::Status CheckCapacityLocked(const int64_t num_bytes) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    if (pending_results_.size() >= max_pending_results_) {
+      return absl::ResourceExhaustedError(
+          absl::StrCat("Too many pending results (", pending_results_.size(),
+                       "); fetch results using DoGet or retry later"));
+    }
+    if (pending_bytes_ + num_bytes > max_pending_bytes_) {
+      return absl::ResourceExhaustedError(absl::StrCat(
+          "Pending results would exceed ", max_pending_bytes_,
+          " bytes; fetch results using DoGet or retry later"));
+    }
+    return absl::OkStatus();
+  }
+
+  const FlightQueryFunction run_query_;
+  const absl::Duration result_ttl_;
+  const size_t max_pending_results_;
+  const int64_t max_pending_bytes_;
+  absl::Mutex mu_;
+  absl::BitGen bit_gen_ ABSL_GUARDED_BY(mu_);
+  absl::flat_hash_map<std::string, PendingResult> pending_results_
+      ABSL_GUARDED_BY(mu_);
+  // Total size of pending_results_.
+  int64_t pending_bytes_ ABSL_GUARDED_BY(mu_) = 0;
+  bool shutting_down_ ABSL_GUARDED_BY(mu_) = false;
+  // Declared last, as it accesses the members above.
+  std::thread expiry_thread_;
+};
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<flight::FlightServerBase>> StartFlightService(
+    FlightQueryFunction run_query, const FlightServiceOptions& options) {
+  flight::Location location;
+  if (const auto status =
+          flight::Location::ForGrpcTcp("0.0.0.0", options.port, &location);
+      !status.ok()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Failed to create Flight location: ", status.ToString()));
+  }
+
+  auto result =
+      std::make_unique<FlightServiceImpl>(std::move(run_query), options);
+  if (const auto status = result->Init(flight::FlightServerOptions(location));
+      !status.ok()) {
+    return absl::InternalError(absl::StrCat(
+        "Failed to start Flight service: ", status.ToString()));
+  }
+  std::cout << "Starting Arrow Flight service on " << location.ToString()
+            << std::endl;
+  return result;
+}
+
+}  // namespace seqr
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <absl/status/statusor.h>
+#include <absl/time/time.h>
+#include <arrow/flight/server.h>
+#include <arrow/record_batch.h>
+#include <arrow/type.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "seqr_query_service.pb.h"
+
+namespace seqr {
+
+// The filtered record batches of a query.
+struct FlightQueryResult {
+  // Kept alive until the record batches have been streamed, e.g. the memory
+  // pool they were allocated from.
+  std::shared_ptr<void> owner;
+  // May be nullptr if there are no record batches.
+  std::shared_ptr<arrow::Schema> schema;
+  arrow::RecordBatchVector record_batches;
+  // Stats of the query, e.g. conjunct stats, without record batches.
+  QueryResponse response;
+};
+
+// Key of the schema metadata in FlightInfo that contains
+// FlightQueryResult::response, as a base64-encoded serialized QueryResponse.
+inline constexpr char kQueryResponseMetadataKey[] = "seqr.query_response";
+
+using FlightQueryFunction =
+    std::function<absl::StatusOr<FlightQueryResult>(const QueryRequest&)>;
+
+struct FlightServiceOptions {
+  // With 0, an unused port is picked; see FlightServerBase::port().
+  int port = 0;
+  // Results that haven't been fetched within this time are dropped.
+  absl::Duration result_ttl = absl::Minutes(1);
+  // Queries fail with RESOURCE_EXHAUSTED while this many results are pending,
+  // or if their result would exceed the total size of pending results.
+  size_t max_pending_results = 100;
+  int64_t max_pending_bytes = 1LL << 30;
+};
+
+// Serves queries using Arrow Flight, which streams the result record batches
+// without copying them into a protobuf message. GetFlightInfo expects a
+// command descriptor containing a serialized QueryRequest, runs the query and
+// returns a single endpoint. Its ticket can be passed to DoGet once to stream
+// the result. The schema metadata of the FlightInfo contains the query stats,
+// see kQueryResponseMetadataKey. The service is shut down when it's destroyed.
+absl::StatusOr<std::unique_ptr<arrow::flight::FlightServerBase>>
+StartFlightService(FlightQueryFunction run_query,
+                   const FlightServiceOptions& options);
+
+}  // namespace seqr
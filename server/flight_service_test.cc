@@ -0,0 +1,190 @@
+#include "flight_service.h"
+
+#include <absl/strings/escaping.h>
+#include <arrow/flight/client.h>
+#include <arrow/ipc/dictionary.h>
+#include <arrow/table.h>
+#include <arrow/util/key_value_metadata.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <utility>
+
+#include "xpos_intervals_test_util.h"
+
+namespace seqr {
+
+namespace flight = arrow::flight;
+
+namespace {
+
+// Returns two record batches, unless max_rows is exceeded.
+absl::StatusOr<FlightQueryResult> FakeQuery(const QueryRequest& request) {
+  if (request.max_rows() > 0 && request.max_rows() < 3) {
+    return absl::CancelledError("Too many rows");
+  }
+  FlightQueryResult result;
+  result.record_batches = {MakeXposRecordBatch({1, 2}),
+                           MakeXposRecordBatch({3})};
+  result.schema = result.record_batches.front()->schema();
+  result.response.set_peak_memory_bytes(42);
+  return result;
+}
+
+absl::Status GetFlightInfo(flight::FlightClient* const client,
+                           std::unique_ptr<flight::FlightInfo>* const info) {
+  const auto status = client->GetFlightInfo(
+      flight::FlightDescriptor::Command(QueryRequest().SerializeAsString()),
+      info);
+  return status.ok() ? absl::OkStatus() : absl::InternalError(status.message());
+}
+
+std::unique_ptr<flight::FlightClient> ConnectClient(const int port) {
+  flight::Location location;
+  EXPECT_TRUE(flight::Location::ForGrpcTcp("localhost", port, &location).ok());
+  std::unique_ptr<flight::FlightClient> client;
+  EXPECT_TRUE(flight::FlightClient::Connect(location, &client).ok());
+  return client;
+}
+
+TEST(FlightService, StreamsResults) {
+  const auto service = StartFlightService(FakeQuery, {});
+  ASSERT_TRUE(service.ok()) << service.status();
+  const auto client = ConnectClient((*service)->port());
+  ASSERT_TRUE(client != nullptr);
+
+  std::unique_ptr<flight::FlightInfo> info;
+  const auto info_status = client->GetFlightInfo(
+      flight::FlightDescriptor::Command(QueryRequest().SerializeAsString()),
+      &info);
+  ASSERT_TRUE(info_status.ok()) << info_status;
+  EXPECT_EQ(info->total_records(), 3);
+  ASSERT_EQ(info->endpoints().size(), 1);
+  const flight::Ticket& ticket = info->endpoints()[0].ticket;
+
+  std::unique_ptr<flight::FlightStreamReader> stream;
+  ASSERT_TRUE(client->DoGet(ticket, &stream).ok());
+  std::shared_ptr<arrow::Table> table;
+  const auto read_status = stream->ReadAll(&table);
+  ASSERT_TRUE(read_status.ok()) << read_status;
+  EXPECT_EQ(table->num_rows(), 3);
+  EXPECT_TRUE(table->GetColumnByName("xpos") != nullptr);
+
+  // Tickets can only be used once.
+  std::unique_ptr<flight::FlightStreamReader> second_stream;
+  auto status = client->DoGet(ticket, &second_stream);
+  if (status.ok()) {
+    status = second_stream->ReadAll(&table);
+  }
+  EXPECT_FALSE(status.ok());
+}
+
+TEST(FlightService, InvalidRequests) {
+  const auto service = StartFlightService(FakeQuery, {});
+  ASSERT_TRUE(service.ok()) << service.status();
+  const auto client = ConnectClient((*service)->port());
+  ASSERT_TRUE(client != nullptr);
+
+  std::unique_ptr<flight::FlightInfo> info;
+  EXPECT_TRUE(
+      client->GetFlightInfo(flight::FlightDescriptor::Path({"query"}), &info)
+          .IsInvalid());
+  EXPECT_TRUE(client
+                  ->GetFlightInfo(
+                      flight::FlightDescriptor::Command("not a QueryRequest"),
+                      &info)
+                  .IsInvalid());
+
+  QueryRequest request;
+  request.set_max_rows(1);
+  const auto status = client->GetFlightInfo(
+      flight::FlightDescriptor::Command(request.SerializeAsString()), &info);
+  EXPECT_FALSE(status.ok());
+  EXPECT_NE(status.message().find("Too many rows"), std::string::npos)
+      << status;
+}
+
+TEST(FlightService, ReturnsQueryStats) {
+  const auto service = StartFlightService(FakeQuery, {});
+  ASSERT_TRUE(service.ok()) << service.status();
+  const auto client = ConnectClient((*service)->port());
+  ASSERT_TRUE(client != nullptr);
+
+  std::unique_ptr<flight::FlightInfo> info;
+  const auto info_status = GetFlightInfo(client.get(), &info);
+  ASSERT_TRUE(info_status.ok()) << info_status;
+  arrow::ipc::DictionaryMemo dictionary_memo;
+  std::shared_ptr<arrow::Schema> schema;
+  ASSERT_TRUE(info->GetSchema(&dictionary_memo, &schema).ok());
+  ASSERT_TRUE(schema->metadata() != nullptr);
+  const auto metadata = schema->metadata()->Get(kQueryResponseMetadataKey);
+  ASSERT_TRUE(metadata.ok()) << metadata.status();
+  std::string serialized_response;
+  ASSERT_TRUE(absl::Base64Unescape(*metadata, &serialized_response));
+  QueryResponse response;
+  ASSERT_TRUE(response.ParseFromString(serialized_response));
+  EXPECT_EQ(response.peak_memory_bytes(), 42);
+}
+
+TEST(FlightService, LimitsPendingResults) {
+  {
+    const auto service = StartFlightService(
+        FakeQuery, {.max_pending_results = 1});
+    ASSERT_TRUE(service.ok()) << service.status();
+    const auto client = ConnectClient((*service)->port());
+    ASSERT_TRUE(client != nullptr);
+
+    std::unique_ptr<flight::FlightInfo> info;
+    ASSERT_TRUE(GetFlightInfo(client.get(), &info).ok());
+    std::unique_ptr<flight::FlightInfo> second_info;
+    const auto status = GetFlightInfo(client.get(), &second_info);
+    EXPECT_NE(status.message().find("Too many pending results"),
+              std::string::npos)
+        << status;
+
+    // Fetching the result makes room for another one.
+    std::unique_ptr<flight::FlightStreamReader> stream;
+    ASSERT_TRUE(client->DoGet(info->endpoints()[0].ticket, &stream).ok());
+    std::shared_ptr<arrow::Table> table;
+    ASSERT_TRUE(stream->ReadAll(&table).ok());
+    EXPECT_TRUE(GetFlightInfo(client.get(), &second_info).ok());
+  }
+
+  const auto service = StartFlightService(FakeQuery, {.max_pending_bytes = 16});
+  ASSERT_TRUE(service.ok()) << service.status();
+  const auto client = ConnectClient((*service)->port());
+  ASSERT_TRUE(client != nullptr);
+  std::unique_ptr<flight::FlightInfo> info;
+  const auto status = GetFlightInfo(client.get(), &info);
+  EXPECT_NE(status.message().find("Pending results would exceed 16 bytes"),
+            std::string::npos)
+      << status;
+}
+
+TEST(FlightService, DropsExpiredResults) {
+  const auto service = StartFlightService(
+      FakeQuery, {.result_ttl = absl::ZeroDuration()});
+  ASSERT_TRUE(service.ok()) << service.status();
+  const auto client = ConnectClient((*service)->port());
+  ASSERT_TRUE(client != nullptr);
+
+  std::unique_ptr<flight::FlightInfo> info;
+  ASSERT_TRUE(client
+                  ->GetFlightInfo(flight::FlightDescriptor::Command(
+                                      QueryRequest().SerializeAsString()),
+                                  &info)
+                  .ok());
+  ASSERT_EQ(info->endpoints().size(), 1);
+
+  std::unique_ptr<flight::FlightStreamReader> stream;
+  auto status = client->DoGet(info->endpoints()[0].ticket, &stream);
+  if (status.ok()) {
+    std::shared_ptr<arrow::Table> table;
+    status = stream->ReadAll(&table);
+  }
+  EXPECT_FALSE(status.ok());
+}
+
+}  // namespace
+
+}  // namespace seqr
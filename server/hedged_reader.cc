@@ -0,0 +1,351 @@
+#include "hedged_reader.h"
+
+#include <absl/base/thread_annotations.h>
+#include <absl/strings/str_cat.h>
+#include <absl/synchronization/blocking_counter.h>
+#include <absl/synchronization/mutex.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+
+namespace seqr {
+
+namespace {
+
+// Number of recent latencies the hedging threshold is based on.
+constexpr size_t kLatencyWindow = 1000;
+
+// Threads of the attempt pool exit after being idle for this long.
+constexpr absl::Duration kIdleThreadTimeout = absl::Seconds(30);
+
+// Operations have separate latency windows, as e.g. metadata lookups are much
+// faster than reads.
+enum Operation { kRead, kReadRange, kGetMetadata, kNumOperations };
+
+// Runs functions on reused threads. Since the functions block on requests, a
+// new thread is started whenever no thread is idle, so functions never wait
+// for each other.
+class CachedThreadPool {
+ public:
+  void Schedule(std::function<void()> func) {
+    absl::MutexLock l(&mu_);
+    queue_.push(std::move(func));
+    if (queue_.size() > num_idle_threads_) {
+      std::thread(&CachedThreadPool::WorkLoop, this).detach();
+    }
+  }
+
+ private:
+  bool WorkAvailable() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return !queue_.empty();
+  }
+
+  void WorkLoop() {
+    while (true) {
+      std::function<void()> func;
+      {
+        absl::MutexLock l(&mu_);
+        ++num_idle_threads_;
+        const bool work_available = mu_.AwaitWithTimeout(
+            absl::Condition(this, &CachedThreadPool::WorkAvailable),
+            kIdleThreadTimeout);
+        --num_idle_threads_;
+        if (!work_available) {
+          return;
+        }
+        func = std::move(queue_.front());
+        queue_.pop();
+      }
+      func();
+    }
+  }
+
+  absl::Mutex mu_;
+  std::queue<std::function<void()>> queue_ ABSL_GUARDED_BY(mu_);
+  size_t num_idle_threads_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+// Shared by all readers. Never destroyed, as attempts that lost the race may
+// still be running at exit.
+CachedThreadPool& AttemptPool() {
+  static CachedThreadPool* const pool = new CachedThreadPool();
+  return *pool;
+}
+
+}  // namespace
+
+struct HedgedReader::SharedState
+    : public std::enable_shared_from_this<SharedState> {
+  explicit SharedState(const HedgedReaderOptions& options)
+      : options(options) {}
+
+  // Runs request on the attempt pool, plus a duplicate if it's slow, and
+  // returns the first successful result. Errors are only returned once all
+  // attempts have failed.
+  template <typename T>
+  absl::StatusOr<T> Hedge(Operation operation,
+                          std::function<absl::StatusOr<T>()> request);
+
+  // Returns absl::InfiniteDuration() if hedging is disabled or there aren't
+  // enough samples of the operation yet.
+  absl::Duration HedgeDelay(Operation operation) const;
+
+  bool AcquireHedgeBudget();
+
+  void RecordLatency(Operation operation, absl::Duration latency);
+
+  // Ring buffer of the latencies of original requests.
+  struct LatencyWindow {
+    std::vector<absl::Duration> latencies;
+    size_t next_index = 0;
+  };
+
+  const HedgedReaderOptions options;
+  mutable absl::Mutex mu;
+  std::array<LatencyWindow, kNumOperations> latency_windows ABSL_GUARDED_BY(mu);
+  HedgedReaderStats stats ABSL_GUARDED_BY(mu);
+};
+
+template <typename T>
+absl::StatusOr<T> HedgedReader::SharedState::Hedge(
+    const Operation operation, std::function<absl::StatusOr<T>()> request) {
+  // The attempts of a single request.
+  struct Race {
+    bool HasResult() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu) {
+      return result.has_value();
+    }
+
+    absl::Mutex mu;
+    int num_pending ABSL_GUARDED_BY(mu) = 0;
+    std::optional<absl::StatusOr<T>> result ABSL_GUARDED_BY(mu);
+  };
+  const auto race = std::make_shared<Race>();
+
+  // Must be called with race->mu held.
+  const auto start_attempt = [&](const bool is_hedge) {
+    ++race->num_pending;
+    AttemptPool().Schedule([self = shared_from_this(), race, request,
+                            operation, is_hedge] {
+      const absl::Time start = absl::Now();
+      auto result = request();
+      if (!is_hedge) {
+        self->RecordLatency(operation, absl::Now() - start);
+      }
+      absl::MutexLock lock(&race->mu);
+      --race->num_pending;
+      if (race->result.has_value() ||
+          (!result.ok() && race->num_pending > 0)) {
+        return;
+      }
+      if (is_hedge) {
+        absl::MutexLock stats_lock(&self->mu);
+        ++self->stats.num_hedge_wins;
+      }
+      race->result = std::move(result);
+    });
+  };
+
+  {
+    absl::MutexLock lock(&mu);
+    ++stats.num_requests;
+  }
+  const absl::Condition has_result(race.get(), &Race::HasResult);
+  race->mu.Lock();
+  start_attempt(false);
+  if (!race->mu.AwaitWithTimeout(has_result, HedgeDelay(operation)) &&
+      AcquireHedgeBudget()) {
+    start_attempt(true);
+  }
+  race->mu.Await(has_result);
+  absl::StatusOr<T> result = *std::move(race->result);
+  race->mu.Unlock();
+  return result;
+}
+
+absl::Duration HedgedReader::SharedState::HedgeDelay(
+    const Operation operation) const {
+  absl::MutexLock lock(&mu);
+  const auto& latencies = latency_windows[operation].latencies;
+  if (options.max_hedge_fraction <= 0 ||
+      latencies.size() < static_cast<size_t>(options.min_latency_samples) ||
+      latencies.empty()) {
+    return absl::InfiniteDuration();
+  }
+  std::vector<absl::Duration> sorted = latencies;
+  const size_t index =
+      std::min(sorted.size() - 1,
+               static_cast<size_t>(options.hedge_percentile * sorted.size()));
+  std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+  return std::max(options.min_hedge_delay, sorted[index]);
+}
+
+bool HedgedReader::SharedState::AcquireHedgeBudget() {
+  absl::MutexLock lock(&mu);
+  if (stats.num_hedges + 1 >
+      options.max_hedge_fraction * stats.num_requests) {
+    return false;
+  }
+  ++stats.num_hedges;
+  return true;
+}
+
+void HedgedReader::SharedState::RecordLatency(const Operation operation,
+                                              const absl::Duration latency) {
+  absl::MutexLock lock(&mu);
+  LatencyWindow& window = latency_windows[operation];
+  if (window.latencies.size() < kLatencyWindow) {
+    window.latencies.push_back(latency);
+  } else {
+    window.latencies[window.next_index] = latency;
+    window.next_index = (window.next_index + 1) % kLatencyWindow;
+  }
+}
+
+HedgedReader::HedgedReader(std::unique_ptr<UrlReader> base_reader,
+                           HedgedReaderOptions options)
+    : base_reader_(std::move(base_reader)),
+      options_(std::move(options)),
+      shared_state_(std::make_shared<SharedState>(options_)) {}
+
+absl::StatusOr<std::shared_ptr<arrow::Buffer>> HedgedReader::Read(
+    const std::string_view url) const {
+  if (options_.chunk_bytes > 0) {
+    const auto metadata = GetMetadata(url);
+    if (!metadata.ok()) {
+      return metadata.status();
+    }
+    return ReadWithMetadata(url, *metadata);
+  }
+  return shared_state_->Hedge<std::shared_ptr<arrow::Buffer>>(
+      kRead, [base_reader = base_reader_, url = std::string(url)] {
+        return base_reader->Read(url);
+      });
+}
+
+absl::StatusOr<std::shared_ptr<arrow::Buffer>> HedgedReader::ReadWithMetadata(
+    const std::string_view url, const UrlMetadata& metadata) const {
+  if (options_.chunk_bytes > 0 && metadata.size > options_.chunk_bytes) {
+    return ReadChunks(url, metadata.generation, 0, metadata.size);
+  }
+  return shared_state_->Hedge<std::shared_ptr<arrow::Buffer>>(
+      kRead, [base_reader = base_reader_, url = std::string(url), metadata] {
+        return base_reader->ReadWithMetadata(url, metadata);
+      });
+}
+
+absl::StatusOr<std::shared_ptr<arrow::Buffer>> HedgedReader::ReadRange(
+    const std::string_view url, const int64_t offset,
+    const int64_t length) const {
+  if (options_.chunk_bytes > 0 && length > options_.chunk_bytes) {
+    const auto metadata = GetMetadata(url);
+    if (!metadata.ok()) {
+      return metadata.status();
+    }
+    return ReadChunks(url, metadata->generation, offset, length);
+  }
+  return shared_state_->Hedge<std::shared_ptr<arrow::Buffer>>(
+      kReadRange,
+      [base_reader = base_reader_, url = std::string(url), offset, length] {
+        return base_reader->ReadRange(url, offset, length);
+      });
+}
+
+absl::StatusOr<std::shared_ptr<arrow::Buffer>>
+HedgedReader::ReadRangeOfGeneration(const std::string_view url,
+                                    const std::string_view generation,
+                                    const int64_t offset,
+                                    const int64_t length) const {
+  if (options_.chunk_bytes > 0 && length > options_.chunk_bytes) {
+    return ReadChunks(url, generation, offset, length);
+  }
+  return shared_state_->Hedge<std::shared_ptr<arrow::Buffer>>(
+      kReadRange, [base_reader = base_reader_, url = std::string(url),
+                   generation = std::string(generation), offset, length] {
+        return base_reader->ReadRangeOfGeneration(url, generation, offset,
+                                                  length);
+      });
+}
+
+absl::StatusOr<UrlMetadata> HedgedReader::GetMetadata(
+    const std::string_view url) const {
+  return shared_state_->Hedge<UrlMetadata>(
+      kGetMetadata, [base_reader = base_reader_, url = std::string(url)] {
+        return base_reader->GetMetadata(url);
+      });
+}
+
+HedgedReaderStats HedgedReader::Stats() const {
+  absl::MutexLock lock(&shared_state_->mu);
+  return shared_state_->stats;
+}
+
+absl::StatusOr<std::shared_ptr<arrow::Buffer>> HedgedReader::ReadChunks(
+    const std::string_view url, const std::string_view generation,
+    const int64_t offset, const int64_t length) const {
+  if (offset < 0 || length < 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid range ", offset, "+", length, " for ", url));
+  }
+  const int64_t chunk_bytes = options_.chunk_bytes;
+  const int64_t num_chunks = (length + chunk_bytes - 1) / chunk_bytes;
+  auto result = AllocateBlobBuffer(length);
+  if (!result.ok()) {
+    return result.status();
+  }
+  uint8_t* const result_data = (*result)->mutable_data();
+  std::atomic<int64_t> next_chunk = 0;
+  absl::Mutex mu;
+  absl::Status status;  // The first error.
+
+  const auto read_chunks = [&] {
+    for (int64_t chunk = next_chunk++; chunk < num_chunks;
+         chunk = next_chunk++) {
+      const int64_t chunk_offset = chunk * chunk_bytes;
+      const int64_t chunk_length = std::min(chunk_bytes, length - chunk_offset);
+      // Pinning the generation makes sure that all chunks are from the same
+      // content, even if the blob is overwritten while reading.
+      auto data = ReadRangeOfGeneration(url, generation, offset + chunk_offset,
+                                        chunk_length);
+      if (data.ok() && (*data)->size() != chunk_length) {
+        data = absl::DataLossError(absl::StrCat(
+            "Expected ", chunk_length, " bytes, read ", (*data)->size()));
+      }
+      if (!data.ok()) {
+        absl::MutexLock lock(&mu);
+        if (status.ok()) {
+          status = data.status();
+        }
+        // Let the other threads finish early.
+        next_chunk = num_chunks;
+        return;
+      }
+      std::memcpy(result_data + chunk_offset, (*data)->data(), chunk_length);
+    }
+  };
+
+  const int64_t num_threads = std::max<int64_t>(
+      1, std::min<int64_t>(options_.max_parallel_chunks, num_chunks));
+  absl::BlockingCounter pending_threads(num_threads);
+  for (int64_t i = 0; i < num_threads; ++i) {
+    AttemptPool().Schedule([&] {
+      read_chunks();
+      pending_threads.DecrementCount();
+    });
+  }
+  pending_threads.Wait();
+
+  if (!status.ok()) {
+    return status;
+  }
+  return result;
+}
+
+}  // namespace seqr
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <absl/status/statusor.h>
+#include <absl/time/time.h>
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+#include "url_reader.h"
+
+namespace seqr {
+
+struct HedgedReaderOptions {
+  // Blobs larger than this are read as concurrent ranged reads of this size.
+  // Disabled if 0.
+  int64_t chunk_bytes = 0;
+
+  // Maximum number of concurrent chunk reads per blob.
+  int max_parallel_chunks = 8;
+
+  // A duplicate request is sent once a request takes longer than this
+  // percentile of recent request latencies, but never earlier than
+  // min_hedge_delay.
+  double hedge_percentile = 0.95;
+  absl::Duration min_hedge_delay = absl::Milliseconds(20);
+
+  // Hedging only starts once this many latencies have been observed.
+  int min_latency_samples = 20;
+
+  // Caps the number of duplicate requests relative to the number of requests,
+  // so that a slow backend doesn't get twice the load. Disabled if 0.
+  double max_hedge_fraction = 0.05;
+};
+
+struct HedgedReaderStats {
+  int64_t num_requests = 0;
+  int64_t num_hedges = 0;
+  // Number of hedges that finished before the original request.
+  int64_t num_hedge_wins = 0;
+};
+
+// Forwards reads to base_reader, splitting large blobs into chunks that are
+// read concurrently and hedging requests that are slower than usual. The
+// first successful response wins; the other request still runs to
+// completion, as base_reader calls can't be cancelled. Thread-safe.
+class HedgedReader : public UrlReader {
+ public:
+  HedgedReader(std::unique_ptr<UrlReader> base_reader,
+               HedgedReaderOptions options);
+
+  // Looks up the metadata first if chunking is enabled, unless it's passed to
+  // ReadWithMetadata. The chunks are all read from that generation.
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> Read(
+      std::string_view url) const override;
+
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadWithMetadata(
+      std::string_view url, const UrlMetadata& metadata) const override;
+
+  // Like Read, looks up the generation first for ranges that are chunked.
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadRange(
+      std::string_view url, int64_t offset, int64_t length) const override;
+
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadRangeOfGeneration(
+      std::string_view url, std::string_view generation, int64_t offset,
+      int64_t length) const override;
+
+  absl::StatusOr<UrlMetadata> GetMetadata(std::string_view url) const override;
+
+  HedgedReaderStats Stats() const;
+
+ private:
+  // Shared with the threads of requests that lost the race, which may outlive
+  // the reader.
+  struct SharedState;
+
+  // Reads [offset, offset + length) of the given generation as concurrent
+  // chunks.
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadChunks(
+      std::string_view url, std::string_view generation, int64_t offset,
+      int64_t length) const;
+
+  const std::shared_ptr<const UrlReader> base_reader_;
+  const HedgedReaderOptions options_;
+  const std::shared_ptr<SharedState> shared_state_;
+};
+
+}  // namespace seqr
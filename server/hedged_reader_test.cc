@@ -0,0 +1,186 @@
+#include "hedged_reader.h"
+
+#include <absl/strings/str_cat.h>
+#include <absl/time/clock.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+namespace seqr {
+
+namespace {
+
+constexpr char kGeneration[] = "1";
+
+// Serves a single in-memory blob, injecting a delay before each response.
+class FakeReader : public UrlReader {
+ public:
+  FakeReader(std::string content,
+             std::function<absl::Duration(int call_index)> delay)
+      : content_(arrow::Buffer::FromString(std::move(content))),
+        delay_(std::move(delay)) {}
+
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> Read(
+      std::string_view url) const override {
+    return ReadRange(url, 0, content_->size());
+  }
+
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadRange(
+      std::string_view url, const int64_t offset,
+      const int64_t length) const override {
+    absl::SleepFor(delay_(num_calls_++));
+    if (offset < 0 || length < 0 ||
+        offset + length > content_->size()) {
+      return absl::OutOfRangeError(absl::StrCat("Invalid range for ", url));
+    }
+    return arrow::SliceBuffer(content_, offset, length);
+  }
+
+  // Like GCS, fails if the generation isn't the current one.
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadRangeOfGeneration(
+      std::string_view url, const std::string_view generation,
+      const int64_t offset, const int64_t length) const override {
+    if (generation != kGeneration) {
+      return absl::NotFoundError(
+          absl::StrCat("Generation ", generation, " of ", url, " not found"));
+    }
+    return ReadRange(url, offset, length);
+  }
+
+  absl::StatusOr<UrlMetadata> GetMetadata(std::string_view url) const override {
+    ++num_metadata_calls_;
+    return UrlMetadata{content_->size(), kGeneration};
+  }
+
+  int num_calls() const { return num_calls_; }
+  int num_metadata_calls() const { return num_metadata_calls_; }
+
+ private:
+  const std::shared_ptr<arrow::Buffer> content_;
+  const std::function<absl::Duration(int call_index)> delay_;
+  mutable std::atomic<int> num_calls_ = 0;
+  mutable std::atomic<int> num_metadata_calls_ = 0;
+};
+
+std::string ToString(
+    const absl::StatusOr<std::shared_ptr<arrow::Buffer>>& data) {
+  EXPECT_TRUE(data.ok()) << data.status();
+  return data.ok() ? (*data)->ToString() : "";
+}
+
+constexpr char kUrl[] = "gs://bucket/blob";
+
+TEST(HedgedReader, ReadsChunksConcurrently) {
+  std::string content;
+  for (int i = 0; i < 100; ++i) {
+    content += static_cast<char>('a' + i % 26);
+  }
+  auto fake_reader = std::make_unique<FakeReader>(
+      content, [](int) { return absl::Milliseconds(50); });
+  const FakeReader& fake_reader_ref = *fake_reader;
+  HedgedReader hedged_reader(
+      std::move(fake_reader),
+      {.chunk_bytes = 16, .max_parallel_chunks = 7, .max_hedge_fraction = 0});
+
+  const absl::Time start = absl::Now();
+  EXPECT_EQ(ToString(hedged_reader.Read(kUrl)), content);
+  // Seven chunks, read in parallel.
+  EXPECT_EQ(fake_reader_ref.num_calls(), 7);
+  EXPECT_LT(absl::Now() - start, absl::Milliseconds(300));
+
+  // Chunked ranges look up the generation to pin it.
+  EXPECT_EQ(ToString(hedged_reader.ReadRange(kUrl, 10, 40)),
+            content.substr(10, 40));
+  EXPECT_FALSE(hedged_reader.ReadRange(kUrl, 90, 20).ok());
+  EXPECT_EQ(fake_reader_ref.num_metadata_calls(), 3);
+
+  // The metadata doesn't have to be looked up if it's known.
+  const UrlMetadata metadata{static_cast<int64_t>(content.size()),
+                             kGeneration};
+  EXPECT_EQ(ToString(hedged_reader.ReadWithMetadata(kUrl, metadata)), content);
+  EXPECT_EQ(fake_reader_ref.num_metadata_calls(), 3);
+}
+
+TEST(HedgedReader, FailsIfGenerationChanged) {
+  const std::string content(100, 'a');
+  auto fake_reader = std::make_unique<FakeReader>(
+      content, [](int) { return absl::ZeroDuration(); });
+  HedgedReader hedged_reader(std::move(fake_reader),
+                             {.chunk_bytes = 16, .max_hedge_fraction = 0});
+  // All chunks are read from the generation of the metadata.
+  const UrlMetadata metadata{static_cast<int64_t>(content.size()), "0"};
+  const auto data = hedged_reader.ReadWithMetadata(kUrl, metadata);
+  EXPECT_EQ(data.status().code(), absl::StatusCode::kNotFound)
+      << data.status();
+}
+
+TEST(HedgedReader, HedgesSlowRequests) {
+  constexpr int kNumWarmupReads = 20;
+  // The first call after the warmup hangs, all others are fast.
+  auto fake_reader = std::make_unique<FakeReader>(
+      "content", [](const int call_index) {
+        return call_index == kNumWarmupReads ? absl::Seconds(2)
+                                             : absl::Milliseconds(1);
+      });
+  HedgedReader hedged_reader(std::move(fake_reader),
+                             {.min_hedge_delay = absl::Milliseconds(10),
+                              .min_latency_samples = kNumWarmupReads,
+                              .max_hedge_fraction = 0.1});
+  for (int i = 0; i < kNumWarmupReads; ++i) {
+    EXPECT_EQ(ToString(hedged_reader.Read(kUrl)), "content");
+  }
+  EXPECT_EQ(hedged_reader.Stats().num_hedges, 0);
+
+  const absl::Time start = absl::Now();
+  EXPECT_EQ(ToString(hedged_reader.Read(kUrl)), "content");
+  EXPECT_LT(absl::Now() - start, absl::Seconds(1));
+  const auto stats = hedged_reader.Stats();
+  EXPECT_EQ(stats.num_requests, kNumWarmupReads + 1);
+  EXPECT_EQ(stats.num_hedges, 1);
+  EXPECT_EQ(stats.num_hedge_wins, 1);
+}
+
+TEST(HedgedReader, TracksLatenciesPerOperation) {
+  constexpr int kNumWarmupRequests = 20;
+  auto fake_reader = std::make_unique<FakeReader>(
+      "content", [](int) { return absl::Milliseconds(50); });
+  HedgedReader hedged_reader(std::move(fake_reader),
+                             {.min_hedge_delay = absl::Milliseconds(1),
+                              .min_latency_samples = kNumWarmupRequests,
+                              .max_hedge_fraction = 1});
+  // Metadata lookups are fast, which doesn't affect the hedging of reads.
+  for (int i = 0; i < kNumWarmupRequests; ++i) {
+    ASSERT_TRUE(hedged_reader.GetMetadata(kUrl).ok());
+  }
+  EXPECT_EQ(ToString(hedged_reader.Read(kUrl)), "content");
+  EXPECT_EQ(hedged_reader.Stats().num_hedges, 0);
+}
+
+TEST(HedgedReader, RespectsHedgeBudget) {
+  constexpr int kNumWarmupReads = 5;
+  auto fake_reader = std::make_unique<FakeReader>(
+      "content", [](const int call_index) {
+        return call_index >= kNumWarmupReads ? absl::Milliseconds(200)
+                                             : absl::Milliseconds(1);
+      });
+  // Allows a single hedge within the first eight requests.
+  HedgedReader hedged_reader(std::move(fake_reader),
+                             {.hedge_percentile = 0.5,
+                              .min_hedge_delay = absl::Milliseconds(10),
+                              .min_latency_samples = kNumWarmupReads,
+                              .max_hedge_fraction = 0.125});
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(ToString(hedged_reader.Read(kUrl)), "content");
+  }
+  const auto stats = hedged_reader.Stats();
+  EXPECT_EQ(stats.num_requests, 8);
+  EXPECT_EQ(stats.num_hedges, 1);
+  // The hedge was slow too.
+  EXPECT_EQ(stats.num_hedge_wins, 0);
+}
+
+}  // namespace
+
+}  // namespace seqr
@@ -0,0 +1,302 @@
+#include "inheritance.h"
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/container/flat_hash_set.h>
+#include <absl/strings/str_cat.h>
+#include <arrow/array/array_nested.h>
+#include <arrow/array/builder_binary.h>
+#include <arrow/buffer.h>
+#include <arrow/compute/api_scalar.h>
+#include <arrow/compute/api_vector.h>
+
+#include <memory>
+#include <string_view>
+#include <utility>
+
+namespace seqr {
+
+namespace cp = arrow::compute;
+
+namespace {
+
+using InheritanceFilter = QueryRequest::InheritanceFilter;
+using Individual = InheritanceFilter::Individual;
+
+// xpos encodes the contig in multiples of 1e9, with chrX being contig 23.
+constexpr int64_t kChrXStartXpos = 23'000'000'000;
+constexpr int64_t kChrXEndXpos = 24'000'000'000;
+
+// Unaffected carriers are tracked as a bitmask.
+constexpr size_t kMaxUnaffectedIndividuals = 64;
+
+enum class Genotype { kHomAlt, kHet, kHasAlt, kHasRef, kRefRef };
+
+struct GenotypeRequirements {
+  Genotype affected;
+  Genotype unaffected;
+  // Males are hemizygous on chrX, so unaffected males can't be carriers.
+  Genotype unaffected_male;
+};
+
+absl::StatusOr<GenotypeRequirements> RequirementsForMode(
+    const InheritanceFilter::Mode mode) {
+  switch (mode) {
+    case InheritanceFilter::HOMOZYGOUS_RECESSIVE:
+      return GenotypeRequirements{Genotype::kHomAlt, Genotype::kHasRef,
+                                  Genotype::kHasRef};
+    case InheritanceFilter::DE_NOVO:
+      return GenotypeRequirements{Genotype::kHasAlt, Genotype::kRefRef,
+                                  Genotype::kRefRef};
+    case InheritanceFilter::X_LINKED_RECESSIVE:
+      return GenotypeRequirements{Genotype::kHomAlt, Genotype::kHasRef,
+                                  Genotype::kRefRef};
+    case InheritanceFilter::COMPOUND_HET:
+      return GenotypeRequirements{Genotype::kHet, Genotype::kHasRef,
+                                  Genotype::kHasRef};
+    default:
+      return absl::InvalidArgumentError(
+          absl::StrCat("Unsupported inheritance mode ", mode));
+  }
+}
+
+absl::StatusOr<cp::Expression> ContainsSample(const char* const column,
+                                              const std::string& sample_id) {
+  arrow::StringBuilder builder;
+  std::shared_ptr<arrow::Array> value_set;
+  if (const auto status = builder.Append(sample_id); !status.ok()) {
+    return absl::InternalError(status.ToString());
+  }
+  if (const auto status = builder.Finish(&value_set); !status.ok()) {
+    return absl::InternalError(status.ToString());
+  }
+  return cp::call(
+      "string_list_contains_any", {cp::field_ref(column)},
+      std::make_shared<cp::SetLookupOptions>(value_set, /* skip_nulls */ true));
+}
+
+absl::StatusOr<cp::Expression> GenotypeExpression(const std::string& sample_id,
+                                                  const Genotype genotype) {
+  const auto hom_alt = ContainsSample(kNumAlt2Column, sample_id);
+  const auto het = ContainsSample(kNumAlt1Column, sample_id);
+  const auto no_call = ContainsSample(kNoCallColumn, sample_id);
+  for (const auto* const expression : {&hom_alt, &het, &no_call}) {
+    if (!expression->ok()) {
+      return expression->status();
+    }
+  }
+  const auto not_ = [](const cp::Expression& expression) {
+    return cp::call("invert", {expression});
+  };
+
+  switch (genotype) {
+    case Genotype::kHomAlt:
+      return *hom_alt;
+    case Genotype::kHet:
+      return *het;
+    case Genotype::kHasAlt:
+      return cp::or_(*het, *hom_alt);
+    case Genotype::kHasRef:
+      return cp::and_(not_(*hom_alt), not_(*no_call));
+    case Genotype::kRefRef:
+      return cp::and_({not_(*het), not_(*hom_alt), not_(*no_call)});
+  }
+  return absl::InternalError("Unhandled genotype");
+}
+
+// Returns the list column, which must contain strings.
+absl::StatusOr<std::shared_ptr<arrow::ListArray>> GetStringListColumn(
+    const arrow::RecordBatch& record_batch, const char* const name) {
+  const auto column = record_batch.GetColumnByName(name);
+  if (column == nullptr) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Column ", name, " not found"));
+  }
+  if (column->type_id() != arrow::Type::LIST ||
+      static_cast<const arrow::ListType&>(*column->type()).value_type()->id() !=
+          arrow::Type::STRING) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Column ", name, " has unexpected type ",
+                     column->type()->ToString()));
+  }
+  return std::static_pointer_cast<arrow::ListArray>(column);
+}
+
+// Calls func for each non-null string in the list at the given row.
+template <typename Func>
+void ForEachListValue(const arrow::ListArray& list_array, const int64_t row,
+                      Func func) {
+  if (list_array.IsNull(row)) {
+    return;
+  }
+  const auto& values =
+      static_cast<const arrow::StringArray&>(*list_array.values());
+  for (int64_t i = list_array.value_offset(row);
+       i < list_array.value_offset(row + 1); ++i) {
+    if (values.IsValid(i)) {
+      func(values.GetView(i));
+    }
+  }
+}
+
+}  // namespace
+
+absl::StatusOr<cp::Expression> InheritanceExpression(
+    const InheritanceFilter& inheritance_filter) {
+  const auto requirements = RequirementsForMode(inheritance_filter.mode());
+  if (!requirements.ok()) {
+    return requirements.status();
+  }
+
+  std::vector<cp::Expression> conjuncts;
+  bool has_affected = false;
+  for (const auto& individual : inheritance_filter.individuals()) {
+    if (individual.sample_id().empty()) {
+      return absl::InvalidArgumentError("Individual without sample_id");
+    }
+    has_affected |= individual.affected();
+    const Genotype genotype =
+        individual.affected() ? requirements->affected
+        : individual.sex() == Individual::MALE
+            ? requirements->unaffected_male
+            : requirements->unaffected;
+    auto expression = GenotypeExpression(individual.sample_id(), genotype);
+    if (!expression.ok()) {
+      return expression.status();
+    }
+    conjuncts.push_back(*std::move(expression));
+  }
+  if (!has_affected) {
+    return absl::InvalidArgumentError(
+        "Inheritance filter requires at least one affected individual");
+  }
+
+  if (inheritance_filter.mode() == InheritanceFilter::X_LINKED_RECESSIVE) {
+    conjuncts.push_back(cp::and_(
+        cp::greater_equal(cp::field_ref("xpos"), cp::literal(kChrXStartXpos)),
+        cp::less(cp::field_ref("xpos"), cp::literal(kChrXEndXpos))));
+  }
+  return cp::and_(conjuncts);
+}
+
+std::vector<std::string> CompoundHetColumns() {
+  return {kGeneIdsColumn, kNumAlt1Column, kNumAlt2Column};
+}
+
+absl::StatusOr<arrow::RecordBatchVector> FilterCompoundHets(
+    const arrow::RecordBatchVector& candidates,
+    const InheritanceFilter& inheritance_filter,
+    const std::vector<std::string>& output_columns) {
+  absl::flat_hash_map<std::string_view, int> unaffected_bits;
+  for (const auto& individual : inheritance_filter.individuals()) {
+    if (!individual.affected()) {
+      unaffected_bits.emplace(individual.sample_id(), unaffected_bits.size());
+    }
+  }
+  if (unaffected_bits.size() > kMaxUnaffectedIndividuals) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Compound het search supports at most ",
+                     kMaxUnaffectedIndividuals, " unaffected individuals"));
+  }
+
+  // Collect the candidates per gene, together with the unaffected individuals
+  // that carry them.
+  struct Candidate {
+    size_t record_batch_index = 0;
+    int64_t row = 0;
+    uint64_t unaffected_carriers = 0;
+  };
+  std::vector<Candidate> all_candidates;
+  absl::flat_hash_map<std::string_view, std::vector<size_t>> gene_candidates;
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    const auto& record_batch = *candidates[i];
+    const auto gene_ids = GetStringListColumn(record_batch, kGeneIdsColumn);
+    const auto num_alt_1 = GetStringListColumn(record_batch, kNumAlt1Column);
+    const auto num_alt_2 = GetStringListColumn(record_batch, kNumAlt2Column);
+    for (const auto* const column : {&gene_ids, &num_alt_1, &num_alt_2}) {
+      if (!column->ok()) {
+        return column->status();
+      }
+    }
+
+    for (int64_t row = 0; row < record_batch.num_rows(); ++row) {
+      Candidate candidate{i, row, 0};
+      const auto add_carrier = [&](const std::string_view sample_id) {
+        if (const auto it = unaffected_bits.find(sample_id);
+            it != unaffected_bits.end()) {
+          candidate.unaffected_carriers |= uint64_t{1} << it->second;
+        }
+      };
+      ForEachListValue(**num_alt_1, row, add_carrier);
+      ForEachListValue(**num_alt_2, row, add_carrier);
+
+      const size_t candidate_index = all_candidates.size();
+      all_candidates.push_back(candidate);
+      absl::flat_hash_set<std::string_view> genes;
+      ForEachListValue(**gene_ids, row, [&](const std::string_view gene_id) {
+        if (genes.insert(gene_id).second) {
+          gene_candidates[gene_id].push_back(candidate_index);
+        }
+      });
+    }
+  }
+
+  // A pair requires complementary origin: each variant is carried by an
+  // unaffected individual (a parent) that doesn't carry the other one. Pairs
+  // that an unaffected individual carries both of are on the same haplotype,
+  // while variants that no unaffected individual carries, e.g. de novo
+  // variants or missing parental calls, can't be phased.
+  std::vector<bool> selected(all_candidates.size());
+  for (const auto& [gene_id, candidate_indexes] : gene_candidates) {
+    for (size_t i = 0; i < candidate_indexes.size(); ++i) {
+      const auto& lhs = all_candidates[candidate_indexes[i]];
+      for (size_t j = i + 1; j < candidate_indexes.size(); ++j) {
+        const auto& rhs = all_candidates[candidate_indexes[j]];
+        if (lhs.unaffected_carriers != 0 && rhs.unaffected_carriers != 0 &&
+            (lhs.unaffected_carriers & rhs.unaffected_carriers) == 0) {
+          selected[candidate_indexes[i]] = true;
+          selected[candidate_indexes[j]] = true;
+        }
+      }
+    }
+  }
+
+  std::vector<std::vector<int64_t>> selected_rows(candidates.size());
+  for (size_t i = 0; i < all_candidates.size(); ++i) {
+    if (selected[i]) {
+      const auto& candidate = all_candidates[i];
+      selected_rows[candidate.record_batch_index].push_back(candidate.row);
+    }
+  }
+
+  arrow::RecordBatchVector result;
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    const auto& rows = selected_rows[i];
+    if (rows.empty()) {
+      continue;
+    }
+    const auto indices = std::make_shared<arrow::Int64Array>(
+        rows.size(), arrow::Buffer::Wrap(rows));
+    std::vector<std::shared_ptr<arrow::Field>> fields;
+    std::vector<std::shared_ptr<arrow::Array>> columns;
+    for (const auto& name : output_columns) {
+      const auto& schema = *candidates[i]->schema();
+      const int field_index = schema.GetFieldIndex(name);
+      if (field_index < 0) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Column ", name, " not found"));
+      }
+      auto column = cp::Take(*candidates[i]->column(field_index), *indices);
+      if (!column.ok()) {
+        return absl::InternalError(absl::StrCat(
+            "Failed to take compound het rows: ", column.status().ToString()));
+      }
+      fields.push_back(schema.field(field_index));
+      columns.push_back(*std::move(column));
+    }
+    result.push_back(arrow::RecordBatch::Make(arrow::schema(std::move(fields)),
+                                              rows.size(), std::move(columns)));
+  }
+  return result;
+}
+
+}  // namespace seqr
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <absl/status/statusor.h>
+#include <arrow/compute/exec/expression.h>
+#include <arrow/record_batch.h>
+
+#include <string>
+#include <vector>
+
+#include "seqr_query_service.pb.h"
+
+namespace seqr {
+
+// Genotype columns, listing the samples with the respective genotype. Samples
+// that aren't listed in any of them are homozygous reference.
+inline constexpr char kNumAlt1Column[] = "samples_num_alt_1";
+inline constexpr char kNumAlt2Column[] = "samples_num_alt_2";
+inline constexpr char kNoCallColumn[] = "samples_no_call";
+inline constexpr char kGeneIdsColumn[] = "geneIds";
+
+// Returns a filter for the per-variant genotype requirements of the
+// inheritance mode, using "string_list_contains_any" on the genotype columns.
+// For compound heterozygotes, this only selects the candidate variants, which
+// then need to be paired using FilterCompoundHets.
+absl::StatusOr<arrow::compute::Expression> InheritanceExpression(
+    const QueryRequest::InheritanceFilter& inheritance_filter);
+
+// Columns required by FilterCompoundHets.
+std::vector<std::string> CompoundHetColumns();
+
+// Given the candidate variants of all files, returns the ones that form a
+// compound heterozygous pair with another candidate in the same gene. Both
+// variants of a pair must be carried by unaffected individuals, but no
+// unaffected individual may carry both, so pairs of de novo variants or pairs
+// with only one parent observed are rejected. The result only contains the
+// output_columns.
+absl::StatusOr<arrow::RecordBatchVector> FilterCompoundHets(
+    const arrow::RecordBatchVector& candidates,
+    const QueryRequest::InheritanceFilter& inheritance_filter,
+    const std::vector<std::string>& output_columns);
+
+}  // namespace seqr
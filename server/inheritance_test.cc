@@ -0,0 +1,201 @@
+#include "inheritance.h"
+
+#include <arrow/array/builder_binary.h>
+#include <arrow/array/builder_nested.h>
+#include <arrow/array/builder_primitive.h>
+#include <arrow/compute/api_vector.h>
+#include <arrow/compute/registry.h>
+#include <arrow/testing/gtest_util.h>
+#include <gtest/gtest.h>
+
+#include "string_list_contains_any.h"
+
+namespace seqr {
+
+namespace cp = arrow::compute;
+
+namespace {
+
+using InheritanceFilter = QueryRequest::InheritanceFilter;
+
+std::shared_ptr<arrow::Array> MakeStringListArray(
+    const std::vector<std::vector<std::string>>& values) {
+  auto* const memory_pool = arrow::default_memory_pool();
+  arrow::ListBuilder list_builder(
+      memory_pool, std::make_shared<arrow::StringBuilder>(memory_pool));
+  auto& string_builder =
+      static_cast<arrow::StringBuilder&>(*list_builder.value_builder());
+  for (const auto& list : values) {
+    EXPECT_OK(list_builder.Append());
+    EXPECT_OK(string_builder.AppendValues(list));
+  }
+  std::shared_ptr<arrow::Array> result;
+  EXPECT_OK(list_builder.Finish(&result));
+  return result;
+}
+
+// A trio with an affected proband P and unaffected parents F and M.
+std::shared_ptr<arrow::RecordBatch> MakeTrioRecordBatch() {
+  constexpr int64_t kChr1 = 1'000'000'000;
+  constexpr int64_t kChrX = 23'000'000'000;
+  arrow::Int64Builder xpos_builder;
+  EXPECT_OK(xpos_builder.AppendValues({kChr1 + 100, kChr1 + 200, kChr1 + 300,
+                                       kChr1 + 400, kChr1 + 500, kChr1 + 600,
+                                       kChrX + 100, kChrX + 200, kChrX + 300}));
+  std::shared_ptr<arrow::Array> xpos;
+  EXPECT_OK(xpos_builder.Finish(&xpos));
+
+  const auto gene_ids = MakeStringListArray(
+      {{"G1"}, {"G1"}, {"G2"}, {"G2"}, {"G3"}, {"G3"}, {"GX"}, {"GX"}, {"GX"}});
+  const auto num_alt_1 = MakeStringListArray({{"P", "F"},
+                                              {"P", "M"},
+                                              {"P", "F"},
+                                              {"P", "F"},
+                                              {"F", "M"},
+                                              {"P"},
+                                              {"M"},
+                                              {"F"},
+                                              {}});
+  const auto num_alt_2 = MakeStringListArray(
+      {{}, {}, {}, {}, {"P"}, {}, {"P"}, {"P"}, {}});
+  const auto no_call = MakeStringListArray(
+      {{}, {}, {}, {}, {}, {}, {}, {}, {"P"}});
+
+  return arrow::RecordBatch::Make(
+      arrow::schema({arrow::field("xpos", arrow::int64()),
+                     arrow::field(kGeneIdsColumn, gene_ids->type()),
+                     arrow::field(kNumAlt1Column, num_alt_1->type()),
+                     arrow::field(kNumAlt2Column, num_alt_2->type()),
+                     arrow::field(kNoCallColumn, no_call->type())}),
+      xpos->length(), {xpos, gene_ids, num_alt_1, num_alt_2, no_call});
+}
+
+InheritanceFilter MakeTrioFilter(const InheritanceFilter::Mode mode) {
+  InheritanceFilter result;
+  result.set_mode(mode);
+  auto* const proband = result.add_individuals();
+  proband->set_sample_id("P");
+  proband->set_affected(true);
+  auto* const father = result.add_individuals();
+  father->set_sample_id("F");
+  father->set_sex(InheritanceFilter::Individual::MALE);
+  auto* const mother = result.add_individuals();
+  mother->set_sample_id("M");
+  mother->set_sex(InheritanceFilter::Individual::FEMALE);
+  return result;
+}
+
+std::vector<int64_t> XposValues(const arrow::RecordBatch& record_batch) {
+  const auto& xpos =
+      static_cast<const arrow::Int64Array&>(*record_batch.column(0));
+  return {xpos.raw_values(), xpos.raw_values() + xpos.length()};
+}
+
+class InheritanceTest : public testing::Test {
+ protected:
+  static void SetUpTestSuite() {
+    ASSERT_OK(RegisterStringListContainsAny(cp::GetFunctionRegistry()));
+  }
+
+  // Returns the rows of the trio record batch that match the inheritance
+  // expression.
+  std::shared_ptr<arrow::RecordBatch> Filter(
+      const InheritanceFilter::Mode mode) {
+    const auto record_batch = MakeTrioRecordBatch();
+    const auto expression = InheritanceExpression(MakeTrioFilter(mode));
+    EXPECT_TRUE(expression.ok()) << expression.status();
+    EXPECT_OK_AND_ASSIGN(const auto bound_expression,
+                         expression->Bind(*record_batch->schema()));
+    EXPECT_OK_AND_ASSIGN(
+        const auto mask,
+        cp::ExecuteScalarExpression(bound_expression, record_batch));
+    EXPECT_OK_AND_ASSIGN(const auto result, cp::Filter(record_batch, mask));
+    return result.record_batch();
+  }
+};
+
+TEST_F(InheritanceTest, HomozygousRecessive) {
+  EXPECT_EQ(XposValues(*Filter(InheritanceFilter::HOMOZYGOUS_RECESSIVE)),
+            (std::vector<int64_t>{1'000'000'500, 23'000'000'100,
+                                  23'000'000'200}));
+}
+
+TEST_F(InheritanceTest, DeNovo) {
+  EXPECT_EQ(XposValues(*Filter(InheritanceFilter::DE_NOVO)),
+            (std::vector<int64_t>{1'000'000'600}));
+}
+
+TEST_F(InheritanceTest, XLinkedRecessive) {
+  // The father is hemizygous and unaffected, so can't carry the variant.
+  EXPECT_EQ(XposValues(*Filter(InheritanceFilter::X_LINKED_RECESSIVE)),
+            (std::vector<int64_t>{23'000'000'100}));
+}
+
+TEST_F(InheritanceTest, CompoundHet) {
+  const auto candidates = Filter(InheritanceFilter::COMPOUND_HET);
+  EXPECT_EQ(XposValues(*candidates),
+            (std::vector<int64_t>{1'000'000'100, 1'000'000'200, 1'000'000'300,
+                                  1'000'000'400, 1'000'000'600}));
+
+  // The G2 variants are both inherited from the father, and G3 only has one
+  // candidate. Splitting the candidates must not affect the result.
+  const auto compound_hets =
+      FilterCompoundHets({candidates->Slice(0, 1), candidates->Slice(1)},
+                         MakeTrioFilter(InheritanceFilter::COMPOUND_HET),
+                         {"xpos"});
+  ASSERT_TRUE(compound_hets.ok()) << compound_hets.status();
+  std::vector<int64_t> xpos_values;
+  for (const auto& record_batch : *compound_hets) {
+    EXPECT_EQ(record_batch->num_columns(), 1);
+    for (const int64_t xpos : XposValues(*record_batch)) {
+      xpos_values.push_back(xpos);
+    }
+  }
+  EXPECT_EQ(xpos_values,
+            (std::vector<int64_t>{1'000'000'100, 1'000'000'200}));
+}
+
+TEST_F(InheritanceTest, CompoundHetRequiresComplementaryOrigin) {
+  // G1: one variant from each parent. G2: both de novo. G3: one inherited
+  // from the father, one de novo.
+  const auto gene_ids = MakeStringListArray(
+      {{"G1"}, {"G1"}, {"G2"}, {"G2"}, {"G3"}, {"G3"}});
+  const auto num_alt_1 = MakeStringListArray(
+      {{"P", "F"}, {"P", "M"}, {"P"}, {"P"}, {"P", "F"}, {"P"}});
+  const auto num_alt_2 = MakeStringListArray({{}, {}, {}, {}, {}, {}});
+  arrow::Int64Builder xpos_builder;
+  ASSERT_OK(xpos_builder.AppendValues({100, 200, 300, 400, 500, 600}));
+  std::shared_ptr<arrow::Array> xpos;
+  ASSERT_OK(xpos_builder.Finish(&xpos));
+  const auto candidates = arrow::RecordBatch::Make(
+      arrow::schema({arrow::field("xpos", arrow::int64()),
+                     arrow::field(kGeneIdsColumn, gene_ids->type()),
+                     arrow::field(kNumAlt1Column, num_alt_1->type()),
+                     arrow::field(kNumAlt2Column, num_alt_2->type())}),
+      xpos->length(), {xpos, gene_ids, num_alt_1, num_alt_2});
+
+  const auto compound_hets =
+      FilterCompoundHets({candidates},
+                         MakeTrioFilter(InheritanceFilter::COMPOUND_HET),
+                         {"xpos"});
+  ASSERT_TRUE(compound_hets.ok()) << compound_hets.status();
+  ASSERT_EQ(compound_hets->size(), 1);
+  EXPECT_EQ(XposValues(*compound_hets->front()),
+            (std::vector<int64_t>{100, 200}));
+}
+
+TEST_F(InheritanceTest, InvalidFilters) {
+  EXPECT_FALSE(InheritanceExpression({}).ok());
+
+  auto inheritance_filter = MakeTrioFilter(InheritanceFilter::DE_NOVO);
+  inheritance_filter.mutable_individuals(0)->set_affected(false);
+  EXPECT_FALSE(InheritanceExpression(inheritance_filter).ok());
+
+  inheritance_filter.mutable_individuals(0)->set_affected(true);
+  inheritance_filter.mutable_individuals(1)->clear_sample_id();
+  EXPECT_FALSE(InheritanceExpression(inheritance_filter).ok());
+}
+
+}  // namespace
+
+}  // namespace seqr
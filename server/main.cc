@@ -1,9 +1,51 @@
+#include <absl/flags/flag.h>
 #include <absl/flags/parse.h>
 
 #include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
 
+#include "disk_cache_reader.h"
+#include "hedged_reader.h"
+#include "preload_reader.h"
 #include "server.h"
 
+ABSL_FLAG(int64_t, gcs_chunk_bytes, 16LL << 20,
+          "GCS blobs larger than this are read as concurrent ranged reads of "
+          "this size. Disabled if 0.");
+ABSL_FLAG(int, gcs_parallel_chunks, 8,
+          "Maximum number of concurrent chunk reads per GCS blob.");
+ABSL_FLAG(double, gcs_hedge_percentile, 0.95,
+          "GCS requests slower than this percentile of recent latencies are "
+          "hedged with a duplicate request.");
+ABSL_FLAG(double, gcs_max_hedge_fraction, 0.05,
+          "Maximum ratio of hedged to total GCS requests. Hedging is disabled "
+          "if 0.");
+ABSL_FLAG(std::string, disk_cache_dir, "",
+          "Directory for caching GCS blobs on local disk, e.g. on a local SSD. "
+          "Disabled if empty.");
+ABSL_FLAG(int64_t, disk_cache_max_bytes, 100LL << 30,
+          "Maximum total size of the disk cache.");
+ABSL_FLAG(std::string, preload_manifest_url, "",
+          "URL of a manifest listing one blob URL per line, which are loaded "
+          "at startup before the health service reports SERVING. Disabled if "
+          "empty.");
+ABSL_FLAG(int64_t, preload_max_bytes, 4LL << 30,
+          "Maximum total size of the preloaded blobs.");
+ABSL_FLAG(int, preload_threads, 16, "Number of blobs preloaded concurrently.");
+ABSL_FLAG(bool, preload_pin_in_memory, true,
+          "Whether to pin preloaded blobs in memory. If false, they're only "
+          "read through the disk cache to populate it.");
+ABSL_FLAG(int, flight_port, 0,
+          "Port for serving queries using Arrow Flight, in addition to the "
+          "gRPC service on $PORT. Disabled if 0.");
+ABSL_FLAG(std::vector<std::string>, worker_backends, {},
+          "Comma-separated addresses of backend instances, e.g. "
+          "\"10.0.0.2:8080,10.0.0.3:8080\". If set, this instance runs as a "
+          "coordinator that partitions queries by URL across the workers and "
+          "merges their results, instead of reading any data itself.");
+
 int main(int argc, char** argv) {
   absl::ParseCommandLine(argc, argv);
 
@@ -19,6 +61,18 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  if (const auto worker_backends = absl::GetFlag(FLAGS_worker_backends);
+      !worker_backends.empty()) {
+    auto coordinator = seqr::CreateCoordinatorServer(port, worker_backends);
+    if (!coordinator.ok()) {
+      std::cerr << "Failed to create coordinator: " << coordinator.status()
+                << std::endl;
+      return 1;
+    }
+    (*coordinator)->server->Wait();
+    return 0;
+  }
+
   auto gcs_reader = seqr::MakeGcsReader();
   if (!gcs_reader.ok()) {
     std::cerr << "Failed to create GCS reader: " << gcs_reader.status()
@@ -26,13 +80,63 @@ int main(int argc, char** argv) {
     return 1;
   }
 
-  auto grpc_server = seqr::CreateServer(port, **gcs_reader);
+  std::unique_ptr<seqr::UrlReader> url_reader =
+      std::make_unique<seqr::HedgedReader>(
+          *std::move(gcs_reader),
+          seqr::HedgedReaderOptions{
+              .chunk_bytes = absl::GetFlag(FLAGS_gcs_chunk_bytes),
+              .max_parallel_chunks = absl::GetFlag(FLAGS_gcs_parallel_chunks),
+              .hedge_percentile = absl::GetFlag(FLAGS_gcs_hedge_percentile),
+              .max_hedge_fraction =
+                  absl::GetFlag(FLAGS_gcs_max_hedge_fraction)});
+  if (const auto disk_cache_dir = absl::GetFlag(FLAGS_disk_cache_dir);
+      !disk_cache_dir.empty()) {
+    auto disk_cache_reader = seqr::MakeDiskCacheReader(
+        std::move(url_reader),
+        {.directory = disk_cache_dir,
+         .max_bytes = absl::GetFlag(FLAGS_disk_cache_max_bytes)});
+    if (!disk_cache_reader.ok()) {
+      std::cerr << "Failed to create disk cache: "
+                << disk_cache_reader.status() << std::endl;
+      return 1;
+    }
+    url_reader = *std::move(disk_cache_reader);
+  }
+
+  const auto preload_manifest_url = absl::GetFlag(FLAGS_preload_manifest_url);
+  std::vector<std::string> preload_urls;
+  if (!preload_manifest_url.empty()) {
+    const auto manifest = url_reader->Read(preload_manifest_url);
+    if (!manifest.ok()) {
+      std::cerr << "Failed to read preload manifest: " << manifest.status()
+                << std::endl;
+      return 1;
+    }
+    preload_urls = seqr::ParsePreloadManifest((*manifest)->ToString());
+  }
+  auto preload_reader =
+      std::make_unique<seqr::PreloadReader>(std::move(url_reader));
+
+  // Queries are served while preloading, but instances only report readiness
+  // once the preloaded blobs are available.
+  auto grpc_server = seqr::CreateServer(
+      port, *preload_reader, absl::GetFlag(FLAGS_flight_port),
+      /* serving */ preload_urls.empty());
   if (!grpc_server.ok()) {
     std::cerr << "Failed to create server: " << grpc_server.status()
               << std::endl;
     return 1;
   }
 
+  if (!preload_urls.empty()) {
+    preload_reader->Preload(
+        preload_urls,
+        {.max_bytes = absl::GetFlag(FLAGS_preload_max_bytes),
+         .num_threads = absl::GetFlag(FLAGS_preload_threads),
+         .pin_in_memory = absl::GetFlag(FLAGS_preload_pin_in_memory)});
+    (*grpc_server)->server->GetHealthCheckService()->SetServingStatus(true);
+  }
+
   (*grpc_server)->server->Wait();
 
   return 0;
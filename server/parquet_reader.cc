@@ -0,0 +1,354 @@
+#include "parquet_reader.h"
+
+#include <absl/container/flat_hash_set.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_replace.h>
+#include <arrow/buffer.h>
+#include <arrow/io/interfaces.h>
+#include <arrow/table.h>
+#include <arrow/util/parallel.h>
+#include <parquet/arrow/reader.h>
+#include <parquet/arrow/schema.h>
+#include <parquet/exception.h>
+#include <parquet/file_reader.h>
+#include <parquet/metadata.h>
+#include <parquet/properties.h>
+#include <parquet/statistics.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+
+namespace seqr {
+
+namespace cp = arrow::compute;
+
+namespace {
+
+// Elasticsearch replaces dots in column names, and so does the conversion to
+// Arrow files.
+std::string ArrowColumnName(const std::string_view parquet_name) {
+  return absl::StrReplaceAll(parquet_name, {{".", "_"}});
+}
+
+// Adapts UrlReader ranged reads to Arrow's file interface. ReadAt is
+// thread-safe, which allows reading column chunks concurrently.
+class UrlRandomAccessFile : public arrow::io::RandomAccessFile {
+ public:
+  UrlRandomAccessFile(const UrlReader& url_reader, std::string url,
+                      const int64_t size)
+      : url_reader_(url_reader), url_(std::move(url)), size_(size) {}
+
+  arrow::Status Close() override {
+    closed_ = true;
+    return arrow::Status::OK();
+  }
+
+  bool closed() const override { return closed_; }
+
+  arrow::Result<int64_t> Tell() const override { return position_; }
+
+  arrow::Status Seek(const int64_t position) override {
+    position_ = position;
+    return arrow::Status::OK();
+  }
+
+  arrow::Result<int64_t> GetSize() override { return size_; }
+
+  arrow::Result<int64_t> Read(const int64_t nbytes, void* const out) override {
+    auto result = ReadAt(position_, nbytes, out);
+    if (result.ok()) {
+      position_ += *result;
+    }
+    return result;
+  }
+
+  arrow::Result<std::shared_ptr<arrow::Buffer>> Read(
+      const int64_t nbytes) override {
+    auto result = ReadAt(position_, nbytes);
+    if (result.ok()) {
+      position_ += (*result)->size();
+    }
+    return result;
+  }
+
+  arrow::Result<int64_t> ReadAt(const int64_t position, const int64_t nbytes,
+                                void* const out) override {
+    const auto data = ReadAt(position, nbytes);
+    if (!data.ok()) {
+      return data.status();
+    }
+    std::memcpy(out, (*data)->data(), (*data)->size());
+    return (*data)->size();
+  }
+
+  // Returns the buffer from the UrlReader without copying.
+  arrow::Result<std::shared_ptr<arrow::Buffer>> ReadAt(
+      const int64_t position, int64_t nbytes) override {
+    if (position < 0 || position > size_) {
+      return arrow::Status::IOError("Invalid read position ", position,
+                                    " for ", url_);
+    }
+    nbytes = std::min(nbytes, size_ - position);
+    auto data = url_reader_.ReadRange(url_, position, nbytes);
+    if (!data.ok()) {
+      return arrow::Status::IOError(data.status().ToString());
+    }
+    return *std::move(data);
+  }
+
+ private:
+  const UrlReader& url_reader_;
+  const std::string url_;
+  const int64_t size_;
+  int64_t position_ = 0;
+  bool closed_ = false;
+};
+
+// A top-level primitive column, for which row group statistics are useful.
+struct StatisticsColumn {
+  std::string name;
+  int leaf_index = 0;
+  std::shared_ptr<arrow::DataType> type;
+};
+
+// Returns an expression that's guaranteed to be true for all rows in the row
+// group, based on the column chunk statistics. See Arrow's
+// ParquetFileFragment, which does the same for datasets.
+cp::Expression RowGroupGuarantee(const parquet::RowGroupMetaData& row_group,
+                                 const std::vector<StatisticsColumn>& columns) {
+  std::vector<cp::Expression> conjuncts;
+  for (const auto& column : columns) {
+    const auto column_chunk = row_group.ColumnChunk(column.leaf_index);
+    if (!column_chunk->is_stats_set()) {
+      continue;
+    }
+    const auto statistics = column_chunk->statistics();
+    const auto field = cp::field_ref(column.name);
+    if (statistics->HasNullCount() &&
+        statistics->null_count() == row_group.num_rows()) {
+      conjuncts.push_back(cp::call("is_null", {field}));
+      continue;
+    }
+    // With nulls, the guarantee would be a disjunction, which doesn't help
+    // simplification.
+    if (!statistics->HasMinMax() || !statistics->HasNullCount() ||
+        statistics->null_count() != 0) {
+      continue;
+    }
+
+    std::shared_ptr<arrow::Scalar> min, max;
+    if (!parquet::arrow::StatisticsAsScalars(*statistics, &min, &max).ok()) {
+      continue;
+    }
+    const auto typed_min = min->CastTo(column.type);
+    const auto typed_max = max->CastTo(column.type);
+    if (!typed_min.ok() || !typed_max.ok()) {
+      continue;
+    }
+    conjuncts.push_back(
+        cp::and_(cp::greater_equal(field, cp::literal(*typed_min)),
+                 cp::less_equal(field, cp::literal(*typed_max))));
+  }
+  return conjuncts.empty() ? cp::literal(true) : cp::and_(conjuncts);
+}
+
+struct Footer {
+  std::shared_ptr<UrlRandomAccessFile> file;
+  std::shared_ptr<parquet::FileMetaData> file_metadata;
+};
+
+// Fetches and parses the footer of a Parquet file.
+absl::StatusOr<Footer> ReadFooter(const UrlReader& url_reader,
+                                  const std::string_view url) {
+  const auto url_metadata = url_reader.GetMetadata(url);
+  if (!url_metadata.ok()) {
+    return url_metadata.status();
+  }
+  Footer result;
+  result.file = std::make_shared<UrlRandomAccessFile>(
+      url_reader, std::string(url), url_metadata->size);
+  try {
+    result.file_metadata =
+        parquet::ParquetFileReader::Open(result.file)->metadata();
+  } catch (const parquet::ParquetException& e) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Failed to open Parquet file ", url, ": ", e.what()));
+  }
+  return result;
+}
+
+}  // namespace
+
+absl::StatusOr<ParquetReadResult> ReadParquetFile(
+    const UrlReader& url_reader, const std::string_view url,
+    const ParquetReadOptions& options) {
+  auto footer = ReadFooter(url_reader, url);
+  if (!footer.ok()) {
+    return footer.status();
+  }
+  // The footer is only parsed once, and then shared by the row group readers.
+  const auto& file = footer->file;
+  const auto& file_metadata = footer->file_metadata;
+
+  const parquet::ReaderProperties reader_properties(options.memory_pool);
+  parquet::ArrowReaderProperties arrow_reader_properties;
+  // Coalesce and prefetch the column chunk reads of a row group.
+  arrow_reader_properties.set_pre_buffer(true);
+  // Row groups are decoded in parallel already.
+  arrow_reader_properties.set_use_threads(false);
+
+  std::shared_ptr<arrow::Schema> parquet_schema;
+  if (const auto status = parquet::arrow::FromParquetSchema(
+          file_metadata->schema(), arrow_reader_properties,
+          file_metadata->key_value_metadata(), &parquet_schema);
+      !status.ok()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Failed to convert Parquet schema of ", url, ": ", status.ToString()));
+  }
+
+  // Select the top-level fields and their leaf columns.
+  const absl::flat_hash_set<std::string> columns(options.columns.begin(),
+                                                 options.columns.end());
+  ParquetReadResult result;
+  std::vector<std::shared_ptr<arrow::Field>> fields;
+  for (const auto& field : parquet_schema->fields()) {
+    const std::string name = ArrowColumnName(field->name());
+    if (columns.empty() || columns.contains(name)) {
+      fields.push_back(field->WithName(name));
+    }
+  }
+  if (!columns.empty() && fields.size() != columns.size()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Not all requested columns found in ", url));
+  }
+  result.schema = arrow::schema(std::move(fields), parquet_schema->metadata());
+
+  const auto* const schema_descriptor = file_metadata->schema();
+  std::vector<int> column_indices;
+  std::vector<StatisticsColumn> statistics_columns;
+  absl::flat_hash_set<std::string> predicate_columns;
+  for (const auto& field_ref : cp::FieldsInExpression(options.predicate)) {
+    if (const auto* const name = field_ref.name(); name != nullptr) {
+      predicate_columns.insert(*name);
+    }
+  }
+  for (int i = 0; i < schema_descriptor->num_columns(); ++i) {
+    const auto* const root = schema_descriptor->GetColumnRoot(i);
+    const std::string name = ArrowColumnName(root->name());
+    if (!columns.empty() && !columns.contains(name)) {
+      continue;
+    }
+    column_indices.push_back(i);
+    if (root->is_primitive() && predicate_columns.contains(name)) {
+      statistics_columns.push_back(
+          {name, i, result.schema->GetFieldByName(name)->type()});
+    }
+  }
+
+  auto predicate = options.predicate.Bind(*result.schema);
+  if (!predicate.ok()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Failed to bind predicate for ", url, ": ",
+                     predicate.status().ToString()));
+  }
+
+  // Prune row groups using their statistics.
+  result.num_row_groups = file_metadata->num_row_groups();
+  std::vector<int> row_groups;
+  for (int i = 0; i < result.num_row_groups; ++i) {
+    auto guarantee =
+        RowGroupGuarantee(*file_metadata->RowGroup(i), statistics_columns)
+            .Bind(*result.schema);
+    if (guarantee.ok()) {
+      const auto simplified = cp::SimplifyWithGuarantee(*predicate, *guarantee);
+      if (simplified.ok() && !simplified->IsSatisfiable()) {
+        ++result.num_pruned_row_groups;
+        continue;
+      }
+    }
+    row_groups.push_back(i);
+  }
+
+  // Each task uses its own reader, as pre-buffering isn't safe for concurrent
+  // reads through the same reader.
+  std::vector<std::shared_ptr<arrow::Table>> tables(row_groups.size());
+  if (const auto status = arrow::internal::ParallelFor(
+          static_cast<int>(row_groups.size()),
+          [&](const int i) -> arrow::Status {
+            std::unique_ptr<parquet::ParquetFileReader> parquet_file_reader;
+            try {
+              parquet_file_reader = parquet::ParquetFileReader::Open(
+                  file, reader_properties, file_metadata);
+            } catch (const parquet::ParquetException& e) {
+              return arrow::Status::IOError(e.what());
+            }
+            std::unique_ptr<parquet::arrow::FileReader> reader;
+            ARROW_RETURN_NOT_OK(parquet::arrow::FileReader::Make(
+                options.memory_pool, std::move(parquet_file_reader),
+                arrow_reader_properties, &reader));
+            return reader->ReadRowGroup(row_groups[i], column_indices,
+                                        &tables[i]);
+          });
+      !status.ok()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Failed to read row groups of ", url, ": ", status.ToString()));
+  }
+
+  for (const auto& table : tables) {
+    const auto renamed_table =
+        table->RenameColumns(result.schema->field_names());
+    if (!renamed_table.ok()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Failed to rename columns of ", url, ": ",
+                       renamed_table.status().ToString()));
+    }
+    arrow::TableBatchReader batch_reader(**renamed_table);
+    while (true) {
+      std::shared_ptr<arrow::RecordBatch> record_batch;
+      if (const auto status = batch_reader.ReadNext(&record_batch);
+          !status.ok()) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Failed to read record batch of ", url, ": ",
+                         status.ToString()));
+      }
+      if (record_batch == nullptr) {
+        break;
+      }
+      result.record_batches.push_back(std::move(record_batch));
+    }
+  }
+
+  return result;
+}
+
+absl::StatusOr<ParquetFileInfo> ReadParquetFileInfo(
+    const UrlReader& url_reader, const std::string_view url) {
+  const auto footer = ReadFooter(url_reader, url);
+  if (!footer.ok()) {
+    return footer.status();
+  }
+  const auto& file_metadata = *footer->file_metadata;
+
+  std::shared_ptr<arrow::Schema> parquet_schema;
+  if (const auto status = parquet::arrow::FromParquetSchema(
+          file_metadata.schema(), parquet::ArrowReaderProperties(),
+          file_metadata.key_value_metadata(), &parquet_schema);
+      !status.ok()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Failed to convert Parquet schema of ", url, ": ", status.ToString()));
+  }
+  std::vector<std::shared_ptr<arrow::Field>> fields;
+  for (const auto& field : parquet_schema->fields()) {
+    fields.push_back(field->WithName(ArrowColumnName(field->name())));
+  }
+
+  ParquetFileInfo result;
+  result.schema = arrow::schema(std::move(fields), parquet_schema->metadata());
+  result.num_rows = file_metadata.num_rows();
+  result.num_row_groups = file_metadata.num_row_groups();
+  return result;
+}
+
+}  // namespace seqr
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <absl/status/statusor.h>
+#include <arrow/compute/exec/expression.h>
+#include <arrow/memory_pool.h>
+#include <arrow/record_batch.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "url_reader.h"
+
+namespace seqr {
+
+struct ParquetReadOptions {
+  // Top-level columns to read, named like in the Arrow files, i.e. with dots
+  // replaced by underscores. Reads all columns if empty.
+  std::vector<std::string> columns;
+
+  // Row groups whose column statistics prove that no row satisfies the
+  // predicate are skipped.
+  arrow::compute::Expression predicate = arrow::compute::literal(true);
+
+  // Used for the decoded columns, e.g. a QueryMemoryPool.
+  arrow::MemoryPool* memory_pool = arrow::default_memory_pool();
+};
+
+struct ParquetReadResult {
+  // Schema of the columns that were read, with renamed columns.
+  std::shared_ptr<arrow::Schema> schema;
+  arrow::RecordBatchVector record_batches;
+  int num_row_groups = 0;
+  int num_pruned_row_groups = 0;
+};
+
+// Reads a Parquet file using ranged reads, so only the footer and the column
+// chunks of the requested columns in unpruned row groups are fetched. Row
+// groups are decoded in parallel on Arrow's CPU thread pool.
+absl::StatusOr<ParquetReadResult> ReadParquetFile(
+    const UrlReader& url_reader, std::string_view url,
+    const ParquetReadOptions& options);
+
+struct ParquetFileInfo {
+  // With renamed columns, like ParquetReadResult::schema.
+  std::shared_ptr<arrow::Schema> schema;
+  int64_t num_rows = 0;
+  int num_row_groups = 0;
+};
+
+// Only reads the footer of a Parquet file.
+absl::StatusOr<ParquetFileInfo> ReadParquetFileInfo(const UrlReader& url_reader,
+                                                    std::string_view url);
+
+}  // namespace seqr
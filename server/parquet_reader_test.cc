@@ -0,0 +1,149 @@
+#include "parquet_reader.h"
+
+#include <absl/strings/str_cat.h>
+#include <arrow/array/builder_binary.h>
+#include <arrow/array/builder_primitive.h>
+#include <arrow/io/file.h>
+#include <arrow/table.h>
+#include <arrow/testing/gtest_util.h>
+#include <gtest/gtest.h>
+#include <parquet/arrow/writer.h>
+#include <unistd.h>
+
+#include <filesystem>
+
+namespace seqr {
+
+namespace cp = arrow::compute;
+namespace fs = std::filesystem;
+
+namespace {
+
+// Only supports ranged reads, to make sure files aren't read as a whole.
+class RangeOnlyReader : public UrlReader {
+ public:
+  RangeOnlyReader() : base_reader_(*MakeLocalFileReader()) {}
+
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> Read(
+      std::string_view url) const override {
+    return absl::UnimplementedError("Only ranged reads are supported");
+  }
+
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadRange(
+      std::string_view url, const int64_t offset,
+      const int64_t length) const override {
+    return base_reader_->ReadRange(url, offset, length);
+  }
+
+  absl::StatusOr<UrlMetadata> GetMetadata(std::string_view url) const override {
+    return base_reader_->GetMetadata(url);
+  }
+
+ private:
+  const std::unique_ptr<UrlReader> base_reader_;
+};
+
+class ParquetReaderTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = fs::temp_directory_path() /
+            absl::StrCat("parquet_reader_test_", getpid(), ".parquet");
+
+    // Eight rows with ascending xpos values, written as four row groups.
+    auto* const memory_pool = arrow::default_memory_pool();
+    arrow::Int64Builder xpos_builder(memory_pool);
+    ASSERT_OK(xpos_builder.AppendValues({10, 20, 30, 40, 50, 60, 70, 80}));
+    std::shared_ptr<arrow::Array> xpos;
+    ASSERT_OK(xpos_builder.Finish(&xpos));
+
+    arrow::StringBuilder contig_builder(memory_pool);
+    ASSERT_OK(contig_builder.AppendValues(
+        {"1", "1", "2", "2", "3", "3", "4", "4"}));
+    std::shared_ptr<arrow::Array> contig;
+    ASSERT_OK(contig_builder.Finish(&contig));
+
+    arrow::DoubleBuilder af_builder(memory_pool);
+    ASSERT_OK(
+        af_builder.AppendValues({0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8}));
+    std::shared_ptr<arrow::Array> af;
+    ASSERT_OK(af_builder.Finish(&af));
+
+    const auto table = arrow::Table::Make(
+        arrow::schema({arrow::field("xpos", arrow::int64()),
+                       arrow::field("locus.contig", arrow::utf8()),
+                       arrow::field("AF", arrow::float64())}),
+        {xpos, contig, af});
+    ASSERT_OK_AND_ASSIGN(const auto output_stream,
+                         arrow::io::FileOutputStream::Open(path_.string()));
+    ASSERT_OK(parquet::arrow::WriteTable(*table, memory_pool, output_stream,
+                                         /* chunk_size */ 2));
+    ASSERT_OK(output_stream->Close());
+  }
+
+  void TearDown() override { fs::remove(path_); }
+
+  std::string url() const { return absl::StrCat("file://", path_.string()); }
+
+  fs::path path_;
+  RangeOnlyReader url_reader_;
+};
+
+TEST_F(ParquetReaderTest, ReadsAllColumns) {
+  const auto result = ReadParquetFile(url_reader_, url(), {});
+  ASSERT_TRUE(result.ok()) << result.status();
+  EXPECT_EQ(result->schema->field_names(),
+            (std::vector<std::string>{"xpos", "locus_contig", "AF"}));
+  EXPECT_EQ(result->num_row_groups, 4);
+  EXPECT_EQ(result->num_pruned_row_groups, 0);
+  int64_t num_rows = 0;
+  for (const auto& record_batch : result->record_batches) {
+    EXPECT_EQ(record_batch->schema()->field(1)->name(), "locus_contig");
+    num_rows += record_batch->num_rows();
+  }
+  EXPECT_EQ(num_rows, 8);
+}
+
+TEST_F(ParquetReaderTest, PrunesRowGroups) {
+  ParquetReadOptions options;
+  options.columns = {"locus_contig", "xpos"};
+  options.predicate = cp::and_(
+      cp::greater_equal(cp::field_ref("xpos"), cp::literal(int64_t{35})),
+      cp::less(cp::field_ref("xpos"), cp::literal(int64_t{55})));
+  const auto result = ReadParquetFile(url_reader_, url(), options);
+  ASSERT_TRUE(result.ok()) << result.status();
+  EXPECT_EQ(result->schema->field_names(),
+            (std::vector<std::string>{"xpos", "locus_contig"}));
+  EXPECT_EQ(result->num_row_groups, 4);
+  EXPECT_EQ(result->num_pruned_row_groups, 2);
+
+  // Row groups are read as a whole, the predicate isn't applied to rows.
+  std::vector<int64_t> xpos_values;
+  for (const auto& record_batch : result->record_batches) {
+    EXPECT_EQ(record_batch->num_columns(), 2);
+    const auto& xpos =
+        static_cast<const arrow::Int64Array&>(*record_batch->column(0));
+    xpos_values.insert(xpos_values.end(), xpos.raw_values(),
+                       xpos.raw_values() + xpos.length());
+  }
+  EXPECT_EQ(xpos_values, (std::vector<int64_t>{30, 40, 50, 60}));
+}
+
+TEST_F(ParquetReaderTest, PrunesAllRowGroups) {
+  ParquetReadOptions options;
+  options.columns = {"AF"};
+  options.predicate = cp::greater(cp::field_ref("AF"), cp::literal(0.9));
+  const auto result = ReadParquetFile(url_reader_, url(), options);
+  ASSERT_TRUE(result.ok()) << result.status();
+  EXPECT_EQ(result->num_pruned_row_groups, 4);
+  EXPECT_TRUE(result->record_batches.empty());
+}
+
+TEST_F(ParquetReaderTest, MissingColumn) {
+  ParquetReadOptions options;
+  options.columns = {"xpos", "locus.contig"};
+  EXPECT_FALSE(ReadParquetFile(url_reader_, url(), options).ok());
+}
+
+}  // namespace
+
+}  // namespace seqr
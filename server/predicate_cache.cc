@@ -0,0 +1,138 @@
+#include "predicate_cache.h"
+
+#include <absl/hash/hash.h>
+#include <absl/strings/str_cat.h>
+#include <arrow/compute/api_scalar.h>
+#include <crc32c/crc32c.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace seqr {
+
+namespace cp = arrow::compute;
+
+namespace {
+
+// The footer of an Arrow IPC file is usually much smaller than this.
+constexpr int64_t kMaxFooterBytes = 64 << 10;
+
+// Appends digests of the exact value sets of SetLookupOptions, e.g. of gene ID
+// lookups. Expression::ToString abbreviates value sets with more than 20
+// elements, so different sets could otherwise share a key.
+void AppendValueSetDigests(const cp::Expression& expression,
+                           std::string* const key) {
+  const auto* const call = expression.call();
+  if (call == nullptr) {
+    return;
+  }
+  if (const auto* const options =
+          dynamic_cast<const cp::SetLookupOptions*>(call->options.get());
+      options != nullptr) {
+    std::string serialized;
+    int64_t num_values = 0;
+    if (options->value_set.is_array()) {
+      const auto value_set = options->value_set.make_array();
+      num_values = value_set->length();
+      for (int64_t i = 0; i < num_values; ++i) {
+        auto scalar = value_set->GetScalar(i);
+        const std::string value =
+            scalar.ok() ? (*scalar)->ToString() : scalar.status().ToString();
+        // Length prefixes make the serialization unambiguous.
+        absl::StrAppend(&serialized, value.size(), ":", value);
+      }
+    } else {
+      serialized = options->value_set.ToString();
+    }
+    absl::StrAppend(
+        key, "#", num_values, ":",
+        absl::Hex(crc32c::Crc32c(serialized), absl::kZeroPad8), ":",
+        absl::Hex(absl::Hash<std::string>()(serialized), absl::kZeroPad16));
+  }
+  for (const auto& argument : call->arguments) {
+    AppendValueSetDigests(argument, key);
+  }
+}
+
+}  // namespace
+
+PredicateCache::PredicateCache(const int64_t max_bytes)
+    : max_bytes_(max_bytes) {}
+
+std::shared_ptr<arrow::Buffer> PredicateCache::Lookup(
+    const std::string_view file_key, const int record_batch_index,
+    const std::string_view conjunct_key) {
+  const std::string key = Key(file_key, record_batch_index, conjunct_key);
+  absl::MutexLock lock(&mu_);
+  const auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    ++stats_.misses;
+    return nullptr;
+  }
+  ++stats_.hits;
+  lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+  return it->second.bitmap;
+}
+
+void PredicateCache::Insert(const std::string_view file_key,
+                            const int record_batch_index,
+                            const std::string_view conjunct_key,
+                            std::shared_ptr<arrow::Buffer> bitmap) {
+  std::string key = Key(file_key, record_batch_index, conjunct_key);
+  const int64_t size = key.size() + bitmap->size();
+  if (size > max_bytes_) {
+    return;
+  }
+
+  absl::MutexLock lock(&mu_);
+  if (entries_.contains(key)) {  // Inserted by a concurrent query.
+    return;
+  }
+  lru_.push_front(key);
+  entries_[std::move(key)] = {std::move(bitmap), lru_.begin()};
+  ++stats_.num_entries;
+  stats_.bytes += size;
+  EvictLocked();
+}
+
+PredicateCacheStats PredicateCache::Stats() const {
+  absl::MutexLock lock(&mu_);
+  return stats_;
+}
+
+std::string PredicateCache::Key(const std::string_view file_key,
+                                const int record_batch_index,
+                                const std::string_view conjunct_key) {
+  return absl::StrCat(file_key, "\n", record_batch_index, "\n", conjunct_key);
+}
+
+void PredicateCache::EvictLocked() {
+  while (stats_.bytes > max_bytes_ && !lru_.empty()) {
+    const auto it = entries_.find(lru_.back());
+    stats_.bytes -= it->first.size() + it->second.bitmap->size();
+    --stats_.num_entries;
+    ++stats_.evictions;
+    entries_.erase(it);
+    lru_.pop_back();
+  }
+}
+
+std::string PredicateCacheFileKey(const std::string_view url,
+                                  const arrow::Buffer& data) {
+  const int64_t footer_bytes = std::min(data.size(), kMaxFooterBytes);
+  return absl::StrCat(
+      url, "#", data.size(), "#",
+      absl::Hex(crc32c::Crc32c(data.data() + data.size() - footer_bytes,
+                               footer_bytes)));
+}
+
+std::string PredicateCacheConjunctKey(const cp::Expression& bound_conjunct) {
+  auto canonical = cp::Canonicalize(bound_conjunct);
+  const cp::Expression& expression =
+      canonical.ok() ? *canonical : bound_conjunct;
+  std::string result = expression.ToString();
+  AppendValueSetDigests(expression, &result);
+  return result;
+}
+
+}  // namespace seqr
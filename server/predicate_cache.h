@@ -0,0 +1,79 @@
+#pragma once
+
+#include <absl/base/thread_annotations.h>
+#include <absl/container/flat_hash_map.h>
+#include <absl/synchronization/mutex.h>
+#include <arrow/buffer.h>
+#include <arrow/compute/exec/expression.h>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace seqr {
+
+struct PredicateCacheStats {
+  int64_t hits = 0;
+  int64_t misses = 0;
+  int64_t evictions = 0;
+  int64_t num_entries = 0;
+  int64_t bytes = 0;
+};
+
+// Caches which rows of a record batch pass a filter conjunct, as bitmaps with
+// one bit per row. Conjuncts like "AF <= 0.01" repeat in most queries against
+// a project, so this avoids evaluating them again for every query. Entries are
+// keyed by file, record batch index and the canonical form of the conjunct.
+// The least recently used bitmaps are evicted to stay below max_bytes.
+// Thread-safe.
+class PredicateCache {
+ public:
+  explicit PredicateCache(int64_t max_bytes);
+
+  PredicateCache(const PredicateCache&) = delete;
+  PredicateCache& operator=(const PredicateCache&) = delete;
+
+  // Returns nullptr if the bitmap isn't cached.
+  std::shared_ptr<arrow::Buffer> Lookup(std::string_view file_key,
+                                        int record_batch_index,
+                                        std::string_view conjunct_key);
+
+  void Insert(std::string_view file_key, int record_batch_index,
+              std::string_view conjunct_key,
+              std::shared_ptr<arrow::Buffer> bitmap);
+
+  PredicateCacheStats Stats() const;
+
+ private:
+  struct Entry {
+    std::shared_ptr<arrow::Buffer> bitmap;
+    std::list<std::string>::iterator lru_position;
+  };
+
+  static std::string Key(std::string_view file_key, int record_batch_index,
+                         std::string_view conjunct_key);
+
+  void EvictLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const int64_t max_bytes_;
+  mutable absl::Mutex mu_;
+  absl::flat_hash_map<std::string, Entry> entries_ ABSL_GUARDED_BY(mu_);
+  // Most recently used keys first.
+  std::list<std::string> lru_ ABSL_GUARDED_BY(mu_);
+  PredicateCacheStats stats_ ABSL_GUARDED_BY(mu_);
+};
+
+// Identifies the contents of an Arrow IPC file, so that cached bitmaps aren't
+// used for a modified file. Combines the URL with the size and a checksum of
+// the footer, which contains the offsets and lengths of all record batches.
+std::string PredicateCacheFileKey(std::string_view url,
+                                  const arrow::Buffer& data);
+
+// Returns the same key for equivalent bound conjuncts, e.g. regardless of the
+// order of the arguments of commutative functions.
+std::string PredicateCacheConjunctKey(
+    const arrow::compute::Expression& bound_conjunct);
+
+}  // namespace seqr
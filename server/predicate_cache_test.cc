@@ -0,0 +1,113 @@
+#include "predicate_cache.h"
+
+#include <absl/strings/str_cat.h>
+#include <arrow/array/builder_binary.h>
+#include <arrow/compute/api_scalar.h>
+#include <gtest/gtest.h>
+
+#include <string>
+
+namespace seqr {
+
+namespace cp = arrow::compute;
+
+namespace {
+
+std::shared_ptr<arrow::Buffer> MakeBitmap(const std::string& bytes) {
+  return arrow::Buffer::FromString(bytes);
+}
+
+TEST(PredicateCache, LooksUpInsertedBitmaps) {
+  PredicateCache predicate_cache(1 << 20);
+  EXPECT_TRUE(predicate_cache.Lookup("file", 0, "AF <= 0.01") == nullptr);
+  predicate_cache.Insert("file", 0, "AF <= 0.01", MakeBitmap("\x05"));
+
+  const auto bitmap = predicate_cache.Lookup("file", 0, "AF <= 0.01");
+  ASSERT_TRUE(bitmap != nullptr);
+  EXPECT_EQ(bitmap->ToString(), "\x05");
+  EXPECT_TRUE(predicate_cache.Lookup("file", 1, "AF <= 0.01") == nullptr);
+  EXPECT_TRUE(predicate_cache.Lookup("other", 0, "AF <= 0.01") == nullptr);
+  EXPECT_TRUE(predicate_cache.Lookup("file", 0, "AF <= 0.02") == nullptr);
+
+  const auto stats = predicate_cache.Stats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 4);
+  EXPECT_EQ(stats.num_entries, 1);
+  EXPECT_GT(stats.bytes, 0);
+}
+
+TEST(PredicateCache, EvictsLeastRecentlyUsed) {
+  const std::string bitmap(100, '\xff');
+  // Each entry takes a bit more than the bitmap size, for its key.
+  PredicateCache predicate_cache(250);
+  predicate_cache.Insert("file", 0, "a", MakeBitmap(bitmap));
+  predicate_cache.Insert("file", 1, "a", MakeBitmap(bitmap));
+  ASSERT_TRUE(predicate_cache.Lookup("file", 0, "a") != nullptr);
+  predicate_cache.Insert("file", 2, "a", MakeBitmap(bitmap));
+
+  EXPECT_TRUE(predicate_cache.Lookup("file", 0, "a") != nullptr);
+  EXPECT_TRUE(predicate_cache.Lookup("file", 1, "a") == nullptr);
+  EXPECT_TRUE(predicate_cache.Lookup("file", 2, "a") != nullptr);
+  const auto stats = predicate_cache.Stats();
+  EXPECT_EQ(stats.evictions, 1);
+  EXPECT_EQ(stats.num_entries, 2);
+  EXPECT_LE(stats.bytes, 250);
+
+  // Too large to cache at all.
+  predicate_cache.Insert("file", 3, "a", MakeBitmap(std::string(300, 'x')));
+  EXPECT_TRUE(predicate_cache.Lookup("file", 3, "a") == nullptr);
+}
+
+TEST(PredicateCache, Keys) {
+  const auto data = arrow::Buffer::FromString("some arrow file");
+  const auto modified_data = arrow::Buffer::FromString("some arrow File");
+  EXPECT_EQ(PredicateCacheFileKey("gs://bucket/file.arrow", *data),
+            PredicateCacheFileKey("gs://bucket/file.arrow", *data));
+  EXPECT_NE(PredicateCacheFileKey("gs://bucket/file.arrow", *data),
+            PredicateCacheFileKey("gs://bucket/file.arrow", *modified_data));
+  EXPECT_NE(PredicateCacheFileKey("gs://bucket/file.arrow", *data),
+            PredicateCacheFileKey("gs://bucket/other.arrow", *data));
+
+  const auto schema = arrow::schema({arrow::field("AF", arrow::float64())});
+  const auto bind = [&schema](const cp::Expression& expression) {
+    auto result = expression.Bind(*schema);
+    EXPECT_TRUE(result.ok()) << result.status();
+    return *std::move(result);
+  };
+  EXPECT_EQ(PredicateCacheConjunctKey(bind(
+                cp::less_equal(cp::field_ref("AF"), cp::literal(0.01)))),
+            PredicateCacheConjunctKey(bind(
+                cp::less_equal(cp::field_ref("AF"), cp::literal(0.01)))));
+  EXPECT_NE(PredicateCacheConjunctKey(bind(
+                cp::less_equal(cp::field_ref("AF"), cp::literal(0.01)))),
+            PredicateCacheConjunctKey(bind(
+                cp::less_equal(cp::field_ref("AF"), cp::literal(0.05)))));
+}
+
+TEST(PredicateCache, ConjunctKeysDistinguishLargeValueSets) {
+  const auto schema = arrow::schema({arrow::field("variantId", arrow::utf8())});
+  // Both sets have more than 20 values and only differ in the middle, which
+  // Expression::ToString omits.
+  const auto make_key = [&schema](const std::string& middle_value) {
+    arrow::StringBuilder builder;
+    for (int i = 0; i < 30; ++i) {
+      EXPECT_TRUE(
+          builder.Append(i == 15 ? middle_value : absl::StrCat("1-", i, "-A-G"))
+              .ok());
+    }
+    std::shared_ptr<arrow::Array> value_set;
+    EXPECT_TRUE(builder.Finish(&value_set).ok());
+    auto bound =
+        cp::call("is_in", {cp::field_ref("variantId")},
+                 cp::SetLookupOptions(value_set, /* skip_nulls */ true))
+            .Bind(*schema);
+    EXPECT_TRUE(bound.ok()) << bound.status();
+    return PredicateCacheConjunctKey(*bound);
+  };
+  EXPECT_EQ(make_key("1-100-C-T"), make_key("1-100-C-T"));
+  EXPECT_NE(make_key("1-100-C-T"), make_key("1-200-C-T"));
+}
+
+}  // namespace
+
+}  // namespace seqr
@@ -0,0 +1,213 @@
+#include "preload_reader.h"
+
+#include <absl/strings/match.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_split.h>
+#include <absl/strings/strip.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+#include <arrow/io/memory.h>
+#include <arrow/ipc/reader.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+
+namespace seqr {
+
+namespace {
+
+// Checks that the data is a readable Arrow file by parsing its footer.
+absl::Status ValidateArrowFile(const std::shared_ptr<arrow::Buffer>& data) {
+  arrow::io::BufferReader buffer_reader{data};
+  const auto record_batch_file_reader =
+      arrow::ipc::RecordBatchFileReader::Open(&buffer_reader);
+  if (!record_batch_file_reader.ok()) {
+    return absl::InvalidArgumentError(
+        record_batch_file_reader.status().ToString());
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+std::vector<std::string> ParsePreloadManifest(const std::string_view content) {
+  std::vector<std::string> result;
+  for (const std::string_view line : absl::StrSplit(content, '\n')) {
+    const std::string_view url = absl::StripAsciiWhitespace(line);
+    if (!url.empty() && !absl::StartsWith(url, "#")) {
+      result.emplace_back(url);
+    }
+  }
+  return result;
+}
+
+PreloadReader::PreloadReader(std::unique_ptr<UrlReader> base_reader)
+    : base_reader_(std::move(base_reader)) {}
+
+PreloadResult PreloadReader::Preload(const std::vector<std::string>& urls,
+                                     const PreloadOptions& options) {
+  const absl::Time start = absl::Now();
+  std::atomic<size_t> next_index = 0;
+  std::atomic<int> num_loaded = 0;
+  std::atomic<int> num_skipped = 0;
+  std::atomic<int> num_failed = 0;
+  std::atomic<int64_t> num_bytes = 0;
+
+  const auto load = [&](const std::string& url) -> absl::Status {
+    auto metadata = base_reader_->GetMetadata(url);
+    if (!metadata.ok()) {
+      return metadata.status();
+    }
+
+    // Reserve the budget before reading, so concurrent loads can't exceed it.
+    if (num_bytes.fetch_add(metadata->size) + metadata->size >
+        options.max_bytes) {
+      num_bytes.fetch_sub(metadata->size);
+      ++num_skipped;
+      std::cout << "Skipping preload of " << url << " (" << metadata->size
+                << " bytes): budget of " << options.max_bytes
+                << " bytes exhausted" << std::endl;
+      return absl::OkStatus();
+    }
+
+    auto data = base_reader_->ReadWithMetadata(url, *metadata);
+    if (!data.ok()) {
+      num_bytes.fetch_sub(metadata->size);
+      return data.status();
+    }
+    if ((*data)->size() != metadata->size) {
+      num_bytes.fetch_sub(metadata->size);
+      return absl::DataLossError(absl::StrCat(
+          "Expected ", metadata->size, " bytes, read ", (*data)->size()));
+    }
+    if (absl::EndsWith(url, ".arrow")) {
+      if (const auto status = ValidateArrowFile(*data); !status.ok()) {
+        num_bytes.fetch_sub(metadata->size);
+        return status;
+      }
+    }
+
+    if (options.pin_in_memory) {
+      auto pinned_blob = std::make_shared<PinnedBlob>(
+          PinnedBlob{*std::move(metadata), *std::move(data)});
+      absl::MutexLock lock(&mu_);
+      pinned_blobs_[url] = std::move(pinned_blob);
+    }
+
+    const int loaded = ++num_loaded;
+    std::cout << "Preloaded " << url << " (" << loaded << "/" << urls.size()
+              << " files, " << num_bytes.load() << " bytes)" << std::endl;
+    return absl::OkStatus();
+  };
+
+  std::vector<std::thread> threads;
+  const int num_threads =
+      std::max(1, std::min(options.num_threads, static_cast<int>(urls.size())));
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&] {
+      for (size_t index = next_index++; index < urls.size();
+           index = next_index++) {
+        if (const auto status = load(urls[index]); !status.ok()) {
+          ++num_failed;
+          std::cerr << "Failed to preload " << urls[index] << ": " << status
+                    << std::endl;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  PreloadResult result{num_loaded, num_skipped, num_failed, num_bytes};
+  std::cout << "Preloaded " << result.num_loaded << " files ("
+            << result.num_bytes << " bytes) in " << absl::Now() - start
+            << ", skipped " << result.num_skipped << ", failed "
+            << result.num_failed << std::endl;
+  return result;
+}
+
+std::shared_ptr<const PreloadReader::PinnedBlob> PreloadReader::FindPinnedBlob(
+    const std::string_view url) const {
+  absl::MutexLock lock(&mu_);
+  const auto it = pinned_blobs_.find(url);
+  return it == pinned_blobs_.end() ? nullptr : it->second;
+}
+
+absl::StatusOr<std::shared_ptr<arrow::Buffer>> PreloadReader::Read(
+    const std::string_view url) const {
+  if (const auto pinned_blob = FindPinnedBlob(url); pinned_blob != nullptr) {
+    return pinned_blob->data;
+  }
+  return base_reader_->Read(url);
+}
+
+absl::StatusOr<std::shared_ptr<arrow::Buffer>> PreloadReader::ReadWithMetadata(
+    const std::string_view url, const UrlMetadata& metadata) const {
+  if (const auto pinned_blob = FindPinnedBlob(url);
+      pinned_blob != nullptr &&
+      pinned_blob->metadata.generation == metadata.generation) {
+    return pinned_blob->data;
+  }
+  return base_reader_->ReadWithMetadata(url, metadata);
+}
+
+absl::StatusOr<std::shared_ptr<arrow::Buffer>> PreloadReader::ReadRange(
+    const std::string_view url, const int64_t offset,
+    const int64_t length) const {
+  const auto pinned_blob = FindPinnedBlob(url);
+  if (pinned_blob == nullptr) {
+    return base_reader_->ReadRange(url, offset, length);
+  }
+  return ReadPinnedRange(*pinned_blob, url, offset, length);
+}
+
+absl::StatusOr<std::shared_ptr<arrow::Buffer>>
+PreloadReader::ReadRangeOfGeneration(const std::string_view url,
+                                     const std::string_view generation,
+                                     const int64_t offset,
+                                     const int64_t length) const {
+  const auto pinned_blob = FindPinnedBlob(url);
+  if (pinned_blob == nullptr ||
+      pinned_blob->metadata.generation != generation) {
+    return base_reader_->ReadRangeOfGeneration(url, generation, offset,
+                                               length);
+  }
+  return ReadPinnedRange(*pinned_blob, url, offset, length);
+}
+
+absl::StatusOr<std::shared_ptr<arrow::Buffer>> PreloadReader::ReadPinnedRange(
+    const PinnedBlob& pinned_blob, const std::string_view url,
+    const int64_t offset, const int64_t length) {
+  const auto& data = pinned_blob.data;
+  if (offset < 0 || length < 0 || offset + length > data->size()) {
+    return absl::OutOfRangeError(
+        absl::StrCat("Range [", offset, ", ", offset + length,
+                     ") exceeds the size of ", url));
+  }
+  // The slice keeps the pinned buffer alive, without copying. Unaligned ranges
+  // are copied, as readers return aligned buffers.
+  if ((data->address() + offset) % kBlobAlignment == 0) {
+    return arrow::SliceBuffer(data, offset, length);
+  }
+  auto result = AllocateBlobBuffer(length);
+  if (!result.ok()) {
+    return result.status();
+  }
+  std::memcpy((*result)->mutable_data(), data->data() + offset, length);
+  return result;
+}
+
+absl::StatusOr<UrlMetadata> PreloadReader::GetMetadata(
+    const std::string_view url) const {
+  if (const auto pinned_blob = FindPinnedBlob(url); pinned_blob != nullptr) {
+    return pinned_blob->metadata;
+  }
+  return base_reader_->GetMetadata(url);
+}
+
+}  // namespace seqr
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <absl/base/thread_annotations.h>
+#include <absl/container/flat_hash_map.h>
+#include <absl/status/statusor.h>
+#include <absl/synchronization/mutex.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "url_reader.h"
+
+namespace seqr {
+
+// Parses a preload manifest, which lists one URL per line. Empty lines and
+// lines starting with '#' are ignored.
+std::vector<std::string> ParsePreloadManifest(std::string_view content);
+
+struct PreloadOptions {
+  // Maximum total size of the preloaded blobs. Blobs that don't fit anymore
+  // are skipped.
+  int64_t max_bytes = 0;
+
+  // Number of blobs that are loaded concurrently.
+  int num_threads = 16;
+
+  // If false, blobs are only read through the base reader without keeping
+  // them in memory, e.g. to populate a disk cache.
+  bool pin_in_memory = true;
+};
+
+struct PreloadResult {
+  int num_loaded = 0;
+  int num_skipped = 0;  // Because of PreloadOptions::max_bytes.
+  int num_failed = 0;
+  int64_t num_bytes = 0;
+};
+
+// Forwards reads to base_reader, except for blobs that have been pinned in
+// memory by Preload. Pinned blobs aren't revalidated, so only immutable blobs
+// should be preloaded. Thread-safe.
+class PreloadReader : public UrlReader {
+ public:
+  explicit PreloadReader(std::unique_ptr<UrlReader> base_reader);
+
+  // Loads the blobs in parallel and logs the progress. Arrow files are
+  // validated by parsing their footer. Failures are logged and counted, but
+  // don't stop the other blobs from loading.
+  PreloadResult Preload(const std::vector<std::string>& urls,
+                        const PreloadOptions& options);
+
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> Read(
+      std::string_view url) const override;
+
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadWithMetadata(
+      std::string_view url, const UrlMetadata& metadata) const override;
+
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadRange(
+      std::string_view url, int64_t offset, int64_t length) const override;
+
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadRangeOfGeneration(
+      std::string_view url, std::string_view generation, int64_t offset,
+      int64_t length) const override;
+
+  absl::StatusOr<UrlMetadata> GetMetadata(std::string_view url) const override;
+
+ private:
+  struct PinnedBlob {
+    UrlMetadata metadata;
+    std::shared_ptr<arrow::Buffer> data;
+  };
+
+  std::shared_ptr<const PinnedBlob> FindPinnedBlob(std::string_view url) const;
+
+  static absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadPinnedRange(
+      const PinnedBlob& pinned_blob, std::string_view url, int64_t offset,
+      int64_t length);
+
+  const std::unique_ptr<UrlReader> base_reader_;
+  mutable absl::Mutex mu_;
+  absl::flat_hash_map<std::string, std::shared_ptr<const PinnedBlob>>
+      pinned_blobs_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace seqr
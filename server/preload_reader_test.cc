@@ -0,0 +1,72 @@
+#include "preload_reader.h"
+
+#include <absl/strings/str_cat.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+#include "url_reader_test_util.h"
+
+namespace seqr {
+
+namespace {
+
+using PreloadReaderTest = BlobDirectoryTest;
+
+TEST(ParsePreloadManifest, SkipsCommentsAndEmptyLines) {
+  EXPECT_EQ(ParsePreloadManifest("# Project A\ngs://a/1.arrow\n\n"
+                                 "  gs://a/2.arrow \n#gs://a/3.arrow"),
+            (std::vector<std::string>{"gs://a/1.arrow", "gs://a/2.arrow"}));
+}
+
+TEST_F(PreloadReaderTest, PinsBlobsWithinBudget) {
+  const std::string first = WriteBlob("first.txt", "0123456789");
+  const std::string second = WriteBlob("second.txt", "abcdefghij");
+  const std::string invalid = WriteBlob("invalid.arrow", "not arrow");
+  const std::string other = WriteBlob("other.txt", "xyz");
+
+  std::atomic<int> num_reads = 0;
+  PreloadReader preload_reader(std::make_unique<CountingReader>(&num_reads));
+  const PreloadResult result = preload_reader.Preload(
+      {invalid, first, second, absl::StrCat("file://", root_.string(), "/no")},
+      {.max_bytes = 15, .num_threads = 1});
+  EXPECT_EQ(result.num_loaded, 1);
+  EXPECT_EQ(result.num_skipped, 1);
+  EXPECT_EQ(result.num_failed, 2);
+  EXPECT_EQ(result.num_bytes, 10);
+
+  num_reads = 0;
+  EXPECT_EQ(ToString(preload_reader.Read(first)), "0123456789");
+  const auto range = preload_reader.ReadRange(first, 2, 3);
+  EXPECT_EQ(ToString(range), "234");
+  ASSERT_TRUE(range.ok());
+  EXPECT_EQ((*range)->address() % kBlobAlignment, 0);
+  EXPECT_FALSE(preload_reader.ReadRange(first, 8, 3).ok());
+  const auto metadata = preload_reader.GetMetadata(first);
+  ASSERT_TRUE(metadata.ok()) << metadata.status();
+  EXPECT_EQ(metadata->size, 10);
+  EXPECT_EQ(num_reads, 0);
+
+  // Blobs that weren't pinned are read through the base reader.
+  EXPECT_EQ(ToString(preload_reader.Read(second)), "abcdefghij");
+  EXPECT_EQ(ToString(preload_reader.Read(other)), "xyz");
+  EXPECT_EQ(num_reads, 2);
+}
+
+TEST_F(PreloadReaderTest, ReadsWithoutPinning) {
+  const std::string url = WriteBlob("blob.txt", "content");
+
+  std::atomic<int> num_reads = 0;
+  PreloadReader preload_reader(std::make_unique<CountingReader>(&num_reads));
+  const PreloadResult result = preload_reader.Preload(
+      {url}, {.max_bytes = 100, .pin_in_memory = false});
+  EXPECT_EQ(result.num_loaded, 1);
+  EXPECT_EQ(num_reads, 1);
+
+  EXPECT_EQ(ToString(preload_reader.Read(url)), "content");
+  EXPECT_EQ(num_reads, 2);
+}
+
+}  // namespace
+
+}  // namespace seqr
@@ -0,0 +1,63 @@
+#include "query_memory_pool.h"
+
+namespace seqr {
+
+QueryMemoryPool::QueryMemoryPool(const int64_t max_bytes,
+                                 arrow::MemoryPool* const parent)
+    : max_bytes_(max_bytes), parent_(parent) {}
+
+arrow::Status QueryMemoryPool::Reserve(const int64_t size) {
+  const int64_t bytes_allocated = bytes_allocated_.fetch_add(size) + size;
+  if (max_bytes_ > 0 && size > 0 && bytes_allocated > max_bytes_) {
+    bytes_allocated_.fetch_sub(size);
+    limit_exceeded_ = true;
+    return arrow::Status::OutOfMemory("Query memory limit of ", max_bytes_,
+                                      " bytes exceeded when allocating ", size,
+                                      " bytes");
+  }
+
+  int64_t max_memory = max_memory_.load();
+  while (bytes_allocated > max_memory &&
+         !max_memory_.compare_exchange_weak(max_memory, bytes_allocated)) {
+  }
+  return arrow::Status::OK();
+}
+
+arrow::Status QueryMemoryPool::Allocate(const int64_t size,
+                                        uint8_t** const out) {
+  ARROW_RETURN_NOT_OK(Reserve(size));
+  if (const auto status = parent_->Allocate(size, out); !status.ok()) {
+    bytes_allocated_.fetch_sub(size);
+    return status;
+  }
+  return arrow::Status::OK();
+}
+
+arrow::Status QueryMemoryPool::Reallocate(const int64_t old_size,
+                                          const int64_t new_size,
+                                          uint8_t** const ptr) {
+  ARROW_RETURN_NOT_OK(Reserve(new_size - old_size));
+  if (const auto status = parent_->Reallocate(old_size, new_size, ptr);
+      !status.ok()) {
+    bytes_allocated_.fetch_sub(new_size - old_size);
+    return status;
+  }
+  return arrow::Status::OK();
+}
+
+void QueryMemoryPool::Free(uint8_t* const buffer, const int64_t size) {
+  parent_->Free(buffer, size);
+  bytes_allocated_.fetch_sub(size);
+}
+
+int64_t QueryMemoryPool::bytes_allocated() const { return bytes_allocated_; }
+
+int64_t QueryMemoryPool::max_memory() const { return max_memory_; }
+
+std::string QueryMemoryPool::backend_name() const {
+  return parent_->backend_name();
+}
+
+bool QueryMemoryPool::limit_exceeded() const { return limit_exceeded_; }
+
+}  // namespace seqr
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <arrow/memory_pool.h>
+#include <arrow/status.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace seqr {
+
+// Forwards allocations to a parent pool, while tracking the current and peak
+// number of bytes allocated by a single query. Allocations that would exceed
+// max_bytes fail with an out-of-memory status, which makes the query fail
+// instead of the whole process. Thread-safe.
+class QueryMemoryPool : public arrow::MemoryPool {
+ public:
+  // A max_bytes value of zero disables the limit. The parent pool must outlive
+  // this pool, which in turn must outlive all buffers allocated from it.
+  explicit QueryMemoryPool(
+      int64_t max_bytes,
+      arrow::MemoryPool* parent = arrow::default_memory_pool());
+
+  QueryMemoryPool(const QueryMemoryPool&) = delete;
+  QueryMemoryPool& operator=(const QueryMemoryPool&) = delete;
+
+  arrow::Status Allocate(int64_t size, uint8_t** out) override;
+  arrow::Status Reallocate(int64_t old_size, int64_t new_size,
+                           uint8_t** ptr) override;
+  void Free(uint8_t* buffer, int64_t size) override;
+
+  int64_t bytes_allocated() const override;
+  // Peak number of bytes allocated.
+  int64_t max_memory() const override;
+  std::string backend_name() const override;
+
+  int64_t max_bytes() const { return max_bytes_; }
+
+  // Whether an allocation has been rejected because of the limit.
+  bool limit_exceeded() const;
+
+ private:
+  // Accounts for additional bytes, failing if the limit would be exceeded.
+  arrow::Status Reserve(int64_t size);
+
+  const int64_t max_bytes_;
+  arrow::MemoryPool* const parent_;
+  std::atomic<int64_t> bytes_allocated_ = 0;
+  std::atomic<int64_t> max_memory_ = 0;
+  std::atomic<bool> limit_exceeded_ = false;
+};
+
+}  // namespace seqr
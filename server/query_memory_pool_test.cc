@@ -0,0 +1,43 @@
+#include "query_memory_pool.h"
+
+#include <arrow/buffer.h>
+#include <arrow/testing/gtest_util.h>
+#include <gtest/gtest.h>
+
+namespace seqr {
+
+TEST(QueryMemoryPool, TracksCurrentAndPeakBytes) {
+  QueryMemoryPool memory_pool(0);
+  {
+    ASSERT_OK_AND_ASSIGN(auto first,
+                         arrow::AllocateResizableBuffer(1000, &memory_pool));
+    ASSERT_OK_AND_ASSIGN(auto second,
+                         arrow::AllocateBuffer(3000, &memory_pool));
+    EXPECT_GE(memory_pool.bytes_allocated(), 4000);
+    ASSERT_OK(first->Resize(2000));
+    EXPECT_GE(memory_pool.bytes_allocated(), 5000);
+  }
+  EXPECT_EQ(memory_pool.bytes_allocated(), 0);
+  EXPECT_GE(memory_pool.max_memory(), 5000);
+  EXPECT_FALSE(memory_pool.limit_exceeded());
+}
+
+TEST(QueryMemoryPool, EnforcesLimit) {
+  QueryMemoryPool memory_pool(4096);
+  ASSERT_OK_AND_ASSIGN(auto buffer,
+                       arrow::AllocateResizableBuffer(2048, &memory_pool));
+  EXPECT_TRUE(arrow::AllocateBuffer(4096, &memory_pool)
+                  .status()
+                  .IsOutOfMemory());
+  EXPECT_TRUE(buffer->Resize(8192).IsOutOfMemory());
+  EXPECT_TRUE(memory_pool.limit_exceeded());
+
+  // Failed allocations aren't accounted for.
+  const int64_t bytes_allocated = memory_pool.bytes_allocated();
+  EXPECT_GE(bytes_allocated, 2048);
+  EXPECT_LE(bytes_allocated, 4096);
+  buffer.reset();
+  EXPECT_EQ(memory_pool.bytes_allocated(), 0);
+}
+
+}  // namespace seqr
@@ -0,0 +1,386 @@
+#include "resident_column_store.h"
+
+#include <absl/strings/str_cat.h>
+#include <arrow/io/memory.h>
+#include <arrow/ipc/options.h>
+#include <arrow/ipc/reader.h>
+#include <arrow/ipc/writer.h>
+#include <arrow/record_batch.h>
+#include <arrow/util/compression.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace seqr {
+
+namespace {
+
+// Temperatures halve about every 35 queries.
+constexpr double kTemperatureDecay = 0.98;
+// Projection columns are only decoded for record batches with matches.
+constexpr double kFilterWeight = 1;
+constexpr double kProjectionWeight = 0.25;
+
+int64_t ArrayBytes(const arrow::ArrayData& data) {
+  int64_t result = 0;
+  for (const auto& buffer : data.buffers) {
+    if (buffer != nullptr) {
+      result += buffer->size();
+    }
+  }
+  for (const auto& child : data.child_data) {
+    result += ArrayBytes(*child);
+  }
+  if (data.dictionary != nullptr) {
+    result += ArrayBytes(*data.dictionary);
+  }
+  return result;
+}
+
+// Whether any buffer is a slice of another one, e.g. of the file buffer.
+bool ReferencesParentBuffer(const arrow::ArrayData& data) {
+  for (const auto& buffer : data.buffers) {
+    if (buffer != nullptr && buffer->parent() != nullptr) {
+      return true;
+    }
+  }
+  for (const auto& child : data.child_data) {
+    if (ReferencesParentBuffer(*child)) {
+      return true;
+    }
+  }
+  return data.dictionary != nullptr && ReferencesParentBuffer(*data.dictionary);
+}
+
+// Copies the buffers into the default memory pool, so entries don't hold on to
+// memory of the query that decoded them.
+absl::StatusOr<std::shared_ptr<arrow::ArrayData>> CopyArrayData(
+    const arrow::ArrayData& data) {
+  auto result = data.Copy();
+  for (auto& buffer : result->buffers) {
+    if (buffer == nullptr) {
+      continue;
+    }
+    auto copy = arrow::AllocateBuffer(buffer->size());
+    if (!copy.ok()) {
+      return absl::ResourceExhaustedError(copy.status().ToString());
+    }
+    std::memcpy((*copy)->mutable_data(), buffer->data(), buffer->size());
+    buffer = *std::move(copy);
+  }
+  for (auto& child : result->child_data) {
+    auto copy = CopyArrayData(*child);
+    if (!copy.ok()) {
+      return copy.status();
+    }
+    child = *std::move(copy);
+  }
+  if (result->dictionary != nullptr) {
+    auto copy = CopyArrayData(*result->dictionary);
+    if (!copy.ok()) {
+      return copy.status();
+    }
+    result->dictionary = *std::move(copy);
+  }
+  return result;
+}
+
+// Serializes the array as an LZ4-compressed Arrow IPC stream. Unlike a single
+// record batch message, the stream also contains dictionaries.
+absl::StatusOr<std::shared_ptr<arrow::Buffer>> Compress(
+    const std::string_view column, const std::shared_ptr<arrow::Array>& array) {
+  auto codec = arrow::util::Codec::Create(arrow::Compression::LZ4_FRAME);
+  if (!codec.ok()) {
+    return absl::InternalError(codec.status().ToString());
+  }
+  auto write_options = arrow::ipc::IpcWriteOptions::Defaults();
+  write_options.codec = *std::move(codec);
+  write_options.use_threads = false;
+
+  auto output_stream = arrow::io::BufferOutputStream::Create();
+  if (!output_stream.ok()) {
+    return absl::ResourceExhaustedError(output_stream.status().ToString());
+  }
+  const auto schema =
+      arrow::schema({arrow::field(std::string(column), array->type())});
+  auto writer =
+      arrow::ipc::MakeStreamWriter(*output_stream, schema, write_options);
+  if (!writer.ok()) {
+    return absl::InternalError(writer.status().ToString());
+  }
+  if (const auto status = (*writer)->WriteRecordBatch(
+          *arrow::RecordBatch::Make(schema, array->length(), {array}));
+      !status.ok()) {
+    return absl::InternalError(status.ToString());
+  }
+  if (const auto status = (*writer)->Close(); !status.ok()) {
+    return absl::InternalError(status.ToString());
+  }
+  auto result = (*output_stream)->Finish();
+  if (!result.ok()) {
+    return absl::InternalError(result.status().ToString());
+  }
+  return *std::move(result);
+}
+
+absl::StatusOr<std::shared_ptr<arrow::Array>> Decompress(
+    std::shared_ptr<arrow::Buffer> compressed,
+    arrow::MemoryPool* const memory_pool) {
+  auto read_options = arrow::ipc::IpcReadOptions::Defaults();
+  read_options.memory_pool = memory_pool;
+  read_options.use_threads = false;
+  auto reader = arrow::ipc::RecordBatchStreamReader::Open(
+      std::make_shared<arrow::io::BufferReader>(std::move(compressed)),
+      read_options);
+  if (!reader.ok()) {
+    return absl::InternalError(reader.status().ToString());
+  }
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  if (const auto status = (*reader)->ReadNext(&record_batch); !status.ok()) {
+    return absl::InternalError(status.ToString());
+  }
+  if (record_batch == nullptr || record_batch->num_columns() != 1) {
+    return absl::InternalError("Invalid compressed column");
+  }
+  return record_batch->column(0);
+}
+
+}  // namespace
+
+ResidentColumnStore::ResidentColumnStore(const int64_t max_bytes)
+    : max_bytes_(max_bytes) {}
+
+void ResidentColumnStore::RecordQuery(
+    const std::vector<std::string>& filter_columns,
+    const std::vector<std::string>& projection_columns) {
+  absl::MutexLock lock(&mu_);
+  for (auto& [column, info] : columns_) {
+    info.temperature *= kTemperatureDecay;
+  }
+  for (const auto& column : filter_columns) {
+    GetColumnInfoLocked(column)->temperature += kFilterWeight;
+  }
+  for (const auto& column : projection_columns) {
+    GetColumnInfoLocked(column)->temperature += kProjectionWeight;
+  }
+
+  // Decode the hottest columns that fit, and compress the remaining ones.
+  std::vector<ColumnInfo*> column_infos;
+  column_infos.reserve(columns_.size());
+  for (auto& [column, info] : columns_) {
+    column_infos.push_back(&info);
+  }
+  std::sort(column_infos.begin(), column_infos.end(),
+            [](const ColumnInfo* const lhs, const ColumnInfo* const rhs) {
+              return lhs->temperature > rhs->temperature;
+            });
+  int64_t remaining_bytes = max_bytes_;
+  for (ColumnInfo* const info : column_infos) {
+    const int64_t decoded_bytes =
+        info->decoded_bytes + info->evicted_decoded_bytes;
+    info->hot = decoded_bytes <= remaining_bytes;
+    if (info->hot) {
+      remaining_bytes -= decoded_bytes;
+      continue;
+    }
+    // Assume no compression until it has been observed.
+    const double compression_ratio =
+        info->compressed_decoded_bytes > 0
+            ? static_cast<double>(info->compressed_bytes) /
+                  info->compressed_decoded_bytes
+            : 1;
+    remaining_bytes -=
+        std::min<int64_t>(remaining_bytes, decoded_bytes * compression_ratio);
+  }
+}
+
+absl::StatusOr<std::shared_ptr<arrow::Array>> ResidentColumnStore::Lookup(
+    const std::string_view file_key, const int record_batch_index,
+    const std::string_view column, arrow::MemoryPool* const memory_pool) {
+  const std::string key = Key(file_key, record_batch_index, column);
+  std::shared_ptr<arrow::Array> decoded;
+  std::shared_ptr<arrow::Buffer> compressed;
+  bool hot = false;
+  {
+    absl::MutexLock lock(&mu_);
+    const auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      ++stats_.misses;
+      return nullptr;
+    }
+    Entry& entry = it->second;
+    ColumnInfo& info = *entry.column_info;
+    info.lru.splice(info.lru.begin(), info.lru, entry.lru_position);
+    decoded = entry.decoded;
+    compressed = entry.compressed;
+    // Like on insertion, entries that can't fit decoded stay cold.
+    hot = info.hot && entry.decoded_bytes <= max_bytes_;
+    ++(decoded != nullptr ? stats_.hot_hits : stats_.cold_hits);
+  }
+
+  // Entries are converted outside of the lock, and only replaced if no
+  // concurrent lookup has converted them in the meantime.
+  if (decoded != nullptr) {
+    if (!hot) {
+      if (auto demoted = Compress(column, decoded); demoted.ok()) {
+        absl::MutexLock lock(&mu_);
+        const auto it = entries_.find(key);
+        if (it != entries_.end() && it->second.decoded == decoded) {
+          ReplaceDataLocked(&it->second, nullptr, *std::move(demoted));
+        }
+      }
+    }
+    return decoded;
+  }
+
+  // Entries that are promoted are decompressed directly into memory owned by
+  // the store, like the copies of inserted hot entries. Otherwise the memory
+  // is only used by the query, so it's accounted to it.
+  auto result = Decompress(
+      compressed, hot ? arrow::default_memory_pool() : memory_pool);
+  if (!result.ok()) {
+    return absl::InternalError(absl::StrCat("Failed to decompress column ",
+                                            column, ": ",
+                                            result.status().message()));
+  }
+  if (hot) {
+    absl::MutexLock lock(&mu_);
+    const auto it = entries_.find(key);
+    if (it != entries_.end() && it->second.compressed == compressed) {
+      ReplaceDataLocked(&it->second, *result, nullptr);
+      EvictLocked();
+    }
+  }
+  return result;
+}
+
+void ResidentColumnStore::Insert(const std::string_view file_key,
+                                 const int record_batch_index,
+                                 const std::string_view column,
+                                 std::shared_ptr<arrow::Array> array) {
+  // Uncompressed columns can be read from the file without decoding.
+  if (array == nullptr || ReferencesParentBuffer(*array->data())) {
+    return;
+  }
+  std::string key = Key(file_key, record_batch_index, column);
+  const int64_t decoded_bytes = ArrayBytes(*array->data());
+  bool hot = false;
+  {
+    absl::MutexLock lock(&mu_);
+    if (entries_.contains(key)) {
+      return;
+    }
+    hot = GetColumnInfoLocked(column)->hot && decoded_bytes <= max_bytes_;
+  }
+
+  // On failure, the column is decoded from the file again next time.
+  std::shared_ptr<arrow::Buffer> compressed;
+  if (hot) {
+    auto copy = CopyArrayData(*array->data());
+    if (!copy.ok()) {
+      return;
+    }
+    array = arrow::MakeArray(*std::move(copy));
+  } else {
+    auto result = Compress(column, array);
+    if (!result.ok() || (*result)->size() > max_bytes_) {
+      return;
+    }
+    compressed = *std::move(result);
+    array.reset();
+  }
+
+  absl::MutexLock lock(&mu_);
+  auto [it, inserted] = entries_.try_emplace(std::move(key));
+  if (!inserted) {
+    return;  // Inserted by a concurrent query.
+  }
+  Entry& entry = it->second;
+  entry.column_info = GetColumnInfoLocked(column);
+  entry.decoded_bytes = decoded_bytes;
+  ColumnInfo& info = *entry.column_info;
+  info.decoded_bytes += decoded_bytes;
+  info.evicted_decoded_bytes -=
+      std::min(info.evicted_decoded_bytes, decoded_bytes);
+  SetDataLocked(it->first, &entry, std::move(array), std::move(compressed));
+  EvictLocked();
+}
+
+ResidentColumnStoreStats ResidentColumnStore::Stats() const {
+  absl::MutexLock lock(&mu_);
+  return stats_;
+}
+
+std::string ResidentColumnStore::Key(const std::string_view file_key,
+                                     const int record_batch_index,
+                                     const std::string_view column) {
+  return absl::StrCat(file_key, "\n", record_batch_index, "\n", column);
+}
+
+ResidentColumnStore::ColumnInfo* ResidentColumnStore::GetColumnInfoLocked(
+    const std::string_view column) {
+  return &columns_[column];
+}
+
+void ResidentColumnStore::SetDataLocked(
+    const std::string& key, Entry* const entry,
+    std::shared_ptr<arrow::Array> decoded,
+    std::shared_ptr<arrow::Buffer> compressed) {
+  entry->column_info->lru.push_front(key);
+  entry->lru_position = entry->column_info->lru.begin();
+  ReplaceDataLocked(entry, std::move(decoded), std::move(compressed));
+}
+
+void ResidentColumnStore::ReplaceDataLocked(
+    Entry* const entry, std::shared_ptr<arrow::Array> decoded,
+    std::shared_ptr<arrow::Buffer> compressed) {
+  if (entry->decoded != nullptr) {
+    --stats_.num_hot_entries;
+    stats_.hot_bytes -= entry->decoded_bytes;
+  } else if (entry->compressed != nullptr) {
+    --stats_.num_cold_entries;
+    stats_.cold_bytes -= entry->compressed->size();
+  }
+  entry->decoded = std::move(decoded);
+  entry->compressed = std::move(compressed);
+  if (entry->decoded != nullptr) {
+    ++stats_.num_hot_entries;
+    stats_.hot_bytes += entry->decoded_bytes;
+  } else if (entry->compressed != nullptr) {
+    ++stats_.num_cold_entries;
+    stats_.cold_bytes += entry->compressed->size();
+    entry->column_info->compressed_decoded_bytes += entry->decoded_bytes;
+    entry->column_info->compressed_bytes += entry->compressed->size();
+  }
+}
+
+void ResidentColumnStore::EraseEntryLocked(const std::string& key) {
+  const auto it = entries_.find(key);
+  Entry& entry = it->second;
+  ReplaceDataLocked(&entry, nullptr, nullptr);
+  ColumnInfo& info = *entry.column_info;
+  info.decoded_bytes -= entry.decoded_bytes;
+  info.evicted_decoded_bytes += entry.decoded_bytes;
+  info.lru.erase(entry.lru_position);
+  entries_.erase(it);
+  ++stats_.evictions;
+}
+
+void ResidentColumnStore::EvictLocked() {
+  while (stats_.hot_bytes + stats_.cold_bytes > max_bytes_) {
+    ColumnInfo* coldest = nullptr;
+    for (auto& [column, info] : columns_) {
+      if (!info.lru.empty() &&
+          (coldest == nullptr || info.temperature < coldest->temperature)) {
+        coldest = &info;
+      }
+    }
+    if (coldest == nullptr) {
+      return;
+    }
+    EraseEntryLocked(coldest->lru.back());
+  }
+}
+
+}  // namespace seqr
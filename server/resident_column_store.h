@@ -0,0 +1,133 @@
+#pragma once
+
+#include <absl/base/thread_annotations.h>
+#include <absl/container/flat_hash_map.h>
+#include <absl/container/node_hash_map.h>
+#include <absl/status/statusor.h>
+#include <absl/synchronization/mutex.h>
+#include <arrow/array.h>
+#include <arrow/buffer.h>
+#include <arrow/memory_pool.h>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace seqr {
+
+struct ResidentColumnStoreStats {
+  int64_t hot_hits = 0;
+  int64_t cold_hits = 0;  // Decompressed on lookup.
+  int64_t misses = 0;
+  int64_t evictions = 0;
+  int64_t num_hot_entries = 0;
+  int64_t num_cold_entries = 0;
+  int64_t hot_bytes = 0;
+  int64_t cold_bytes = 0;
+};
+
+// Keeps decoded columns of Arrow files in memory across queries, so they don't
+// have to be decompressed from the file for every query. Entries are keyed by
+// file, record batch index and column name. Hot columns are stored decoded,
+// while cold columns are stored compressed with LZ4, which decompresses much
+// faster than the zstd level the files are written with.
+//
+// Column temperature is tracked from the filter and projection columns of
+// queries, decaying over time. The hottest columns are decoded as long as
+// they fit into max_bytes, and the remaining ones are compressed. Entries are
+// converted lazily when they're looked up. When over budget, entries of the
+// coldest columns are evicted first. Thread-safe.
+class ResidentColumnStore {
+ public:
+  explicit ResidentColumnStore(int64_t max_bytes);
+
+  ResidentColumnStore(const ResidentColumnStore&) = delete;
+  ResidentColumnStore& operator=(const ResidentColumnStore&) = delete;
+
+  // Updates the column temperatures and decides which columns are hot. Called
+  // once per query, before scanning. Filter columns are decoded for every
+  // record batch, so they weigh more than columns that are only projected.
+  void RecordQuery(const std::vector<std::string>& filter_columns,
+                   const std::vector<std::string>& projection_columns);
+
+  // Returns nullptr if the column isn't resident. Cold entries are
+  // decompressed into memory_pool, e.g. a query's QueryMemoryPool, unless
+  // they're promoted to hot, in which case the store owns their memory.
+  absl::StatusOr<std::shared_ptr<arrow::Array>> Lookup(
+      std::string_view file_key, int record_batch_index,
+      std::string_view column,
+      arrow::MemoryPool* memory_pool = arrow::default_memory_pool());
+
+  // Columns that reference the file's buffer without copying, i.e. that
+  // weren't compressed in the file, are ignored. The array may be allocated
+  // from a query's memory pool: entries are copied or compressed into memory
+  // owned by the store.
+  void Insert(std::string_view file_key, int record_batch_index,
+              std::string_view column, std::shared_ptr<arrow::Array> array);
+
+  ResidentColumnStoreStats Stats() const;
+
+ private:
+  struct ColumnInfo {
+    double temperature = 0;
+    bool hot = true;
+    // Decoded size of the resident entries.
+    int64_t decoded_bytes = 0;
+    // Decoded size of evicted entries, so that decoded_bytes +
+    // evicted_decoded_bytes estimates the size of the column if it were fully
+    // hot. Evicted entries aren't tracked individually, so inserted entries
+    // are assumed to replace evicted ones.
+    int64_t evicted_decoded_bytes = 0;
+    // Totals of all compressed entries, to estimate the compression ratio.
+    int64_t compressed_decoded_bytes = 0;
+    int64_t compressed_bytes = 0;
+    // Keys of resident entries, most recently used first.
+    std::list<std::string> lru;
+  };
+
+  // Exactly one of decoded and compressed is set.
+  struct Entry {
+    ColumnInfo* column_info = nullptr;
+    int64_t decoded_bytes = 0;
+    // Set for hot entries.
+    std::shared_ptr<arrow::Array> decoded;
+    // Set for cold entries.
+    std::shared_ptr<arrow::Buffer> compressed;
+    std::list<std::string>::iterator lru_position;
+  };
+
+  static std::string Key(std::string_view file_key, int record_batch_index,
+                         std::string_view column);
+
+  ColumnInfo* GetColumnInfoLocked(std::string_view column)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Stores the data of a new entry.
+  void SetDataLocked(const std::string& key, Entry* entry,
+                     std::shared_ptr<arrow::Array> decoded,
+                     std::shared_ptr<arrow::Buffer> compressed)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Replaces the data of a resident entry, e.g. to promote or demote it.
+  void ReplaceDataLocked(Entry* entry, std::shared_ptr<arrow::Array> decoded,
+                         std::shared_ptr<arrow::Buffer> compressed)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Erases the entry, keeping only its decoded size.
+  void EraseEntryLocked(const std::string& key)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  void EvictLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const int64_t max_bytes_;
+  mutable absl::Mutex mu_;
+  // Pointers to the values are stable.
+  absl::node_hash_map<std::string, ColumnInfo> columns_ ABSL_GUARDED_BY(mu_);
+  absl::flat_hash_map<std::string, Entry> entries_ ABSL_GUARDED_BY(mu_);
+  ResidentColumnStoreStats stats_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace seqr
@@ -0,0 +1,143 @@
+#include "resident_column_store.h"
+
+#include <arrow/array/builder_primitive.h>
+#include <arrow/memory_pool.h>
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace seqr {
+
+namespace {
+
+// 8000 bytes decoded, but compresses well.
+std::shared_ptr<arrow::Array> MakeColumn(
+    arrow::MemoryPool* const memory_pool = arrow::default_memory_pool()) {
+  arrow::Int64Builder builder(memory_pool);
+  EXPECT_TRUE(builder.AppendValues(std::vector<int64_t>(1000, 42)).ok());
+  std::shared_ptr<arrow::Array> result;
+  EXPECT_TRUE(builder.Finish(&result).ok());
+  return result;
+}
+
+TEST(ResidentColumnStore, StoresHotColumnsDecoded) {
+  ResidentColumnStore column_store(1 << 20);
+  column_store.RecordQuery({"AF"}, {"xpos"});
+  const auto column = MakeColumn();
+  EXPECT_TRUE(*column_store.Lookup("file", 0, "AF") == nullptr);
+  column_store.Insert("file", 0, "AF", column);
+
+  const auto result = column_store.Lookup("file", 0, "AF");
+  ASSERT_TRUE(result.ok()) << result.status();
+  ASSERT_TRUE(*result != nullptr);
+  EXPECT_TRUE((*result)->Equals(*column));
+  EXPECT_TRUE(*column_store.Lookup("file", 1, "AF") == nullptr);
+  EXPECT_TRUE(*column_store.Lookup("other", 0, "AF") == nullptr);
+  EXPECT_TRUE(*column_store.Lookup("file", 0, "xpos") == nullptr);
+
+  const auto stats = column_store.Stats();
+  EXPECT_EQ(stats.hot_hits, 1);
+  EXPECT_EQ(stats.misses, 4);
+  EXPECT_EQ(stats.num_hot_entries, 1);
+  EXPECT_EQ(stats.hot_bytes, 8000);
+  EXPECT_EQ(stats.num_cold_entries, 0);
+}
+
+TEST(ResidentColumnStore, CopiesColumnsOutOfQueryMemory) {
+  ResidentColumnStore column_store(1 << 20);
+  column_store.RecordQuery({"AF"}, {});
+  arrow::ProxyMemoryPool query_memory_pool(arrow::default_memory_pool());
+  auto column = MakeColumn(&query_memory_pool);
+  column_store.Insert("file", 0, "AF", column);
+  column.reset();
+  EXPECT_EQ(query_memory_pool.bytes_allocated(), 0);
+
+  const auto result = column_store.Lookup("file", 0, "AF");
+  ASSERT_TRUE(result.ok()) << result.status();
+  ASSERT_TRUE(*result != nullptr);
+  EXPECT_TRUE((*result)->Equals(*MakeColumn()));
+}
+
+TEST(ResidentColumnStore, CompressesColumnsThatDontFitDecoded) {
+  ResidentColumnStore column_store(4000);
+  column_store.RecordQuery({"AF"}, {});
+  const auto column = MakeColumn();
+  column_store.Insert("file", 0, "AF", column);
+
+  auto stats = column_store.Stats();
+  EXPECT_EQ(stats.num_hot_entries, 0);
+  EXPECT_EQ(stats.num_cold_entries, 1);
+  EXPECT_LT(stats.cold_bytes, 4000);
+
+  const auto result = column_store.Lookup("file", 0, "AF");
+  ASSERT_TRUE(result.ok()) << result.status();
+  ASSERT_TRUE(*result != nullptr);
+  EXPECT_TRUE((*result)->Equals(*column));
+  EXPECT_EQ(column_store.Stats().cold_hits, 1);
+}
+
+TEST(ResidentColumnStore, DecompressesColdColumnsIntoQueryMemory) {
+  ResidentColumnStore column_store(4000);
+  column_store.RecordQuery({"AF"}, {});
+  column_store.Insert("file", 0, "AF", MakeColumn());
+
+  arrow::ProxyMemoryPool query_memory_pool(arrow::default_memory_pool());
+  auto result = column_store.Lookup("file", 0, "AF", &query_memory_pool);
+  ASSERT_TRUE(result.ok()) << result.status();
+  ASSERT_TRUE(*result != nullptr);
+  EXPECT_GE(query_memory_pool.bytes_allocated(), 8000);
+  result = nullptr;
+  EXPECT_EQ(query_memory_pool.bytes_allocated(), 0);
+}
+
+TEST(ResidentColumnStore, AdaptsToColumnTemperature) {
+  // Fits one decoded and one compressed column.
+  ResidentColumnStore column_store(12000);
+  column_store.RecordQuery({"AF"}, {"variantId"});
+  column_store.Insert("file", 0, "AF", MakeColumn());
+  // Evicted, since variantId is colder and both don't fit decoded.
+  column_store.Insert("file", 0, "variantId", MakeColumn());
+  auto stats = column_store.Stats();
+  EXPECT_EQ(stats.num_hot_entries, 1);
+  EXPECT_EQ(stats.evictions, 1);
+
+  // Now that its size is known, variantId is compressed.
+  column_store.RecordQuery({"AF"}, {"variantId"});
+  column_store.Insert("file", 0, "variantId", MakeColumn());
+  stats = column_store.Stats();
+  EXPECT_EQ(stats.num_hot_entries, 1);
+  EXPECT_EQ(stats.num_cold_entries, 1);
+  EXPECT_LE(stats.hot_bytes + stats.cold_bytes, 12000);
+
+  // Once variantId becomes hotter, the entries are swapped on lookup.
+  for (int i = 0; i < 3; ++i) {
+    column_store.RecordQuery({"variantId"}, {});
+  }
+  for (const char* const column : {"AF", "variantId", "variantId"}) {
+    const auto result = column_store.Lookup("file", 0, column);
+    ASSERT_TRUE(result.ok()) << result.status();
+    ASSERT_TRUE(*result != nullptr) << column;
+  }
+  stats = column_store.Stats();
+  EXPECT_EQ(stats.num_hot_entries, 1);
+  EXPECT_EQ(stats.num_cold_entries, 1);
+  EXPECT_EQ(stats.hot_hits, 2);  // AF before being demoted, then variantId.
+  EXPECT_EQ(stats.cold_hits, 1);
+  EXPECT_LE(stats.hot_bytes + stats.cold_bytes, 12000);
+}
+
+TEST(ResidentColumnStore, IgnoresUncompressedColumns) {
+  ResidentColumnStore column_store(1 << 20);
+  column_store.RecordQuery({"AF"}, {});
+  // Slices of a parent buffer, like columns read from an uncompressed file.
+  const auto column = MakeColumn();
+  const auto parent = column->data()->buffers[1];
+  const auto view = std::make_shared<arrow::Int64Array>(
+      column->length(), arrow::SliceBuffer(parent, 0, parent->size()));
+  column_store.Insert("file", 0, "AF", view);
+  EXPECT_TRUE(*column_store.Lookup("file", 0, "AF") == nullptr);
+}
+
+}  // namespace
+
+}  // namespace seqr
@@ -0,0 +1,129 @@
+#include "result_size_estimator.h"
+
+#include <absl/random/distributions.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <numeric>
+
+namespace seqr {
+
+namespace {
+
+// Cumulative distribution function of Student's t distribution, using the
+// closed forms for integer degrees of freedom (Abramowitz and Stegun 26.7.3
+// and 26.7.4).
+double StudentTCdf(const double t, const int degrees_of_freedom) {
+  const double theta = std::atan(t / std::sqrt(degrees_of_freedom));
+  const double cos_squared = std::cos(theta) * std::cos(theta);
+  double sum = 1;
+  double term = 1;
+  double a = 0;  // Probability of |T| < |t|, with the sign of t.
+  if (degrees_of_freedom % 2 == 1) {
+    for (int k = 3; k <= degrees_of_freedom - 2; k += 2) {
+      term *= (k - 1.0) / k * cos_squared;
+      sum += term;
+    }
+    if (degrees_of_freedom == 1) {
+      sum = 0;
+    }
+    a = 2 / std::numbers::pi *
+        (theta + std::sin(theta) * std::cos(theta) * sum);
+  } else {
+    for (int k = 2; k <= degrees_of_freedom - 2; k += 2) {
+      term *= (k - 1.0) / k * cos_squared;
+      sum += term;
+    }
+    a = std::sin(theta) * sum;
+  }
+  return (1 + a) / 2;
+}
+
+}  // namespace
+
+double StudentTQuantile(const double probability,
+                        const int degrees_of_freedom) {
+  if (probability < 0.5) {
+    return -StudentTQuantile(1 - probability, degrees_of_freedom);
+  }
+  // Bisection, as the CDF is monotonic.
+  double lower = 0;
+  double upper = 1;
+  while (StudentTCdf(upper, degrees_of_freedom) < probability) {
+    lower = upper;
+    upper *= 2;
+  }
+  for (int i = 0; i < 100; ++i) {
+    const double middle = (lower + upper) / 2;
+    (StudentTCdf(middle, degrees_of_freedom) < probability ? lower : upper) =
+        middle;
+  }
+  return (lower + upper) / 2;
+}
+
+size_t ResultSizeSampleSize(const size_t num_files,
+                            const double sample_fraction) {
+  const auto fraction_size =
+      static_cast<size_t>(std::ceil(sample_fraction * num_files));
+  return std::min(num_files, std::max<size_t>(2, fraction_size));
+}
+
+std::vector<size_t> StratifiedSample(const size_t population_size,
+                                     const size_t num_samples,
+                                     absl::BitGenRef bit_gen) {
+  std::vector<size_t> result;
+  if (num_samples == 0) {
+    return result;
+  }
+  if (num_samples >= population_size) {
+    result.resize(population_size);
+    std::iota(result.begin(), result.end(), 0);
+    return result;
+  }
+  result.reserve(num_samples);
+  for (size_t i = 0; i < num_samples; ++i) {
+    const size_t begin = i * population_size / num_samples;
+    const size_t end = (i + 1) * population_size / num_samples;
+    result.push_back(absl::Uniform<size_t>(bit_gen, begin, end));
+  }
+  return result;
+}
+
+ResultSizeEstimate EstimateResultSize(
+    const std::vector<int64_t>& sampled_matches, const int num_files,
+    const double confidence) {
+  ResultSizeEstimate result;
+  result.num_sampled_files = sampled_matches.size();
+  result.num_files = num_files;
+  const int64_t observed =
+      std::accumulate(sampled_matches.begin(), sampled_matches.end(),
+                      static_cast<int64_t>(0));
+  const double n = sampled_matches.size();
+  if (n == 0 || n >= num_files) {  // Nothing to extrapolate.
+    result.estimated_rows = result.lower_bound = result.upper_bound = observed;
+    return result;
+  }
+
+  const double mean = observed / n;
+  double sum_of_squares = 0;
+  for (const int64_t matches : sampled_matches) {
+    sum_of_squares += (matches - mean) * (matches - mean);
+  }
+  const double sample_variance = n > 1 ? sum_of_squares / (n - 1) : 0;
+  const double estimate = num_files * mean;
+  const double standard_error =
+      num_files * std::sqrt((1 - n / num_files) * sample_variance / n);
+  const double t = n > 1 ? StudentTQuantile(confidence, n - 1) : 0;
+
+  result.estimated_rows = std::llround(estimate);
+  result.lower_bound =
+      std::max(observed, static_cast<int64_t>(
+                             std::floor(estimate - t * standard_error)));
+  result.upper_bound =
+      std::max(result.lower_bound,
+               static_cast<int64_t>(std::ceil(estimate + t * standard_error)));
+  return result;
+}
+
+}  // namespace seqr
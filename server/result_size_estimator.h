@@ -0,0 +1,47 @@
+#pragma once
+
+#include <absl/random/bit_gen_ref.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace seqr {
+
+struct ResultSizeEstimate {
+  int64_t estimated_rows = 0;
+  // Confidence bounds for the number of matching rows. The lower bound is at
+  // least the number of matches that were actually observed.
+  int64_t lower_bound = 0;
+  int64_t upper_bound = 0;
+  int num_sampled_files = 0;
+  int num_files = 0;
+};
+
+// Returns the number of files to sample: the given fraction, but at least two
+// files, so the spread of the matches can be estimated.
+size_t ResultSizeSampleSize(size_t num_files, double sample_fraction);
+
+// Splits [0, population_size) into num_samples contiguous strata of nearly
+// equal size and picks a random element of each. Files are usually ordered by
+// genomic position, so the sample covers all regions of the genome. Returns
+// the sorted indexes.
+std::vector<size_t> StratifiedSample(size_t population_size,
+                                     size_t num_samples,
+                                     absl::BitGenRef bit_gen);
+
+// Returns the quantile of Student's t distribution for the given probability,
+// which must be in (0, 1).
+double StudentTQuantile(double probability, int degrees_of_freedom);
+
+// Extrapolates the number of matching rows in num_files files from the
+// numbers of matches in the sampled files, using the expansion estimator. Each
+// bound holds with the given one-sided confidence, using the Student t
+// quantile for the sample size and the finite population correction. Small
+// samples therefore have wide bounds. The variance is estimated as if the
+// sample was unstratified, which overestimates it if the strata differ.
+ResultSizeEstimate EstimateResultSize(
+    const std::vector<int64_t>& sampled_matches, int num_files,
+    double confidence);
+
+}  // namespace seqr
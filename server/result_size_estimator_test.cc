@@ -0,0 +1,82 @@
+#include "result_size_estimator.h"
+
+#include <absl/random/random.h>
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace seqr {
+
+namespace {
+
+TEST(ResultSizeEstimator, SampleSize) {
+  EXPECT_EQ(ResultSizeSampleSize(0, 0.05), 0);
+  EXPECT_EQ(ResultSizeSampleSize(1, 0.05), 1);
+  EXPECT_EQ(ResultSizeSampleSize(10, 0.05), 2);
+  EXPECT_EQ(ResultSizeSampleSize(100, 0.05), 5);
+  EXPECT_EQ(ResultSizeSampleSize(101, 0.05), 6);
+  EXPECT_EQ(ResultSizeSampleSize(100, 1), 100);
+}
+
+TEST(ResultSizeEstimator, StratifiedSample) {
+  absl::BitGen bit_gen;
+  EXPECT_TRUE(StratifiedSample(10, 0, bit_gen).empty());
+  EXPECT_EQ(StratifiedSample(3, 5, bit_gen), (std::vector<size_t>{0, 1, 2}));
+
+  // One element of each of the strata [0, 3), [3, 6) and [6, 10).
+  for (int i = 0; i < 100; ++i) {
+    const auto sample = StratifiedSample(10, 3, bit_gen);
+    ASSERT_EQ(sample.size(), 3);
+    EXPECT_LT(sample[0], 3);
+    EXPECT_GE(sample[1], 3);
+    EXPECT_LT(sample[1], 6);
+    EXPECT_GE(sample[2], 6);
+    EXPECT_LT(sample[2], 10);
+  }
+}
+
+TEST(ResultSizeEstimator, ExactIfAllFilesSampled) {
+  const auto estimate = EstimateResultSize({3, 0, 5}, 3, 0.99);
+  EXPECT_EQ(estimate.estimated_rows, 8);
+  EXPECT_EQ(estimate.lower_bound, 8);
+  EXPECT_EQ(estimate.upper_bound, 8);
+  EXPECT_EQ(estimate.num_sampled_files, 3);
+  EXPECT_EQ(estimate.num_files, 3);
+}
+
+TEST(ResultSizeEstimator, Extrapolates) {
+  // Without variance, the bounds match the estimate.
+  auto estimate = EstimateResultSize({10, 10}, 100, 0.99);
+  EXPECT_EQ(estimate.estimated_rows, 1000);
+  EXPECT_EQ(estimate.lower_bound, 1000);
+  EXPECT_EQ(estimate.upper_bound, 1000);
+
+  // Mean 10, sample variance 200, standard error
+  // 100 * sqrt((1 - 2 / 100) * 200 / 2) = 989.9. The 75% quantile of the t
+  // distribution with one degree of freedom is 1.
+  estimate = EstimateResultSize({0, 20}, 100, 0.75);
+  EXPECT_EQ(estimate.estimated_rows, 1000);
+  EXPECT_EQ(estimate.lower_bound, 20);  // Clamped to the observed matches.
+  EXPECT_EQ(estimate.upper_bound, 1990);
+
+  // Standard error 244.9, and the t quantile for three degrees of freedom is
+  // 4.54 instead of the normal distribution's 2.33.
+  estimate = EstimateResultSize({100, 120, 110, 90}, 40, 0.99);
+  EXPECT_EQ(estimate.estimated_rows, 4200);
+  EXPECT_EQ(estimate.lower_bound, 3087);
+  EXPECT_EQ(estimate.upper_bound, 5313);
+}
+
+TEST(ResultSizeEstimator, StudentTQuantile) {
+  EXPECT_NEAR(StudentTQuantile(0.99, 1), 31.821, 1e-3);
+  EXPECT_NEAR(StudentTQuantile(0.99, 2), 6.965, 1e-3);
+  EXPECT_NEAR(StudentTQuantile(0.99, 9), 2.821, 1e-3);
+  EXPECT_NEAR(StudentTQuantile(0.975, 30), 2.042, 1e-3);
+  EXPECT_NEAR(StudentTQuantile(0.99, 1000), 2.330, 1e-3);
+  EXPECT_NEAR(StudentTQuantile(0.01, 9), -2.821, 1e-3);
+  EXPECT_NEAR(StudentTQuantile(0.5, 5), 0, 1e-9);
+}
+
+}  // namespace
+
+}  // namespace seqr
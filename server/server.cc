@@ -1,52 +1,124 @@
 #include "server.h"
 
 #include <absl/base/thread_annotations.h>
+#include <absl/container/flat_hash_set.h>
 #include <absl/flags/flag.h>
+#include <absl/random/random.h>
 #include <absl/status/statusor.h>
+#include <absl/strings/cord.h>
+#include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 #include <absl/synchronization/blocking_counter.h>
 #include <absl/synchronization/mutex.h>
 #include <absl/time/time.h>
 #include <arrow/array/builder_binary.h>
 #include <arrow/compute/api_scalar.h>
+#include <arrow/compute/cast.h>
+#include <arrow/compute/exec.h>
 #include <arrow/compute/function.h>
 #include <arrow/dataset/dataset.h>
 #include <arrow/dataset/scanner.h>
 #include <arrow/io/memory.h>
 #include <arrow/ipc/options.h>
-#include <arrow/ipc/reader.h>
 #include <arrow/ipc/writer.h>
+#include <grpcpp/ext/health_check_service_server_builder_option.h>
 #include <grpcpp/ext/proto_server_reflection_plugin.h>
 #include <grpcpp/grpcpp.h>
 #include <grpcpp/health_check_service_interface.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <functional>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <numeric>
 #include <optional>
 #include <queue>
 #include <string_view>
 #include <thread>  // NOLINT(build/c++11)
+#include <tuple>
 #include <vector>
 
+#include "arrow_file_scanner.h"
+#include "conjunct_ordering.h"
+#include "coordinator.h"
+#include "dataset_catalog.h"
+#include "file_index.h"
+#include "flight_service.h"
+#include "health.grpc.pb.h"
+#include "inheritance.h"
+#include "parquet_reader.h"
+#include "predicate_cache.h"
+#include "query_memory_pool.h"
+#include "resident_column_store.h"
+#include "result_size_estimator.h"
 #include "seqr_query_service.grpc.pb.h"
 #include "string_list_contains_any.h"
+#include "xpos_intervals.h"
 
 ABSL_FLAG(int, num_threads, 16,
           "The number of thread pool workers. This implicitly puts a limit on "
           "the amount of memory that's required, which is important for Cloud "
           "Run deployments that only have 8 GB of RAM.");
+ABSL_FLAG(int64_t, max_query_memory_bytes, 0,
+          "Queries whose Arrow allocations exceed this many bytes fail with "
+          "RESOURCE_EXHAUSTED. Zero means no limit.");
+ABSL_FLAG(int64_t, compound_het_max_candidates_factor, 100,
+          "Compound het queries fail if more than this multiple of max_rows "
+          "variants pass the filter, before they're paired.");
+ABSL_FLAG(absl::Duration, flight_result_ttl, absl::Minutes(1),
+          "Arrow Flight results that haven't been fetched using DoGet within "
+          "this time are dropped.");
+ABSL_FLAG(int, flight_max_pending_results, 100,
+          "Arrow Flight queries fail with RESOURCE_EXHAUSTED while this many "
+          "results haven't been fetched.");
+ABSL_FLAG(int64_t, flight_max_pending_bytes, 1LL << 30,
+          "Arrow Flight queries fail with RESOURCE_EXHAUSTED if the total size "
+          "of results that haven't been fetched would exceed this.");
+ABSL_FLAG(int64_t, predicate_cache_max_bytes, 256LL << 20,
+          "Memory budget for caching the results of filter conjuncts per "
+          "record batch of Arrow files, across queries. Disabled if 0.");
+ABSL_FLAG(int64_t, resident_column_store_max_bytes, 1LL << 30,
+          "Memory budget for keeping decoded columns of registered datasets "
+          "across queries, with frequently used columns decoded and the "
+          "others compressed. Disabled if 0.");
+ABSL_FLAG(double, result_size_sample_fraction, 0.05,
+          "Fraction of the selected files that are sampled for queries that "
+          "request a result size estimation without specifying a fraction.");
+ABSL_FLAG(bool, log_conjunct_stats, false,
+          "Whether to log the evaluation stats of the filter conjuncts for "
+          "every query.");
+ABSL_FLAG(bool, log_query_memory, false,
+          "Whether to log the peak memory usage of every query.");
 
 namespace seqr {
 namespace {
 
+// Confidence of each bound of result size estimates.
+constexpr double kResultSizeConfidence = 0.99;
+
+// Payload of errors for exceeding max_rows, which the gRPC service reports as
+// kMaxRowsExceededMetadataKey.
+constexpr char kMaxRowsExceededPayload[] = "seqr.MaxRowsExceeded";
+
+absl::Status MaxRowsExceededError(const std::string_view message) {
+  absl::Status result = absl::CancelledError(message);
+  result.SetPayload(kMaxRowsExceededPayload, absl::Cord());
+  return result;
+}
+
 absl::Status MaxRowsExceededError(const size_t max_rows) {
-  return absl::CancelledError(
+  return MaxRowsExceededError(
       absl::StrCat("More than ", max_rows,
                    " rows matched; please use a more restrictive search"));
 }
 
+bool IsMaxRowsExceeded(const absl::Status& status) {
+  return status.GetPayload(kMaxRowsExceededPayload).has_value();
+}
+
 // Adapted from the Abseil thread pool.
 class ThreadPool {
  public:
@@ -183,8 +255,72 @@ struct ScannerOptions {
   std::vector<std::string> projection_columns;
   arrow::compute::Expression filter_expression;
   size_t max_rows = 0;
+  // Normalized xpos intervals requested in addition to filter_expression.
+  std::vector<XposInterval> xpos_intervals;
+  // If true, xpos_intervals are applied using binary search. Otherwise they're
+  // already part of filter_expression.
+  bool xpos_sorted = false;
+  // Point lookups, which are already part of filter_expression. File indexes
+  // are only used to skip files and record batches that can't match.
+  IndexLookup index_lookup;
+  // If set, compound het pairs are found after scanning all files. The
+  // projection columns then include CompoundHetColumns().
+  const seqr::QueryRequest::InheritanceFilter* compound_het_filter = nullptr;
+  // Limit for the compound het candidates, since max_rows applies to the
+  // pairs.
+  size_t max_compound_het_candidates = 0;
+  // Per-query pool for all Arrow allocations, see QueryMemoryPool.
+  arrow::MemoryPool* memory_pool = arrow::default_memory_pool();
+  // Shared by all queries. Only used for Arrow files.
+  PredicateCache* predicate_cache = nullptr;
+  // Shared by all queries. Only used for Arrow files of registered datasets.
+  ResidentColumnStore* column_store = nullptr;
+
+  // Limit for the rows that pass the filter.
+  size_t max_filtered_rows() const {
+    return compound_het_filter != nullptr ? max_compound_het_candidates
+                                          : max_rows;
+  }
+
+  // Error for exceeding max_filtered_rows().
+  absl::Status MaxFilteredRowsExceededError() const {
+    if (compound_het_filter == nullptr) {
+      return MaxRowsExceededError(max_rows);
+    }
+    return MaxRowsExceededError(absl::StrCat(
+        "More than ", max_compound_het_candidates,
+        " compound het candidates matched; please use a more restrictive "
+        "search"));
+  }
 };
 
+// Returns an expression proto for calling a function with SetLookupOptions on a
+// column.
+seqr::QueryRequest::Expression SetLookupCall(
+    const std::string_view function_name, const std::string_view column,
+    const google::protobuf::RepeatedPtrField<std::string>& values) {
+  seqr::QueryRequest::Expression result;
+  auto* const call = result.mutable_call();
+  call->set_function_name(std::string(function_name));
+  call->add_arguments()->set_column(std::string(column));
+  *call->mutable_set_lookup_options()->mutable_values() = values;
+  return result;
+}
+
+// Returns --compound_het_max_candidates_factor times max_rows, saturating
+// instead of overflowing.
+size_t MaxCompoundHetCandidates(const int64_t max_rows) {
+  const int64_t factor = std::max<int64_t>(
+      absl::GetFlag(FLAGS_compound_het_max_candidates_factor), 1);
+  if (max_rows <= 0) {
+    return 0;
+  }
+  if (max_rows > std::numeric_limits<int64_t>::max() / factor) {
+    return std::numeric_limits<size_t>::max();
+  }
+  return static_cast<size_t>(max_rows * factor);
+}
+
 absl::StatusOr<ScannerOptions> BuildScannerOptions(
     const seqr::QueryRequest& request) {
   auto filter_expression = BuildFilterExpression(request.filter_expression());
@@ -197,56 +333,215 @@ absl::StatusOr<ScannerOptions> BuildScannerOptions(
         absl::StrCat("Invalid max_rows value of ", request.max_rows()));
   }
 
-  return ScannerOptions{{request.projection_columns().begin(),
-                         request.projection_columns().end()},
-                        *std::move(filter_expression),
-                        static_cast<size_t>(request.max_rows())};
+  std::vector<XposInterval> xpos_intervals;
+  xpos_intervals.reserve(request.xpos_intervals_size());
+  for (const auto& interval : request.xpos_intervals()) {
+    if (interval.start_xpos() >= interval.end_xpos()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid xpos interval [", interval.start_xpos(), ", ",
+                       interval.end_xpos(), ")"));
+    }
+    xpos_intervals.push_back({interval.start_xpos(), interval.end_xpos()});
+  }
+  xpos_intervals = NormalizeXposIntervals(std::move(xpos_intervals));
+
+  if (!xpos_intervals.empty() && !request.xpos_sorted()) {
+    *filter_expression = arrow::compute::and_(
+        XposIntervalsExpression(xpos_intervals), *std::move(filter_expression));
+  }
+
+  // Point lookups are regular filters, so results don't depend on indexes.
+  for (const auto& [function_name, column, values] :
+       {std::make_tuple("string_list_contains_any", "geneIds",
+                        &request.gene_ids()),
+        std::make_tuple("is_in", "variantId", &request.variant_ids()),
+        std::make_tuple("is_in", "rsid", &request.rsids())}) {
+    if (values->empty()) {
+      continue;
+    }
+    auto lookup_expression =
+        BuildFilterExpression(SetLookupCall(function_name, column, *values));
+    if (!lookup_expression.ok()) {
+      return lookup_expression.status();
+    }
+    *filter_expression = arrow::compute::and_(*std::move(lookup_expression),
+                                              *std::move(filter_expression));
+  }
+
+  std::vector<std::string> projection_columns{
+      request.projection_columns().begin(), request.projection_columns().end()};
+  const seqr::QueryRequest::InheritanceFilter* compound_het_filter = nullptr;
+  if (request.has_inheritance_filter()) {
+    const auto& inheritance_filter = request.inheritance_filter();
+    auto inheritance_expression = InheritanceExpression(inheritance_filter);
+    if (!inheritance_expression.ok()) {
+      return inheritance_expression.status();
+    }
+    *filter_expression = arrow::compute::and_(
+        *std::move(inheritance_expression), *std::move(filter_expression));
+
+    if (inheritance_filter.mode() ==
+        seqr::QueryRequest::InheritanceFilter::COMPOUND_HET) {
+      compound_het_filter = &inheritance_filter;
+      for (auto& column : CompoundHetColumns()) {
+        if (std::find(projection_columns.begin(), projection_columns.end(),
+                      column) == projection_columns.end()) {
+          projection_columns.push_back(std::move(column));
+        }
+      }
+    }
+  }
+
+  return ScannerOptions{
+      std::move(projection_columns),
+      *std::move(filter_expression),
+      static_cast<size_t>(request.max_rows()),
+      std::move(xpos_intervals),
+      request.xpos_sorted(),
+      IndexLookup{{request.gene_ids().begin(), request.gene_ids().end()},
+                  {request.variant_ids().begin(), request.variant_ids().end()},
+                  {request.rsids().begin(), request.rsids().end()}},
+      compound_het_filter,
+      MaxCompoundHetCandidates(request.max_rows())};
 }
 
-absl::StatusOr<arrow::RecordBatchVector> ProcessArrowUrl(
-    const UrlReader& url_reader, const std::string_view url,
-    const ScannerOptions& scanner_options,
-    std::atomic<size_t>* const num_rows) {
-  // Early cancellation.
-  if (*num_rows > scanner_options.max_rows) {
-    return MaxRowsExceededError(scanner_options.max_rows);
+// Returns the indexes of the URLs that need to be processed, skipping files
+// whose xpos bounds don't overlap any of the requested xpos intervals.
+absl::StatusOr<std::vector<size_t>> SelectArrowUrls(
+    const seqr::QueryRequest& request, const ScannerOptions& scanner_options) {
+  const size_t num_arrow_urls = request.arrow_urls_size();
+  const auto& bounds = request.arrow_url_xpos_bounds();
+  if (!bounds.empty() && static_cast<size_t>(bounds.size()) != num_arrow_urls) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Expected ", num_arrow_urls,
+                     " arrow_url_xpos_bounds, got ", bounds.size()));
+  }
+  if (request.index_urls_size() > 0 &&
+      static_cast<size_t>(request.index_urls_size()) != num_arrow_urls) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Expected ", num_arrow_urls, " index_urls, got ",
+                     request.index_urls_size()));
   }
 
-  const auto data = url_reader.Read(url);
+  std::vector<size_t> result;
+  result.reserve(num_arrow_urls);
+  for (size_t i = 0; i < num_arrow_urls; ++i) {
+    if (!bounds.empty() && !scanner_options.xpos_intervals.empty() &&
+        !OverlapsAnyXposInterval(
+            scanner_options.xpos_intervals,
+            {bounds[i].start_xpos(), bounds[i].end_xpos()})) {
+      continue;
+    }
+    result.push_back(i);
+  }
+  return result;
+}
+
+// Returns for each record batch whether it may match the point lookups.
+absl::StatusOr<std::vector<bool>> ReadIndexMatches(
+    const UrlReader& url_reader, const std::string_view index_url,
+    const IndexLookup& index_lookup) {
+  const auto data = url_reader.Read(index_url);
   if (!data.ok()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Failed to read ", index_url, ": ", data.status().message()));
+  }
+
+  FileIndex file_index;
+  if (!file_index.ParseFromArray((*data)->data(), (*data)->size())) {
     return absl::InvalidArgumentError(
-        absl::StrCat("Failed to read ", url, ": ", data.status().message()));
+        absl::StrCat("Failed to parse file index ", index_url));
   }
 
-  arrow::ipc::IpcReadOptions ipc_read_options;
-  // We parallelize over URLs already, no need for nested parallelism.
-  ipc_read_options.use_threads = false;
+  return MatchRecordBatches(file_index, index_lookup);
+}
 
-  arrow::io::BufferReader buffer_reader{{data->data(), data->size()}};
-  auto record_batch_file_reader =
-      arrow::ipc::RecordBatchFileReader::Open(&buffer_reader, ipc_read_options);
-  if (!record_batch_file_reader.ok()) {
-    return absl::InvalidArgumentError(
-        absl::StrCat("Failed to open record batch reader for ", url, ": ",
-                     record_batch_file_reader.status().ToString()));
+// Returns the type with dictionary-encoded values replaced by the dictionary
+// value type. Returns the same pointer if there are no dictionaries.
+std::shared_ptr<arrow::DataType> DecodedType(
+    const std::shared_ptr<arrow::DataType>& type) {
+  if (type->id() == arrow::Type::DICTIONARY) {
+    return static_cast<const arrow::DictionaryType&>(*type).value_type();
   }
+  if (type->id() == arrow::Type::LIST) {
+    const auto& list_type = static_cast<const arrow::ListType&>(*type);
+    const auto value_type = DecodedType(list_type.value_type());
+    if (value_type != list_type.value_type()) {
+      return arrow::list(list_type.value_field()->WithType(value_type));
+    }
+  }
+  return type;
+}
 
-  const auto schema = (*record_batch_file_reader)->schema();
+// Dictionaries differ between files, but all record batches in the response
+// must have the same schema, so dictionary-encoded columns are decoded.
+absl::StatusOr<std::shared_ptr<arrow::RecordBatch>> DecodeDictionaries(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch,
+    arrow::MemoryPool* const memory_pool) {
+  arrow::compute::ExecContext exec_context(memory_pool);
+  const auto& schema = record_batch->schema();
+  std::vector<std::shared_ptr<arrow::Field>> fields;
+  std::vector<std::shared_ptr<arrow::Array>> columns;
+  bool has_dictionaries = false;
+  for (int i = 0; i < record_batch->num_columns(); ++i) {
+    const auto& field = schema->field(i);
+    const auto& column = record_batch->column(i);
+    const auto decoded_type = DecodedType(field->type());
+    if (decoded_type == field->type()) {
+      fields.push_back(field);
+      columns.push_back(column);
+      continue;
+    }
 
-  const int num_record_batches =
-      (*record_batch_file_reader)->num_record_batches();
-  arrow::RecordBatchVector record_batches;
-  record_batches.reserve(num_record_batches);
-  for (int i = 0; i < num_record_batches; ++i) {
-    auto record_batch = (*record_batch_file_reader)->ReadRecordBatch(i);
-    if (!record_batch.ok()) {
+    has_dictionaries = true;
+    auto decoded_column = arrow::compute::Cast(
+        *column, decoded_type, arrow::compute::CastOptions::Safe(),
+        &exec_context);
+    if (!decoded_column.ok()) {
       return absl::InvalidArgumentError(
-          absl::StrCat("Failed to read record batch ", i, " for ", url, ": ",
-                       record_batch.status().ToString()));
+          absl::StrCat("Failed to decode dictionaries of ", field->name(),
+                       ": ", decoded_column.status().ToString()));
     }
-    record_batches.push_back(std::move(*record_batch));
+    fields.push_back(field->WithType(decoded_type));
+    columns.push_back(*std::move(decoded_column));
+  }
+
+  if (!has_dictionaries) {
+    return record_batch;
   }
+  return arrow::RecordBatch::Make(arrow::schema(std::move(fields)),
+                                  record_batch->num_rows(), std::move(columns));
+}
+
+// Appends the record batch to record_batches. If the xpos intervals haven't
+// been added to the filter because the batch is sorted, only the matching
+// slices are appended.
+absl::Status AppendRecordBatch(
+    std::shared_ptr<arrow::RecordBatch> record_batch, const bool xpos_sorted,
+    const ScannerOptions& scanner_options,
+    arrow::RecordBatchVector* const record_batches) {
+  if (scanner_options.xpos_intervals.empty() || !xpos_sorted) {
+    record_batches->push_back(std::move(record_batch));
+    return absl::OkStatus();
+  }
+
+  auto slices =
+      SliceSortedRecordBatch(*record_batch, scanner_options.xpos_intervals);
+  if (!slices.ok()) {
+    return slices.status();
+  }
+  for (auto& slice : *slices) {
+    record_batches->push_back(std::move(slice));
+  }
+  return absl::OkStatus();
+}
 
+// Applies the projection and filter to the record batches of a file.
+absl::StatusOr<arrow::RecordBatchVector> ScanRecordBatches(
+    const std::string_view url, const std::shared_ptr<arrow::Schema>& schema,
+    arrow::RecordBatchVector record_batches,
+    const ScannerOptions& scanner_options,
+    std::atomic<size_t>* const num_rows) {
   auto in_memory_dataset = std::make_shared<arrow::dataset::InMemoryDataset>(
       schema, std::move(record_batches));
   auto scanner_builder = in_memory_dataset->NewScan();
@@ -270,6 +565,13 @@ absl::StatusOr<arrow::RecordBatchVector> ProcessArrowUrl(
         "Failed to set scanner filter for ", url, ": ", status.ToString()));
   }
 
+  if (const auto status = (*scanner_builder)->Pool(scanner_options.memory_pool);
+      !status.ok()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Failed to set scanner memory pool for ", url, ": ",
+                     status.ToString()));
+  }
+
   // We parallelize over URLs already, no need for nested parallelism.
   if (const auto status = (*scanner_builder)->UseThreads(false); !status.ok()) {
     return absl::InvalidArgumentError(
@@ -286,13 +588,20 @@ absl::StatusOr<arrow::RecordBatchVector> ProcessArrowUrl(
 
   arrow::RecordBatchVector result;
   if (const auto status = (*scanner)->Scan(
-          [&result,
+          [&result, &scanner_options,
            num_rows](arrow::dataset::TaggedRecordBatch tagged_record_batch) {
             auto& record_batch = tagged_record_batch.record_batch;
-            if (record_batch->num_rows() > 0) {
-              *num_rows += record_batch->num_rows();
-              result.push_back(std::move(record_batch));
+            if (record_batch->num_rows() == 0) {
+              return arrow::Status::OK();
+            }
+            auto decoded_record_batch =
+                DecodeDictionaries(record_batch, scanner_options.memory_pool);
+            if (!decoded_record_batch.ok()) {
+              return arrow::Status::Invalid(
+                  decoded_record_batch.status().message());
             }
+            *num_rows += record_batch->num_rows();
+            result.push_back(*std::move(decoded_record_batch));
             return arrow::Status::OK();
           });
       !status.ok()) {
@@ -303,146 +612,729 @@ absl::StatusOr<arrow::RecordBatchVector> ProcessArrowUrl(
   return result;
 }
 
-class QueryServiceImpl final : public seqr::QueryService::Service {
+absl::StatusOr<arrow::RecordBatchVector> ProcessArrowUrl(
+    const UrlReader& url_reader, const std::string_view url,
+    const std::string_view index_url, const ScannerOptions& scanner_options,
+    ConjunctOrdering* const conjunct_ordering,
+    std::atomic<size_t>* const num_rows) {
+  // Early cancellation.
+  if (*num_rows > scanner_options.max_filtered_rows()) {
+    return scanner_options.MaxFilteredRowsExceededError();
+  }
+
+  // An index might allow skipping the whole file, or some record batches.
+  std::vector<bool> record_batch_matches;
+  if (!index_url.empty() && !scanner_options.index_lookup.empty()) {
+    auto index_matches =
+        ReadIndexMatches(url_reader, index_url, scanner_options.index_lookup);
+    if (!index_matches.ok()) {
+      return index_matches.status();
+    }
+    if (std::find(index_matches->begin(), index_matches->end(), true) ==
+        index_matches->end()) {
+      return arrow::RecordBatchVector{};
+    }
+    record_batch_matches = *std::move(index_matches);
+  }
+
+  const auto data = url_reader.Read(url);
+  if (!data.ok()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Failed to read ", url, ": ", data.status().message()));
+  }
+
+  ArrowFileScanOptions arrow_file_scan_options;
+  arrow_file_scan_options.projection_columns =
+      scanner_options.projection_columns;
+  arrow_file_scan_options.filter_expression = scanner_options.filter_expression;
+  // Files written by tools/parquet_to_arrow.cc are marked as sorted. If the
+  // request isn't aware of this, the intervals are also part of the filter.
+  arrow_file_scan_options.xpos_intervals = scanner_options.xpos_intervals;
+  arrow_file_scan_options.xpos_sorted = scanner_options.xpos_sorted;
+  arrow_file_scan_options.record_batch_matches =
+      std::move(record_batch_matches);
+  arrow_file_scan_options.conjunct_ordering = conjunct_ordering;
+  arrow_file_scan_options.memory_pool = scanner_options.memory_pool;
+  if (scanner_options.predicate_cache != nullptr ||
+      scanner_options.column_store != nullptr) {
+    const std::string file_key = PredicateCacheFileKey(url, **data);
+    if (scanner_options.predicate_cache != nullptr) {
+      arrow_file_scan_options.predicate_cache = scanner_options.predicate_cache;
+      arrow_file_scan_options.predicate_cache_file_key = file_key;
+    }
+    if (scanner_options.column_store != nullptr) {
+      arrow_file_scan_options.column_store = scanner_options.column_store;
+      arrow_file_scan_options.column_store_file_key = file_key;
+    }
+  }
+
+  // Record batches reference the buffer without copying.
+  arrow::io::BufferReader buffer_reader{*data};
+  auto scan_result = ScanArrowFile(&buffer_reader, arrow_file_scan_options);
+  if (!scan_result.ok()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Failed to scan ", url, ": ", scan_result.status().message()));
+  }
+
+  arrow::RecordBatchVector result;
+  result.reserve(scan_result->record_batches.size());
+  for (const auto& record_batch : scan_result->record_batches) {
+    auto decoded_record_batch =
+        DecodeDictionaries(record_batch, scanner_options.memory_pool);
+    if (!decoded_record_batch.ok()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Failed to decode record batch for ", url, ": ",
+                       decoded_record_batch.status().message()));
+    }
+    *num_rows += record_batch->num_rows();
+    result.push_back(*std::move(decoded_record_batch));
+  }
+  return result;
+}
+
+// Parquet files are read without a local copy: row groups that can't match
+// are skipped using their statistics, and only the needed columns are read.
+absl::StatusOr<arrow::RecordBatchVector> ProcessParquetUrl(
+    const UrlReader& url_reader, const std::string_view url,
+    const std::string_view index_url, const ScannerOptions& scanner_options,
+    std::atomic<size_t>* const num_rows) {
+  namespace cp = arrow::compute;
+
+  // Early cancellation.
+  if (*num_rows > scanner_options.max_filtered_rows()) {
+    return scanner_options.MaxFilteredRowsExceededError();
+  }
+
+  if (!index_url.empty() && !scanner_options.index_lookup.empty()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("File indexes are not supported for Parquet file ", url));
+  }
+
+  ParquetReadOptions parquet_read_options;
+  absl::flat_hash_set<std::string> columns(
+      scanner_options.projection_columns.begin(),
+      scanner_options.projection_columns.end());
+  for (const auto& field_ref :
+       cp::FieldsInExpression(scanner_options.filter_expression)) {
+    if (const auto* const name = field_ref.name(); name != nullptr) {
+      columns.insert(*name);
+    }
+  }
+  parquet_read_options.predicate = scanner_options.filter_expression;
+  if (!scanner_options.xpos_intervals.empty()) {
+    columns.insert("xpos");
+    parquet_read_options.predicate =
+        cp::and_(XposIntervalsExpression(scanner_options.xpos_intervals),
+                 parquet_read_options.predicate);
+  }
+  parquet_read_options.columns.assign(columns.begin(), columns.end());
+  parquet_read_options.memory_pool = scanner_options.memory_pool;
+
+  auto parquet_read_result =
+      ReadParquetFile(url_reader, url, parquet_read_options);
+  if (!parquet_read_result.ok()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Failed to read ", url, ": ",
+                     parquet_read_result.status().message()));
+  }
+
+  const auto& schema = parquet_read_result->schema;
+  const bool xpos_sorted =
+      scanner_options.xpos_sorted || IsSortedByXpos(*schema);
+  arrow::RecordBatchVector record_batches;
+  for (auto& record_batch : parquet_read_result->record_batches) {
+    if (const auto status = AppendRecordBatch(
+            std::move(record_batch), xpos_sorted, scanner_options,
+            &record_batches);
+        !status.ok()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Failed to apply xpos intervals for ", url, ": ",
+                       status.message()));
+    }
+  }
+
+  return ScanRecordBatches(url, schema, std::move(record_batches),
+                           scanner_options, num_rows);
+}
+
+// Adds the conjunct stats to the response, and optionally logs them.
+void SetConjunctStats(const ConjunctOrdering& conjunct_ordering,
+                      seqr::QueryResponse* const response) {
+  const auto stats = conjunct_ordering.Stats();
+  const bool log_conjunct_stats = absl::GetFlag(FLAGS_log_conjunct_stats);
+  for (const int conjunct_index : conjunct_ordering.Order()) {
+    const auto& conjunct_stats = stats[conjunct_index];
+    auto* const response_stats = response->add_conjunct_stats();
+    response_stats->set_expression(
+        conjunct_ordering.conjuncts()[conjunct_index].ToString());
+    response_stats->set_rows_in(conjunct_stats.rows_in);
+    response_stats->set_rows_out(conjunct_stats.rows_out);
+    response_stats->set_nanos(conjunct_stats.nanos);
+    response_stats->set_cache_hits(conjunct_stats.cache_hits);
+    response_stats->set_cache_misses(conjunct_stats.cache_misses);
+    if (log_conjunct_stats) {
+      std::cout << "Conjunct " << response_stats->expression() << ": "
+                << conjunct_stats.rows_out << "/" << conjunct_stats.rows_in
+                << " rows passed in "
+                << absl::Nanoseconds(conjunct_stats.nanos) << ", "
+                << conjunct_stats.cache_hits << "/"
+                << conjunct_stats.cache_hits + conjunct_stats.cache_misses
+                << " cache hits" << std::endl;
+    }
+  }
+}
+
+// The filtered record batches of a query, in the order of the files.
+struct QueryResult {
+  // nullptr if there are no record batches.
+  std::shared_ptr<arrow::Schema> schema;
+  arrow::RecordBatchVector record_batches;
+  size_t num_rows = 0;
+};
+
+absl::Status MemoryLimitExceededError(const QueryMemoryPool& memory_pool) {
+  return absl::ResourceExhaustedError(
+      absl::StrCat("Query exceeded the memory limit of ",
+                   memory_pool.max_bytes(),
+                   " bytes; please use a more restrictive search"));
+}
+
+grpc::Status ToGrpcStatus(const absl::Status& status) {
+  // Abseil uses the same canonical codes as gRPC.
+  return grpc::Status(static_cast<grpc::StatusCode>(status.code()),
+                      std::string(status.message()));
+}
+
+// Extrapolates the number of result rows from the processed sample of files
+// and adds the estimate to the response. Fails fast if max_rows is certain to
+// be exceeded, or if a sampled file couldn't be processed.
+absl::Status EstimateSampledResultSize(
+    const std::vector<size_t>& sample,
+    const std::vector<absl::StatusOr<arrow::RecordBatchVector>>&
+        partial_results,
+    const size_t num_rows, const size_t num_files, const size_t max_rows,
+    seqr::QueryResponse* const response) {
+  if (num_rows > max_rows) {
+    return MaxRowsExceededError(max_rows);
+  }
+  std::vector<int64_t> sampled_matches;
+  sampled_matches.reserve(sample.size());
+  for (const size_t i : sample) {
+    const auto& partial_result = partial_results[i];
+    if (!partial_result.ok()) {
+      return absl::InvalidArgumentError(partial_result.status().message());
+    }
+    int64_t matches = 0;
+    for (const auto& record_batch : *partial_result) {
+      matches += record_batch->num_rows();
+    }
+    sampled_matches.push_back(matches);
+  }
+
+  const ResultSizeEstimate estimate =
+      EstimateResultSize(sampled_matches, num_files, kResultSizeConfidence);
+  auto& estimate_proto = *response->mutable_result_size_estimate();
+  estimate_proto.set_estimated_rows(estimate.estimated_rows);
+  estimate_proto.set_lower_bound(estimate.lower_bound);
+  estimate_proto.set_upper_bound(estimate.upper_bound);
+  estimate_proto.set_sampled_files(estimate.num_sampled_files);
+  estimate_proto.set_total_files(estimate.num_files);
+  // gRPC doesn't return the response for failed calls, so the error message
+  // includes the estimate.
+  if (static_cast<uint64_t>(estimate.lower_bound) > max_rows) {
+    return MaxRowsExceededError(absl::StrCat(
+        "An estimated ", estimate.estimated_rows, " rows (at least ",
+        estimate.lower_bound, ") match, more than ", max_rows,
+        "; please use a more restrictive search"));
+  }
+  return absl::OkStatus();
+}
+
+// Runs queries on a shared thread pool. Used by both the gRPC and the Arrow
+// Flight service.
+class QueryEngine {
  public:
-  explicit QueryServiceImpl(const UrlReader& url_reader)
-      : url_reader_(url_reader) {}
+  explicit QueryEngine(const UrlReader& url_reader)
+      : url_reader_(url_reader), dataset_catalog_(url_reader) {
+    if (const int64_t max_bytes =
+            absl::GetFlag(FLAGS_predicate_cache_max_bytes);
+        max_bytes > 0) {
+      predicate_cache_.emplace(max_bytes);
+    }
+    if (const int64_t max_bytes =
+            absl::GetFlag(FLAGS_resident_column_store_max_bytes);
+        max_bytes > 0) {
+      column_store_.emplace(max_bytes);
+    }
+  }
+
+  DatasetCatalog& dataset_catalog() { return dataset_catalog_; }
+
+  // Resolves the dataset_id of the request, if set. The conjunct stats are
+  // added to response even if the query fails. The memory pool must outlive
+  // the result.
+  absl::StatusOr<QueryResult> Run(const seqr::QueryRequest& request,
+                                  QueryMemoryPool* const memory_pool,
+                                  seqr::QueryResponse* const response) {
+    std::optional<seqr::QueryRequest> expanded_request;
+    std::shared_ptr<const DatasetEntry> dataset_entry;
+    if (!request.dataset_id().empty()) {
+      dataset_entry = dataset_catalog_.Find(request.dataset_id());
+      if (dataset_entry == nullptr) {
+        return absl::NotFoundError(
+            absl::StrCat("Unknown dataset ", request.dataset_id()));
+      }
+      auto expanded = ExpandDataset(request, dataset_entry->dataset);
+      if (!expanded.ok()) {
+        return expanded.status();
+      }
+      expanded_request = *std::move(expanded);
+    }
+
+    auto result = RunQuery(
+        expanded_request.has_value() ? *expanded_request : request,
+        dataset_entry != nullptr ? dataset_entry->schema.get() : nullptr,
+        memory_pool, response);
+    if (memory_pool->limit_exceeded()) {
+      return MemoryLimitExceededError(*memory_pool);
+    }
+    return result;
+  }
 
  private:
-  grpc::Status Query(grpc::ServerContext* const context,
-                     const seqr::QueryRequest* const request,
-                     seqr::QueryResponse* const response) override {
+  // If dataset_schema is set, the referenced columns are validated first.
+  absl::StatusOr<QueryResult> RunQuery(
+      const seqr::QueryRequest& request,
+      const arrow::Schema* const dataset_schema,
+      QueryMemoryPool* const memory_pool,
+      seqr::QueryResponse* const response) {
     // Build options that are shared between worker threads.
-    const auto scanner_options = BuildScannerOptions(*request);
+    auto scanner_options = BuildScannerOptions(request);
     if (!scanner_options.ok()) {
-      return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
-                          absl::StrCat("Failed to build scanner options: ",
-                                       scanner_options.status().message()));
+      return absl::InvalidArgumentError(
+          absl::StrCat("Failed to build scanner options: ",
+                       scanner_options.status().message()));
+    }
+    if (dataset_schema != nullptr) {
+      if (const auto status =
+              ValidateColumns(*dataset_schema,
+                              scanner_options->projection_columns,
+                              scanner_options->filter_expression);
+          !status.ok()) {
+        return status;
+      }
+    }
+    scanner_options->memory_pool = memory_pool;
+    if (predicate_cache_.has_value()) {
+      scanner_options->predicate_cache = &*predicate_cache_;
+    }
+    // Files of registered datasets are queried repeatedly, while arrow_urls
+    // might only be used once.
+    if (column_store_.has_value() && dataset_schema != nullptr) {
+      std::vector<std::string> filter_columns;
+      for (const auto& field_ref : arrow::compute::FieldsInExpression(
+               scanner_options->filter_expression)) {
+        if (const auto* const name = field_ref.name(); name != nullptr) {
+          filter_columns.push_back(*name);
+        }
+      }
+      column_store_->RecordQuery(filter_columns,
+                                 scanner_options->projection_columns);
+      scanner_options->column_store = &*column_store_;
+    }
+
+    if (const double sample_fraction =
+            request.result_size_estimation().sample_fraction();
+        sample_fraction < 0 || sample_fraction > 1) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid sample_fraction value of ", sample_fraction));
+    }
+
+    const auto url_indexes = SelectArrowUrls(request, *scanner_options);
+    if (!url_indexes.ok()) {
+      return absl::InvalidArgumentError(url_indexes.status().message());
     }
 
     // Process the URLs in parallel.
-    const size_t num_arrow_urls = request->arrow_urls_size();
+    const size_t num_arrow_urls = url_indexes->size();
     std::vector<absl::StatusOr<arrow::RecordBatchVector>> partial_results(
         num_arrow_urls);
     std::atomic<size_t> num_rows = 0;  // Number of filtered rows across URLs.
-    absl::BlockingCounter blocking_counter(num_arrow_urls);
-    for (size_t i = 0; i < num_arrow_urls; ++i) {
-      thread_pool_.Schedule([&url_reader = url_reader_,
-                             &url = request->arrow_urls(i),
-                             &result = partial_results[i], &scanner_options,
-                             &num_rows, &blocking_counter] {
-        result = ProcessArrowUrl(url_reader, url, *scanner_options, &num_rows);
-        blocking_counter.DecrementCount();
-      });
+    // Learns the conjunct order across all files of the query.
+    ConjunctOrdering conjunct_ordering(
+        FlattenConjunction(scanner_options->filter_expression));
+    // Processes the URLs at the given positions of url_indexes and waits for
+    // them to finish.
+    const auto process = [&](const std::vector<size_t>& positions) {
+      absl::BlockingCounter blocking_counter(positions.size());
+      for (const size_t i : positions) {
+        const size_t url_index = (*url_indexes)[i];
+        const std::string_view index_url =
+            request.index_urls_size() > 0
+                ? std::string_view(request.index_urls(url_index))
+                : std::string_view();
+        thread_pool_.Schedule([&url_reader = url_reader_,
+                               &url = request.arrow_urls(url_index), index_url,
+                               &result = partial_results[i], &scanner_options,
+                               &conjunct_ordering, &num_rows,
+                               &blocking_counter] {
+          result = absl::EndsWith(url, ".parquet")
+                       ? ProcessParquetUrl(url_reader, url, index_url,
+                                           *scanner_options, &num_rows)
+                       : ProcessArrowUrl(url_reader, url, index_url,
+                                         *scanner_options, &conjunct_ordering,
+                                         &num_rows);
+          blocking_counter.DecrementCount();
+        });
+      }
+      blocking_counter.Wait();
+    };
+
+    std::vector<size_t> positions(num_arrow_urls);
+    std::iota(positions.begin(), positions.end(), 0);
+    if (request.has_result_size_estimation()) {
+      // Process a sample of the files first. These are part of the result, so
+      // only the remaining files are processed afterwards.
+      const double sample_fraction =
+          request.result_size_estimation().sample_fraction() > 0
+              ? request.result_size_estimation().sample_fraction()
+              : absl::GetFlag(FLAGS_result_size_sample_fraction);
+      absl::BitGen bit_gen;
+      const std::vector<size_t> sample = StratifiedSample(
+          num_arrow_urls, ResultSizeSampleSize(num_arrow_urls, sample_fraction),
+          bit_gen);
+      process(sample);
+
+      const auto status = EstimateSampledResultSize(
+          sample, partial_results, num_rows, num_arrow_urls,
+          scanner_options->max_filtered_rows(), response);
+      if (!status.ok() || request.result_size_estimation().estimate_only()) {
+        SetConjunctStats(conjunct_ordering, response);
+        if (!status.ok()) {
+          return status;
+        }
+        return QueryResult();
+      }
+
+      std::vector<size_t> remaining;
+      std::set_difference(positions.begin(), positions.end(), sample.begin(),
+                          sample.end(), std::back_inserter(remaining));
+      positions = std::move(remaining);
     }
+    process(positions);
 
-    blocking_counter.Wait();
+    SetConjunctStats(conjunct_ordering, response);
 
-    if (num_rows > scanner_options->max_rows) {
-      return grpc::Status(
-          grpc::StatusCode::CANCELLED,
-          std::string(
-              MaxRowsExceededError(scanner_options->max_rows).message()));
+    if (num_rows > scanner_options->max_filtered_rows()) {
+      return scanner_options->MaxFilteredRowsExceededError();
     }
 
-    // Serialize the result record batches to the response proto.
-    std::shared_ptr<arrow::Schema> schema;
-    for (const auto& result : partial_results) {
-      if (!result.ok()) {
-        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
-                            std::string(result.status().message()));
+    // Compound hets can span files, so they're paired after gathering the
+    // candidates of all files.
+    if (scanner_options->compound_het_filter != nullptr) {
+      arrow::RecordBatchVector candidates;
+      for (auto& result : partial_results) {
+        if (!result.ok()) {
+          return absl::InvalidArgumentError(result.status().message());
+        }
+        for (auto& record_batch : *result) {
+          candidates.push_back(std::move(record_batch));
+        }
       }
-      if (!result->empty()) {
-        schema = result->front()->schema();
-        break;
+      auto compound_hets = FilterCompoundHets(
+          candidates, *scanner_options->compound_het_filter,
+          {request.projection_columns().begin(),
+           request.projection_columns().end()});
+      if (!compound_hets.ok()) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Failed to filter compound hets: ",
+                         compound_hets.status().message()));
       }
+      num_rows = 0;
+      for (const auto& record_batch : *compound_hets) {
+        num_rows += record_batch->num_rows();
+      }
+      if (num_rows > scanner_options->max_rows) {
+        return MaxRowsExceededError(scanner_options->max_rows);
+      }
+      partial_results.clear();
+      partial_results.push_back(*std::move(compound_hets));
     }
 
-    if (schema == nullptr) {  // No results found.
-      return grpc::Status::OK;
+    QueryResult result;
+    result.num_rows = num_rows;
+    for (auto& partial_result : partial_results) {
+      if (!partial_result.ok()) {
+        return absl::InvalidArgumentError(partial_result.status().message());
+      }
+      for (auto& record_batch : *partial_result) {
+        if (result.schema == nullptr) {
+          result.schema = record_batch->schema();
+        }
+        result.record_batches.push_back(std::move(record_batch));
+      }
     }
+    return result;
+  }
+
+  ThreadPool thread_pool_{absl::GetFlag(FLAGS_num_threads)};
+  const UrlReader& url_reader_;
+  DatasetCatalog dataset_catalog_;
+  std::optional<PredicateCache> predicate_cache_;
+  std::optional<ResidentColumnStore> column_store_;
+};
 
-    auto buffer_output_stream = arrow::io::BufferOutputStream::Create();
-    if (!buffer_output_stream.ok()) {
+// Serializes the record batches to the response proto.
+grpc::Status SerializeQueryResult(const QueryResult& result,
+                                  QueryMemoryPool* const memory_pool,
+                                  seqr::QueryResponse* const response) {
+  if (result.schema == nullptr) {  // No results found.
+    return grpc::Status::OK;
+  }
+
+  auto buffer_output_stream = arrow::io::BufferOutputStream::Create(
+      /* initial_capacity */ 4096, memory_pool);
+  if (!buffer_output_stream.ok()) {
+    return grpc::Status(
+        grpc::StatusCode::INVALID_ARGUMENT,
+        absl::StrCat("Failed to create buffer output stream: ",
+                     buffer_output_stream.status().message()));
+  }
+
+  auto ipc_write_options = arrow::ipc::IpcWriteOptions::Defaults();
+  ipc_write_options.memory_pool = memory_pool;
+  auto file_writer = arrow::ipc::MakeFileWriter(
+      *buffer_output_stream, result.schema, ipc_write_options);
+  if (!file_writer.ok()) {
+    return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                        absl::StrCat("Failed to create file writer: ",
+                                     file_writer.status().message()));
+  }
+
+  for (const auto& record_batch : result.record_batches) {
+    if (const auto status = (*file_writer)->WriteRecordBatch(*record_batch);
+        !status.ok()) {
       return grpc::Status(
           grpc::StatusCode::INVALID_ARGUMENT,
-          absl::StrCat("Failed to create buffer output stream: ",
-                       buffer_output_stream.status().message()));
+          absl::StrCat("Failed to write record batch: ", status.message()));
+    }
+  }
+
+  if (const auto status = (*file_writer)->Close(); !status.ok()) {
+    return grpc::Status(
+        grpc::StatusCode::INVALID_ARGUMENT,
+        absl::StrCat("Failed to close file writer: ", status.message()));
+  }
+
+  const auto buffer = (*buffer_output_stream)->Finish();
+  if (!buffer.ok()) {
+    return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                        absl::StrCat("Failed to finish buffer output stream: ",
+                                     buffer.status().message()));
+  }
+
+  response->set_num_rows(result.num_rows);
+  response->set_record_batches((*buffer)->ToString());
+
+  return grpc::Status::OK;
+}
+
+class QueryServiceImpl final : public seqr::QueryService::Service {
+ public:
+  explicit QueryServiceImpl(QueryEngine* const query_engine)
+      : query_engine_(query_engine) {}
+
+ private:
+  grpc::Status Query(grpc::ServerContext* const context,
+                     const seqr::QueryRequest* const request,
+                     seqr::QueryResponse* const response) override {
+    // Must outlive all Arrow buffers of the query.
+    QueryMemoryPool memory_pool(absl::GetFlag(FLAGS_max_query_memory_bytes));
+    const auto result = query_engine_->Run(*request, &memory_pool, response);
+    if (!result.ok() && IsMaxRowsExceeded(result.status())) {
+      context->AddTrailingMetadata(kMaxRowsExceededMetadataKey, "true");
+    }
+    const grpc::Status status =
+        result.ok() ? SerializeQueryResult(*result, &memory_pool, response)
+                    : ToGrpcStatus(result.status());
+    response->set_peak_memory_bytes(memory_pool.max_memory());
+    if (absl::GetFlag(FLAGS_log_query_memory)) {
+      std::cout << "Query peak memory: " << memory_pool.max_memory()
+                << " bytes" << std::endl;
     }
+    if (memory_pool.limit_exceeded()) {
+      return ToGrpcStatus(MemoryLimitExceededError(memory_pool));
+    }
+    return status;
+  }
 
-    auto file_writer =
-        arrow::ipc::MakeFileWriter(*buffer_output_stream, schema);
-    if (!file_writer.ok()) {
-      return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
-                          absl::StrCat("Failed to create file writer: ",
-                                       file_writer.status().message()));
+  grpc::Status RegisterDataset(
+      grpc::ServerContext* const context,
+      const seqr::RegisterDatasetRequest* const request,
+      seqr::Dataset* const response) override {
+    auto dataset = query_engine_->dataset_catalog().Register(*request);
+    if (!dataset.ok()) {
+      return ToGrpcStatus(dataset.status());
     }
+    *response = *std::move(dataset);
+    return grpc::Status::OK;
+  }
 
-    for (const auto& result : partial_results) {
-      for (const auto& record_batch : *result) {
-        if (const auto status = (*file_writer)->WriteRecordBatch(*record_batch);
-            !status.ok()) {
-          return grpc::Status(
-              grpc::StatusCode::INVALID_ARGUMENT,
-              absl::StrCat("Failed to write record batch: ", status.message()));
-        }
-      }
+  grpc::Status ListDatasets(
+      grpc::ServerContext* const context,
+      const seqr::ListDatasetsRequest* const request,
+      seqr::ListDatasetsResponse* const response) override {
+    for (auto& dataset :
+         query_engine_->dataset_catalog().List(request->include_files())) {
+      *response->add_datasets() = std::move(dataset);
     }
+    return grpc::Status::OK;
+  }
 
-    if (const auto status = (*file_writer)->Close(); !status.ok()) {
-      return grpc::Status(
-          grpc::StatusCode::INVALID_ARGUMENT,
-          absl::StrCat("Failed to close file writer: ", status.message()));
+  QueryEngine* const query_engine_;
+};
+
+// Runs Arrow Flight queries. Each result keeps its memory pool alive until
+// it has been streamed.
+absl::StatusOr<FlightQueryResult> RunFlightQuery(
+    QueryEngine* const query_engine, const seqr::QueryRequest& request) {
+  auto memory_pool = std::make_shared<QueryMemoryPool>(
+      absl::GetFlag(FLAGS_max_query_memory_bytes));
+  seqr::QueryResponse response;
+  auto result = query_engine->Run(request, memory_pool.get(), &response);
+  if (absl::GetFlag(FLAGS_log_query_memory)) {
+    std::cout << "Flight query peak memory: " << memory_pool->max_memory()
+              << " bytes" << std::endl;
+  }
+  if (!result.ok()) {
+    return result.status();
+  }
+  response.set_num_rows(result->num_rows);
+  response.set_peak_memory_bytes(memory_pool->max_memory());
+  return FlightQueryResult{.owner = std::move(memory_pool),
+                           .schema = std::move(result->schema),
+                           .record_batches = std::move(result->record_batches),
+                           .response = std::move(response)};
+}
+
+absl::Status RegisterArrowComputeFunctions() {
+  // The global registry rejects duplicate function names, but servers can be
+  // created multiple times within a process (e.g. in tests).
+  static const absl::Status status = [] {
+    auto* const registry = arrow::compute::GetFunctionRegistry();
+    if (const auto status = RegisterStringListContainsAny(registry);
+        !status.ok()) {
+      return absl::InternalError(absl::StrCat(
+          "Error calling RegisterStringListContainsAny: ", status.message()));
+    }
+    if (const auto status = RegisterSampleValueGreaterEqual(registry);
+        !status.ok()) {
+      return absl::InternalError(absl::StrCat(
+          "Error calling RegisterSampleValueGreaterEqual: ", status.message()));
     }
+    return absl::OkStatus();
+  }();
+  return status;
+}
 
-    const auto buffer = (*buffer_output_stream)->Finish();
-    if (!buffer.ok()) {
-      return grpc::Status(
-          grpc::StatusCode::INVALID_ARGUMENT,
-          absl::StrCat("Failed to finish buffer output stream: ",
-                       buffer.status().message()));
+// The serving status reported by HealthServiceImpl, set through
+// grpc::Server::GetHealthCheckService. A single status applies to all services.
+class HealthStatus final : public grpc::HealthCheckServiceInterface {
+ public:
+  explicit HealthStatus(const bool serving) : serving_(serving) {}
+
+  void SetServingStatus(const std::string& service_name,
+                        const bool serving) override {
+    SetServingStatus(serving);
+  }
+
+  void SetServingStatus(const bool serving) override {
+    absl::MutexLock lock(&mu_);
+    if (!shut_down_) {
+      serving_ = serving;
     }
+  }
 
-    response->set_num_rows(num_rows);
-    response->set_record_batches((*buffer)->ToString());
+  void Shutdown() override {
+    absl::MutexLock lock(&mu_);
+    serving_ = false;
+    shut_down_ = true;
+  }
 
-    return grpc::Status::OK;
+  bool serving() const {
+    absl::MutexLock lock(&mu_);
+    return serving_;
   }
 
-  ThreadPool thread_pool_{absl::GetFlag(FLAGS_num_threads)};
-  const UrlReader& url_reader_;
+ private:
+  mutable absl::Mutex mu_;
+  bool serving_ ABSL_GUARDED_BY(mu_);
+  bool shut_down_ ABSL_GUARDED_BY(mu_) = false;
 };
 
-absl::Status RegisterArrowComputeFunctions() {
-  auto* const registry = arrow::compute::GetFunctionRegistry();
-  if (const auto status = RegisterStringListContainsAny(registry);
-      !status.ok()) {
-    return absl::InternalError(absl::StrCat(
-        "Error calling RegisterStringListContainsAny: ", status.message()));
+// Replaces gRPC's default health service, which reports SERVING as soon as
+// the server starts, so instances can start out as NOT_SERVING. Only Check is
+// implemented, which is what readiness probes use.
+class HealthServiceImpl final : public grpc::health::v1::Health::Service {
+ public:
+  explicit HealthServiceImpl(const HealthStatus* const health_status)
+      : health_status_(health_status) {}
+
+ private:
+  grpc::Status Check(
+      grpc::ServerContext* const context,
+      const grpc::health::v1::HealthCheckRequest* const request,
+      grpc::health::v1::HealthCheckResponse* const response) override {
+    response->set_status(
+        health_status_->serving()
+            ? grpc::health::v1::HealthCheckResponse::SERVING
+            : grpc::health::v1::HealthCheckResponse::NOT_SERVING);
+    return grpc::Status::OK;
   }
-  return absl::OkStatus();
-}
+
+  // Owned by the server.
+  const HealthStatus* const health_status_;
+};
 
 class GrpcServerImpl : public GrpcServer {
  public:
-  explicit GrpcServerImpl(const UrlReader& url_reader)
-      : query_service_impl(url_reader) {}
+  GrpcServerImpl(const UrlReader& url_reader,
+                 const HealthStatus* const health_status)
+      : query_engine(url_reader),
+        query_service_impl(&query_engine),
+        health_service_impl(health_status) {}
 
+  QueryEngine query_engine;
   // The server does not take ownership of the services, which is why we keep
   // the service alive here.
   QueryServiceImpl query_service_impl;
+  HealthServiceImpl health_service_impl;
+  // Only set if a Flight port was specified. Declared last, so it's shut down
+  // before the query engine is destroyed.
+  std::unique_ptr<arrow::flight::FlightServerBase> flight_service;
+};
+
+class CoordinatorGrpcServerImpl : public GrpcServer {
+ public:
+  CoordinatorGrpcServerImpl(
+      std::vector<std::shared_ptr<QueryService::StubInterface>> workers,
+      const std::vector<std::string>& worker_addresses)
+      : coordinator_service(
+            MakeCoordinatorService(std::move(workers), worker_addresses)) {}
+
+  const std::unique_ptr<QueryService::Service> coordinator_service;
 };
 
 }  // namespace
 
 absl::StatusOr<std::unique_ptr<GrpcServer>> CreateServer(
-    const int port, const UrlReader& url_reader) {
+    const int port, const UrlReader& url_reader, const int flight_port,
+    const bool serving) {
   if (const auto status = seqr::RegisterArrowComputeFunctions(); !status.ok()) {
     return absl::InternalError(absl::StrCat(
         "Failed to register Arrow compute functions: ", status.message()));
   }
 
-  grpc::EnableDefaultHealthCheckService(true);
   grpc::reflection::InitProtoReflectionServerBuilderPlugin();
 
   const std::string server_address = absl::StrCat("[::]:", port);
@@ -450,8 +1342,64 @@ absl::StatusOr<std::unique_ptr<GrpcServer>> CreateServer(
   grpc::ServerBuilder builder;
   builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
 
-  auto result = std::make_unique<GrpcServerImpl>(url_reader);
+  // The status is set before the server starts, so it can't report SERVING
+  // too early.
+  auto health_status = std::make_unique<HealthStatus>(serving);
+  auto result =
+      std::make_unique<GrpcServerImpl>(url_reader, health_status.get());
+  builder.SetOption(
+      std::make_unique<grpc::HealthCheckServiceServerBuilderOption>(
+          std::move(health_status)));
   builder.RegisterService(&result->query_service_impl);
+  builder.RegisterService(&result->health_service_impl);
+  result->server = builder.BuildAndStart();
+
+  if (flight_port != 0) {
+    auto flight_service = StartFlightService(
+        [query_engine = &result->query_engine](
+            const seqr::QueryRequest& request) {
+          return RunFlightQuery(query_engine, request);
+        },
+        {.port = flight_port,
+         .result_ttl = absl::GetFlag(FLAGS_flight_result_ttl),
+         .max_pending_results = static_cast<size_t>(
+             absl::GetFlag(FLAGS_flight_max_pending_results)),
+         .max_pending_bytes = absl::GetFlag(FLAGS_flight_max_pending_bytes)});
+    if (!flight_service.ok()) {
+      return flight_service.status();
+    }
+    result->flight_service = *std::move(flight_service);
+  }
+  return result;
+}
+
+absl::StatusOr<std::unique_ptr<GrpcServer>> CreateCoordinatorServer(
+    const int port, const std::vector<std::string>& worker_addresses) {
+  if (worker_addresses.empty()) {
+    return absl::InvalidArgumentError("No worker addresses specified");
+  }
+
+  // Worker responses can exceed the default limit of 4 MiB.
+  grpc::ChannelArguments channel_arguments;
+  channel_arguments.SetMaxReceiveMessageSize(-1);
+  std::vector<std::shared_ptr<QueryService::StubInterface>> workers;
+  for (const auto& address : worker_addresses) {
+    workers.push_back(QueryService::NewStub(grpc::CreateCustomChannel(
+        address, grpc::InsecureChannelCredentials(), channel_arguments)));
+  }
+
+  grpc::EnableDefaultHealthCheckService(true);
+  grpc::reflection::InitProtoReflectionServerBuilderPlugin();
+
+  const std::string server_address = absl::StrCat("[::]:", port);
+  std::cout << "Starting coordinator on " << server_address << " with "
+            << workers.size() << " workers" << std::endl;
+  grpc::ServerBuilder builder;
+  builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
+
+  auto result = std::make_unique<CoordinatorGrpcServerImpl>(std::move(workers),
+                                                            worker_addresses);
+  builder.RegisterService(result->coordinator_service.get());
   result->server = builder.BuildAndStart();
   return result;
 }
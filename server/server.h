@@ -4,6 +4,8 @@
 #include <grpcpp/grpcpp.h>
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "url_reader.h"
 
@@ -20,8 +22,18 @@ class GrpcServer {
   std::unique_ptr<grpc::Server> server;
 };
 
+// If flight_port is non-zero, queries are also served using Arrow Flight on
+// that port. See flight_service.h. If serving is false, the gRPC health
+// service reports NOT_SERVING until it's changed through
+// server->GetHealthCheckService(), while queries are served regardless.
 absl::StatusOr<std::unique_ptr<GrpcServer>> CreateServer(
-    int port, const UrlReader& url_reader);
+    int port, const UrlReader& url_reader, int flight_port = 0,
+    bool serving = true);
+
+// Creates a server that forwards queries to the backends at worker_addresses
+// (e.g. "localhost:8080") and merges their results. See coordinator.h.
+absl::StatusOr<std::unique_ptr<GrpcServer>> CreateCoordinatorServer(
+    int port, const std::vector<std::string>& worker_addresses);
 
 }  // namespace seqr
 
@@ -1,72 +1,84 @@
 #include "server.h"
 
 #include <absl/container/flat_hash_set.h>
+#include <absl/flags/declare.h>
+#include <absl/flags/flag.h>
+#include <absl/flags/reflection.h>
+#include <absl/strings/escaping.h>
 #include <absl/strings/str_cat.h>
 #include <arrow/array.h>
+#include <arrow/flight/client.h>
+#include <arrow/io/file.h>
 #include <arrow/io/memory.h>
+#include <arrow/ipc/dictionary.h>
 #include <arrow/ipc/reader.h>
 #include <arrow/table.h>
-#include <arrow/util/string_view.h>
+#include <arrow/util/key_value_metadata.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/text_format.h>
 #include <grpcpp/grpcpp.h>
 #include <gtest/gtest.h>
+#include <parquet/arrow/writer.h>
+#include <unistd.h>
 
+#include <filesystem>
 #include <fstream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 
+#include "coordinator.h"
+#include "file_converter.h"
+#include "flight_service.h"
+#include "health.grpc.pb.h"
 #include "seqr_query_service.grpc.pb.h"
 
+ABSL_DECLARE_FLAG(int64_t, compound_het_max_candidates_factor);
+ABSL_DECLARE_FLAG(int64_t, max_query_memory_bytes);
+ABSL_DECLARE_FLAG(int64_t, resident_column_store_max_bytes);
+
 namespace seqr {
 
-TEST(Server, EndToEnd) {
-  constexpr int kPort = 12345;
-  const auto local_file_reader = MakeLocalFileReader();
-  ASSERT_TRUE(local_file_reader.ok());
-  auto server = CreateServer(kPort, **local_file_reader);
-  ASSERT_TRUE(server.ok()) << server.status();
-
-  auto channel = grpc::CreateChannel(absl::StrCat("localhost:", kPort),
-                                     grpc::InsecureChannelCredentials());
-  auto stub = QueryService::NewStub(channel);
-  ASSERT_TRUE(stub != nullptr);
+using XposAndVariantIds =
+    absl::flat_hash_set<std::tuple<int64_t, std::string>>;
 
+QueryRequest ReadNa12878TrioQuery() {
   const char kQueryTextProtoFilename[] =
       "testdata/na12878_trio_query.textproto";
   std::ifstream ifs{kQueryTextProtoFilename};
-  ASSERT_TRUE(ifs);
+  EXPECT_TRUE(ifs);
   google::protobuf::io::IstreamInputStream iis{&ifs};
   QueryRequest request;
-  ASSERT_TRUE(google::protobuf::TextFormat::Parse(&iis, &request));
-
-  grpc::ClientContext context;
-  QueryResponse response;
-  auto status = stub->Query(&context, request, &response);
-  ASSERT_TRUE(status.ok()) << status.error_message();
-
-  constexpr size_t kNumExpectedRows = 6;
-  EXPECT_EQ(response.num_rows(), kNumExpectedRows);
+  EXPECT_TRUE(google::protobuf::TextFormat::Parse(&iis, &request));
+  return request;
+}
 
+// Returns the xpos and variantId values of the serialized record batches.
+void ParseXposAndVariantIds(const std::string& record_batches,
+                            const size_t num_expected_rows,
+                            XposAndVariantIds* const result) {
   auto record_batch_file_reader = arrow::ipc::RecordBatchFileReader::Open(
-      std::make_shared<arrow::io::BufferReader>(response.record_batches()));
+      std::make_shared<arrow::io::BufferReader>(record_batches));
   ASSERT_TRUE(record_batch_file_reader.ok())
       << record_batch_file_reader.status();
   const size_t num_record_batches =
       (*record_batch_file_reader)->num_record_batches();
-  arrow::RecordBatchVector record_batches;
-  record_batches.reserve(num_record_batches);
+  arrow::RecordBatchVector batches;
+  batches.reserve(num_record_batches);
   for (size_t i = 0; i < num_record_batches; ++i) {
     auto record_batch = (*record_batch_file_reader)->ReadRecordBatch(i);
     ASSERT_TRUE(record_batch.ok()) << record_batch.status();
-    record_batches.push_back(*record_batch);
+    batches.push_back(*record_batch);
   }
 
-  const auto table = arrow::Table::FromRecordBatches(record_batches);
+  const auto table = arrow::Table::FromRecordBatches(batches);
   ASSERT_TRUE(table.ok()) << table.status();
 
   const auto xpos_col = (*table)->GetColumnByName("xpos");
   ASSERT_TRUE(xpos_col != nullptr);
   std::vector<int64_t> xpos_vals;
-  xpos_vals.reserve(kNumExpectedRows);
+  xpos_vals.reserve(num_expected_rows);
   for (int i = 0; i < xpos_col->num_chunks(); ++i) {
     const auto chunk = xpos_col->chunk(i);
     ASSERT_TRUE(chunk != nullptr);
@@ -76,12 +88,12 @@ TEST(Server, EndToEnd) {
       xpos_vals.push_back(int64_array->Value(j));
     }
   }
-  ASSERT_EQ(xpos_vals.size(), kNumExpectedRows);
+  ASSERT_EQ(xpos_vals.size(), num_expected_rows);
 
   const auto variant_id_col = (*table)->GetColumnByName("variantId");
   ASSERT_TRUE(variant_id_col != nullptr);
-  std::vector<arrow::util::string_view> variant_id_vals;
-  variant_id_vals.reserve(kNumExpectedRows);
+  std::vector<std::string> variant_id_vals;
+  variant_id_vals.reserve(num_expected_rows);
   for (int i = 0; i < variant_id_col->num_chunks(); ++i) {
     const auto chunk = variant_id_col->chunk(i);
     ASSERT_TRUE(chunk != nullptr);
@@ -89,24 +101,697 @@ TEST(Server, EndToEnd) {
         std::static_pointer_cast<arrow::StringArray>(chunk);
     for (int j = 0; j < string_array->length(); ++j) {
       ASSERT_FALSE(string_array->IsNull(j));
-      variant_id_vals.push_back(string_array->Value(j));
+      variant_id_vals.push_back(string_array->GetString(j));
     }
   }
-  ASSERT_EQ(variant_id_vals.size(), kNumExpectedRows);
+  ASSERT_EQ(variant_id_vals.size(), num_expected_rows);
 
-  absl::flat_hash_set<std::tuple<int64_t, arrow::util::string_view>> actual;
-  actual.reserve(kNumExpectedRows);
-  for (size_t i = 0; i < kNumExpectedRows; ++i) {
-    actual.insert(std::make_pair(xpos_vals[i], variant_id_vals[i]));
+  result->reserve(num_expected_rows);
+  for (size_t i = 0; i < num_expected_rows; ++i) {
+    result->insert(std::make_tuple(xpos_vals[i], variant_id_vals[i]));
   }
+}
+
+constexpr int kPort = 12345;
+
+struct TestServer {
+  // Declared first, as the server reads through it.
+  std::unique_ptr<UrlReader> url_reader;
+  std::unique_ptr<GrpcServer> server;
+  std::unique_ptr<QueryService::Stub> stub;
+};
+
+// Starts a server on kPort that reads local files, and connects to it. The
+// server and stub are null if the server couldn't be created.
+TestServer StartTestServer(const int flight_port = 0,
+                           const bool serving = true) {
+  TestServer result;
+  auto local_file_reader = MakeLocalFileReader();
+  EXPECT_TRUE(local_file_reader.ok()) << local_file_reader.status();
+  if (!local_file_reader.ok()) {
+    return result;
+  }
+  result.url_reader = *std::move(local_file_reader);
+  auto server = CreateServer(kPort, *result.url_reader, flight_port, serving);
+  EXPECT_TRUE(server.ok()) << server.status();
+  if (!server.ok()) {
+    return result;
+  }
+  result.server = *std::move(server);
+  result.stub = QueryService::NewStub(
+      grpc::CreateChannel(absl::StrCat("localhost:", kPort),
+                          grpc::InsecureChannelCredentials()));
+  return result;
+}
+
+constexpr char kTrioDatasetId[] = "na12878_trio";
+
+// Registers the files of the NA12878 trio query as a dataset.
+Dataset RegisterTrioDataset(QueryService::Stub* const stub) {
+  RegisterDatasetRequest request;
+  request.set_dataset_id(kTrioDatasetId);
+  for (const auto& arrow_url : ReadNa12878TrioQuery().arrow_urls()) {
+    request.add_files()->set_url(arrow_url);
+  }
+  grpc::ClientContext context;
+  Dataset dataset;
+  const auto status = stub->RegisterDataset(&context, request, &dataset);
+  EXPECT_TRUE(status.ok()) << status.error_message();
+  return dataset;
+}
+
+TEST(Server, EndToEnd) {
+  const auto test_server = StartTestServer();
+  ASSERT_TRUE(test_server.stub != nullptr);
+  QueryService::Stub* const stub = test_server.stub.get();
+
+  const QueryRequest request = ReadNa12878TrioQuery();
+
+  grpc::ClientContext context;
+  QueryResponse response;
+  auto status = stub->Query(&context, request, &response);
+  ASSERT_TRUE(status.ok()) << status.error_message();
+
+  constexpr size_t kNumExpectedRows = 6;
+  EXPECT_EQ(response.num_rows(), kNumExpectedRows);
+  ASSERT_GT(response.conjunct_stats_size(), 0);
+  EXPECT_GT(response.conjunct_stats(0).rows_in(), 0);
+  EXPECT_GT(response.peak_memory_bytes(), 0);
+
+  XposAndVariantIds actual;
+  ParseXposAndVariantIds(response.record_batches(), kNumExpectedRows, &actual);
 
   // Compare with values validated using BigQuery.
-  const absl::flat_hash_set<std::tuple<int64_t, arrow::util::string_view>>
-      expected{{1001050069, "1-1050069-G-A"},  {1001054900, "1-1054900-C-T"},
-               {1002024923, "1-2024923-G-A"},  {1002302812, "1-2302812-A-G"},
-               {1011145001, "1-11145001-C-T"}, {1011241657, "1-11241657-A-G"}};
+  const XposAndVariantIds expected{
+      {1001050069, "1-1050069-G-A"},  {1001054900, "1-1054900-C-T"},
+      {1002024923, "1-2024923-G-A"},  {1002302812, "1-2302812-A-G"},
+      {1011145001, "1-11145001-C-T"}, {1011241657, "1-11241657-A-G"}};
 
   EXPECT_EQ(actual, expected);
 }
 
+TEST(Server, PredicateCache) {
+  const auto test_server = StartTestServer();
+  ASSERT_TRUE(test_server.stub != nullptr);
+  QueryService::Stub* const stub = test_server.stub.get();
+
+  // The second query reuses the cached conjunct results of the first one.
+  const QueryRequest request = ReadNa12878TrioQuery();
+  std::vector<XposAndVariantIds> results;
+  int64_t cache_hits = 0;
+  for (int i = 0; i < 2; ++i) {
+    grpc::ClientContext context;
+    QueryResponse response;
+    const auto status = stub->Query(&context, request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+    constexpr size_t kNumExpectedRows = 6;
+    ASSERT_EQ(response.num_rows(), kNumExpectedRows);
+    ParseXposAndVariantIds(response.record_batches(), kNumExpectedRows,
+                           &results.emplace_back());
+    cache_hits = 0;
+    for (const auto& conjunct_stats : response.conjunct_stats()) {
+      cache_hits += conjunct_stats.cache_hits();
+    }
+  }
+  EXPECT_GT(cache_hits, 0);
+  EXPECT_EQ(results[0], results[1]);
+}
+
+TEST(Server, ResultSizeEstimation) {
+  const auto test_server = StartTestServer();
+  ASSERT_TRUE(test_server.stub != nullptr);
+  QueryService::Stub* const stub = test_server.stub.get();
+  constexpr int64_t kNumExpectedRows = 6;
+
+  // Sampling all files makes the estimate exact.
+  {
+    QueryRequest request = ReadNa12878TrioQuery();
+    auto& estimation = *request.mutable_result_size_estimation();
+    estimation.set_sample_fraction(1);
+    estimation.set_estimate_only(true);
+    grpc::ClientContext context;
+    QueryResponse response;
+    const auto status = stub->Query(&context, request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+    EXPECT_EQ(response.num_rows(), 0);
+    const auto& estimate = response.result_size_estimate();
+    EXPECT_EQ(estimate.estimated_rows(), kNumExpectedRows);
+    EXPECT_EQ(estimate.lower_bound(), kNumExpectedRows);
+    EXPECT_EQ(estimate.upper_bound(), kNumExpectedRows);
+    EXPECT_EQ(estimate.sampled_files(), 3);
+    EXPECT_EQ(estimate.total_files(), 3);
+  }
+
+  {
+    QueryRequest request = ReadNa12878TrioQuery();
+    request.mutable_result_size_estimation()->set_sample_fraction(1);
+    request.set_max_rows(kNumExpectedRows - 1);
+    grpc::ClientContext context;
+    QueryResponse response;
+    const auto status = stub->Query(&context, request, &response);
+    EXPECT_EQ(status.error_code(), grpc::StatusCode::CANCELLED)
+        << status.error_message();
+    // Lets coordinators tell this apart from cancelled calls.
+    EXPECT_EQ(context.GetServerTrailingMetadata().count(
+                  kMaxRowsExceededMetadataKey),
+              1);
+  }
+
+  // The sampled files are part of the result, which matches the one without
+  // estimation.
+  std::vector<XposAndVariantIds> results;
+  for (const bool estimate : {false, true}) {
+    QueryRequest request = ReadNa12878TrioQuery();
+    if (estimate) {
+      request.mutable_result_size_estimation();
+    }
+    grpc::ClientContext context;
+    QueryResponse response;
+    const auto status = stub->Query(&context, request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+    ASSERT_EQ(response.num_rows(), kNumExpectedRows);
+    ParseXposAndVariantIds(response.record_batches(), kNumExpectedRows,
+                           &results.emplace_back());
+    EXPECT_EQ(response.has_result_size_estimate(), estimate);
+    if (estimate) {
+      EXPECT_EQ(response.result_size_estimate().sampled_files(), 2);
+      EXPECT_EQ(response.result_size_estimate().total_files(), 3);
+    }
+  }
+  EXPECT_EQ(results[0], results[1]);
+}
+
+TEST(Server, MemoryLimit) {
+  const auto test_server = StartTestServer();
+  ASSERT_TRUE(test_server.stub != nullptr);
+  QueryService::Stub* const stub = test_server.stub.get();
+
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_max_query_memory_bytes, 1024);
+  grpc::ClientContext context;
+  QueryResponse response;
+  const auto status = stub->Query(&context, ReadNa12878TrioQuery(), &response);
+  EXPECT_EQ(status.error_code(), grpc::StatusCode::RESOURCE_EXHAUSTED)
+      << status.error_message();
+}
+
+TEST(Server, CompoundHetMaxRows) {
+  const auto test_server = StartTestServer();
+  ASSERT_TRUE(test_server.stub != nullptr);
+  QueryService::Stub* const stub = test_server.stub.get();
+
+  // 13475 variants are candidates, of which 5103 form pairs.
+  constexpr int kNumExpectedRows = 5103;
+  QueryRequest request;
+  for (const auto& arrow_url : ReadNa12878TrioQuery().arrow_urls()) {
+    request.add_arrow_urls(arrow_url);
+  }
+  request.add_projection_columns("xpos");
+  request.mutable_filter_expression()->mutable_literal()->set_bool_value(true);
+  auto& inheritance_filter = *request.mutable_inheritance_filter();
+  inheritance_filter.set_mode(QueryRequest::InheritanceFilter::COMPOUND_HET);
+  for (const auto* const sample_id : {"NA12878", "NA12891", "NA12892"}) {
+    auto& individual = *inheritance_filter.add_individuals();
+    individual.set_sample_id(sample_id);
+    individual.set_affected(individual.sample_id() == "NA12878");
+  }
+
+  request.set_max_rows(10000);
+  {
+    grpc::ClientContext context;
+    QueryResponse response;
+    const auto status = stub->Query(&context, request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+    EXPECT_EQ(response.num_rows(), kNumExpectedRows);
+  }
+
+  request.set_max_rows(kNumExpectedRows - 1);
+  {
+    grpc::ClientContext context;
+    QueryResponse response;
+    const auto status = stub->Query(&context, request, &response);
+    EXPECT_EQ(status.error_code(), grpc::StatusCode::CANCELLED)
+        << status.error_message();
+  }
+
+  // The candidates exceed max_rows even though the pairs don't.
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_compound_het_max_candidates_factor, 1);
+  request.set_max_rows(10000);
+  {
+    grpc::ClientContext context;
+    QueryResponse response;
+    const auto status = stub->Query(&context, request, &response);
+    EXPECT_EQ(status.error_code(), grpc::StatusCode::CANCELLED)
+        << status.error_message();
+    EXPECT_NE(status.error_message().find("compound het candidates"),
+              std::string::npos)
+        << status.error_message();
+  }
+}
+
+TEST(Server, Flight) {
+  constexpr int kFlightPort = 12346;
+  const auto test_server = StartTestServer(kFlightPort);
+  ASSERT_TRUE(test_server.server != nullptr);
+
+  arrow::flight::Location location;
+  ASSERT_TRUE(
+      arrow::flight::Location::ForGrpcTcp("localhost", kFlightPort, &location)
+          .ok());
+  std::unique_ptr<arrow::flight::FlightClient> client;
+  ASSERT_TRUE(arrow::flight::FlightClient::Connect(location, &client).ok());
+
+  QueryRequest request = ReadNa12878TrioQuery();
+  std::unique_ptr<arrow::flight::FlightInfo> info;
+  const auto info_status = client->GetFlightInfo(
+      arrow::flight::FlightDescriptor::Command(request.SerializeAsString()),
+      &info);
+  ASSERT_TRUE(info_status.ok()) << info_status;
+  constexpr int64_t kNumExpectedRows = 6;
+  EXPECT_EQ(info->total_records(), kNumExpectedRows);
+  ASSERT_EQ(info->endpoints().size(), 1);
+
+  // The query stats are part of the schema metadata.
+  arrow::ipc::DictionaryMemo dictionary_memo;
+  std::shared_ptr<arrow::Schema> schema;
+  ASSERT_TRUE(info->GetSchema(&dictionary_memo, &schema).ok());
+  ASSERT_TRUE(schema->metadata() != nullptr);
+  const auto metadata = schema->metadata()->Get(kQueryResponseMetadataKey);
+  ASSERT_TRUE(metadata.ok()) << metadata.status();
+  std::string serialized_response;
+  ASSERT_TRUE(absl::Base64Unescape(*metadata, &serialized_response));
+  QueryResponse response;
+  ASSERT_TRUE(response.ParseFromString(serialized_response));
+  EXPECT_EQ(response.num_rows(), kNumExpectedRows);
+  EXPECT_GT(response.conjunct_stats_size(), 0);
+  EXPECT_GT(response.peak_memory_bytes(), 0);
+
+  std::unique_ptr<arrow::flight::FlightStreamReader> stream;
+  ASSERT_TRUE(client->DoGet(info->endpoints()[0].ticket, &stream).ok());
+  std::shared_ptr<arrow::Table> table;
+  const auto read_status = stream->ReadAll(&table);
+  ASSERT_TRUE(read_status.ok()) << read_status;
+  ASSERT_EQ(table->num_rows(), kNumExpectedRows);
+
+  const auto combined_table = table->CombineChunks();
+  ASSERT_TRUE(combined_table.ok()) << combined_table.status();
+  const auto xpos_col = std::static_pointer_cast<arrow::Int64Array>(
+      (*combined_table)->GetColumnByName("xpos")->chunk(0));
+  const auto variant_id_col = std::static_pointer_cast<arrow::StringArray>(
+      (*combined_table)->GetColumnByName("variantId")->chunk(0));
+  XposAndVariantIds actual;
+  for (int64_t i = 0; i < table->num_rows(); ++i) {
+    actual.insert(
+        std::make_tuple(xpos_col->Value(i), variant_id_col->GetString(i)));
+  }
+  const XposAndVariantIds expected{
+      {1001050069, "1-1050069-G-A"},  {1001054900, "1-1054900-C-T"},
+      {1002024923, "1-2024923-G-A"},  {1002302812, "1-2302812-A-G"},
+      {1011145001, "1-11145001-C-T"}, {1011241657, "1-11241657-A-G"}};
+  EXPECT_EQ(actual, expected);
+
+  // Errors are reported by GetFlightInfo.
+  request.set_max_rows(5);
+  const auto status = client->GetFlightInfo(
+      arrow::flight::FlightDescriptor::Command(request.SerializeAsString()),
+      &info);
+  EXPECT_FALSE(status.ok());
+  EXPECT_NE(status.message().find("rows matched"), std::string::npos)
+      << status;
+}
+
+TEST(Server, Coordinator) {
+  constexpr int kWorkerPorts[] = {12346, 12347};
+  const auto local_file_reader = MakeLocalFileReader();
+  ASSERT_TRUE(local_file_reader.ok());
+  std::vector<std::unique_ptr<GrpcServer>> workers;
+  std::vector<std::string> worker_addresses;
+  for (const int worker_port : kWorkerPorts) {
+    auto worker = CreateServer(worker_port, **local_file_reader);
+    ASSERT_TRUE(worker.ok()) << worker.status();
+    workers.push_back(*std::move(worker));
+    worker_addresses.push_back(absl::StrCat("localhost:", worker_port));
+  }
+  auto server = CreateCoordinatorServer(kPort, worker_addresses);
+  ASSERT_TRUE(server.ok()) << server.status();
+
+  auto channel = grpc::CreateChannel(absl::StrCat("localhost:", kPort),
+                                     grpc::InsecureChannelCredentials());
+  auto stub = QueryService::NewStub(channel);
+  ASSERT_TRUE(stub != nullptr);
+
+  QueryRequest request = ReadNa12878TrioQuery();
+  {
+    grpc::ClientContext context;
+    QueryResponse response;
+    const auto status = stub->Query(&context, request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    constexpr size_t kNumExpectedRows = 6;
+    EXPECT_EQ(response.num_rows(), kNumExpectedRows);
+    EXPECT_GT(response.conjunct_stats_size(), 0);
+
+    XposAndVariantIds actual;
+    ParseXposAndVariantIds(response.record_batches(), kNumExpectedRows,
+                           &actual);
+    const XposAndVariantIds expected{
+        {1001050069, "1-1050069-G-A"},  {1001054900, "1-1054900-C-T"},
+        {1002024923, "1-2024923-G-A"},  {1002302812, "1-2302812-A-G"},
+        {1011145001, "1-11145001-C-T"}, {1011241657, "1-11241657-A-G"}};
+    EXPECT_EQ(actual, expected);
+  }
+
+  // The limit applies to the total across workers.
+  request.set_max_rows(5);
+  grpc::ClientContext context;
+  QueryResponse response;
+  const auto status = stub->Query(&context, request, &response);
+  EXPECT_EQ(status.error_code(), grpc::StatusCode::CANCELLED)
+      << status.error_message();
+  EXPECT_NE(status.error_message().find("More than 5 rows matched"),
+            std::string::npos)
+      << status.error_message();
+}
+
+TEST(Server, HealthService) {
+  const auto test_server =
+      StartTestServer(/* flight_port */ 0, /* serving */ false);
+  ASSERT_TRUE(test_server.server != nullptr);
+
+  auto channel = grpc::CreateChannel(absl::StrCat("localhost:", kPort),
+                                     grpc::InsecureChannelCredentials());
+  auto stub = grpc::health::v1::Health::NewStub(channel);
+  ASSERT_TRUE(stub != nullptr);
+  const auto check = [&stub] {
+    grpc::ClientContext context;
+    grpc::health::v1::HealthCheckResponse response;
+    const auto status = stub->Check(
+        &context, grpc::health::v1::HealthCheckRequest(), &response);
+    EXPECT_TRUE(status.ok()) << status.error_message();
+    return response.status();
+  };
+
+  EXPECT_EQ(check(), grpc::health::v1::HealthCheckResponse::NOT_SERVING);
+  test_server.server->server->GetHealthCheckService()->SetServingStatus(true);
+  EXPECT_EQ(check(), grpc::health::v1::HealthCheckResponse::SERVING);
+}
+
+TEST(Server, Datasets) {
+  const auto test_server = StartTestServer();
+  ASSERT_TRUE(test_server.stub != nullptr);
+  QueryService::Stub* const stub = test_server.stub.get();
+
+  QueryRequest request = ReadNa12878TrioQuery();
+  {
+    const Dataset dataset = RegisterTrioDataset(stub);
+    ASSERT_EQ(dataset.files_size(), request.arrow_urls_size());
+    EXPECT_GT(dataset.num_rows(), 0);
+  }
+  {
+    grpc::ClientContext context;
+    ListDatasetsResponse response;
+    const auto status =
+        stub->ListDatasets(&context, ListDatasetsRequest(), &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+    ASSERT_EQ(response.datasets_size(), 1);
+    EXPECT_EQ(response.datasets(0).dataset_id(), kTrioDatasetId);
+    EXPECT_EQ(response.datasets(0).files_size(), 0);
+  }
+
+  request.clear_arrow_urls();
+  request.set_dataset_id(kTrioDatasetId);
+  {
+    grpc::ClientContext context;
+    QueryResponse response;
+    const auto status = stub->Query(&context, request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    constexpr size_t kNumExpectedRows = 6;
+    EXPECT_EQ(response.num_rows(), kNumExpectedRows);
+    XposAndVariantIds actual;
+    ParseXposAndVariantIds(response.record_batches(), kNumExpectedRows,
+                           &actual);
+    const XposAndVariantIds expected{
+        {1001050069, "1-1050069-G-A"},  {1001054900, "1-1054900-C-T"},
+        {1002024923, "1-2024923-G-A"},  {1002302812, "1-2302812-A-G"},
+        {1011145001, "1-11145001-C-T"}, {1011241657, "1-11241657-A-G"}};
+    EXPECT_EQ(actual, expected);
+  }
+  {
+    QueryRequest unknown_column_request = request;
+    unknown_column_request.add_projection_columns("unknownColumn");
+    grpc::ClientContext context;
+    QueryResponse response;
+    const auto status =
+        stub->Query(&context, unknown_column_request, &response);
+    EXPECT_EQ(status.error_code(), grpc::StatusCode::INVALID_ARGUMENT)
+        << status.error_message();
+  }
+
+  request.set_dataset_id("unknown");
+  grpc::ClientContext context;
+  QueryResponse response;
+  const auto status = stub->Query(&context, request, &response);
+  EXPECT_EQ(status.error_code(), grpc::StatusCode::NOT_FOUND)
+      << status.error_message();
+}
+
+TEST(Server, ResidentColumns) {
+  // Small enough that some of the columns are only stored compressed.
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_resident_column_store_max_bytes, 256 << 10);
+  const auto test_server = StartTestServer();
+  ASSERT_TRUE(test_server.stub != nullptr);
+  QueryService::Stub* const stub = test_server.stub.get();
+  ASSERT_GT(RegisterTrioDataset(stub).num_rows(), 0);
+
+  // Later queries use the resident columns, which must not change results.
+  QueryRequest request = ReadNa12878TrioQuery();
+  request.clear_arrow_urls();
+  request.set_dataset_id(kTrioDatasetId);
+  std::vector<XposAndVariantIds> results;
+  for (int i = 0; i < 3; ++i) {
+    grpc::ClientContext context;
+    QueryResponse response;
+    const auto status = stub->Query(&context, request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+    constexpr size_t kNumExpectedRows = 6;
+    ASSERT_EQ(response.num_rows(), kNumExpectedRows);
+    ParseXposAndVariantIds(response.record_batches(), kNumExpectedRows,
+                           &results.emplace_back());
+  }
+  EXPECT_EQ(results[0], results[1]);
+  EXPECT_EQ(results[0], results[2]);
+}
+
+TEST(Server, XposIntervals) {
+  const auto test_server = StartTestServer();
+  ASSERT_TRUE(test_server.stub != nullptr);
+  QueryService::Stub* const stub = test_server.stub.get();
+
+  QueryRequest request = ReadNa12878TrioQuery();
+  auto* const interval = request.add_xpos_intervals();
+  interval->set_start_xpos(1001000000);
+  interval->set_end_xpos(1002100000);
+
+  // The test data files are sorted by xpos, so both code paths must return the
+  // same result. The file bounds exclude the second and third file.
+  for (const bool xpos_sorted : {false, true}) {
+    request.set_xpos_sorted(xpos_sorted);
+    request.clear_arrow_url_xpos_bounds();
+    for (const auto& [start, end] :
+         std::vector<std::pair<int64_t, int64_t>>{{1000010146, 1004935109},
+                                                  {1004935115, 1010870257},
+                                                  {1010871566, 1016346402}}) {
+      auto* const bounds = request.add_arrow_url_xpos_bounds();
+      bounds->set_start_xpos(start);
+      bounds->set_end_xpos(end);
+    }
+
+    grpc::ClientContext context;
+    QueryResponse response;
+    auto status = stub->Query(&context, request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    constexpr size_t kNumExpectedRows = 3;
+    EXPECT_EQ(response.num_rows(), kNumExpectedRows);
+
+    XposAndVariantIds actual;
+    ParseXposAndVariantIds(response.record_batches(), kNumExpectedRows,
+                           &actual);
+
+    const XposAndVariantIds expected{{1001050069, "1-1050069-G-A"},
+                                     {1001054900, "1-1054900-C-T"},
+                                     {1002024923, "1-2024923-G-A"}};
+    EXPECT_EQ(actual, expected);
+  }
+}
+
+TEST(Server, PointLookups) {
+  const auto test_server = StartTestServer();
+  ASSERT_TRUE(test_server.stub != nullptr);
+  QueryService::Stub* const stub = test_server.stub.get();
+
+  QueryRequest request = ReadNa12878TrioQuery();
+  request.add_variant_ids("1-1054900-C-T");
+  request.add_variant_ids("1-11241657-A-G");
+  request.add_variant_ids("1-12345-A-G");  // Doesn't exist.
+
+  grpc::ClientContext context;
+  QueryResponse response;
+  auto status = stub->Query(&context, request, &response);
+  ASSERT_TRUE(status.ok()) << status.error_message();
+
+  constexpr size_t kNumExpectedRows = 2;
+  EXPECT_EQ(response.num_rows(), kNumExpectedRows);
+
+  XposAndVariantIds actual;
+  ParseXposAndVariantIds(response.record_batches(), kNumExpectedRows, &actual);
+
+  const XposAndVariantIds expected{{1001054900, "1-1054900-C-T"},
+                                   {1011241657, "1-11241657-A-G"}};
+  EXPECT_EQ(actual, expected);
+}
+
+// Reads the test data into a table.
+std::shared_ptr<arrow::Table> ReadTestTable(const std::string& path) {
+  auto input = arrow::io::ReadableFile::Open(path);
+  EXPECT_TRUE(input.ok()) << input.status();
+  auto record_batch_file_reader =
+      arrow::ipc::RecordBatchFileReader::Open(*input);
+  EXPECT_TRUE(record_batch_file_reader.ok())
+      << record_batch_file_reader.status();
+  arrow::RecordBatchVector record_batches;
+  for (int i = 0; i < (*record_batch_file_reader)->num_record_batches(); ++i) {
+    auto record_batch = (*record_batch_file_reader)->ReadRecordBatch(i);
+    EXPECT_TRUE(record_batch.ok()) << record_batch.status();
+    record_batches.push_back(*record_batch);
+  }
+  auto table = arrow::Table::FromRecordBatches(
+      (*record_batch_file_reader)->schema(), record_batches);
+  EXPECT_TRUE(table.ok()) << table.status();
+  return *table;
+}
+
+// Rewrites the test data using ConvertTable and returns the new URL.
+std::string ConvertTestFile(const std::string& url,
+                            const std::filesystem::path& output_dir) {
+  const std::string path = url.substr(std::string_view("file://").size());
+  ConversionOptions options;
+  options.record_batch_size = 1024;
+  const auto converted_file = ConvertTable(ReadTestTable(path), options);
+  EXPECT_TRUE(converted_file.ok()) << converted_file.status();
+
+  const auto output_path =
+      output_dir / std::filesystem::path(path).filename().replace_extension(
+                       ".lz4.arrow");
+  std::ofstream ofs{output_path, std::ios::binary};
+  ofs.write(reinterpret_cast<const char*>(converted_file->arrow_file->data()),
+            converted_file->arrow_file->size());
+  return absl::StrCat("file://", output_path.string());
+}
+
+TEST(Server, ConvertedFiles) {
+  const auto test_server = StartTestServer();
+  ASSERT_TRUE(test_server.stub != nullptr);
+  QueryService::Stub* const stub = test_server.stub.get();
+
+  const auto output_dir = std::filesystem::temp_directory_path() /
+                          absl::StrCat("server_test_", getpid());
+  std::filesystem::create_directories(output_dir);
+
+  // The converted files use dictionary-encoded sample lists, which the filter
+  // refers to, and are marked as sorted by xpos.
+  QueryRequest request = ReadNa12878TrioQuery();
+  for (auto& url : *request.mutable_arrow_urls()) {
+    url = ConvertTestFile(url, output_dir);
+  }
+  request.add_projection_columns("samples_num_alt_2");
+
+  for (const bool with_interval : {false, true}) {
+    if (with_interval) {
+      auto* const interval = request.add_xpos_intervals();
+      interval->set_start_xpos(1001000000);
+      interval->set_end_xpos(1002100000);
+    }
+
+    grpc::ClientContext context;
+    QueryResponse response;
+    auto status = stub->Query(&context, request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    const size_t num_expected_rows = with_interval ? 3 : 6;
+    EXPECT_EQ(response.num_rows(), num_expected_rows);
+
+    XposAndVariantIds actual;
+    ParseXposAndVariantIds(response.record_batches(), num_expected_rows,
+                           &actual);
+    XposAndVariantIds expected{{1001050069, "1-1050069-G-A"},
+                               {1001054900, "1-1054900-C-T"},
+                               {1002024923, "1-2024923-G-A"}};
+    if (!with_interval) {
+      expected.insert({{1002302812, "1-2302812-A-G"},
+                       {1011145001, "1-11145001-C-T"},
+                       {1011241657, "1-11241657-A-G"}});
+    }
+    EXPECT_EQ(actual, expected);
+  }
+
+  std::filesystem::remove_all(output_dir);
+}
+
+// Rewrites the test data as a Parquet file with small row groups and returns
+// the new URL.
+std::string WriteParquetTestFile(const std::string& url,
+                                 const std::filesystem::path& output_dir) {
+  const std::string path = url.substr(std::string_view("file://").size());
+  const auto output_path =
+      output_dir /
+      std::filesystem::path(path).filename().replace_extension(".parquet");
+  auto output_stream = arrow::io::FileOutputStream::Open(output_path.string());
+  EXPECT_TRUE(output_stream.ok()) << output_stream.status();
+  const auto status = parquet::arrow::WriteTable(
+      *ReadTestTable(path), arrow::default_memory_pool(), *output_stream,
+      /* chunk_size */ 1024);
+  EXPECT_TRUE(status.ok()) << status;
+  EXPECT_TRUE((*output_stream)->Close().ok());
+  return absl::StrCat("file://", output_path.string());
+}
+
+TEST(Server, ParquetFiles) {
+  const auto test_server = StartTestServer();
+  ASSERT_TRUE(test_server.stub != nullptr);
+  QueryService::Stub* const stub = test_server.stub.get();
+
+  const auto output_dir = std::filesystem::temp_directory_path() /
+                          absl::StrCat("server_test_", getpid());
+  std::filesystem::create_directories(output_dir);
+
+  QueryRequest request = ReadNa12878TrioQuery();
+  for (auto& url : *request.mutable_arrow_urls()) {
+    url = WriteParquetTestFile(url, output_dir);
+  }
+  auto* const interval = request.add_xpos_intervals();
+  interval->set_start_xpos(1001000000);
+  interval->set_end_xpos(1002100000);
+
+  grpc::ClientContext context;
+  QueryResponse response;
+  auto status = stub->Query(&context, request, &response);
+  ASSERT_TRUE(status.ok()) << status.error_message();
+
+  constexpr size_t kNumExpectedRows = 3;
+  EXPECT_EQ(response.num_rows(), kNumExpectedRows);
+
+  XposAndVariantIds actual;
+  ParseXposAndVariantIds(response.record_batches(), kNumExpectedRows, &actual);
+  const XposAndVariantIds expected{{1001050069, "1-1050069-G-A"},
+                                   {1001054900, "1-1054900-C-T"},
+                                   {1002024923, "1-2024923-G-A"}};
+  EXPECT_EQ(actual, expected);
+
+  std::filesystem::remove_all(output_dir);
+}
+
 }  // namespace seqr
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace seqr {
+
+// FNV-1a, followed by the splitmix64 finalizer to spread the bits. Unlike
+// absl::Hash, this is stable across processes, so the result can be persisted.
+// Don't change this, as existing index files and caches depend on it.
+inline uint64_t StableHash(const std::string_view value) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (const unsigned char c : value) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  hash ^= hash >> 30;
+  hash *= 0xbf58476d1ce4e5b9ULL;
+  hash ^= hash >> 27;
+  hash *= 0x94d049bb133111ebULL;
+  hash ^= hash >> 31;
+  return hash;
+}
+
+}  // namespace seqr
@@ -1,12 +1,15 @@
 #include "string_list_contains_any.h"
 
 #include <absl/container/flat_hash_set.h>
+#include <arrow/array/array_dict.h>
+#include <arrow/array/array_primitive.h>
 #include <arrow/compute/api_scalar.h>
 #include <arrow/compute/exec.h>
 #include <arrow/compute/function.h>
 #include <arrow/compute/kernel.h>
 #include <arrow/compute/registry.h>
 #include <arrow/type.h>
+#include <arrow/type_traits.h>
 #include <arrow/util/bitmap_writer.h>
 #include <arrow/util/string_view.h>
 #include <arrow/visitor_inline.h>
@@ -46,10 +49,13 @@ arrow::Result<std::unique_ptr<cp::KernelState>> InitStringListContainsAny(
   return result;
 }
 
-template <typename Comparator>
-arrow::Status ExecStringListContainsAnyWithComparator(
-    cp::KernelContext* const ctx, const cp::ExecBatch& batch,
-    arrow::Datum* const out, const Comparator& comparator) {
+// Sets the output to true for lists that contain an element for which
+// element_matches(i, j) is true, where i is the row and j is the index into the
+// list values.
+template <typename ElementMatches>
+arrow::Status ExecListContainsAny(const cp::ExecBatch& batch,
+                                  arrow::Datum* const out,
+                                  const ElementMatches& element_matches) {
   // The boolean output array has already been preallocated.
   // See IsIn (scalar_set_lookup.cc).
   arrow::ArrayData* const output = out->mutable_array();
@@ -62,7 +68,6 @@ arrow::Status ExecStringListContainsAnyWithComparator(
   // https://arrow.apache.org/docs/format/Columnar.html#variable-size-list-layout
   // https://arrow.apache.org/docs/format/Columnar.html#variable-size-binary-layout
   arrow::ListArray lists(batch[0].array());
-  const auto& strings = static_cast<const arrow::StringArray&>(*lists.values());
   const auto* const list_offsets = lists.raw_value_offsets();
   // See ListValueLength (scalar_nested.cc).
   arrow::internal::VisitBitBlocksVoid(
@@ -71,12 +76,7 @@ arrow::Status ExecStringListContainsAnyWithComparator(
         // See BinaryJoin (scalar_string.cc).
         const auto end = list_offsets[i + 1];
         for (auto j = list_offsets[i]; j < end; ++j) {
-          // Need to check for null values here, as the docs say:
-          // "It should be noted that a null value may have a positive slot
-          // length. That is, a null value may occupy a non-empty memory space
-          // in the data buffer. When this is true, the content of the
-          // corresponding memory space is undefined."
-          if (!strings.IsNull(j) && comparator(strings.GetView(j))) {
+          if (element_matches(i, j)) {
             writer.Set();
             writer.Next();
             return;
@@ -95,6 +95,23 @@ arrow::Status ExecStringListContainsAnyWithComparator(
   return arrow::Status::OK();
 }
 
+template <typename Comparator>
+arrow::Status ExecStringListContainsAnyWithComparator(
+    const cp::ExecBatch& batch, arrow::Datum* const out,
+    const Comparator& comparator) {
+  arrow::ListArray lists(batch[0].array());
+  const auto& strings = static_cast<const arrow::StringArray&>(*lists.values());
+  return ExecListContainsAny(
+      batch, out, [&strings, &comparator](int64_t, const int64_t j) {
+        // Need to check for null values here, as the docs say:
+        // "It should be noted that a null value may have a positive slot
+        // length. That is, a null value may occupy a non-empty memory space
+        // in the data buffer. When this is true, the content of the
+        // corresponding memory space is undefined."
+        return !strings.IsNull(j) && comparator(strings.GetView(j));
+      });
+}
+
 arrow::Status ExecStringListContainsAny(cp::KernelContext* const ctx,
                                         const cp::ExecBatch& batch,
                                         arrow::Datum* const out) {
@@ -104,7 +121,7 @@ arrow::Status ExecStringListContainsAny(cp::KernelContext* const ctx,
 
   if (value_set.size() == 1) {  // Fast path for comparing with a single string.
     return ExecStringListContainsAnyWithComparator(
-        ctx, batch, out,
+        batch, out,
         [value = *(value_set.begin())](const arrow::util::string_view sv) {
           return sv == value;
         });
@@ -112,11 +129,145 @@ arrow::Status ExecStringListContainsAny(cp::KernelContext* const ctx,
 
   // Default path, when there's an actual set of strings.
   return ExecStringListContainsAnyWithComparator(
-      ctx, batch, out, [&value_set](const arrow::util::string_view sv) {
+      batch, out, [&value_set](const arrow::util::string_view sv) {
         return value_set.contains(sv);
       });
 }
 
+// For lists of dictionary-encoded strings (see file_converter.h), each
+// dictionary entry is only looked up once per batch.
+std::vector<uint8_t> DictionaryMatches(
+    const absl::flat_hash_set<arrow::util::string_view>& value_set,
+    const arrow::DictionaryArray& values) {
+  const auto& dictionary =
+      static_cast<const arrow::StringArray&>(*values.dictionary());
+  std::vector<uint8_t> result(dictionary.length());
+  for (int64_t i = 0; i < dictionary.length(); ++i) {
+    result[i] =
+        !dictionary.IsNull(i) && value_set.contains(dictionary.GetView(i));
+  }
+  return result;
+}
+
+arrow::Status ExecDictionaryStringListContainsAny(cp::KernelContext* const ctx,
+                                                  const cp::ExecBatch& batch,
+                                                  arrow::Datum* const out) {
+  const auto& value_set =
+      static_cast<const StringListContainsAnyState&>(*ctx->state()).value_set;
+
+  arrow::ListArray lists(batch[0].array());
+  const auto& values =
+      static_cast<const arrow::DictionaryArray&>(*lists.values());
+  const auto dictionary_matches = DictionaryMatches(value_set, values);
+
+  const auto& indices =
+      static_cast<const arrow::Int32Array&>(*values.indices());
+  return ExecListContainsAny(
+      batch, out, [&indices, &dictionary_matches](int64_t, const int64_t j) {
+        return !indices.IsNull(j) && dictionary_matches[indices.Value(j)];
+      });
+}
+
+// Sets the output to true for rows where a sample for which
+// sample_matches(j) is true has an aligned value that's at least the
+// threshold, where j is the index into the sample list values.
+template <typename ValueType, typename SampleMatches>
+arrow::Status ExecSampleValueGreaterEqualWithMatcher(
+    const cp::ExecBatch& batch, arrow::Datum* const out,
+    const SampleMatches& sample_matches) {
+  const auto& threshold_scalar = *batch[2].scalar();
+  if (!threshold_scalar.is_valid) {
+    return arrow::Status::Invalid(
+        "sample_value_greater_equal threshold must not be null");
+  }
+  const double threshold =
+      static_cast<const arrow::DoubleScalar&>(threshold_scalar).value;
+
+  arrow::ListArray sample_lists(batch[0].array());
+  arrow::ListArray value_lists(batch[1].array());
+  const auto* const sample_offsets = sample_lists.raw_value_offsets();
+  const auto* const value_offsets = value_lists.raw_value_offsets();
+  for (int64_t i = 0; i < sample_lists.length(); ++i) {
+    if (sample_lists.IsValid(i) && value_lists.IsValid(i) &&
+        sample_offsets[i + 1] - sample_offsets[i] !=
+            value_offsets[i + 1] - value_offsets[i]) {
+      return arrow::Status::Invalid("sample_value_greater_equal lists of row ",
+                                    i, " aren't aligned");
+    }
+  }
+
+  const auto& values =
+      static_cast<const arrow::NumericArray<ValueType>&>(*value_lists.values());
+  const auto* const raw_values = values.raw_values();
+  return ExecListContainsAny(
+      batch, out, [&](const int64_t i, const int64_t j) {
+        if (!sample_matches(j) || value_lists.IsNull(i)) {
+          return false;
+        }
+        const int64_t k = value_offsets[i] + (j - sample_offsets[i]);
+        return values.IsValid(k) &&
+               static_cast<double>(raw_values[k]) >= threshold;
+      });
+}
+
+template <typename ValueType>
+arrow::Status ExecSampleValueGreaterEqual(cp::KernelContext* const ctx,
+                                          const cp::ExecBatch& batch,
+                                          arrow::Datum* const out) {
+  const auto& value_set =
+      static_cast<const StringListContainsAnyState&>(*ctx->state()).value_set;
+  arrow::ListArray sample_lists(batch[0].array());
+  const auto& strings =
+      static_cast<const arrow::StringArray&>(*sample_lists.values());
+
+  if (value_set.size() == 1) {  // Fast path for a single sample.
+    return ExecSampleValueGreaterEqualWithMatcher<ValueType>(
+        batch, out, [&strings, value = *(value_set.begin())](const int64_t j) {
+          return !strings.IsNull(j) && strings.GetView(j) == value;
+        });
+  }
+
+  return ExecSampleValueGreaterEqualWithMatcher<ValueType>(
+      batch, out, [&strings, &value_set](const int64_t j) {
+        return !strings.IsNull(j) && value_set.contains(strings.GetView(j));
+      });
+}
+
+template <typename ValueType>
+arrow::Status ExecDictionarySampleValueGreaterEqual(
+    cp::KernelContext* const ctx, const cp::ExecBatch& batch,
+    arrow::Datum* const out) {
+  const auto& value_set =
+      static_cast<const StringListContainsAnyState&>(*ctx->state()).value_set;
+  arrow::ListArray sample_lists(batch[0].array());
+  const auto& samples =
+      static_cast<const arrow::DictionaryArray&>(*sample_lists.values());
+  const auto dictionary_matches = DictionaryMatches(value_set, samples);
+  const auto& indices =
+      static_cast<const arrow::Int32Array&>(*samples.indices());
+  return ExecSampleValueGreaterEqualWithMatcher<ValueType>(
+      batch, out, [&indices, &dictionary_matches](const int64_t j) {
+        return !indices.IsNull(j) && dictionary_matches[indices.Value(j)];
+      });
+}
+
+// Casts numeric thresholds to double, so clients can pass e.g. an int32
+// literal for GQ.
+class SampleValueGreaterEqualFunction : public cp::ScalarFunction {
+ public:
+  SampleValueGreaterEqualFunction()
+      : cp::ScalarFunction("sample_value_greater_equal", cp::Arity::Ternary(),
+                           nullptr) {}
+
+  arrow::Result<const cp::Kernel*> DispatchBest(
+      std::vector<arrow::ValueDescr>* values) const override {
+    if (values->size() == 3 && arrow::is_numeric((*values)[2].type->id())) {
+      (*values)[2].type = arrow::float64();
+    }
+    return DispatchExact(*values);
+  }
+};
+
 }  // namespace
 
 arrow::Status RegisterStringListContainsAny(
@@ -125,21 +276,74 @@ arrow::Status RegisterStringListContainsAny(
       "string_list_contains_any", cp::Arity::Unary(), nullptr);
   // For list field names, Arrow uses "item", while Parquet uses "element".
   for (const auto field_name : {"item", "element"}) {
-    // See Arrow's scalar_set_lookup.cc's IsIn for reference.
-    cp::ScalarKernel kernel;
-    kernel.init = InitStringListContainsAny;
-    kernel.exec = ExecStringListContainsAny;
-    kernel.null_handling = cp::NullHandling::OUTPUT_NOT_NULL;
-    kernel.signature =
-        cp::KernelSignature::Make({arrow::list(std::make_shared<arrow::Field>(
-                                      field_name, arrow::utf8()))},
-                                  arrow::boolean());
-    if (const auto status = string_list_contains_any->AddKernel(kernel);
-        !status.ok()) {
-      return status;
+    for (const bool dictionary_encoded : {false, true}) {
+      // See Arrow's scalar_set_lookup.cc's IsIn for reference.
+      cp::ScalarKernel kernel;
+      kernel.init = InitStringListContainsAny;
+      kernel.exec = dictionary_encoded ? ExecDictionaryStringListContainsAny
+                                       : ExecStringListContainsAny;
+      kernel.null_handling = cp::NullHandling::OUTPUT_NOT_NULL;
+      const auto value_type = dictionary_encoded
+                                  ? arrow::dictionary(arrow::int32(),
+                                                      arrow::utf8())
+                                  : arrow::utf8();
+      kernel.signature = cp::KernelSignature::Make(
+          {arrow::list(std::make_shared<arrow::Field>(field_name, value_type))},
+          arrow::boolean());
+      if (const auto status = string_list_contains_any->AddKernel(kernel);
+          !status.ok()) {
+        return status;
+      }
     }
   }
   return registry->AddFunction(std::move(string_list_contains_any));
 }
 
+arrow::Status RegisterSampleValueGreaterEqual(
+    cp::FunctionRegistry* const registry) {
+  struct ValueKernels {
+    std::shared_ptr<arrow::DataType> type;
+    cp::ArrayKernelExec exec;
+    cp::ArrayKernelExec dictionary_exec;
+  };
+  const std::vector<ValueKernels> value_kernels = {
+      {arrow::int32(), ExecSampleValueGreaterEqual<arrow::Int32Type>,
+       ExecDictionarySampleValueGreaterEqual<arrow::Int32Type>},
+      {arrow::float32(), ExecSampleValueGreaterEqual<arrow::FloatType>,
+       ExecDictionarySampleValueGreaterEqual<arrow::FloatType>},
+      {arrow::float64(), ExecSampleValueGreaterEqual<arrow::DoubleType>,
+       ExecDictionarySampleValueGreaterEqual<arrow::DoubleType>},
+  };
+
+  auto sample_value_greater_equal =
+      std::make_shared<SampleValueGreaterEqualFunction>();
+  for (const auto field_name : {"item", "element"}) {
+    for (const bool dictionary_encoded : {false, true}) {
+      const auto sample_type = dictionary_encoded
+                                   ? arrow::dictionary(arrow::int32(),
+                                                       arrow::utf8())
+                                   : arrow::utf8();
+      for (const auto& value_kernel : value_kernels) {
+        cp::ScalarKernel kernel;
+        kernel.init = InitStringListContainsAny;
+        kernel.exec = dictionary_encoded ? value_kernel.dictionary_exec
+                                         : value_kernel.exec;
+        kernel.null_handling = cp::NullHandling::OUTPUT_NOT_NULL;
+        kernel.signature = cp::KernelSignature::Make(
+            {arrow::list(
+                 std::make_shared<arrow::Field>(field_name, sample_type)),
+             arrow::list(
+                 std::make_shared<arrow::Field>(field_name, value_kernel.type)),
+             cp::InputType::Scalar(arrow::float64())},
+            arrow::boolean());
+        if (const auto status = sample_value_greater_equal->AddKernel(kernel);
+            !status.ok()) {
+          return status;
+        }
+      }
+    }
+  }
+  return registry->AddFunction(std::move(sample_value_greater_equal));
+}
+
 }  // namespace seqr
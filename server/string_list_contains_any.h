@@ -10,5 +10,14 @@ namespace seqr {
 arrow::Status RegisterStringListContainsAny(
     arrow::compute::FunctionRegistry* registry);
 
+// Call this function once at startup time to register the Arrow compute
+// function "sample_value_greater_equal". Its arguments are a List<string> of
+// sample IDs, an aligned List<number> of per-sample values (e.g. GQ or AB) and
+// a scalar threshold. Given SetLookupOptions with the samples to look up, it
+// outputs true iff one of those samples has a value that's at least the
+// threshold.
+arrow::Status RegisterSampleValueGreaterEqual(
+    arrow::compute::FunctionRegistry* registry);
+
 }  // namespace seqr
 
@@ -4,10 +4,14 @@
 #include <arrow/array/builder_nested.h>
 #include <arrow/array/builder_primitive.h>
 #include <arrow/compute/api_scalar.h>
+#include <arrow/compute/api_vector.h>
 #include <arrow/compute/exec.h>
+#include <arrow/scalar.h>
 #include <arrow/testing/gtest_util.h>
 #include <gtest/gtest.h>
 
+#include <optional>
+
 namespace seqr {
 namespace cp = arrow::compute;
 
@@ -77,6 +81,18 @@ void CheckStringListContainsAny(
   std::shared_ptr<arrow::BooleanArray> expected;
   ASSERT_OK(expected_builder.Finish(&expected));
   ASSERT_EQ(*result, *expected);
+
+  // Lists of dictionary-encoded strings must give the same result.
+  ASSERT_OK_AND_ASSIGN(const auto encoded_values,
+                       cp::DictionaryEncode(input->values()));
+  const auto dictionary_input = std::make_shared<arrow::ListArray>(
+      arrow::list(arrow::field("item", encoded_values.type())),
+      input->length(), input->value_offsets(), encoded_values.make_array(),
+      input->null_bitmap(), input->null_count(), input->offset());
+  auto dictionary_result = cp::CallFunction(
+      "string_list_contains_any", {dictionary_input}, &options, &ctx);
+  ASSERT_OK(dictionary_result);
+  ASSERT_EQ(*dictionary_result, *expected);
 }
 
 TEST(TestStringListContainsAny, OneLookupValues) {
@@ -166,4 +182,122 @@ TEST(TestStringListContainsAny, TwoLookupValues) {
                              string_validity, expected_values);
 }
 
+// Returns a list array, where null lists are given as std::nullopt.
+template <typename Builder, typename T>
+std::shared_ptr<arrow::Array> MakeListArray(
+    const std::vector<std::optional<std::vector<T>>>& lists) {
+  auto* const memory_pool = arrow::default_memory_pool();
+  arrow::ListBuilder list_builder(memory_pool,
+                                  std::make_shared<Builder>(memory_pool));
+  auto& value_builder = static_cast<Builder&>(*list_builder.value_builder());
+  for (const auto& list : lists) {
+    if (!list.has_value()) {
+      EXPECT_OK(list_builder.AppendNull());
+      continue;
+    }
+    EXPECT_OK(list_builder.Append());
+    EXPECT_OK(value_builder.AppendValues(*list));
+  }
+  std::shared_ptr<arrow::Array> result;
+  EXPECT_OK(list_builder.Finish(&result));
+  return result;
+}
+
+class TestSampleValueGreaterEqual : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_OK(RegisterSampleValueGreaterEqual(registry_.get()));
+  }
+
+  arrow::Result<arrow::Datum> Call(
+      const std::vector<std::string>& lookup_values,
+      const std::shared_ptr<arrow::Array>& samples,
+      const std::shared_ptr<arrow::Array>& values,
+      const std::shared_ptr<arrow::Scalar>& threshold) {
+    arrow::StringBuilder value_set_builder;
+    EXPECT_OK(value_set_builder.AppendValues(lookup_values));
+    std::shared_ptr<arrow::Array> value_set;
+    EXPECT_OK(value_set_builder.Finish(&value_set));
+    const cp::SetLookupOptions options{value_set, true};
+    cp::ExecContext ctx(arrow::default_memory_pool(), nullptr,
+                        registry_.get());
+    return cp::CallFunction("sample_value_greater_equal",
+                            {samples, values, threshold}, &options, &ctx);
+  }
+
+  // Checks plain and dictionary-encoded sample lists.
+  void Check(const std::vector<std::string>& lookup_values,
+             const std::shared_ptr<arrow::Array>& samples,
+             const std::shared_ptr<arrow::Array>& values,
+             const double threshold, const std::vector<bool>& expected_values) {
+    arrow::BooleanBuilder expected_builder;
+    ASSERT_OK(expected_builder.AppendValues(expected_values));
+    std::shared_ptr<arrow::Array> expected;
+    ASSERT_OK(expected_builder.Finish(&expected));
+
+    const auto threshold_scalar = arrow::MakeScalar(threshold);
+    ASSERT_OK_AND_ASSIGN(
+        const auto result,
+        Call(lookup_values, samples, values, threshold_scalar));
+    ASSERT_EQ(*result.make_array(), *expected);
+
+    const auto& sample_lists = static_cast<const arrow::ListArray&>(*samples);
+    ASSERT_OK_AND_ASSIGN(const auto encoded_samples,
+                         cp::DictionaryEncode(sample_lists.values()));
+    const auto dictionary_samples = std::make_shared<arrow::ListArray>(
+        arrow::list(arrow::field("item", encoded_samples.type())),
+        sample_lists.length(), sample_lists.value_offsets(),
+        encoded_samples.make_array(), sample_lists.null_bitmap(),
+        sample_lists.null_count(), sample_lists.offset());
+    ASSERT_OK_AND_ASSIGN(
+        const auto dictionary_result,
+        Call(lookup_values, dictionary_samples, values, threshold_scalar));
+    ASSERT_EQ(*dictionary_result.make_array(), *expected);
+  }
+
+  // Don't clobber the global registry.
+  const std::shared_ptr<cp::FunctionRegistry> registry_ =
+      cp::FunctionRegistry::Make();
+};
+
+TEST_F(TestSampleValueGreaterEqual, GenotypeQuality) {
+  const auto samples = MakeListArray<arrow::StringBuilder, std::string>(
+      {{{"s01", "s02"}},
+       {{"s02", "s03"}},
+       {{"s03"}},
+       std::nullopt,
+       {{"s01", "s02"}},
+       std::vector<std::string>{}});
+  const auto gq = MakeListArray<arrow::Int32Builder, int32_t>(
+      {{{10, 30}},
+       {{20, 99}},
+       {{99}},
+       std::nullopt,
+       std::nullopt,
+       std::vector<int32_t>{}});
+
+  // A single lookup value triggers the fast path.
+  Check({"s02"}, samples, gq, 20, {true, true, false, false, false, false});
+  Check({"s02"}, samples, gq, 25, {true, false, false, false, false, false});
+  Check({"s01", "s03"}, samples, gq, 20,
+        {false, true, true, false, false, false});
+}
+
+TEST_F(TestSampleValueGreaterEqual, AlleleBalance) {
+  const auto samples = MakeListArray<arrow::StringBuilder, std::string>(
+      {{{"s01", "s02"}}, {{"s02"}}, {{"s02"}}});
+  const auto ab = MakeListArray<arrow::FloatBuilder, float>(
+      {{{0.5f, 0.25f}}, {{0.125f}}, std::nullopt});
+  Check({"s02"}, samples, ab, 0.25, {true, false, false});
+  Check({"s01", "s02"}, samples, ab, 0.125, {true, true, false});
+  Check({"s01", "s02"}, samples, ab, 0.3, {true, false, false});
+}
+
+TEST_F(TestSampleValueGreaterEqual, UnalignedLists) {
+  const auto samples = MakeListArray<arrow::StringBuilder, std::string>(
+      {{{"s01", "s02"}}});
+  const auto gq = MakeListArray<arrow::Int32Builder, int32_t>({{{10}}});
+  EXPECT_FALSE(Call({"s01"}, samples, gq, arrow::MakeScalar(5.0)).ok());
+}
+
 }  // namespace seqr
@@ -2,11 +2,15 @@
 
 #include <absl/flags/declare.h>
 #include <absl/flags/flag.h>
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
 #include <absl/strings/strip.h>
+#include <arrow/memory_pool.h>
 #include <google/cloud/storage/client.h>
 
 #include <filesystem>
 #include <fstream>
+#include <utility>
 
 ABSL_DECLARE_FLAG(int, num_threads);
 
@@ -16,9 +20,27 @@ namespace gcs = google::cloud::storage;
 
 namespace {
 
+// Splits a gs://bucket/blob URL.
+absl::StatusOr<std::pair<std::string, std::string>> ParseGcsUrl(
+    std::string_view url) {
+  if (!absl::ConsumePrefix(&url, "gs://")) {
+    return absl::InvalidArgumentError(absl::StrCat("Unsupported URL: ", url));
+  }
+
+  const size_t slash_pos = url.find_first_of('/');
+  if (slash_pos == std::string_view::npos) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Incomplete blob URL ", url));
+  }
+
+  return std::make_pair(std::string(url.substr(0, slash_pos)),
+                        std::string(url.substr(slash_pos + 1)));
+}
+
 class LocalFileReader : public UrlReader {
  public:
-  absl::StatusOr<std::vector<char>> Read(std::string_view url) const override {
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> Read(
+      std::string_view url) const override {
     if (!absl::ConsumePrefix(&url, "file://")) {
       return absl::InvalidArgumentError(absl::StrCat("Unsupported URL: ", url));
     }
@@ -29,44 +51,103 @@ class LocalFileReader : public UrlReader {
           absl::StrCat("Failed to determine file size for ", url));
     }
 
-    std::vector<char> result(file_size, 0);
-    std::ifstream ifs{std::string(url)};
-    ifs.read(result.data(), file_size);
+    auto result = AllocateBlobBuffer(file_size);
+    if (!result.ok()) {
+      return result.status();
+    }
+    std::ifstream ifs{std::string(url), std::ios::binary};
+    if (!ifs) {
+      return absl::NotFoundError(absl::StrCat("Failed to open ", url));
+    }
+    ifs.read(reinterpret_cast<char*>((*result)->mutable_data()), file_size);
+    if (static_cast<std::uintmax_t>(ifs.gcount()) != file_size) {
+      return absl::DataLossError(absl::StrCat("Expected ", file_size,
+                                              " bytes, read ", ifs.gcount(),
+                                              " from ", url));
+    }
     return result;
   }
-};
 
-class GcsReader : public UrlReader {
- public:
-  absl::StatusOr<std::vector<char>> Read(std::string_view url) const override {
-    if (!absl::ConsumePrefix(&url, "gs://")) {
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadRange(
+      std::string_view url, const int64_t offset,
+      const int64_t length) const override {
+    if (!absl::ConsumePrefix(&url, "file://")) {
       return absl::InvalidArgumentError(absl::StrCat("Unsupported URL: ", url));
     }
-
-    const size_t slash_pos = url.find_first_of('/');
-    if (slash_pos == std::string_view::npos) {
+    if (offset < 0 || length < 0) {
       return absl::InvalidArgumentError(
-          absl::StrCat("Incomplete blob URL ", url));
+          absl::StrCat("Invalid range ", offset, "+", length, " for ", url));
     }
 
-    const auto bucket = url.substr(0, slash_pos);
-    const auto blob = url.substr(slash_pos + 1);
+    std::ifstream ifs{std::string(url), std::ios::binary};
+    if (!ifs) {
+      return absl::NotFoundError(absl::StrCat("Failed to open ", url));
+    }
+    auto result = AllocateBlobBuffer(length);
+    if (!result.ok()) {
+      return result.status();
+    }
+    ifs.seekg(offset);
+    ifs.read(reinterpret_cast<char*>((*result)->mutable_data()), length);
+    if (ifs.gcount() != length) {
+      return absl::OutOfRangeError(absl::StrCat(
+          "Failed to read range ", offset, "+", length, " of ", url));
+    }
+    return result;
+  }
+
+  absl::StatusOr<UrlMetadata> GetMetadata(std::string_view url) const override {
+    if (!absl::ConsumePrefix(&url, "file://")) {
+      return absl::InvalidArgumentError(absl::StrCat("Unsupported URL: ", url));
+    }
+
+    std::error_code error_code;
+    const std::uintmax_t file_size =
+        std::filesystem::file_size(url, error_code);
+    if (error_code) {
+      return absl::NotFoundError(
+          absl::StrCat("Failed to determine file size for ", url, ": ",
+                       error_code.message()));
+    }
+    const auto last_write_time =
+        std::filesystem::last_write_time(url, error_code);
+    if (error_code) {
+      return absl::NotFoundError(
+          absl::StrCat("Failed to determine last write time for ", url, ": ",
+                       error_code.message()));
+    }
+
+    // Local files don't have generations, so use the modification time.
+    return UrlMetadata{
+        static_cast<int64_t>(file_size),
+        absl::StrCat(last_write_time.time_since_epoch().count())};
+  }
+};
+
+class GcsReader : public UrlReader {
+ public:
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> Read(
+      std::string_view url) const override {
+    const auto bucket_and_blob = ParseGcsUrl(url);
+    if (!bucket_and_blob.ok()) {
+      return bucket_and_blob.status();
+    }
+    const auto& [bucket, blob] = *bucket_and_blob;
 
     // Make a copy of the GCS client for thread-safety.
     gcs::Client gcs_client = shared_gcs_client_;
 
     try {
-      auto reader =
-          gcs_client.ReadObject(std::string(bucket), std::string(blob));
+      auto reader = gcs_client.ReadObject(bucket, blob);
       if (reader.bad()) {
         return absl::InvalidArgumentError(
             absl::StrCat("Failed to read blob: ", reader.status().message()));
       }
 
-      std::optional<int> content_length;
+      std::optional<int64_t> content_length;
       for (const auto& header : reader.headers()) {
         if (header.first == "content-length") {
-          int value = 0;
+          int64_t value = 0;
           if (!absl::SimpleAtoi(header.second, &value)) {
             return absl::NotFoundError(
                 "Couldn't parse content-length header value");
@@ -78,12 +159,21 @@ class GcsReader : public UrlReader {
         return absl::NotFoundError("Couldn't find content-length header");
       }
 
-      std::vector<char> result(*content_length, '\0');
-      reader.read(result.data(), result.size());
+      auto result = AllocateBlobBuffer(*content_length);
+      if (!result.ok()) {
+        return result.status();
+      }
+      reader.read(reinterpret_cast<char*>((*result)->mutable_data()),
+                  *content_length);
       if (reader.bad()) {
         return absl::InvalidArgumentError(
             absl::StrCat("Failed to read blob: ", reader.status().message()));
       }
+      if (reader.gcount() != *content_length) {
+        return absl::DataLossError(
+            absl::StrCat("Expected ", *content_length, " bytes, read ",
+                         reader.gcount(), " from ", url));
+      }
       return result;
     } catch (const std::exception& e) {
       // Unfortunately the googe-cloud-storage library throws exceptions.
@@ -92,7 +182,99 @@ class GcsReader : public UrlReader {
     }
   }
 
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadRange(
+      std::string_view url, const int64_t offset,
+      const int64_t length) const override {
+    return ReadGcsRange(url, gcs::Generation(), offset, length);
+  }
+
+  // Pins the generation in the request, so GCS fails it if the object has
+  // been overwritten since.
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadRangeOfGeneration(
+      std::string_view url, const std::string_view generation,
+      const int64_t offset, const int64_t length) const override {
+    int64_t generation_value = 0;
+    if (!absl::SimpleAtoi(generation, &generation_value)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid generation ", generation, " for ", url));
+    }
+    return ReadGcsRange(url, gcs::Generation(generation_value), offset,
+                        length);
+  }
+
+  absl::StatusOr<UrlMetadata> GetMetadata(std::string_view url) const override {
+    const auto bucket_and_blob = ParseGcsUrl(url);
+    if (!bucket_and_blob.ok()) {
+      return bucket_and_blob.status();
+    }
+    const auto& [bucket, blob] = *bucket_and_blob;
+
+    // Make a copy of the GCS client for thread-safety.
+    gcs::Client gcs_client = shared_gcs_client_;
+
+    try {
+      const auto metadata = gcs_client.GetObjectMetadata(bucket, blob);
+      if (!metadata) {
+        return absl::NotFoundError(
+            absl::StrCat("Failed to get metadata for ", url, ": ",
+                         metadata.status().message()));
+      }
+      return UrlMetadata{static_cast<int64_t>(metadata->size()),
+                         absl::StrCat(metadata->generation())};
+    } catch (const std::exception& e) {
+      return absl::InternalError(absl::StrCat(
+          "Exception during metadata lookup of ", url, ": ", e.what()));
+    }
+  }
+
  private:
+  // Reads a range of the given generation, or of the latest one if
+  // generation is unset.
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadGcsRange(
+      std::string_view url, const gcs::Generation& generation,
+      const int64_t offset, const int64_t length) const {
+    if (offset < 0 || length < 0) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid range ", offset, "+", length, " for ", url));
+    }
+    if (length == 0) {
+      return AllocateBlobBuffer(0);  // GCS rejects empty ranges.
+    }
+
+    const auto bucket_and_blob = ParseGcsUrl(url);
+    if (!bucket_and_blob.ok()) {
+      return bucket_and_blob.status();
+    }
+    const auto& [bucket, blob] = *bucket_and_blob;
+
+    // Make a copy of the GCS client for thread-safety.
+    gcs::Client gcs_client = shared_gcs_client_;
+
+    try {
+      auto reader = gcs_client.ReadObject(
+          bucket, blob, gcs::ReadRange(offset, offset + length), generation);
+      if (reader.bad()) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Failed to read blob: ", reader.status().message()));
+      }
+
+      auto result = AllocateBlobBuffer(length);
+      if (!result.ok()) {
+        return result.status();
+      }
+      reader.read(reinterpret_cast<char*>((*result)->mutable_data()), length);
+      if (reader.bad() || reader.gcount() != length) {
+        return absl::OutOfRangeError(
+            absl::StrCat("Failed to read range ", offset, "+", length, " of ",
+                         url, ": ", reader.status().message()));
+      }
+      return result;
+    } catch (const std::exception& e) {
+      return absl::InternalError(
+          absl::StrCat("Exception during reading of ", url, ": ", e.what()));
+    }
+  }
+
   // Share connection pool, but need to make copies for thread-safety.
   gcs::Client shared_gcs_client_{
       google::cloud::Options{}.set<gcs::ConnectionPoolSizeOption>(
@@ -101,6 +283,42 @@ class GcsReader : public UrlReader {
 
 }  // namespace
 
+absl::StatusOr<std::shared_ptr<arrow::Buffer>>
+UrlReader::ReadRangeOfGeneration(const std::string_view url,
+                                 const std::string_view generation,
+                                 const int64_t offset,
+                                 const int64_t length) const {
+  auto result = ReadRange(url, offset, length);
+  if (!result.ok()) {
+    return result;
+  }
+  // Generations change with every write, so if the generation is still the
+  // expected one, it hasn't changed while reading either.
+  const auto metadata = GetMetadata(url);
+  if (!metadata.ok()) {
+    return metadata.status();
+  }
+  if (metadata->generation != generation) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Expected generation ", generation, " of ", url,
+                     ", found ", metadata->generation));
+  }
+  return result;
+}
+
+absl::StatusOr<std::shared_ptr<arrow::Buffer>> AllocateBlobBuffer(
+    const int64_t size) {
+  // Unlike std::vector, this doesn't zero-initialize the memory, which is
+  // significant for large blobs.
+  auto buffer = arrow::AllocateBuffer(size, arrow::default_memory_pool());
+  if (!buffer.ok()) {
+    return absl::ResourceExhaustedError(
+        absl::StrCat("Failed to allocate ", size, " bytes: ",
+                     buffer.status().ToString()));
+  }
+  return std::shared_ptr<arrow::Buffer>(*std::move(buffer));
+}
+
 absl::StatusOr<std::unique_ptr<UrlReader>> MakeLocalFileReader() {
   return std::make_unique<LocalFileReader>();
 }
@@ -1,21 +1,65 @@
 #pragma once
 
 #include <absl/status/statusor.h>
+#include <arrow/buffer.h>
 
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <string_view>
-#include <vector>
 
 namespace seqr {
 
+struct UrlMetadata {
+  int64_t size = 0;
+  // Changes whenever the content changes, e.g. the GCS object generation.
+  std::string generation;
+};
+
 class UrlReader {
  public:
   virtual ~UrlReader() = default;
 
-  virtual absl::StatusOr<std::vector<char>> Read(
+  // Buffers returned by all read methods are 64-byte aligned, so Arrow arrays
+  // can reference them without copying. They may be shared between callers
+  // and must not be modified.
+  virtual absl::StatusOr<std::shared_ptr<arrow::Buffer>> Read(
+      std::string_view url) const = 0;
+
+  // Like Read, for callers that already know the metadata of the content,
+  // e.g. from GetMetadata, so readers don't have to look it up again. Fails if
+  // the content has changed since, i.e. if its generation differs, so the
+  // result always has metadata.size bytes.
+  virtual absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadWithMetadata(
+      std::string_view url, const UrlMetadata& metadata) const {
+    return ReadRangeOfGeneration(url, metadata.generation, 0, metadata.size);
+  }
+
+  // Reads length bytes starting at offset. Fails if the range exceeds the end
+  // of the content.
+  virtual absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadRange(
+      std::string_view url, int64_t offset, int64_t length) const = 0;
+
+  // Like ReadRange, but fails if the content doesn't have the given
+  // generation (see UrlMetadata), so that several ranges are guaranteed to be
+  // from the same content. By default, the generation is compared after
+  // reading the range.
+  virtual absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadRangeOfGeneration(
+      std::string_view url, std::string_view generation, int64_t offset,
+      int64_t length) const;
+
+  // Returns the metadata without reading the content.
+  virtual absl::StatusOr<UrlMetadata> GetMetadata(
       std::string_view url) const = 0;
 };
 
+// Alignment of the buffers returned by UrlReader.
+inline constexpr int64_t kBlobAlignment = 64;
+
+// Allocates an uninitialized, 64-byte aligned buffer for reading a blob.
+absl::StatusOr<std::shared_ptr<arrow::Buffer>> AllocateBlobBuffer(
+    int64_t size);
+
 // Reads from a local file system.
 absl::StatusOr<std::unique_ptr<UrlReader>> MakeLocalFileReader();
 
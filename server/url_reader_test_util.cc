@@ -0,0 +1,56 @@
+#include "url_reader_test_util.h"
+
+#include <absl/strings/str_cat.h>
+#include <unistd.h>
+
+#include <fstream>
+
+namespace seqr {
+
+namespace fs = std::filesystem;
+
+CountingReader::CountingReader(std::atomic<int>* const num_reads)
+    : base_reader_(*MakeLocalFileReader()), num_reads_(num_reads) {}
+
+absl::StatusOr<std::shared_ptr<arrow::Buffer>> CountingReader::Read(
+    std::string_view url) const {
+  ++*num_reads_;
+  return base_reader_->Read(url);
+}
+
+absl::StatusOr<std::shared_ptr<arrow::Buffer>> CountingReader::ReadRange(
+    std::string_view url, const int64_t offset, const int64_t length) const {
+  ++*num_reads_;
+  return base_reader_->ReadRange(url, offset, length);
+}
+
+absl::StatusOr<UrlMetadata> CountingReader::GetMetadata(
+    std::string_view url) const {
+  return base_reader_->GetMetadata(url);
+}
+
+std::string ToString(
+    const absl::StatusOr<std::shared_ptr<arrow::Buffer>>& data) {
+  EXPECT_TRUE(data.ok()) << data.status();
+  return data.ok() ? (*data)->ToString() : "";
+}
+
+void BlobDirectoryTest::SetUp() {
+  // Test executables may run in parallel, so the directory is per process.
+  root_ = fs::temp_directory_path() /
+          absl::StrCat("seqr_blob_directory_test_", getpid());
+  fs::remove_all(root_);
+  fs::create_directories(root_ / "blobs");
+}
+
+void BlobDirectoryTest::TearDown() { fs::remove_all(root_); }
+
+std::string BlobDirectoryTest::WriteBlob(const std::string& name,
+                                         const std::string& content) {
+  const fs::path path = root_ / "blobs" / name;
+  std::ofstream ofs{path, std::ios::binary | std::ios::trunc};
+  ofs << content;
+  return absl::StrCat("file://", path.string());
+}
+
+}  // namespace seqr
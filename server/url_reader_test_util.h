@@ -0,0 +1,52 @@
+#pragma once
+
+#include <absl/status/statusor.h>
+#include <arrow/buffer.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "url_reader.h"
+
+namespace seqr {
+
+// Counts the reads that reach the local file system.
+class CountingReader : public UrlReader {
+ public:
+  explicit CountingReader(std::atomic<int>* num_reads);
+
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> Read(
+      std::string_view url) const override;
+
+  absl::StatusOr<std::shared_ptr<arrow::Buffer>> ReadRange(
+      std::string_view url, int64_t offset, int64_t length) const override;
+
+  absl::StatusOr<UrlMetadata> GetMetadata(std::string_view url) const override;
+
+ private:
+  const std::unique_ptr<UrlReader> base_reader_;
+  std::atomic<int>* const num_reads_;
+};
+
+// Returns the content of a successful read, failing the test otherwise.
+std::string ToString(
+    const absl::StatusOr<std::shared_ptr<arrow::Buffer>>& data);
+
+// Provides a temporary directory that's removed after each test.
+class BlobDirectoryTest : public testing::Test {
+ protected:
+  void SetUp() override;
+
+  void TearDown() override;
+
+  // Writes a blob to root_ / "blobs" and returns its URL.
+  std::string WriteBlob(const std::string& name, const std::string& content);
+
+  std::filesystem::path root_;
+};
+
+}  // namespace seqr
@@ -0,0 +1,121 @@
+#include "xpos_intervals.h"
+
+#include <absl/strings/str_cat.h>
+#include <arrow/array/array_primitive.h>
+#include <arrow/type.h>
+
+#include <algorithm>
+
+namespace seqr {
+
+namespace cp = arrow::compute;
+
+std::vector<XposInterval> NormalizeXposIntervals(
+    std::vector<XposInterval> intervals) {
+  std::sort(intervals.begin(), intervals.end(),
+            [](const XposInterval& lhs, const XposInterval& rhs) {
+              return lhs.start < rhs.start;
+            });
+
+  std::vector<XposInterval> result;
+  result.reserve(intervals.size());
+  for (const auto& interval : intervals) {
+    if (interval.start >= interval.end) {
+      continue;
+    }
+    if (!result.empty() && interval.start <= result.back().end) {
+      result.back().end = std::max(result.back().end, interval.end);
+    } else {
+      result.push_back(interval);
+    }
+  }
+  return result;
+}
+
+bool OverlapsAnyXposInterval(const std::vector<XposInterval>& intervals,
+                             const XposInterval& range) {
+  // Find the first interval that ends after the start of the range.
+  const auto it = std::upper_bound(
+      intervals.begin(), intervals.end(), range.start,
+      [](const int64_t start, const XposInterval& interval) {
+        return start < interval.end;
+      });
+  return it != intervals.end() && it->start < range.end;
+}
+
+cp::Expression XposIntervalsExpression(
+    const std::vector<XposInterval>& intervals) {
+  std::vector<cp::Expression> disjuncts;
+  disjuncts.reserve(intervals.size());
+  for (const auto& interval : intervals) {
+    disjuncts.push_back(
+        cp::and_(cp::greater_equal(cp::field_ref("xpos"),
+                                   cp::literal(interval.start)),
+                 cp::less(cp::field_ref("xpos"), cp::literal(interval.end))));
+  }
+  return cp::or_(disjuncts);
+}
+
+bool IsSortedByXpos(const arrow::Schema& schema) {
+  const auto& metadata = schema.metadata();
+  if (metadata == nullptr) {
+    return false;
+  }
+  const auto sorted_by = metadata->Get(kSortedByMetadataKey);
+  return sorted_by.ok() && *sorted_by == kSortedByXpos;
+}
+
+absl::StatusOr<std::vector<RowRange>> SortedXposRowRanges(
+    const arrow::RecordBatch& record_batch,
+    const std::vector<XposInterval>& intervals) {
+  const auto xpos_column = record_batch.GetColumnByName("xpos");
+  if (xpos_column == nullptr) {
+    return absl::InvalidArgumentError("Column xpos not found");
+  }
+  if (xpos_column->type_id() != arrow::Type::INT64) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Column xpos has unexpected type ", xpos_column->type()->ToString()));
+  }
+  if (xpos_column->null_count() > 0) {
+    return absl::InvalidArgumentError("Column xpos contains null values");
+  }
+
+  const auto& xpos_array = static_cast<const arrow::Int64Array&>(*xpos_column);
+  const int64_t* const begin = xpos_array.raw_values();
+  const int64_t* const end = begin + xpos_array.length();
+
+  std::vector<RowRange> result;
+  const int64_t* range_begin = begin;
+  for (const auto& interval : intervals) {
+    // As intervals are sorted, we only need to search the remaining rows.
+    range_begin = std::lower_bound(range_begin, end, interval.start);
+    const int64_t* const range_end =
+        std::lower_bound(range_begin, end, interval.end);
+    if (range_begin != range_end) {
+      result.push_back({range_begin - begin, range_end - range_begin});
+    }
+    if (range_end == end) {
+      break;
+    }
+    range_begin = range_end;
+  }
+  return result;
+}
+
+absl::StatusOr<arrow::RecordBatchVector> SliceSortedRecordBatch(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch,
+    const std::vector<XposInterval>& intervals) {
+  const auto row_ranges = SortedXposRowRanges(*record_batch, intervals);
+  if (!row_ranges.ok()) {
+    return row_ranges.status();
+  }
+
+  arrow::RecordBatchVector result;
+  result.reserve(row_ranges->size());
+  for (const auto& row_range : *row_ranges) {
+    result.push_back(record_batch->Slice(row_range.offset, row_range.length));
+  }
+  return result;
+}
+
+}  // namespace seqr
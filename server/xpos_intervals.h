@@ -0,0 +1,60 @@
+#pragma once
+
+#include <absl/status/statusor.h>
+#include <arrow/compute/exec/expression.h>
+#include <arrow/record_batch.h>
+#include <arrow/type.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace seqr {
+
+// A half-open range [start, end) of xpos values.
+struct XposInterval {
+  int64_t start = 0;
+  int64_t end = 0;
+};
+
+// Sorts the intervals by start and merges the ones that overlap or touch.
+// Empty intervals are dropped.
+std::vector<XposInterval> NormalizeXposIntervals(
+    std::vector<XposInterval> intervals);
+
+// Returns true iff the given range overlaps any of the normalized intervals.
+bool OverlapsAnyXposInterval(const std::vector<XposInterval>& intervals,
+                             const XposInterval& range);
+
+// Returns an expression that evaluates to true iff the "xpos" column falls into
+// one of the intervals.
+arrow::compute::Expression XposIntervalsExpression(
+    const std::vector<XposInterval>& intervals);
+
+// Schema metadata that marks files whose record batches are sorted by xpos,
+// across the whole file. See tools/parquet_to_arrow.cc.
+inline constexpr char kSortedByMetadataKey[] = "seqr:sorted_by";
+inline constexpr char kSortedByXpos[] = "xpos";
+
+// Returns true iff the schema metadata marks the file as sorted by xpos.
+bool IsSortedByXpos(const arrow::Schema& schema);
+
+// A contiguous range of rows within a record batch.
+struct RowRange {
+  int64_t offset = 0;
+  int64_t length = 0;
+};
+
+// Returns the row ranges of the record batch that fall into the normalized
+// intervals, with the same requirements as SliceSortedRecordBatch.
+absl::StatusOr<std::vector<RowRange>> SortedXposRowRanges(
+    const arrow::RecordBatch& record_batch,
+    const std::vector<XposInterval>& intervals);
+
+// Returns the slices of the record batch that fall into the normalized
+// intervals. The "xpos" column of the record batch must be sorted and must not
+// contain nulls, which allows finding the slice boundaries using binary search.
+absl::StatusOr<arrow::RecordBatchVector> SliceSortedRecordBatch(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch,
+    const std::vector<XposInterval>& intervals);
+
+}  // namespace seqr
@@ -0,0 +1,102 @@
+#include "xpos_intervals.h"
+
+#include <arrow/array/builder_primitive.h>
+#include <arrow/testing/gtest_util.h>
+#include <arrow/util/key_value_metadata.h>
+#include <gtest/gtest.h>
+
+#include "xpos_intervals_test_util.h"
+
+namespace seqr {
+
+std::vector<std::pair<int64_t, int64_t>> ToPairs(
+    const std::vector<XposInterval>& intervals) {
+  std::vector<std::pair<int64_t, int64_t>> result;
+  for (const auto& interval : intervals) {
+    result.emplace_back(interval.start, interval.end);
+  }
+  return result;
+}
+
+std::vector<std::vector<int64_t>> SliceValues(
+    const arrow::RecordBatchVector& slices) {
+  std::vector<std::vector<int64_t>> result;
+  for (const auto& slice : slices) {
+    const auto& xpos_array =
+        static_cast<const arrow::Int64Array&>(*slice->column(0));
+    result.emplace_back(xpos_array.raw_values(),
+                        xpos_array.raw_values() + xpos_array.length());
+  }
+  return result;
+}
+
+TEST(XposIntervals, Normalize) {
+  const auto normalized = NormalizeXposIntervals(
+      {{30, 40}, {10, 20}, {15, 25}, {25, 28}, {50, 50}, {60, 70}});
+  const std::vector<std::pair<int64_t, int64_t>> expected{
+      {10, 28}, {30, 40}, {60, 70}};
+  EXPECT_EQ(ToPairs(normalized), expected);
+}
+
+TEST(XposIntervals, OverlapsAny) {
+  const std::vector<XposInterval> intervals{{10, 20}, {30, 40}};
+  EXPECT_FALSE(OverlapsAnyXposInterval(intervals, {0, 10}));
+  EXPECT_TRUE(OverlapsAnyXposInterval(intervals, {0, 11}));
+  EXPECT_TRUE(OverlapsAnyXposInterval(intervals, {19, 21}));
+  EXPECT_FALSE(OverlapsAnyXposInterval(intervals, {20, 30}));
+  EXPECT_TRUE(OverlapsAnyXposInterval(intervals, {0, 100}));
+  EXPECT_FALSE(OverlapsAnyXposInterval(intervals, {40, 100}));
+  EXPECT_FALSE(OverlapsAnyXposInterval({}, {0, 100}));
+}
+
+TEST(XposIntervals, SliceSortedRecordBatch) {
+  const auto record_batch =
+      MakeXposRecordBatch({1, 3, 3, 5, 7, 9, 9, 11, 13, 15});
+  const auto slices = SliceSortedRecordBatch(
+      record_batch, NormalizeXposIntervals({{3, 6}, {9, 12}, {20, 30}}));
+  ASSERT_TRUE(slices.ok()) << slices.status();
+  const std::vector<std::vector<int64_t>> expected{{3, 3, 5}, {9, 9, 11}};
+  EXPECT_EQ(SliceValues(*slices), expected);
+}
+
+TEST(XposIntervals, SortedXposRowRanges) {
+  const auto record_batch =
+      MakeXposRecordBatch({1, 3, 3, 5, 7, 9, 9, 11, 13, 15});
+  const auto row_ranges = SortedXposRowRanges(
+      *record_batch, NormalizeXposIntervals({{0, 2}, {9, 12}, {20, 30}}));
+  ASSERT_TRUE(row_ranges.ok()) << row_ranges.status();
+  ASSERT_EQ(row_ranges->size(), 2);
+  EXPECT_EQ((*row_ranges)[0].offset, 0);
+  EXPECT_EQ((*row_ranges)[0].length, 1);
+  EXPECT_EQ((*row_ranges)[1].offset, 5);
+  EXPECT_EQ((*row_ranges)[1].length, 3);
+}
+
+TEST(XposIntervals, SliceSortedRecordBatchNoMatches) {
+  const auto record_batch = MakeXposRecordBatch({1, 3, 5});
+  const auto slices =
+      SliceSortedRecordBatch(record_batch, NormalizeXposIntervals({{6, 10}}));
+  ASSERT_TRUE(slices.ok()) << slices.status();
+  EXPECT_TRUE(slices->empty());
+}
+
+TEST(XposIntervals, SliceSortedRecordBatchMissingColumn) {
+  arrow::Int64Builder builder;
+  ASSERT_OK(builder.Append(1));
+  std::shared_ptr<arrow::Array> array;
+  ASSERT_OK(builder.Finish(&array));
+  const auto record_batch = arrow::RecordBatch::Make(
+      arrow::schema({arrow::field("pos", arrow::int64())}), 1, {array});
+  EXPECT_FALSE(SliceSortedRecordBatch(record_batch, {{0, 10}}).ok());
+}
+
+TEST(XposIntervals, IsSortedByXpos) {
+  const auto schema = arrow::schema({arrow::field("xpos", arrow::int64())});
+  EXPECT_FALSE(IsSortedByXpos(*schema));
+  EXPECT_TRUE(IsSortedByXpos(*schema->WithMetadata(
+      arrow::key_value_metadata({kSortedByMetadataKey}, {kSortedByXpos}))));
+  EXPECT_FALSE(IsSortedByXpos(*schema->WithMetadata(
+      arrow::key_value_metadata({kSortedByMetadataKey}, {"pos"}))));
+}
+
+}  // namespace seqr
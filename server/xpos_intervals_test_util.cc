@@ -0,0 +1,19 @@
+#include "xpos_intervals_test_util.h"
+
+#include <arrow/array/builder_primitive.h>
+#include <gtest/gtest.h>
+
+namespace seqr {
+
+std::shared_ptr<arrow::RecordBatch> MakeXposRecordBatch(
+    const std::vector<int64_t>& xpos_values) {
+  arrow::Int64Builder builder;
+  EXPECT_TRUE(builder.AppendValues(xpos_values).ok());
+  std::shared_ptr<arrow::Array> xpos_array;
+  EXPECT_TRUE(builder.Finish(&xpos_array).ok());
+  return arrow::RecordBatch::Make(
+      arrow::schema({arrow::field("xpos", arrow::int64())}),
+      xpos_array->length(), {xpos_array});
+}
+
+}  // namespace seqr
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <arrow/record_batch.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace seqr {
+
+// Returns a record batch with a single "xpos" column.
+std::shared_ptr<arrow::RecordBatch> MakeXposRecordBatch(
+    const std::vector<int64_t>& xpos_values);
+
+}  // namespace seqr
@@ -0,0 +1,77 @@
+// Builds the lookup index (see FileIndex in seqr_file_metadata.proto) for an
+// Arrow file. The index is typically stored next to the Arrow file and passed
+// to queries using QueryRequest.index_urls.
+
+#include <absl/flags/flag.h>
+#include <absl/flags/parse.h>
+#include <absl/strings/match.h>
+#include <arrow/io/memory.h>
+#include <arrow/ipc/reader.h>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "file_index.h"
+#include "url_reader.h"
+
+ABSL_FLAG(std::string, input_url, "",
+          "URL of the Arrow file to index (gs:// or file://).");
+ABSL_FLAG(std::string, output_path, "",
+          "Local path of the binary FileIndex proto to write.");
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+
+  const std::string input_url = absl::GetFlag(FLAGS_input_url);
+  const std::string output_path = absl::GetFlag(FLAGS_output_path);
+  if (input_url.empty() || output_path.empty()) {
+    std::cerr << "--input_url and --output_path are required" << std::endl;
+    return 1;
+  }
+
+  auto url_reader = absl::StartsWith(input_url, "gs://")
+                        ? seqr::MakeGcsReader()
+                        : seqr::MakeLocalFileReader();
+  if (!url_reader.ok()) {
+    std::cerr << "Failed to create URL reader: " << url_reader.status()
+              << std::endl;
+    return 1;
+  }
+
+  const auto data = (*url_reader)->Read(input_url);
+  if (!data.ok()) {
+    std::cerr << "Failed to read " << input_url << ": " << data.status()
+              << std::endl;
+    return 1;
+  }
+
+  arrow::io::BufferReader buffer_reader{*data};
+  auto record_batch_file_reader =
+      arrow::ipc::RecordBatchFileReader::Open(&buffer_reader);
+  if (!record_batch_file_reader.ok()) {
+    std::cerr << "Failed to open record batch reader: "
+              << record_batch_file_reader.status().ToString() << std::endl;
+    return 1;
+  }
+
+  const auto file_index =
+      seqr::BuildFileIndex(record_batch_file_reader->get());
+  if (!file_index.ok()) {
+    std::cerr << "Failed to build file index: " << file_index.status()
+              << std::endl;
+    return 1;
+  }
+
+  std::ofstream ofs{output_path, std::ios::binary};
+  if (!ofs || !file_index->SerializeToOstream(&ofs)) {
+    std::cerr << "Failed to write " << output_path << std::endl;
+    return 1;
+  }
+
+  std::cout << "Indexed " << file_index->record_batches_size()
+            << " record batches and " << file_index->gene_id_rows_size()
+            << " gene IDs" << std::endl;
+
+  return 0;
+}
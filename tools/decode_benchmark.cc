@@ -0,0 +1,147 @@
+// Measures how fast Arrow files can be decoded, i.e. opened and decompressed
+// into record batches, on a single thread like in the server. Files are read
+// into memory first, so I/O isn't included. For example, to compare the output
+// of pipeline/parquet_to_arrow.py with tools/parquet_to_arrow.cc:
+//
+// decode_benchmark
+//   --urls=file:///tmp/part-00000.zstd.arrow,file:///tmp/part-00000.lz4.arrow
+
+#include <absl/flags/flag.h>
+#include <absl/flags/parse.h>
+#include <absl/strings/match.h>
+#include <absl/strings/str_cat.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+#include <arrow/io/memory.h>
+#include <arrow/ipc/reader.h>
+#include <arrow/util/byte_size.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "url_reader.h"
+
+ABSL_FLAG(std::vector<std::string>, urls, {},
+          "Comma-separated URLs of Arrow files (gs:// or file://).");
+ABSL_FLAG(std::vector<std::string>, columns, {},
+          "Comma-separated columns to decode. Decodes all columns if empty.");
+ABSL_FLAG(int, iterations, 5, "Number of times to decode each file.");
+
+namespace {
+
+struct DecodeResult {
+  int num_record_batches = 0;
+  int64_t num_rows = 0;
+  int64_t decoded_bytes = 0;
+};
+
+absl::StatusOr<DecodeResult> Decode(
+    const std::shared_ptr<arrow::Buffer>& data,
+    const std::vector<std::string>& columns) {
+  arrow::io::BufferReader buffer_reader{data};
+
+  arrow::ipc::IpcReadOptions ipc_read_options;
+  ipc_read_options.use_threads = false;
+  if (!columns.empty()) {
+    auto record_batch_file_reader =
+        arrow::ipc::RecordBatchFileReader::Open(&buffer_reader);
+    if (!record_batch_file_reader.ok()) {
+      return absl::InvalidArgumentError(
+          record_batch_file_reader.status().ToString());
+    }
+    const auto schema = (*record_batch_file_reader)->schema();
+    for (const auto& column : columns) {
+      const int field_index = schema->GetFieldIndex(column);
+      if (field_index < 0) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Column ", column, " not found"));
+      }
+      ipc_read_options.included_fields.push_back(field_index);
+    }
+  }
+
+  auto record_batch_file_reader =
+      arrow::ipc::RecordBatchFileReader::Open(&buffer_reader, ipc_read_options);
+  if (!record_batch_file_reader.ok()) {
+    return absl::InvalidArgumentError(
+        record_batch_file_reader.status().ToString());
+  }
+
+  DecodeResult result;
+  result.num_record_batches =
+      (*record_batch_file_reader)->num_record_batches();
+  for (int i = 0; i < result.num_record_batches; ++i) {
+    const auto record_batch = (*record_batch_file_reader)->ReadRecordBatch(i);
+    if (!record_batch.ok()) {
+      return absl::InvalidArgumentError(record_batch.status().ToString());
+    }
+    result.num_rows += (*record_batch)->num_rows();
+    result.decoded_bytes += arrow::util::TotalBufferSize(**record_batch);
+  }
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+
+  const auto urls = absl::GetFlag(FLAGS_urls);
+  const auto columns = absl::GetFlag(FLAGS_columns);
+  const int iterations = absl::GetFlag(FLAGS_iterations);
+  if (urls.empty() || iterations <= 0) {
+    std::cerr << "--urls and a positive --iterations value are required"
+              << std::endl;
+    return 1;
+  }
+
+  for (const auto& url : urls) {
+    auto url_reader = absl::StartsWith(url, "gs://")
+                          ? seqr::MakeGcsReader()
+                          : seqr::MakeLocalFileReader();
+    if (!url_reader.ok()) {
+      std::cerr << "Failed to create URL reader: " << url_reader.status()
+                << std::endl;
+      return 1;
+    }
+    const auto data = (*url_reader)->Read(url);
+    if (!data.ok()) {
+      std::cerr << "Failed to read " << url << ": " << data.status()
+                << std::endl;
+      return 1;
+    }
+
+    DecodeResult decode_result;
+    absl::Duration min_duration = absl::InfiniteDuration();
+    absl::Duration total_duration;
+    for (int i = 0; i < iterations; ++i) {
+      const absl::Time start = absl::Now();
+      auto result = Decode(*data, columns);
+      const absl::Duration duration = absl::Now() - start;
+      if (!result.ok()) {
+        std::cerr << "Failed to decode " << url << ": " << result.status()
+                  << std::endl;
+        return 1;
+      }
+      decode_result = *result;
+      min_duration = std::min(min_duration, duration);
+      total_duration += duration;
+    }
+
+    const double min_seconds = absl::ToDoubleSeconds(min_duration);
+    std::cout << url << ":\n"
+              << "  file size: " << (*data)->size() << " bytes, "
+              << decode_result.num_record_batches << " record batches, "
+              << decode_result.num_rows << " rows\n"
+              << "  decode time: min " << min_duration << ", mean "
+              << total_duration / iterations << "\n"
+              << "  throughput: " << decode_result.num_rows / min_seconds
+              << " rows/s, "
+              << decode_result.decoded_bytes / min_seconds / (1 << 20)
+              << " decoded MiB/s" << std::endl;
+  }
+
+  return 0;
+}
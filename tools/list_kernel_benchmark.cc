@@ -0,0 +1,180 @@
+// Measures the throughput of the custom list compute functions
+// (string_list_contains_any and sample_value_greater_equal) on synthetic
+// genotype columns, for a single lookup sample (fast path) and a set of
+// samples, with plain and dictionary-encoded sample lists. For example:
+//
+// list_kernel_benchmark --num_rows=1000000 --samples_per_row=20
+
+#include <absl/flags/flag.h>
+#include <absl/flags/parse.h>
+#include <absl/strings/str_cat.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+#include <arrow/array/builder_binary.h>
+#include <arrow/array/builder_nested.h>
+#include <arrow/array/builder_primitive.h>
+#include <arrow/compute/api_scalar.h>
+#include <arrow/compute/api_vector.h>
+#include <arrow/compute/exec.h>
+#include <arrow/compute/registry.h>
+#include <arrow/scalar.h>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "string_list_contains_any.h"
+
+ABSL_FLAG(int64_t, num_rows, 1'000'000, "Number of rows to generate.");
+ABSL_FLAG(int, num_samples, 1000, "Number of distinct sample IDs.");
+ABSL_FLAG(int, samples_per_row, 10, "Number of samples listed per row.");
+ABSL_FLAG(int, num_lookup_samples, 10,
+          "Number of samples to look up for the set path.");
+ABSL_FLAG(int, iterations, 5, "Number of times to run each function.");
+
+namespace cp = arrow::compute;
+
+namespace {
+
+std::string SampleId(const int index) { return absl::StrCat("S", index); }
+
+struct Columns {
+  std::shared_ptr<arrow::ListArray> samples;
+  std::shared_ptr<arrow::ListArray> dictionary_samples;
+  std::shared_ptr<arrow::Array> gq;
+};
+
+arrow::Result<Columns> MakeColumns(const int64_t num_rows,
+                                   const int num_samples,
+                                   const int samples_per_row) {
+  std::mt19937 random(42);
+  std::uniform_int_distribution<int> sample_distribution(0, num_samples - 1);
+  std::uniform_int_distribution<int32_t> gq_distribution(0, 99);
+
+  auto* const memory_pool = arrow::default_memory_pool();
+  arrow::ListBuilder samples_builder(
+      memory_pool, std::make_shared<arrow::StringBuilder>(memory_pool));
+  auto& sample_builder =
+      static_cast<arrow::StringBuilder&>(*samples_builder.value_builder());
+  arrow::ListBuilder gq_lists_builder(
+      memory_pool, std::make_shared<arrow::Int32Builder>(memory_pool));
+  auto& gq_builder =
+      static_cast<arrow::Int32Builder&>(*gq_lists_builder.value_builder());
+  for (int64_t i = 0; i < num_rows; ++i) {
+    ARROW_RETURN_NOT_OK(samples_builder.Append());
+    ARROW_RETURN_NOT_OK(gq_lists_builder.Append());
+    for (int j = 0; j < samples_per_row; ++j) {
+      ARROW_RETURN_NOT_OK(
+          sample_builder.Append(SampleId(sample_distribution(random))));
+      ARROW_RETURN_NOT_OK(gq_builder.Append(gq_distribution(random)));
+    }
+  }
+
+  Columns result;
+  ARROW_RETURN_NOT_OK(samples_builder.Finish(&result.samples));
+  ARROW_RETURN_NOT_OK(gq_lists_builder.Finish(&result.gq));
+  ARROW_ASSIGN_OR_RAISE(const auto encoded_samples,
+                        cp::DictionaryEncode(result.samples->values()));
+  result.dictionary_samples = std::make_shared<arrow::ListArray>(
+      arrow::list(arrow::field("item", encoded_samples.type())),
+      result.samples->length(), result.samples->value_offsets(),
+      encoded_samples.make_array());
+  return result;
+}
+
+// Returns the minimum duration over the given number of iterations.
+arrow::Result<absl::Duration> Run(const std::string& function_name,
+                                  const std::vector<arrow::Datum>& args,
+                                  const cp::SetLookupOptions& options,
+                                  const int iterations) {
+  absl::Duration min_duration = absl::InfiniteDuration();
+  for (int i = 0; i < iterations; ++i) {
+    const absl::Time start = absl::Now();
+    ARROW_RETURN_NOT_OK(cp::CallFunction(function_name, args, &options));
+    min_duration = std::min(min_duration, absl::Now() - start);
+  }
+  return min_duration;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+
+  const int64_t num_rows = absl::GetFlag(FLAGS_num_rows);
+  const int num_samples = absl::GetFlag(FLAGS_num_samples);
+  const int samples_per_row = absl::GetFlag(FLAGS_samples_per_row);
+  const int num_lookup_samples = absl::GetFlag(FLAGS_num_lookup_samples);
+  const int iterations = absl::GetFlag(FLAGS_iterations);
+  if (num_rows <= 0 || num_samples <= 0 || samples_per_row < 0 ||
+      num_lookup_samples <= 0 || iterations <= 0) {
+    std::cerr << "Flag values must be positive" << std::endl;
+    return 1;
+  }
+
+  auto* const registry = cp::GetFunctionRegistry();
+  if (const auto status = seqr::RegisterStringListContainsAny(registry);
+      !status.ok()) {
+    std::cerr << "Failed to register function: " << status << std::endl;
+    return 1;
+  }
+  if (const auto status = seqr::RegisterSampleValueGreaterEqual(registry);
+      !status.ok()) {
+    std::cerr << "Failed to register function: " << status << std::endl;
+    return 1;
+  }
+
+  const auto columns = MakeColumns(num_rows, num_samples, samples_per_row);
+  if (!columns.ok()) {
+    std::cerr << "Failed to generate columns: " << columns.status()
+              << std::endl;
+    return 1;
+  }
+
+  for (const int lookup_size : {1, num_lookup_samples}) {
+    arrow::StringBuilder value_set_builder;
+    for (int i = 0; i < lookup_size; ++i) {
+      if (const auto status = value_set_builder.Append(SampleId(i));
+          !status.ok()) {
+        std::cerr << "Failed to build value set: " << status << std::endl;
+        return 1;
+      }
+    }
+    std::shared_ptr<arrow::Array> value_set;
+    if (const auto status = value_set_builder.Finish(&value_set);
+        !status.ok()) {
+      std::cerr << "Failed to build value set: " << status << std::endl;
+      return 1;
+    }
+    const cp::SetLookupOptions options{value_set, /* skip_nulls */ true};
+
+    for (const bool dictionary_encoded : {false, true}) {
+      const arrow::Datum samples =
+          dictionary_encoded ? columns->dictionary_samples : columns->samples;
+      using Call = std::pair<std::string, std::vector<arrow::Datum>>;
+      const std::vector<Call> calls = {
+          {"string_list_contains_any", {samples}},
+          {"sample_value_greater_equal",
+           {samples, columns->gq, arrow::MakeScalar(20.0)}}};
+      for (const auto& [function_name, args] : calls) {
+        const auto duration = Run(function_name, args, options, iterations);
+        if (!duration.ok()) {
+          std::cerr << "Failed to run " << function_name << ": "
+                    << duration.status() << std::endl;
+          return 1;
+        }
+        std::cout << function_name << " (" << lookup_size << " lookup "
+                  << (lookup_size == 1 ? "sample" : "samples") << ", "
+                  << (dictionary_encoded ? "dictionary" : "plain")
+                  << "): min " << *duration << ", "
+                  << num_rows / absl::ToDoubleSeconds(*duration)
+                  << " rows/s" << std::endl;
+      }
+    }
+  }
+
+  return 0;
+}
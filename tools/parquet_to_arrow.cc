@@ -0,0 +1,193 @@
+// Converts a Parquet file (or an existing Arrow file) to a query-optimized
+// Arrow file, see ConvertTable in file_converter.h. Optionally writes per
+// record batch statistics (see FileStatistics in seqr_file_metadata.proto).
+
+#include <absl/flags/flag.h>
+#include <absl/flags/parse.h>
+#include <absl/strings/ascii.h>
+#include <absl/strings/match.h>
+#include <arrow/io/memory.h>
+#include <arrow/ipc/reader.h>
+#include <arrow/table.h>
+#include <arrow/util/compression.h>
+#include <parquet/arrow/reader.h>
+
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "file_converter.h"
+#include "url_reader.h"
+
+ABSL_FLAG(std::string, input_url, "",
+          "URL of the Parquet file to convert (gs:// or file://). URLs ending "
+          "in .arrow are read as Arrow IPC files.");
+ABSL_FLAG(std::string, output_path, "", "Local path of the Arrow file.");
+ABSL_FLAG(std::string, statistics_output_path, "",
+          "Optional local path of the binary FileStatistics proto.");
+ABSL_FLAG(int64_t, record_batch_size, 64 * 1024,
+          "Maximum number of rows per record batch.");
+ABSL_FLAG(std::string, compression, "lz4",
+          "Compression codec for the whole file: lz4, zstd or uncompressed.");
+ABSL_FLAG(int, compression_level, std::numeric_limits<int>::min(),
+          "Codec-specific compression level. Uses the codec default if unset.");
+ABSL_FLAG(bool, dictionary_encode_sample_lists, true,
+          "Whether to dictionary-encode the values of samples_* list columns.");
+ABSL_FLAG(std::vector<std::string>, dictionary_columns, {},
+          "Comma-separated low-cardinality string columns to "
+          "dictionary-encode.");
+
+namespace {
+
+absl::StatusOr<std::shared_ptr<arrow::Table>> ReadTable(
+    const std::string& url, const std::shared_ptr<arrow::Buffer>& data) {
+  const auto buffer_reader = std::make_shared<arrow::io::BufferReader>(data);
+
+  if (absl::EndsWith(url, ".arrow")) {
+    auto record_batch_file_reader =
+        arrow::ipc::RecordBatchFileReader::Open(buffer_reader);
+    if (!record_batch_file_reader.ok()) {
+      return absl::InvalidArgumentError(
+          record_batch_file_reader.status().ToString());
+    }
+    arrow::RecordBatchVector record_batches;
+    for (int i = 0; i < (*record_batch_file_reader)->num_record_batches();
+         ++i) {
+      auto record_batch = (*record_batch_file_reader)->ReadRecordBatch(i);
+      if (!record_batch.ok()) {
+        return absl::InvalidArgumentError(record_batch.status().ToString());
+      }
+      record_batches.push_back(*std::move(record_batch));
+    }
+    auto table = arrow::Table::FromRecordBatches(
+        (*record_batch_file_reader)->schema(), record_batches);
+    if (!table.ok()) {
+      return absl::InvalidArgumentError(table.status().ToString());
+    }
+    return *std::move(table);
+  }
+
+  std::unique_ptr<parquet::arrow::FileReader> parquet_reader;
+  if (const auto status = parquet::arrow::OpenFile(
+          buffer_reader, arrow::default_memory_pool(), &parquet_reader);
+      !status.ok()) {
+    return absl::InvalidArgumentError(status.ToString());
+  }
+  parquet_reader->set_use_threads(true);
+  std::shared_ptr<arrow::Table> table;
+  if (const auto status = parquet_reader->ReadTable(&table); !status.ok()) {
+    return absl::InvalidArgumentError(status.ToString());
+  }
+  return table;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+
+  const std::string input_url = absl::GetFlag(FLAGS_input_url);
+  const std::string output_path = absl::GetFlag(FLAGS_output_path);
+  if (input_url.empty() || output_path.empty()) {
+    std::cerr << "--input_url and --output_path are required" << std::endl;
+    return 1;
+  }
+
+  seqr::ConversionOptions options;
+  options.record_batch_size = absl::GetFlag(FLAGS_record_batch_size);
+  const auto compression = arrow::util::Codec::GetCompressionType(
+      absl::AsciiStrToLower(absl::GetFlag(FLAGS_compression)));
+  if (!compression.ok()) {
+    std::cerr << "Invalid --compression: " << compression.status().ToString()
+              << std::endl;
+    return 1;
+  }
+  options.compression = *compression;
+  if (const int level = absl::GetFlag(FLAGS_compression_level);
+      level != std::numeric_limits<int>::min()) {
+    options.compression_level = level;
+  }
+  options.dictionary_encode_sample_lists =
+      absl::GetFlag(FLAGS_dictionary_encode_sample_lists);
+  options.dictionary_columns = absl::GetFlag(FLAGS_dictionary_columns);
+
+  auto url_reader = absl::StartsWith(input_url, "gs://")
+                        ? seqr::MakeGcsReader()
+                        : seqr::MakeLocalFileReader();
+  if (!url_reader.ok()) {
+    std::cerr << "Failed to create URL reader: " << url_reader.status()
+              << std::endl;
+    return 1;
+  }
+
+  const auto data = (*url_reader)->Read(input_url);
+  if (!data.ok()) {
+    std::cerr << "Failed to read " << input_url << ": " << data.status()
+              << std::endl;
+    return 1;
+  }
+
+  const auto table = ReadTable(input_url, *data);
+  if (!table.ok()) {
+    std::cerr << "Failed to read table from " << input_url << ": "
+              << table.status() << std::endl;
+    return 1;
+  }
+
+  const auto converted_file = seqr::ConvertTable(*table, options);
+  if (!converted_file.ok()) {
+    std::cerr << "Failed to convert " << input_url << ": "
+              << converted_file.status() << std::endl;
+    return 1;
+  }
+
+  const auto& arrow_file = *converted_file->arrow_file;
+  std::ofstream ofs{output_path, std::ios::binary};
+  ofs.write(reinterpret_cast<const char*>(arrow_file.data()),
+            arrow_file.size());
+  ofs.close();
+  if (!ofs) {
+    std::cerr << "Failed to write " << output_path << std::endl;
+    return 1;
+  }
+
+  const auto& statistics = converted_file->statistics;
+  if (const auto statistics_output_path =
+          absl::GetFlag(FLAGS_statistics_output_path);
+      !statistics_output_path.empty()) {
+    std::ofstream statistics_ofs{statistics_output_path, std::ios::binary};
+    if (!statistics_ofs || !statistics.SerializeToOstream(&statistics_ofs)) {
+      std::cerr << "Failed to write " << statistics_output_path << std::endl;
+      return 1;
+    }
+  }
+
+  std::cout << "Wrote " << (*table)->num_rows() << " rows in "
+            << statistics.record_batches_size() << " record batches ("
+            << arrow_file.size() << " bytes)" << std::endl;
+
+  // The file is sorted, so the first and last record batches contain the xpos
+  // bounds, which can be passed as QueryRequest.arrow_url_xpos_bounds.
+  if (statistics.record_batches_size() > 0) {
+    const auto find_xpos = [](const auto& record_batch)
+        -> const seqr::FileStatistics::ColumnStatistics* {
+      for (const auto& column : record_batch.columns()) {
+        if (column.name() == "xpos") {
+          return &column;
+        }
+      }
+      return nullptr;
+    };
+    const auto* const first = find_xpos(statistics.record_batches(0));
+    const auto* const last = find_xpos(*statistics.record_batches().rbegin());
+    if (first != nullptr && last != nullptr && first->has_min() &&
+        last->has_max()) {
+      std::cout << "xpos bounds: [" << first->min().int_value() << ", "
+                << last->max().int_value() + 1 << ")" << std::endl;
+    }
+  }
+
+  return 0;
+}